@@ -0,0 +1,237 @@
+#!/usr/bin/env python3
+"""
+Time the programs in test_files with the scripted inputs in bench/inputs.
+
+    bench.py run [--binary ./tac-runner] [--runs 10] [--warmup 2] [--flags "--no-jit"]
+                 [--programs fib_rec,qs] [--sizes small,large] [--output results.json]
+                 [--baseline baseline.json] [--threshold 5]
+    bench.py compare baseline.json results.json [--threshold 5]
+
+Every program and size is run a few times to warm up caches, then timed. The report
+shows the median and 95th percentile of wall time, guest instructions per second and
+peak resident memory. Results can be saved as json, and compared against a previous
+run: medians slower than the baseline by more than the threshold are regressions,
+and make the script exit with status 1.
+"""
+import argparse
+import datetime
+import json
+import os
+import platform
+import re
+import shlex
+import subprocess
+import sys
+import time
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+REPO_DIR = os.path.dirname(BENCH_DIR)
+INPUTS_DIR = os.path.join(BENCH_DIR, "inputs")
+PROGRAMS = ["fib_rec", "fib_it", "heron", "qs", "kmp", "dfs"]
+SIZES = ["small", "medium", "large"]
+
+GUEST_INSTRUCTIONS = re.compile(r"Performance counters: (\d+) guest instructions")
+
+
+def percentile(samples, p):
+    """Nearest rank percentile of a list of samples"""
+    ordered = sorted(samples)
+    rank = max(int(round(p / 100.0 * len(ordered) + 0.5)) - 1, 0)
+    return ordered[min(rank, len(ordered) - 1)]
+
+
+def run_timed(command, input_file):
+    """Run a command with a file as stdin, returns (seconds, peak rss in KiB, stderr, exit status)"""
+    with open(input_file, "rb") as stdin, open(os.devnull, "wb") as devnull:
+        start = time.perf_counter()
+        process = subprocess.Popen(command, stdin=stdin, stdout=devnull, stderr=subprocess.PIPE)
+        stderr = process.stderr.read()
+        process.stderr.close()
+
+        # Waited for by hand, resource usage of the child is only given by wait4
+        _, status, usage = os.wait4(process.pid, 0)
+        elapsed = time.perf_counter() - start
+        process.returncode = os.WEXITSTATUS(status) if os.WIFEXITED(status) else -1
+
+    return elapsed, usage.ru_maxrss, stderr.decode(errors="replace"), process.returncode
+
+
+def failed(stderr, status):
+    return status != 0 or "[ERROR]" in stderr
+
+
+def bench_one(binary, program, size, flags, runs, warmup):
+    source = os.path.join(REPO_DIR, "test_files", program + ".tac")
+    input_file = os.path.join(INPUTS_DIR, program, size + ".in")
+    command = [binary, source, "--quiet"] + flags
+
+    # Guest instructions don't change between runs, count them once
+    with open(input_file, "rb") as stdin:
+        counted = subprocess.run(command + ["--perf-counters"], stdin=stdin, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    stderr = counted.stderr.decode(errors="replace")
+    match = GUEST_INSTRUCTIONS.search(stderr)
+    if failed(stderr, counted.returncode):
+        return {"program": program, "size": size, "error": "program failed, run it by hand to see why"}
+
+    for _ in range(warmup):
+        run_timed(command, input_file)
+
+    times, peak_rss = [], 0
+    for _ in range(runs):
+        elapsed, rss, stderr, status = run_timed(command, input_file)
+        if failed(stderr, status):
+            return {"program": program, "size": size, "error": "program failed, run it by hand to see why"}
+
+        times.append(elapsed)
+        peak_rss = max(peak_rss, rss)
+
+    median = percentile(times, 50)
+    instructions = int(match.group(1)) if match else None
+    return {
+        "program": program,
+        "size": size,
+        "runs": runs,
+        "median_ms": median * 1000,
+        "p95_ms": percentile(times, 95) * 1000,
+        "min_ms": min(times) * 1000,
+        "guest_instructions": instructions,
+        "instructions_per_second": instructions / median if instructions and median > 0 else None,
+        "peak_rss_kib": peak_rss,
+    }
+
+
+def git_commit():
+    try:
+        return subprocess.run(["git", "-C", REPO_DIR, "rev-parse", "--short", "HEAD"],
+                              stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, check=True).stdout.decode().strip()
+    except (OSError, subprocess.CalledProcessError):
+        return None
+
+
+def print_results(results):
+    print("%-8s %-7s %11s %11s %14s %10s" % ("program", "size", "median ms", "p95 ms", "guest instr/s", "peak KiB"))
+    for result in results:
+        if "error" in result:
+            print("%-8s %-7s %s" % (result["program"], result["size"], result["error"]))
+            continue
+
+        rate = result["instructions_per_second"]
+        print("%-8s %-7s %11.2f %11.2f %14s %10d" % (
+            result["program"], result["size"], result["median_ms"], result["p95_ms"],
+            "%.3g" % rate if rate else "-", result["peak_rss_kib"]))
+
+
+def compare(baseline, current, threshold):
+    """Print how medians changed from a baseline, returns how many regressed"""
+    before = {(r["program"], r["size"]): r for r in baseline["results"] if "error" not in r}
+    regressions = 0
+
+    if baseline.get("flags") != current.get("flags"):
+        print("warning: baseline was run with flags %r, results with %r" % (baseline.get("flags"), current.get("flags")))
+
+    print("%-8s %-7s %11s %11s %8s" % ("program", "size", "base ms", "now ms", "change"))
+    for result in current["results"]:
+        key = (result["program"], result["size"])
+        if "error" in result or key not in before:
+            continue
+
+        old, new = before[key]["median_ms"], result["median_ms"]
+        change = (new - old) / old * 100 if old > 0 else 0.0
+        verdict = ""
+        if change > threshold:
+            verdict = "REGRESSION"
+            regressions += 1
+        elif change < -threshold:
+            verdict = "faster"
+
+        print("%-8s %-7s %11.2f %11.2f %+7.1f%% %s" % (key[0], key[1], old, new, change, verdict))
+
+    return regressions
+
+
+def command_run(args):
+    binary = os.path.abspath(args.binary)
+    if not os.access(binary, os.X_OK):
+        print("error: '%s' is not an executable, build it with make first" % args.binary, file=sys.stderr)
+        return 2
+
+    flags = shlex.split(args.flags)
+    programs = args.programs.split(",") if args.programs else PROGRAMS
+    sizes = args.sizes.split(",") if args.sizes else SIZES
+    unknown = [p for p in programs if p not in PROGRAMS] + [s for s in sizes if s not in SIZES]
+    if unknown:
+        print("error: unknown programs or sizes: %s" % ", ".join(unknown), file=sys.stderr)
+        return 2
+
+    results = [bench_one(binary, program, size, flags, args.runs, args.warmup)
+               for program in programs for size in sizes]
+    print_results(results)
+
+    report = {
+        "commit": git_commit(),
+        "date": datetime.datetime.now().isoformat(timespec="seconds"),
+        "host": platform.node(),
+        "binary": args.binary,
+        "flags": args.flags,
+        "runs": args.runs,
+        "warmup": args.warmup,
+        "results": results,
+    }
+
+    if args.output:
+        with open(args.output, "w") as out:
+            json.dump(report, out, indent=2)
+        print("results written to '%s'" % args.output)
+
+    if args.baseline:
+        with open(args.baseline) as baseline:
+            print()
+            if compare(json.load(baseline), report, args.threshold) > 0:
+                return 1
+
+    return 1 if any("error" in result for result in results) else 0
+
+
+def command_compare(args):
+    with open(args.baseline) as baseline, open(args.results) as results:
+        return 1 if compare(json.load(baseline), json.load(results), args.threshold) > 0 else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark tac-runner over test_files with scripted inputs")
+    commands = parser.add_subparsers(dest="command")
+
+    run = commands.add_parser("run", help="time every program and size")
+    run.add_argument("--binary", default=os.path.join(REPO_DIR, "tac-runner"), help="tac-runner to time")
+    run.add_argument("--runs", type=int, default=10, help="timed runs of each program and size")
+    run.add_argument("--warmup", type=int, default=2, help="untimed runs before timing")
+    run.add_argument("--flags", default="", help="extra flags for tac-runner, as one string")
+    run.add_argument("--programs", help="comma separated programs to run, all by default")
+    run.add_argument("--sizes", help="comma separated sizes to run, all by default")
+    run.add_argument("--output", help="where to write results as json")
+    run.add_argument("--baseline", help="results to compare against after running")
+    run.add_argument("--threshold", type=float, default=5.0, help="percent a median can grow before it's a regression")
+
+    diff = commands.add_parser("compare", help="compare two result files")
+    diff.add_argument("baseline", help="results from before the change")
+    diff.add_argument("results", help="results from after the change")
+    diff.add_argument("--threshold", type=float, default=5.0, help="percent a median can grow before it's a regression")
+
+    # Running is the default command
+    argv = sys.argv[1:]
+    if not argv or argv[0] not in ("run", "compare", "-h", "--help"):
+        argv = ["run"] + argv
+
+    args = parser.parse_args(argv)
+    if args.command == "compare":
+        return command_compare(args)
+
+    if args.runs < 1 or args.warmup < 0:
+        print("error: need at least one run, and no negative warmup", file=sys.stderr)
+        return 2
+
+    return command_run(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
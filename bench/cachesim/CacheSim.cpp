@@ -0,0 +1,244 @@
+/*
+    Replay a memory trace written by tac-runner --mem-trace through a set associative cache
+    with LRU replacement, and show hit rates overall, for every memory region and for the
+    functions with the most misses. Accesses spanning several lines reference each of them.
+    Writes allocate lines like reads do. Misses on lines never referenced before are cold
+    misses, the rest are capacity and conflict misses, the ones data layout can avoid.
+    Arguments:
+        filename : str = Memory trace to replay
+        --size n       = Cache size in bytes, 32768 by default
+        --line n       = Line size in bytes, 64 by default
+        --ways n       = Lines in every set, 8 by default
+        --top n        = Functions to show, 20 by default
+*/
+
+// C++ includes
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Local includes
+#include "MemoryTracer.hpp"
+
+#define DEFAULT_CACHE_SIZE 32768
+#define DEFAULT_LINE_SIZE 64
+#define DEFAULT_WAYS 8
+#define DEFAULT_TOP_FUNCTIONS 20
+#define REGIONS 3
+
+using namespace TacRunner;
+
+namespace
+{
+    /**
+     * @brief Set associative cache, every set keeps its lines from the most to the least recently used
+     *
+     */
+    class Cache
+    {
+        public:
+            Cache(size_t size, size_t line, size_t ways)
+                : m_line(line)
+                , m_ways(ways)
+                , m_sets(size / (line * ways))
+                , m_tags(m_sets)
+            {
+                for (auto& set : m_tags)
+                    set.reserve(ways);
+            }
+
+            /**
+             * @brief Reference a line, loading it if it's not in the cache
+             *
+             * @param line address divided by the line size
+             * @return true if the line was in the cache
+             */
+            bool reference(uint64_t line)
+            {
+                auto& set = m_tags[line % m_sets];
+                auto const found = std::find(set.begin(), set.end(), line);
+                bool const hit = found != set.end();
+
+                if (hit)
+                    set.erase(found);
+                else if (set.size() == m_ways)
+                    set.pop_back();
+
+                set.insert(set.begin(), line);
+                return hit;
+            }
+
+            inline size_t line() const { return m_line; }
+            inline size_t sets() const { return m_sets; }
+
+        private:
+            size_t m_line;
+            size_t m_ways;
+            size_t m_sets;
+            std::vector<std::vector<uint64_t>> m_tags; // lines in every set, most recently used first
+    };
+
+    struct Stats
+    {
+        uint64_t reads = 0;
+        uint64_t writes = 0;
+        uint64_t references = 0;    // lines referenced by accesses
+        uint64_t misses = 0;
+        uint64_t cold_misses = 0;   // misses on lines referenced for the first time
+        uint64_t region_misses[REGIONS] = {};
+
+        inline uint64_t accesses() const { return reads + writes; }
+        inline double hit_rate() const { return references == 0 ? 0 : 100.0 * (references - misses) / references; }
+    };
+
+    const char* region_name(int region)
+    {
+        switch (static_cast<MemoryManager::MemoryType>(region))
+        {
+        case MemoryManager::MemoryType::STATIC: return "static";
+        case MemoryManager::MemoryType::STACK_MEM: return "stack";
+        case MemoryManager::MemoryType::HEAP: return "heap";
+        }
+        return "?";
+    }
+
+    void print_header(const std::string& first)
+    {
+        std::cout << std::left << std::setw(32) << first << std::right
+                  << std::setw(12) << "accesses" << std::setw(12) << "writes" << std::setw(12) << "lines"
+                  << std::setw(12) << "misses" << std::setw(12) << "cold" << std::setw(10) << "hit %";
+    }
+
+    void print_stats(const std::string& name, const Stats& stats)
+    {
+        std::cout << std::left << std::setw(32) << name << std::right
+                  << std::setw(12) << stats.accesses() << std::setw(12) << stats.writes << std::setw(12) << stats.references
+                  << std::setw(12) << stats.misses << std::setw(12) << stats.cold_misses
+                  << std::setw(10) << std::fixed << std::setprecision(2) << stats.hit_rate();
+    }
+
+    bool parse_size(const char* text, size_t& out_value)
+    {
+        try
+        {
+            size_t end;
+            auto const value = std::stoul(text, &end);
+            if (text[end] != '\0' || value == 0)
+                return false;
+
+            out_value = value;
+            return true;
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::string filename;
+    size_t size = DEFAULT_CACHE_SIZE, line = DEFAULT_LINE_SIZE, ways = DEFAULT_WAYS, top = DEFAULT_TOP_FUNCTIONS;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string const arg = argv[i];
+        size_t* value = arg == "--size" ? &size : arg == "--line" ? &line : arg == "--ways" ? &ways : arg == "--top" ? &top : nullptr;
+        if (value == nullptr && filename.empty() && arg.compare(0, 2, "--") != 0)
+            filename = arg;
+        else if (value == nullptr || i + 1 == argc || !parse_size(argv[++i], *value))
+        {
+            std::cerr << "Usage: " << argv[0] << " filename [--size bytes] [--line bytes] [--ways n] [--top n]" << std::endl;
+            return 1;
+        }
+    }
+
+    if (filename.empty() || size % (line * ways) != 0)
+    {
+        std::cerr << "Usage: " << argv[0] << " filename [--size bytes] [--line bytes] [--ways n] [--top n]" << std::endl;
+        std::cerr << "The cache size should be a multiple of the line size times the ways" << std::endl;
+        return 1;
+    }
+
+    MemoryTraceReader reader;
+    if (reader.open(filename) == FAIL)
+    {
+        std::cerr << "Could not read memory trace '" << filename << "'" << std::endl;
+        return 1;
+    }
+
+    // Replay every access, one extra function for accesses outside the program
+    Cache cache(size, line, ways);
+    std::unordered_set<uint64_t> seen;
+    Stats total, regions[REGIONS];
+    std::vector<Stats> functions(reader.functions().size() + 1);
+
+    MemoryAccess access;
+    while (reader.next(access))
+    {
+        auto const region = static_cast<int>(access.region) % REGIONS;
+        Stats* const stats[] = { &total, &regions[region], &functions[reader.function_of(access.pc)] };
+        for (auto s : stats)
+            (access.write ? s->writes : s->reads)++;
+
+        auto const first = access.address / line;
+        auto const last = (access.address + std::max(access.size, 1u) - 1) / line;
+        for (uint64_t l = first; l <= last; l++)
+        {
+            bool const hit = cache.reference(l);
+            bool const cold = !hit && seen.insert(l).second;
+            for (auto s : stats)
+            {
+                s->references++;
+                s->misses += !hit;
+                s->cold_misses += cold;
+                s->region_misses[region] += !hit;
+            }
+        }
+    }
+
+    if (reader.truncated())
+        std::cerr << "warning: the trace ends in the middle of an access, it may be incomplete" << std::endl;
+
+    std::cout << "Cache: " << size << " bytes, " << line << " byte lines, " << ways << " ways, "
+              << cache.sets() << " sets, LRU replacement, write allocate" << std::endl << std::endl;
+
+    print_header("region");
+    std::cout << std::endl;
+    for (int region = 0; region < REGIONS; region++)
+        if (regions[region].accesses() > 0)
+        {
+            print_stats(region_name(region), regions[region]);
+            std::cout << std::endl;
+        }
+    print_stats("total", total);
+    std::cout << std::endl << std::endl;
+
+    // Functions with the most misses first
+    std::vector<uint> order;
+    for (uint f = 0; f < functions.size(); f++)
+        if (functions[f].accesses() > 0)
+            order.push_back(f);
+
+    std::sort(order.begin(), order.end(), [&](uint a, uint b) { return functions[a].misses > functions[b].misses; });
+    if (order.size() > top)
+        order.resize(top);
+
+    print_header("function");
+    for (int region = 0; region < REGIONS; region++)
+        std::cout << std::setw(14) << std::string(region_name(region)) + " misses";
+    std::cout << std::endl;
+
+    for (auto f : order)
+    {
+        print_stats(f < reader.functions().size() ? reader.functions()[f] : "<outside program>", functions[f]);
+        for (int region = 0; region < REGIONS; region++)
+            std::cout << std::setw(14) << functions[f].region_misses[region];
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+"""
+Write a valid tac program of a chosen size, to test how reading and loading scale.
+
+    gen_program.py [--functions 100] [--labels 10] [--strings 10] [--loop-depth 2]
+                   [--call-depth 4] [--statements 3] [--seed 1234] [--output file.tac]
+
+The program has a number of functions, called in chains of --call-depth functions from
+main. Every function runs --loop-depth nested loops of two iterations each, and its
+innermost loop goes through --labels labels, each followed by --statements arithmetic
+instructions and a conditional jump to the next label. Strings are declared at the top
+and their addresses read by the functions. The program finishes quickly, and prints
+nothing, whatever its size.
+"""
+import argparse
+import random
+import sys
+
+
+def function(index, labels, strings, loop_depth, calls_next, statements, rng):
+    name = "f%d__0" % index
+    lines = [
+        "@function %s 4" % name,
+        "add _n__T0 BASE 0",
+        "assignw N _n__T0[0]",
+        "assignw A N",
+    ]
+
+    # Nested loops, each with its own counter
+    for depth in range(loop_depth):
+        lines += [
+            "assignw I%d 0" % depth,
+            "@label _%s_loop%d__L" % (name, depth),
+        ]
+
+    # Labels chained by conditional jumps, with some arithmetic between them
+    operations = ["add", "sub", "mult", "lt", "eq", "and"]
+    for label in range(labels):
+        lines.append("@label _%s_block%d__L" % (name, label))
+        for _ in range(statements):
+            lines.append("%s A A %d" % (rng.choice(operations), rng.randint(1, 9)))
+        if strings > 0:
+            lines.append("assignw S str%d" % rng.randrange(strings))
+        target = "_%s_block%d__L" % (name, label + 1) if label + 1 < labels else "_%s_blocks_end__L" % name
+        lines += [
+            "lt C A 0",
+            "goif %s C" % target,
+        ]
+    lines.append("@label _%s_blocks_end__L" % name)
+
+    for depth in reversed(range(loop_depth)):
+        lines += [
+            "add I%d I%d 1" % (depth, depth),
+            "lt C I%d 2" % depth,
+            "goif _%s_loop%d__L C" % (name, depth),
+        ]
+
+    # Call the next function in the chain, and use its result so it's not a tail call
+    if calls_next:
+        lines += [
+            "param P 0",
+            "assignw P[0] A",
+            "call R f%d__0" % (index + 1),
+            "add A A R",
+        ]
+
+    lines += [
+        "return A",
+        "@endfunction 4",
+    ]
+    return lines
+
+
+def generate(functions=100, labels=10, strings=10, loop_depth=2, call_depth=4, statements=3, seed=1234):
+    """Text of a tac program with the given shape"""
+    rng = random.Random(seed)
+    call_depth = max(call_depth, 1)
+    lines = ['@string str%d "string number %d\\n"' % (i, i) for i in range(strings)]
+    lines += [
+        "call ___main main__0",
+        "exit 0",
+    ]
+
+    for index in range(functions):
+        calls_next = (index + 1) % call_depth != 0 and index + 1 < functions
+        lines += function(index, labels, strings, loop_depth, calls_next, statements, rng)
+
+    # main calls the first function of every chain
+    lines.append("@function main__0 4")
+    for index in range(0, functions, call_depth):
+        lines += [
+            "param P 0",
+            "assignw P[0] %d" % index,
+            "call R f%d__0" % index,
+        ]
+    lines += [
+        "return 0",
+        "@endfunction 4",
+    ]
+
+    return "\n".join(lines) + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate a valid tac program of a given size")
+    parser.add_argument("--functions", type=int, default=100, help="functions in the program, main aside")
+    parser.add_argument("--labels", type=int, default=10, help="labels in every function")
+    parser.add_argument("--strings", type=int, default=10, help="strings declared by the program")
+    parser.add_argument("--loop-depth", type=int, default=2, help="nested loops in every function")
+    parser.add_argument("--call-depth", type=int, default=4, help="functions in every chain of calls")
+    parser.add_argument("--statements", type=int, default=3, help="instructions after every label")
+    parser.add_argument("--seed", type=int, default=1234, help="seed for the random instructions")
+    parser.add_argument("--output", help="where to write the program, standard output by default")
+    args = parser.parse_args()
+
+    if min(args.functions, args.labels, args.strings, args.loop_depth, args.statements) < 0 or args.call_depth < 1:
+        print("error: sizes can't be negative, and chains need at least one function", file=sys.stderr)
+        return 2
+
+    text = generate(args.functions, args.labels, args.strings, args.loop_depth, args.call_depth, args.statements, args.seed)
+    if args.output:
+        with open(args.output, "w") as out:
+            out.write(text)
+    else:
+        sys.stdout.write(text)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
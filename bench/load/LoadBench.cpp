@@ -0,0 +1,89 @@
+/*
+    Time how long it takes to get a program running: reading it, setting up a machine for
+    it, and running its first instruction. Prints a json object with every time in
+    milliseconds and the peak resident memory, for bench/scaling.py to collect.
+    Arguments:
+        filename : str = Name of the file to load
+*/
+
+// C++ includes
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sys/resource.h>
+
+// Local includes
+#include "TacMachine.hpp"
+#include "TacReader.hpp"
+#include "Tac.hpp"
+
+using namespace TacRunner;
+
+namespace
+{
+    double ms(std::chrono::nanoseconds time)
+    {
+        return std::chrono::duration<double, std::milli>(time).count();
+    }
+
+    long peak_rss_kib()
+    {
+        rusage usage = {};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " filename" << std::endl;
+        return 1;
+    }
+
+    auto const start = std::chrono::steady_clock::now();
+    TacReader reader;
+    Program program;
+    if (reader.parse(argv[1], program) != 0)
+    {
+        std::cerr << "Could not parse '" << argv[1] << "'" << std::endl;
+        return 1;
+    }
+    auto const parsed = std::chrono::steady_clock::now();
+    auto const parse_rss = peak_rss_kib();
+
+    auto const instructions = program.size();
+    auto const labels = std::count_if(program.begin(), program.end(), [](const Tac& tac) {
+        return tac.instr() == Instr::METALABEL;
+    });
+
+    TacMachine machine(std::move(program));
+    auto const set_up = std::chrono::steady_clock::now();
+    if (machine.status() == TacMachine::Status::ERROR)
+    {
+        std::cerr << "Could not set up a machine for '" << argv[1] << "'" << std::endl;
+        return 1;
+    }
+
+    machine.run_tac_program(1);
+    auto const first_instruction = std::chrono::steady_clock::now();
+
+    auto const& setup = machine.setup_times();
+    std::cout << std::fixed << std::setprecision(3)
+              << "{\"instructions\":" << instructions
+              << ",\"labels\":" << labels
+              << ",\"parse_ms\":" << ms(parsed - start)
+              << ",\"setup_ms\":" << ms(set_up - parsed)
+              << ",\"labels_ms\":" << ms(setup.labels)
+              << ",\"registers_ms\":" << ms(setup.registers)
+              << ",\"tail_calls_ms\":" << ms(setup.tail_calls)
+              << ",\"compilers_ms\":" << ms(setup.compilers)
+              << ",\"first_instruction_ms\":" << ms(first_instruction - start)
+              << ",\"parse_rss_kib\":" << parse_rss
+              << ",\"peak_rss_kib\":" << peak_rss_kib()
+              << "}" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+"""
+Write the scripted inputs used by bench.py, one file per program and problem size,
+into bench/inputs/<program>/<size>.in. Inputs are generated from a fixed seed, so
+running this again gives the same files.
+"""
+import os
+import random
+import sys
+
+SIZES = ["small", "medium", "large"]
+SEED = 1234
+
+
+def rounds(values):
+    """Programs that loop asking 1 to continue or 0 to finish"""
+    lines = []
+    for value in values:
+        lines += ["1", str(value)]
+    return lines + ["0"]
+
+
+def fib_rec(size):
+    n = {"small": 15, "medium": 20, "large": 24}[size]
+    return rounds([n] * 3)
+
+
+def fib_it(size):
+    n, times = {"small": (1000, 5), "medium": (10000, 20), "large": (100000, 20)}[size]
+    return rounds([n] * times)
+
+
+def heron(size):
+    times = {"small": 10, "medium": 100, "large": 1000}[size]
+    rng = random.Random(SEED)
+    return rounds(["%.1f" % rng.uniform(1, 1000000) for _ in range(times)])
+
+
+def qs(size):
+    # The program sorts arrays of up to 50 integers, bigger sizes sort more arrays
+    times = {"small": 2, "medium": 20, "large": 200}[size]
+    rng = random.Random(SEED)
+    lines = []
+    for _ in range(times):
+        lines += ["1", "50"] + [str(rng.randint(-1000, 1000)) for _ in range(50)]
+    return lines + ["0"]
+
+
+def kmp(size):
+    length = {"small": 1000, "medium": 10000, "large": 100000}[size]
+    rng = random.Random(SEED)
+    pattern = "aaaab"
+    text = "".join(rng.choice("aaaab") for _ in range(length))
+    return [str(len(pattern)), pattern, str(len(text)), text]
+
+
+def dfs(size):
+    # The program holds up to 169 nodes and 169 edges
+    nodes = {"small": 10, "medium": 60, "large": 169}[size]
+    rng = random.Random(SEED)
+
+    # A path through every node, so the search goes as deep as the graph, plus random edges
+    edges = [(i, i + 1) for i in range(nodes - 1)]
+    edges += [(rng.randrange(nodes), rng.randrange(nodes)) for _ in range(min(nodes, 169 - len(edges)))]
+    lines = [str(nodes), str(len(edges))]
+    for source, target in edges:
+        lines += [str(source), str(target)]
+    return lines + ["0"]
+
+
+PROGRAMS = {
+    "fib_rec": fib_rec,
+    "fib_it": fib_it,
+    "heron": heron,
+    "qs": qs,
+    "kmp": kmp,
+    "dfs": dfs,
+}
+
+
+def main():
+    root = os.path.join(os.path.dirname(os.path.abspath(__file__)), "inputs")
+    for program, generate in PROGRAMS.items():
+        os.makedirs(os.path.join(root, program), exist_ok=True)
+        for size in SIZES:
+            with open(os.path.join(root, program, size + ".in"), "w") as out:
+                out.write("\n".join(generate(size)) + "\n")
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,389 @@
+/*
+    Microbenchmarks for the hot paths of the interpreter, linked against it as a library.
+    Every benchmark reports nanoseconds per operation, the median of a few repetitions.
+    Arguments:
+        filter : str = Only run benchmarks whose name contains this text (optional)
+        --quick      = Run fewer operations per benchmark, to check they work
+*/
+
+// C++ includes
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Local includes
+#include "TacMachine.hpp"
+#include "TacReader.hpp"
+#include "Tac.hpp"
+
+#define REPETITIONS 5           // times every benchmark is measured, the median is shown
+#define DEFAULT_OPERATIONS 2000000
+#define QUICK_OPERATIONS 20000
+#define OPCODE_UNROLL 64        // copies of an instruction in the body of the timed loop
+#define MEMORY_BLOCKS 256       // blocks of memory accessed by memory benchmarks
+#define MEMORY_BLOCK_SIZE 64
+
+using namespace TacRunner;
+
+namespace
+{
+    volatile REGISTER_TYPE g_sink; // keeps results of benchmarks alive
+
+    uint64_t g_operations = DEFAULT_OPERATIONS;
+    std::string g_filter;
+
+    /**
+     * @brief Run a benchmark a few times and show its median cost per operation
+     *
+     * @param name name of the benchmark
+     * @param operations operations each run performs
+     * @param run runs the benchmark, returns nanoseconds spent in operations
+     */
+    void report(const std::string& name, uint64_t operations, const std::function<double()>& run)
+    {
+        if (!g_filter.empty() && name.find(g_filter) == std::string::npos)
+            return;
+
+        std::vector<double> times;
+        for (int i = 0; i < REPETITIONS; i++)
+            times.push_back(run());
+
+        std::sort(times.begin(), times.end());
+        std::cout << std::left << std::setw(40) << name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(10) << times[REPETITIONS / 2] / operations << " ns/op"
+                  << std::setw(12) << operations << " ops" << std::endl;
+    }
+
+    /**
+     * @brief Nanoseconds spent running a function
+     */
+    template<class F>
+    double time_ns(F&& function)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        function();
+        auto const end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(end - start).count();
+    }
+
+    /**
+     * @brief Parse a program from its text
+     *
+     * @param text tac code
+     * @param out_program where to store the parsed program
+     * @return uint success status, 0 on success, 1 on failure
+     */
+    uint parse(const std::string& text, Program& out_program)
+    {
+        char filename[] = "/tmp/micro-bench-XXXXXX";
+        auto const fd = mkstemp(filename);
+        if (fd == -1)
+            return FAIL;
+
+        auto const written = write(fd, text.data(), text.size());
+        close(fd);
+
+        TacReader reader;
+        auto const status = written == static_cast<ssize_t>(text.size()) ? reader.parse(filename, out_program) : FAIL;
+        unlink(filename);
+        return status == 0 ? SUCCESS : FAIL;
+    }
+
+    /**
+     * @brief A machine that only interprets, so every instruction goes through dispatch
+     */
+    std::unique_ptr<TacMachine> interpreter(const Program& program, bool closures)
+    {
+        auto machine = std::make_unique<TacMachine>(program);
+        machine->disable_jit();
+        machine->disable_traces();
+        if (closures)
+            machine->use_closure_engine();
+
+        return machine;
+    }
+
+    void memory_benchmarks()
+    {
+        // Addresses of blocks in every region, each region in its own manager
+        MemoryManager static_memory, stack_memory, heap_memory;
+        std::vector<uint> static_blocks, stack_blocks, heap_blocks;
+        std::vector<std::byte> frame(MEMORY_BLOCKS * MEMORY_BLOCK_SIZE);
+
+        // Stack reads and writes are only cheap inside the active stack
+        stack_memory.push_memory(frame.data(), frame.size());
+        for (uint i = 0; i < MEMORY_BLOCKS; i++)
+        {
+            static_blocks.push_back(static_memory.get_static_memory(MEMORY_BLOCK_SIZE));
+            stack_blocks.push_back(MemoryManager::stack_start() + i * MEMORY_BLOCK_SIZE);
+            heap_blocks.push_back(heap_memory.malloc(MEMORY_BLOCK_SIZE));
+        }
+
+        auto const regions = {
+            std::make_tuple("static", &static_memory, &static_blocks),
+            std::make_tuple("stack", &stack_memory, &stack_blocks),
+            std::make_tuple("heap", &heap_memory, &heap_blocks)
+        };
+
+        for (auto const& [region, memory, blocks] : regions)
+        {
+            report(std::string("memory/write_word/") + region, g_operations, [&, memory = memory, blocks = blocks]() {
+                return time_ns([&]() {
+                    for (uint64_t i = 0; i < g_operations; i++)
+                        memory->write_word(i, (*blocks)[i % MEMORY_BLOCKS] + (i / MEMORY_BLOCKS % (MEMORY_BLOCK_SIZE / WORD_SIZE)) * WORD_SIZE);
+                });
+            });
+
+            report(std::string("memory/read_word/") + region, g_operations, [&, memory = memory, blocks = blocks]() {
+                return time_ns([&]() {
+                    REGISTER_TYPE word = 0, sum = 0;
+                    for (uint64_t i = 0; i < g_operations; i++)
+                    {
+                        memory->read_word(word, (*blocks)[i % MEMORY_BLOCKS] + (i / MEMORY_BLOCKS % (MEMORY_BLOCK_SIZE / WORD_SIZE)) * WORD_SIZE);
+                        sum += word;
+                    }
+                    g_sink = sum;
+                });
+            });
+        }
+
+        // Allocations of mixed sizes, freeing the oldest of a fixed number of live blocks
+        std::mt19937 rng(1234);
+        std::vector<size_t> sizes(1024);
+        for (auto& size : sizes)
+            size = 8 + rng() % 256;
+
+        for (size_t live : {16, 1024})
+        {
+            std::stringstream name;
+            name << "heap/malloc+free/" << live << " live";
+            report(name.str(), g_operations / 4, [&]() {
+                MemoryManager memory;
+                std::vector<uint> blocks(live, 0);
+                return time_ns([&]() {
+                    for (uint64_t i = 0; i < g_operations / 4; i++)
+                    {
+                        auto& block = blocks[i % live];
+                        if (block != 0)
+                            memory.free(block);
+                        block = memory.malloc(sizes[i % sizes.size()]);
+                    }
+                });
+            });
+        }
+    }
+
+    void register_benchmarks()
+    {
+        for (uint depth : {1, 16, 256})
+        {
+            // Recurse 'depth' times and spin in the innermost call, a register G is only set globally
+            std::stringstream code;
+            code << "assignw G 7\n"
+                 << "param P 0\n"
+                 << "assignw P[0] " << depth - 1 << "\n"
+                 << "call R down__0\n"
+                 << "exit 0\n"
+                 << "@function down__0 4\n"
+                 << "add _n BASE 0\n"
+                 << "assignw N _n[0]\n"
+                 << "assignw L N\n"
+                 << "eq Z N 0\n"
+                 << "goif _bottom Z\n"
+                 << "sub M N 1\n"
+                 << "param P 0\n"
+                 << "assignw P[0] M\n"
+                 << "call R down__0\n"
+                 << "add R R 1\n"
+                 << "return R\n"
+                 << "@label _bottom\n"
+                 << "@label _spin\n"
+                 << "goto _spin\n"
+                 << "@endfunction 4\n";
+
+            Program program;
+            if (parse(code.str(), program) == FAIL)
+            {
+                std::cerr << "Could not parse register benchmark program" << std::endl;
+                return;
+            }
+
+            auto machine = interpreter(program, false);
+            machine->run_tac_program(depth * 16 + 16);
+            REGISTER_TYPE value;
+            if (machine->status() != TacMachine::Status::PAUSED || machine->get_register("G", value) == FAIL)
+            {
+                std::cerr << "Register benchmark program did not reach depth " << depth << std::endl;
+                return;
+            }
+
+            auto const suffix = "/depth " + std::to_string(depth);
+            report("registers/get top frame" + suffix, g_operations, [&]() {
+                return time_ns([&]() {
+                    REGISTER_TYPE value = 0, sum = 0;
+                    for (uint64_t i = 0; i < g_operations; i++)
+                    {
+                        machine->get_register("L", value);
+                        sum += value;
+                    }
+                    g_sink = sum;
+                });
+            });
+
+            report("registers/get global" + suffix, g_operations / 4, [&]() {
+                return time_ns([&]() {
+                    REGISTER_TYPE value = 0, sum = 0;
+                    for (uint64_t i = 0; i < g_operations / 4; i++)
+                    {
+                        machine->get_register("G", value);
+                        sum += value;
+                    }
+                    g_sink = sum;
+                });
+            });
+
+            report("registers/set top frame" + suffix, g_operations, [&]() {
+                return time_ns([&]() {
+                    for (uint64_t i = 0; i < g_operations; i++)
+                        machine->set_register("L", i);
+                });
+            });
+        }
+    }
+
+    void label_benchmarks()
+    {
+        for (uint labels : {16, 1024, 65536})
+        {
+            std::stringstream code;
+            std::vector<std::string> names;
+            for (uint i = 0; i < labels; i++)
+            {
+                names.push_back("_label__L" + std::to_string(i));
+                code << "@label " << names.back() << "\n";
+            }
+            code << "exit 0\n";
+
+            Program program;
+            if (parse(code.str(), program) == FAIL)
+            {
+                std::cerr << "Could not parse label benchmark program" << std::endl;
+                return;
+            }
+
+            // Jump to labels in random order, so lookups don't follow the map
+            std::shuffle(names.begin(), names.end(), std::mt19937(1234));
+            TacMachine machine(program);
+            report("goto_label/" + std::to_string(labels) + " labels", g_operations, [&]() {
+                return time_ns([&]() {
+                    for (uint64_t i = 0; i < g_operations; i++)
+                        machine.goto_label(names[i % names.size()]);
+                });
+            });
+        }
+    }
+
+    /**
+     * @brief Nanoseconds spent running a loop whose body is an instruction repeated, minus
+     *        nanoseconds spent running the same loop with an empty body
+     */
+    void opcode_benchmark(const std::string& name, const std::string& instruction, bool closures)
+    {
+        auto const iterations = std::max<uint64_t>(g_operations / OPCODE_UNROLL, 1);
+        auto const loop = [&](const std::string& body) {
+            std::stringstream code;
+            code << "@staticv buf 64\n"
+                 << "assignw A 7\n"
+                 << "assignw B 3\n"
+                 << "assignw C 0\n"
+                 << "assignw F 2\n"
+                 << "assignw buf[0] 5\n"
+                 << "assignw I 0\n"
+                 << "@label _loop\n";
+            for (uint i = 0; i < OPCODE_UNROLL; i++)
+            {
+                // '%' stands for the number of the copy, so labels are unique
+                std::string copy = body;
+                for (auto at = copy.find('%'); at != std::string::npos; at = copy.find('%'))
+                    copy.replace(at, 1, std::to_string(i));
+                code << copy;
+            }
+            code << "add I I 1\n"
+                 << "lt T I " << iterations << "\n"
+                 << "goif _loop T\n"
+                 << "exit 0\n";
+
+            Program program;
+            if (parse(code.str(), program) == FAIL)
+            {
+                std::cerr << "Could not parse opcode benchmark for '" << name << "'" << std::endl;
+                return 0.0;
+            }
+
+            auto machine = interpreter(program, closures);
+            auto const time = time_ns([&]() { machine->run_tac_program(); });
+            if (machine->status() != TacMachine::Status::FINISHED)
+                std::cerr << "Opcode benchmark for '" << name << "' failed" << std::endl;
+
+            return time;
+        };
+
+        auto const engine = closures ? "closure" : "switch";
+        report(std::string("opcode/") + engine + "/" + name, iterations * OPCODE_UNROLL, [&]() {
+            return std::max(loop(instruction) - loop(""), 0.0);
+        });
+    }
+
+    void opcode_benchmarks()
+    {
+        std::vector<std::pair<std::string, std::string>> const instructions = {
+            { "assignw",        "assignw C A\n" },
+            { "assignw const",  "assignw C 42\n" },
+            { "add",            "add C A B\n" },
+            { "sub",            "sub C A B\n" },
+            { "mult",           "mult C A B\n" },
+            { "div",            "div C A B\n" },
+            { "mod",            "mod C A B\n" },
+            { "eq",             "eq C A B\n" },
+            { "lt",             "lt C A B\n" },
+            { "and",            "and C A B\n" },
+            { "minus",          "minus C A\n" },
+            { "itof",           "itof C A\n" },
+            { "load",           "assignw C buf[0]\n" },
+            { "store",          "assignw buf[4] A\n" },
+            { "goto",           "goto _next__L%\n@label _next__L%\n" },
+            { "goif",           "goif _next__L% F\n@label _next__L%\n" },
+        };
+
+        for (bool closures : {false, true})
+            for (auto const& [name, instruction] : instructions)
+                opcode_benchmark(name, instruction, closures);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string const arg = argv[i];
+        if (arg == "--quick")
+            g_operations = QUICK_OPERATIONS;
+        else
+            g_filter = arg;
+    }
+
+    memory_benchmarks();
+    register_benchmarks();
+    label_benchmarks();
+    opcode_benchmarks();
+
+    return 0;
+}
@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+"""
+Measure how reading and loading programs scales with their size.
+
+    scaling.py [--binary ./load-bench] [--vary functions] [--sizes 250,1000,4000]
+               [--runs 3] [--output scaling.json] [--csv scaling.csv] [--plot scaling.png]
+
+Programs are written by gen_program.py, growing one of their dimensions and keeping the
+rest at their defaults. Labels and statements grow every function at once, so each
+dimension has its own default sizes, chosen so the largest program has about a million
+lines whatever the dimension. Every program is loaded by load-bench a few times, and the median
+of each measure is shown: parse time, label map time, register and tail call analysis,
+whole setup, time until the first instruction runs, and peak resident memory. Between
+consecutive sizes, and over all of them, the growth exponent of every time against lines is shown, 1 for linear growth. Times
+growing faster than SUPERLINEAR are flagged, and make the script exit with status 1.
+"""
+import argparse
+import json
+import math
+import os
+import signal
+import statistics
+import subprocess
+import sys
+import tempfile
+
+sys.dont_write_bytecode = True # keep bench/ free of __pycache__
+import gen_program
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+REPO_DIR = os.path.dirname(BENCH_DIR)
+
+TIMES = ["parse_ms", "labels_ms", "registers_ms", "tail_calls_ms", "setup_ms", "first_instruction_ms"]
+SUPERLINEAR = 1.3   # growth exponent above which a time is flagged
+MIN_FLAGGED_MS = 5  # times below this are too noisy to flag
+
+# Default sizes of every dimension, from about 20 thousand to a million lines
+SIZES = {
+    "functions": "250,1000,4000,16000",
+    "labels": "25,100,400,1600",
+    "strings": "250,1000,4000,16000",
+    "statements": "20,80,320,1280",
+}
+
+
+def load(binary, filename, runs):
+    """Median of every measure over some runs of load-bench"""
+    samples = []
+    for _ in range(runs):
+        result = subprocess.run([binary, filename], stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        if result.returncode != 0:
+            # A negative status is the signal that killed it, SIGKILL when memory runs out
+            status = "exit status %d" % result.returncode
+            if result.returncode < 0:
+                status = "killed by signal %d (%s)" % (-result.returncode, signal.Signals(-result.returncode).name)
+            raise RuntimeError("load-bench failed on '%s', %s: %s" % (filename, status, result.stderr.decode(errors="replace").strip()))
+        samples.append(json.loads(result.stdout.decode()))
+
+    return {key: statistics.median(sample[key] for sample in samples) for key in samples[0]}
+
+
+def exponent(before, after, key):
+    """Growth exponent of a measure against lines of the program between two sizes"""
+    if before[key] <= 0 or after[key] <= 0 or after["lines"] == before["lines"]:
+        return None
+    return math.log(after[key] / before[key]) / math.log(after["lines"] / before["lines"])
+
+
+def plot(results, filename):
+    try:
+        import matplotlib
+        matplotlib.use("Agg")
+        import matplotlib.pyplot as plt
+    except ImportError:
+        print("warning: matplotlib is not installed, no plot written", file=sys.stderr)
+        return
+
+    sizes = [r["lines"] for r in results]
+    figure, (times, memory) = plt.subplots(1, 2, figsize=(12, 5))
+    for key in TIMES:
+        times.loglog(sizes, [max(r[key], 1e-3) for r in results], marker="o", label=key[:-3])
+    times.set_xlabel("lines")
+    times.set_ylabel("ms")
+    times.legend()
+
+    memory.loglog(sizes, [r["peak_rss_kib"] / 1024 for r in results], marker="o")
+    memory.set_xlabel("lines")
+    memory.set_ylabel("peak MiB")
+
+    figure.tight_layout()
+    figure.savefig(filename)
+    print("plot written to '%s'" % filename)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Measure how loading programs scales with their size")
+    parser.add_argument("--binary", default=os.path.join(REPO_DIR, "load-bench"), help="load-bench to run")
+    parser.add_argument("--vary", default="functions", choices=["functions", "labels", "strings", "statements"],
+                        help="dimension of the program to grow")
+    parser.add_argument("--sizes", help="comma separated values of that dimension, depend on the dimension by default")
+    parser.add_argument("--runs", type=int, default=3, help="loads of every program")
+    parser.add_argument("--output", help="where to write results as json")
+    parser.add_argument("--csv", help="where to write results as csv")
+    parser.add_argument("--plot", help="where to write a log-log plot of the results, needs matplotlib")
+    args = parser.parse_args()
+
+    if not os.access(args.binary, os.X_OK):
+        print("error: '%s' is not an executable, build it with make load-bench first" % args.binary, file=sys.stderr)
+        return 2
+
+    results = []
+    with tempfile.TemporaryDirectory() as directory:
+        for size in (int(s) for s in (args.sizes or SIZES[args.vary]).split(",")):
+            filename = os.path.join(directory, "program.tac")
+            text = gen_program.generate(**{args.vary: size})
+            with open(filename, "w") as out:
+                out.write(text)
+
+            result = load(args.binary, filename, args.runs)
+            result[args.vary] = size
+            result["lines"] = text.count("\n")
+            results.append(result)
+
+    # Table of medians, then the growth of every time between sizes
+    print("%-10s %10s %10s" % (args.vary, "lines", "peak MiB") + "".join("%19s" % key[:-3] for key in TIMES))
+    for result in results:
+        print("%-10d %10d %10.1f" % (result[args.vary], result["lines"], result["peak_rss_kib"] / 1024)
+              + "".join("%19.2f" % result[key] for key in TIMES))
+
+    print()
+    print("growth exponent against lines, 1 is linear:")
+    for before, after in zip(results, results[1:]):
+        line = "%-10s %21s" % ("%d->%d" % (before[args.vary], after[args.vary]), "")
+        for key in TIMES:
+            growth = exponent(before, after, key)
+            line += "%19s" % ("-" if growth is None else "%.2f" % growth)
+        print(line)
+
+    # Steps between close sizes are noisy, only growth over the whole range is flagged
+    flagged = []
+    first, last = results[0], results[-1]
+    line = "%-10s %21s" % ("overall", "")
+    for key in TIMES:
+        growth = exponent(first, last, key) if len(results) > 1 else None
+        superlinear = growth is not None and growth > SUPERLINEAR and last[key] >= MIN_FLAGGED_MS
+        line += "%19s" % ("-" if growth is None else "%.2f%s" % (growth, " !" if superlinear else ""))
+        if superlinear:
+            flagged.append("%s grows as lines^%.2f from %d to %d %s" % (key[:-3], growth, first[args.vary], last[args.vary], args.vary))
+    print(line)
+
+    for message in flagged:
+        print("SUPERLINEAR: " + message)
+
+    if args.output:
+        with open(args.output, "w") as out:
+            json.dump({"vary": args.vary, "runs": args.runs, "results": results}, out, indent=2)
+        print("results written to '%s'" % args.output)
+
+    if args.csv:
+        with open(args.csv, "w") as out:
+            keys = [args.vary, "lines", "instructions", "labels"] + TIMES + ["parse_rss_kib", "peak_rss_kib"]
+            out.write(",".join(keys) + "\n")
+            for result in results:
+                out.write(",".join(str(result[key]) for key in keys) + "\n")
+        print("results written to '%s'" % args.csv)
+
+    if args.plot:
+        plot(results, args.plot)
+
+    return 1 if flagged else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
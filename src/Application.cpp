@@ -3,6 +3,12 @@
 #include "TacReader.hpp"
 #include "Tac.hpp"
 #include "TacMachine.hpp"
+#include "ControlFlowGraph.hpp"
+#include "Optimizer.hpp"
+#include "TacWriter.hpp"
+#include "CTranslator.hpp"
+#include "Sampler.hpp"
+#include "PerfCounters.hpp"
 
 // C++ includes 
 #include <sstream>
@@ -67,14 +73,164 @@ namespace TacRunner
 
         App::success("TAC code successfully parsed.");
 
+        // Optimize program if requested so
+        if (m_config.optimization_level > 0)
+        {
+            Optimizer optimizer(m_config.optimization_level, m_config.inline_threshold);
+            if (optimizer.optimize(tac_code) == FAIL)
+            {
+                App::error("Could not optimize program");
+                return;
+            }
+            App::trace(optimizer.report());
+        }
+
+        // Dump control flow graph if requested so
+        if (!m_config.cfg_file.empty())
+        {
+            std::vector<ControlFlowGraph> graphs;
+            std::ofstream cfg_out(m_config.cfg_file);
+            std::stringstream ss;
+            if (!cfg_out.good())
+            {
+                ss << "Could not open file '" << m_config.cfg_file << "' to write control flow graph";
+                App::error(ss.str());
+            }
+            else if (ControlFlowGraph::build(tac_code, graphs) == SUCCESS)
+            {
+                cfg_out << ControlFlowGraph::dot(tac_code, graphs);
+                ss << "Control flow graph written to '" << m_config.cfg_file << "'";
+                App::success(ss.str());
+            }
+        }
+
+        // Write program instead of running it if requested so
+        if (!m_config.emit_tac_file.empty())
+        {
+            std::stringstream ss;
+            if (TacWriter::write(m_config.emit_tac_file, tac_code) == FAIL)
+            {
+                ss << "Could not write tac code to '" << m_config.emit_tac_file << "'";
+                App::error(ss.str());
+            }
+            else
+            {
+                ss << "TAC code written to '" << m_config.emit_tac_file << "'";
+                App::success(ss.str());
+            }
+            return;
+        }
+
         // Try to run program 
         App::trace("Creating tac machine...");
         TacMachine machine(tac_code);
+        if (m_config.register_windows)
+            cerr << machine.register_windows_str() << endl;
+
+        if (m_config.memoize)
+            machine.enable_memoization();
+
+        if (m_config.no_jit)
+            machine.disable_jit();
+
+        if (m_config.no_traces)
+            machine.disable_traces();
+
+        if (m_config.closure_engine)
+            machine.use_closure_engine();
+
+        bool const profile = m_config.profile || !m_config.profile_json_file.empty();
+        if ((profile && machine.enable_profiling() == FAIL) || 
+            (m_config.profile_lines && machine.enable_line_profiling() == FAIL))
+        {
+            App::error("Could not profile program, profiling was disabled when compiling");
+            return;
+        }
+
+        // Translate program into C instead of running it if requested so
+        if (!m_config.aot_file.empty())
+        {
+            if (machine.status() != TacMachine::Status::NOT_STARTED)
+            {
+                App::error("Could not translate program into C");
+                return;
+            }
+
+            std::stringstream ss;
+            if (CTranslator::write(m_config.aot_file, machine) == FAIL)
+            {
+                ss << "Could not write C code to '" << m_config.aot_file << "'";
+                App::error(ss.str());
+            }
+            else
+            {
+                ss << "C code written to '" << m_config.aot_file << "'";
+                App::success(ss.str());
+            }
+            return;
+        }
+
+        std::string perf_counters_str;
         if (machine.status() == TacMachine::Status::NOT_STARTED)
         {
+            // Restore a previous state if requested so
+            if (!m_config.restore_file.empty())
+            {
+                std::stringstream ss;
+                ss << "Restoring machine state from '" << m_config.restore_file << "'...";
+                App::trace(ss.str());
+                if (machine.load_snapshot(m_config.restore_file) == FAIL)
+                {
+                    App::error("Could not restore machine state");
+                    return;
+                }
+            }
+
+            // Sample the program while it runs if requested so
+            if (!m_config.sample_file.empty() && machine.enable_sampling(m_config.sample_frequency) == FAIL)
+                App::warning("Could not start sampling, the program will run without it");
+
+            // Record calls and I/O while the program runs if requested so
+            if (!m_config.trace_out_file.empty() && machine.enable_event_trace(m_config.trace_out_file) == FAIL)
+            {
+                std::stringstream ss;
+                ss << "Could not open file '" << m_config.trace_out_file << "' to write trace events";
+                App::error(ss.str());
+                return;
+            }
+
+            // Record memory accesses while the program runs if requested so
+            if (!m_config.mem_trace_file.empty() && machine.enable_memory_trace(m_config.mem_trace_file) == FAIL)
+            {
+                std::stringstream ss;
+                ss << "Could not open file '" << m_config.mem_trace_file << "' to write memory accesses";
+                App::error(ss.str());
+                return;
+            }
+
+            // Follow heap allocations while the program runs if requested so
+            if (!m_config.heap_profile_file.empty())
+                machine.enable_heap_profiling();
+
+            // Measure the host while the program runs if requested so
+            std::unique_ptr<PerfCounters> counters;
+            if (m_config.perf_counters)
+            {
+                counters = std::make_unique<PerfCounters>();
+                if (counters->start() == FAIL)
+                    App::warning("Hardware performance counters are not available, only time will be measured");
+            }
+
             // Start rogram when correctly created
             App::trace("Starting program...");
-            machine.run_tac_program();
+            auto const first_step = machine.step_count();
+            machine.run_tac_program(m_config.checkpoint_at);
+
+            if (counters != nullptr)
+            {
+                counters->stop();
+                perf_counters_str = counters->str(machine.step_count() - first_step);
+            }
         }
         // vv TESTING AREA, DELETE LATER --------------------------------------------------------------------------------
 
@@ -85,12 +241,127 @@ namespace TacRunner
         if (machine.status() == TacMachine::Status::ERROR)
         {
             stringstream ss;
-            ss << "Program execution failed at line " << machine.program_counter();
+            ss << "Program execution failed at instruction " << machine.program_counter();
+            if (machine.current_instruction().line() != 0)
+                ss << ", line " << machine.current_instruction().line() << " of '" << m_config.filename << "'";
             App::error(ss.str());
 
         }
         else if(machine.status() == TacMachine::Status::FINISHED)
             App::success("Program execution successful");
+        else if(machine.status() == TacMachine::Status::PAUSED)
+        {
+            stringstream ss;
+            ss << "Program paused after " << machine.step_count() << " instructions";
+            App::trace(ss.str());
+        }
+
+        if (m_config.memoize)
+            cerr << machine.memoization_str() << endl;
+
+        if (m_config.profile)
+            cerr << machine.profile_str() << endl;
+
+        if (m_config.profile_lines)
+            cerr << machine.line_profile_str(m_config.filename) << endl;
+
+        if (!perf_counters_str.empty())
+            cerr << perf_counters_str << endl;
+
+        if (!m_config.trace_out_file.empty())
+        {
+            std::stringstream ss;
+            if (machine.close_event_trace() == FAIL)
+            {
+                ss << "Could not write trace events to '" << m_config.trace_out_file << "'";
+                App::error(ss.str());
+            }
+            else
+            {
+                ss << "Trace events written to '" << m_config.trace_out_file << "'";
+                App::success(ss.str());
+            }
+        }
+
+        auto const heap_profile = machine.heap_profile_str();
+        if (!heap_profile.empty())
+        {
+            cerr << heap_profile << endl;
+
+            std::stringstream ss;
+            if (machine.write_heap_series(m_config.heap_profile_file) == FAIL)
+            {
+                ss << "Could not write live heap memory to '" << m_config.heap_profile_file << "'";
+                App::error(ss.str());
+            }
+            else
+            {
+                ss << "Live heap memory over time written to '" << m_config.heap_profile_file << "'";
+                App::success(ss.str());
+            }
+        }
+
+        if (!m_config.mem_trace_file.empty())
+        {
+            std::stringstream ss;
+            auto const accesses = machine.memory_trace_accesses();
+            if (machine.close_memory_trace() == FAIL)
+            {
+                ss << "Could not write memory accesses to '" << m_config.mem_trace_file << "'";
+                App::error(ss.str());
+            }
+            else
+            {
+                ss << accesses << " memory accesses written to '" << m_config.mem_trace_file << "'";
+                App::success(ss.str());
+            }
+        }
+
+        if (!m_config.sample_file.empty() && !machine.sampling_str().empty())
+        {
+            std::stringstream ss;
+            if (machine.write_samples(m_config.sample_file) == FAIL)
+            {
+                ss << "Could not write samples to '" << m_config.sample_file << "'";
+                App::error(ss.str());
+            }
+            else
+            {
+                ss << "Samples written to '" << m_config.sample_file << "' as folded stacks";
+                App::success(ss.str());
+                App::trace(machine.sampling_str());
+            }
+        }
+
+        if (!m_config.profile_json_file.empty())
+        {
+            std::ofstream json_out(m_config.profile_json_file);
+            std::stringstream ss;
+            if (!json_out.good())
+            {
+                ss << "Could not open file '" << m_config.profile_json_file << "' to write profile";
+                App::error(ss.str());
+            }
+            else
+            {
+                json_out << machine.profile_json();
+                ss << "Profile written to '" << m_config.profile_json_file << "'";
+                App::success(ss.str());
+            }
+        }
+
+        // Save a snapshot if requested so
+        if (!m_config.checkpoint_file.empty())
+        {
+            if (machine.save_snapshot(m_config.checkpoint_file) == FAIL)
+                App::error("Could not save machine state");
+            else
+            {
+                stringstream ss;
+                ss << "Machine state saved to '" << m_config.checkpoint_file << "'";
+                App::success(ss.str());
+            }
+        }
 
         if(!m_config.quiet)
         {
@@ -109,7 +380,7 @@ namespace TacRunner
         std::stringstream ss;
         ss << "Tac Runner is a simple virtual machine capable of running tac code." << endl;
         ss << "\tUsage:" << endl;
-        ss << "\t\ttac-runner <name_of_file> [flags]" << endl;
+        ss << "\t\ttac-runner [flags] <name_of_file> [flags]" << endl;
         ss << "\tWhere:" << endl;
         ss << "\t\t<name_of_file> : is the name of the file to be run, should be a valid tac code." << endl;
         ss << "\t\t [flags] : Configuration flags, part of the following: " << endl;
@@ -118,11 +389,80 @@ namespace TacRunner
         ss << "\t\t\t--registers : Show registers" << endl;
         ss << "\t\t\t--labels : show current labels" << endl;
         ss << "\t\t\t--stack-mem-bytes n: show n bytes of stack memory" << endl;
+        ss << "\t\t\t--checkpoint file: save a snapshot of the machine to file when it stops" << endl;
+        ss << "\t\t\t--checkpoint-at n: pause the machine after running n instructions" << endl;
+        ss << "\t\t\t--restore file: restore a snapshot from file before running" << endl;
+        ss << "\t\t\t--dump-cfg file: write the control flow graph of the program to file in dot format" << endl;
+        ss << "\t\t\t--optimize : optimize the program before running it" << endl;
+        ss << "\t\t\t-O0, -O1, -O2 : optimization level, -O2 by default when optimizing" << endl;
+        ss << "\t\t\t--emit-tac file: write the (optimized) program to file instead of running it" << endl;
+        ss << "\t\t\t--inline-threshold n: inline functions with up to n instructions when optimizing, 0 to disable inlining" << endl;
+        ss << "\t\t\t--register-windows : show how many registers each function uses and how many slots they take" << endl;
+        ss << "\t\t\t--memoize : remember results of calls to pure functions, and show hit rates on exit" << endl;
+        ss << "\t\t\t--no-jit : interpret every instruction, without compiling hot functions into native code" << endl;
+        ss << "\t\t\t--no-traces : run hot loops in the interpreter, without recording traces for them" << endl;
+        ss << "\t\t\t--aot file: translate the (optimized) program into a standalone C program written to file instead of running it" << endl;
+        ss << "\t\t\t--profile, --profile=opcodes : count how many times each instruction and pair of instructions runs, and show them on exit" << endl;
+        ss << "\t\t\t--profile=lines : count instructions run by each source line, and calls, instructions and time for each function, and show them on exit" << endl;
+        ss << "\t\t\t--profile-json file: write instruction and instruction pair counts to file in json format" << endl;
+        ss << "\t\t\t--sample file: sample the running functions while the program runs, and write them to file as folded stacks" << endl;
+        ss << "\t\t\t--sample-hz n: samples per second of cpu time when sampling, " << SAMPLE_DEFAULT_FREQUENCY << " by default" << endl;
+        ss << "\t\t\t--trace-out file: write function calls, returns, reads and prints to file as chrome trace events" << endl;
+        ss << "\t\t\t--perf-counters : count host cycles, instructions, branch misses and cache misses while the program runs, and show them per guest instruction on exit" << endl;
+        ss << "\t\t\t--mem-trace file: write every guest memory read and write, with its address, size, region and instruction, to file in a compact binary format" << endl;
+        ss << "\t\t\t--heap-profile file: attribute heap allocations to the instructions performing them, show sites, lifetimes and blocks not freed on exit, and write live heap memory over time to file as csv" << endl;
+        ss << "\t\t\t--engine name: how instructions are run, 'switch' to dispatch every instruction (default), 'closure' to compile them into pre-bound handlers" << endl;
 
 
         return ss.str();
     }
 
+    int Config::flag_value(const std::vector<std::string> &args, const std::string& flag, std::string& out_value)
+    {
+        // The value might be given in the same argument, as in --flag=value
+        auto const prefix = flag + "=";
+        for (auto const& arg : args)
+            if (arg.compare(0, prefix.size(), prefix) == 0)
+            {
+                out_value = arg.substr(prefix.size());
+                return SUCCESS;
+            }
+
+        auto it = std::find(args.begin(), args.end(), flag);
+        if (it == args.end())
+            return SUCCESS;
+
+        if (it + 1 == args.end())
+        {
+            stringstream ss;
+            ss << "Missing value for flag " << flag;
+            App::error(ss.str());
+            return FAIL;
+        }
+
+        out_value = *(it + 1);
+        return SUCCESS;
+    }
+
+    bool Config::takes_value(const std::string& flag)
+    {
+        return  flag == App::stack_mem_bytes() || 
+                flag == App::checkpoint() || 
+                flag == App::checkpoint_at() || 
+                flag == App::restore() || 
+                flag == App::dump_cfg() || 
+                flag == App::emit_tac() ||
+                flag == App::aot() ||
+                flag == App::engine() ||
+                flag == App::profile_json() ||
+                flag == App::sample() ||
+                flag == App::sample_hz() ||
+                flag == App::trace_out() ||
+                flag == App::mem_trace() ||
+                flag == App::heap_profile() ||
+                flag == App::inline_threshold();
+    }
+
     int Config::from_arg_list(const std::vector<std::string> &args, Config& out_config)
     {
         // Store actions here
@@ -136,11 +476,18 @@ namespace TacRunner
             return FAIL;
         }
 
-        // First argument will be the file to parse 
-        auto filename = args[1];
+        // The file to parse is the first argument that is neither a flag nor a flag value
+        std::string filename;
+        for (size_t i = 1; i < args.size() && filename.empty(); i++)
+        {
+            if (takes_value(args[i]))
+                i++;
+            else if (args[i].empty() || args[i][0] != '-')
+                filename = args[i];
+        }
 
         // check if it's just the help flag
-        if (filename == App::help_flag())
+        if (filename.empty() && std::find(args.begin(), args.end(), App::help_flag()) != args.end())
         {
             actions.push_back(Action::SHOW_HELP);
             // This is the only field for now
@@ -149,6 +496,12 @@ namespace TacRunner
             return SUCCESS;
         }
 
+        if (filename.empty())
+        {
+            App::error("Missing file to run");
+            return FAIL;
+        }
+
         // Check if not exists
         std::ifstream my_file(filename.c_str());
         if (!my_file.good())
@@ -181,6 +534,43 @@ namespace TacRunner
         // Check if should show labels
         bool labels = std::find(args.begin(), args.end(), App::labels()) != args.end();
 
+        // Check if should show register windows
+        bool register_windows = std::find(args.begin(), args.end(), App::register_windows()) != args.end();
+
+        // Check if should memoize pure functions
+        bool memoize = std::find(args.begin(), args.end(), App::memoize()) != args.end();
+
+        // Check if should interpret every instruction
+        bool no_jit = std::find(args.begin(), args.end(), App::no_jit()) != args.end();
+        bool no_traces = std::find(args.begin(), args.end(), App::no_traces()) != args.end();
+
+        // Check if should count instructions, and what to count them by
+        bool profile = false, profile_lines = false;
+        for (auto const& arg : args)
+        {
+            auto const prefix = App::profile() + "=";
+            if (arg == App::profile())
+                profile = true;
+            else if (arg.compare(0, prefix.size(), prefix) == 0)
+            {
+                auto const mode = arg.substr(prefix.size());
+                if (mode == "opcodes")
+                    profile = true;
+                else if (mode == "lines")
+                    profile_lines = true;
+                else
+                {
+                    stringstream ss;
+                    ss << "Invalid profile mode: " << arg << ". Valid modes are 'opcodes' and 'lines'";
+                    App::error(ss.str());
+                    return FAIL;
+                }
+            }
+        }
+
+        // Check if should read hardware counters
+        bool perf_counters = std::find(args.begin(), args.end(), App::perf_counters()) != args.end();
+
         // Check if stack memory flag is provided
         uint stack_mem_bytes = 0;
         for(size_t i = 0; i < args.size(); i++)
@@ -212,6 +602,128 @@ namespace TacRunner
         
         }
 
+        // Check snapshot flags
+        std::string checkpoint_file, restore_file, checkpoint_at_str, cfg_file;
+        if (flag_value(args, App::checkpoint(), checkpoint_file) == FAIL ||
+            flag_value(args, App::dump_cfg(), cfg_file) == FAIL ||
+            flag_value(args, App::restore(), restore_file) == FAIL ||
+            flag_value(args, App::checkpoint_at(), checkpoint_at_str) == FAIL)
+            return FAIL;
+
+        // Check optimization flags
+        std::string emit_tac_file, inline_threshold_str, aot_file, profile_json_file;
+        if (flag_value(args, App::emit_tac(), emit_tac_file) == FAIL ||
+            flag_value(args, App::aot(), aot_file) == FAIL ||
+            flag_value(args, App::profile_json(), profile_json_file) == FAIL ||
+            flag_value(args, App::inline_threshold(), inline_threshold_str) == FAIL)
+            return FAIL;
+
+        // Check sampling flags
+        std::string sample_file, sample_hz_str;
+        if (flag_value(args, App::sample(), sample_file) == FAIL ||
+            flag_value(args, App::sample_hz(), sample_hz_str) == FAIL)
+            return FAIL;
+
+        uint sample_frequency = SAMPLE_DEFAULT_FREQUENCY;
+        if (!sample_hz_str.empty())
+        {
+            try
+            {
+                sample_frequency = std::stoul(sample_hz_str);
+            }
+            catch(std::logic_error&)
+            {
+                sample_frequency = 0;
+            }
+
+            if (sample_frequency == 0)
+            {
+                stringstream ss;
+                ss << "Invalid amount of samples per second for flag " << App::sample_hz() << ". Provided: " << sample_hz_str;
+                App::error(ss.str());
+                return FAIL;
+            }
+        }
+
+        // Check event tracing flags
+        std::string trace_out_file;
+        if (flag_value(args, App::trace_out(), trace_out_file) == FAIL)
+            return FAIL;
+
+        // Check memory tracing flags
+        std::string mem_trace_file;
+        if (flag_value(args, App::mem_trace(), mem_trace_file) == FAIL)
+            return FAIL;
+
+        // Check heap profiling flags
+        std::string heap_profile_file;
+        if (flag_value(args, App::heap_profile(), heap_profile_file) == FAIL)
+            return FAIL;
+
+        // Check execution engine
+        std::string engine = "switch";
+        if (flag_value(args, App::engine(), engine) == FAIL)
+            return FAIL;
+
+        if (engine != "switch" && engine != "closure")
+        {
+            stringstream ss;
+            ss << "Invalid engine for flag " << App::engine() << ": " << engine << ". Valid engines are 'switch' and 'closure'";
+            App::error(ss.str());
+            return FAIL;
+        }
+
+        uint inline_threshold = DEFAULT_INLINE_THRESHOLD;
+        if (!inline_threshold_str.empty())
+        {
+            try
+            {
+                inline_threshold = std::stoul(inline_threshold_str);
+            }
+            catch(std::logic_error&)
+            {
+                stringstream ss;
+                ss << "Invalid amount of instructions for flag " << App::inline_threshold() << ". Provided: " << inline_threshold_str;
+                App::error(ss.str());
+                return FAIL;
+            }
+        }
+
+        bool const optimize = std::find(args.begin(), args.end(), App::optimize()) != args.end();
+        uint optimization_level = optimize ? MAX_OPTIMIZATION_LEVEL : 0;
+        for (auto const& arg : args)
+        {
+            auto const& prefix = App::optimization_level();
+            if (arg.compare(0, prefix.size(), prefix) != 0)
+                continue;
+
+            auto const level = arg.substr(prefix.size());
+            if (level.size() != 1 || level[0] < '0' || level[0] > '0' + MAX_OPTIMIZATION_LEVEL)
+            {
+                stringstream ss;
+                ss << "Invalid optimization level: " << arg << ". Valid levels go from 0 to " << MAX_OPTIMIZATION_LEVEL;
+                App::error(ss.str());
+                return FAIL;
+            }
+            optimization_level = level[0] - '0';
+        }
+
+        uint64_t checkpoint_at = 0;
+        if (!checkpoint_at_str.empty())
+        {
+            try
+            {
+                checkpoint_at = std::stoull(checkpoint_at_str);
+            }
+            catch(std::logic_error&)
+            {
+                stringstream ss;
+                ss << "Invalid amount of instructions for flag " << App::checkpoint_at() << ". Provided: " << checkpoint_at_str;
+                App::error(ss.str());
+                return FAIL;
+            }
+        }
+
         // Tell the app to run some code
         actions.push_back(Action::RUN_TAC_CODE);
 
@@ -224,6 +736,28 @@ namespace TacRunner
         out_config.registers    = registers;
         out_config.labels       = labels;
         out_config.show_bytes_of_stack_mem = stack_mem_bytes;
+        out_config.checkpoint_file  = checkpoint_file;
+        out_config.checkpoint_at    = checkpoint_at;
+        out_config.restore_file     = restore_file;
+        out_config.cfg_file         = cfg_file;
+        out_config.optimization_level = optimization_level;
+        out_config.inline_threshold = inline_threshold;
+        out_config.emit_tac_file    = emit_tac_file;
+        out_config.register_windows = register_windows;
+        out_config.memoize          = memoize;
+        out_config.no_jit           = no_jit;
+        out_config.aot_file         = aot_file;
+        out_config.no_traces        = no_traces;
+        out_config.closure_engine   = engine == "closure";
+        out_config.profile          = profile;
+        out_config.profile_lines    = profile_lines;
+        out_config.sample_file      = sample_file;
+        out_config.sample_frequency = sample_frequency;
+        out_config.trace_out_file   = trace_out_file;
+        out_config.perf_counters    = perf_counters;
+        out_config.mem_trace_file   = mem_trace_file;
+        out_config.heap_profile_file = heap_profile_file;
+        out_config.profile_json_file = profile_json_file;
 
         return SUCCESS;
     }
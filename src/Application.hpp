@@ -49,6 +49,28 @@ namespace TacRunner
         uint show_bytes_of_stack_mem; 
         // By default, the stack will only print memory that is active, 
         // provide this field (!= 0) to make it print the specified ammount of bytes
+        std::string checkpoint_file;    // where to store a machine snapshot when it stops, empty for none
+        uint64_t checkpoint_at;         // pause the machine after this many instructions, 0 for never
+        std::string restore_file;       // snapshot to restore before running, empty for none
+        std::string cfg_file;           // where to write the control flow graph in dot format, empty for none
+        uint optimization_level;        // how much to optimize the program before running it, 0 for nothing
+        uint inline_threshold;          // largest function inlined by the optimizer, in instructions, 0 for no inlining
+        std::string emit_tac_file;      // where to write the (optimized) program instead of running it, empty to run it
+        bool register_windows;          // show how many registers and slots each function uses
+        bool memoize;                   // remember results of calls to pure functions
+        bool no_jit;                    // interpret every instruction, without compiling hot functions
+        std::string aot_file;           // where to write the program translated into C instead of running it, empty to run it
+        bool no_traces;                 // run hot loops in the interpreter, without recording traces for them
+        bool closure_engine;            // run instructions through pre-bound handlers instead of the switch
+        bool profile;                   // count instructions and instruction pairs, and show them on exit
+        bool profile_lines;             // count instructions per source line and per function, and show them on exit
+        std::string sample_file;        // where to write samples as folded stacks, empty to not sample
+        uint sample_frequency;          // samples per second of cpu time when sampling
+        std::string trace_out_file;     // where to write trace events for calls and I/O, empty to not record them
+        bool perf_counters;             // count host cycles, instructions and misses while running, and show them on exit
+        std::string mem_trace_file;     // where to write every guest memory access, empty to not record them
+        std::string heap_profile_file;  // where to write live heap memory over time, empty to not profile the heap
+        std::string profile_json_file;  // where to write instruction counts in json format, empty to not write them
 
         /**
          * @brief Create a config from a list of arguments,
@@ -62,6 +84,26 @@ namespace TacRunner
          */
         static int from_arg_list(const std::vector<std::string> &args, Config& out_config);
 
+        /**
+         * @brief Get the value following 'flag' in the argument list, if the flag is present. 
+         *        The value can also be given in the same argument, as in --flag=value
+         * 
+         * @param args Argument list as specified for the command line arguments
+         * @param flag flag whose value is requested
+         * @param out_value where to store the value, untouched if the flag is not present
+         * @return 0 on success, 1 if the flag is present but has no value
+         */
+        static int flag_value(const std::vector<std::string> &args, const std::string& flag, std::string& out_value);
+
+        /**
+         * @brief Tells if a flag is followed by a value, so that value is not mistaken by the filename
+         * 
+         * @param flag flag to check
+         * @return true if the next argument is the value of this flag
+         * @return false otherwise
+         */
+        static bool takes_value(const std::string& flag);
+
         inline bool has_action(Action action) const { return std::find(actions.begin(), actions.end(), action) != actions.end(); }
     };
 
@@ -155,6 +197,175 @@ namespace TacRunner
              */
             static inline std::string stack_mem_bytes()      { return "--stack-mem-bytes"; }
 
+            /**
+             * @brief Use this flag to store a snapshot of the machine in the given 
+             * file when it stops running
+             * 
+             * @return std::string 
+             */
+            static inline std::string checkpoint()      { return "--checkpoint"; }
+
+            /**
+             * @brief Use this flag to pause the machine after the given amount 
+             * of instructions, so a checkpoint can be taken in the middle of the program
+             * 
+             * @return std::string 
+             */
+            static inline std::string checkpoint_at()   { return "--checkpoint-at"; }
+
+            /**
+             * @brief Use this flag to restore a machine snapshot before running
+             * 
+             * @return std::string 
+             */
+            static inline std::string restore()         { return "--restore"; }
+
+            /**
+             * @brief Use this flag to write the control flow graph of the program 
+             * to the given file, in Graphviz dot format
+             * 
+             * @return std::string 
+             */
+            static inline std::string dump_cfg()        { return "--dump-cfg"; }
+
+            /**
+             * @brief Use this flag to optimize the program before running it, 
+             * with the highest optimization level unless another one is specified
+             * 
+             * @return std::string 
+             */
+            static inline std::string optimize()        { return "--optimize"; }
+
+            /**
+             * @brief Prefix of the optimization level flags: -O0, -O1, -O2
+             * 
+             * @return std::string 
+             */
+            static inline std::string optimization_level() { return "-O"; }
+
+            /**
+             * @brief Use this flag to write the (optimized) program to the given file 
+             * as tac code, instead of running it
+             * 
+             * @return std::string 
+             */
+            static inline std::string emit_tac()        { return "--emit-tac"; }
+
+            /**
+             * @brief Use this flag to set the size of the largest function inlined 
+             * into its callers when optimizing, 0 disables inlining
+             * 
+             * @return std::string 
+             */
+            static inline std::string inline_threshold() { return "--inline-threshold"; }
+
+            /**
+             * @brief Use this flag to show the register window of every function: 
+             * how many registers it uses and how many slots they're packed in
+             * 
+             * @return std::string 
+             */
+            static inline std::string register_windows() { return "--register-windows"; }
+
+            /**
+             * @brief Use this flag to remember the results of calls to pure functions, 
+             * so calls with the same arguments don't run them again
+             * 
+             * @return std::string 
+             */
+            static inline std::string memoize()         { return "--memoize"; }
+
+            /**
+             * @brief Use this flag to run every instruction in the interpreter, 
+             * without compiling hot functions into native code
+             * 
+             * @return std::string 
+             */
+            static inline std::string no_jit()          { return "--no-jit"; }
+
+            /**
+             * @brief Use this flag to translate the program into a standalone C program 
+             * written to the given file, instead of running it
+             * 
+             * @return std::string 
+             */
+            static inline std::string aot()             { return "--aot"; }
+
+            /**
+             * @brief Use this flag to run hot loops in the interpreter, 
+             * without recording and optimizing traces for them
+             * 
+             * @return std::string 
+             */
+            static inline std::string no_traces()       { return "--no-traces"; }
+
+            /**
+             * @brief Use this flag to choose how instructions are run: 'switch' or 'closure',
+             *        also accepted as --engine=name
+             * 
+             * @return std::string 
+             */
+            static inline std::string engine()          { return "--engine"; }
+
+            /**
+             * @brief Use this flag to count how many times each instruction 
+             *        and each pair of consecutive instructions runs. As --profile=lines,
+             *        count instructions per source line and per function instead
+             * 
+             * @return std::string 
+             */
+            static inline std::string profile()         { return "--profile"; }
+
+            /**
+             * @brief Use this flag to write instruction counts to a file in json format
+             * 
+             * @return std::string 
+             */
+            static inline std::string profile_json()    { return "--profile-json"; }
+
+            /**
+             * @brief Use this flag to sample the running functions and write them 
+             *        to a file as folded stacks
+             * 
+             * @return std::string 
+             */
+            static inline std::string sample()          { return "--sample"; }
+
+            /**
+             * @brief Use this flag to set how many samples per second are taken when sampling
+             * 
+             * @return std::string 
+             */
+            static inline std::string sample_hz()       { return "--sample-hz"; }
+
+            /**
+             * @brief Use this flag to write function calls and I/O to a file as trace events
+             * 
+             * @return std::string 
+             */
+            static inline std::string trace_out()       { return "--trace-out"; }
+
+            /**
+             * @brief Use this flag to read hardware performance counters while the program runs
+             * 
+             * @return std::string 
+             */
+            static inline std::string perf_counters()   { return "--perf-counters"; }
+
+            /**
+             * @brief Use this flag to write every guest memory read and write to a binary file
+             * 
+             * @return std::string 
+             */
+            static inline std::string mem_trace()       { return "--mem-trace"; }
+
+            /**
+             * @brief Use this flag to attribute heap allocations to the instructions performing them
+             * 
+             * @return std::string 
+             */
+            static inline std::string heap_profile()    { return "--heap-profile"; }
+
             /**
              * @brief Los a message to stderr formated as error
              * 
@@ -0,0 +1,952 @@
+// Local includes
+#include "CTranslator.hpp"
+#include "TacWriter.hpp"
+#include "Application.hpp"
+
+// C++ includes
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+
+using namespace TacRunner;
+
+namespace
+{
+    // Support code for every translated program, it mirrors the machine's memory, frames and I/O
+    const char* const RUNTIME = R"(
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BASE_SLOT (-2)
+#define STACK_SLOT (-3)
+
+/* Activation record for a running function */
+typedef struct
+{
+    uint32_t return_site;   /* call instruction to go back to on return */
+    uint32_t stack_pointer; /* stack pointer before the call */
+    uint32_t frame_pointer; /* frame pointer before the call */
+    int32_t return_slot;    /* slot in the caller's window where the return value is stored */
+    uint32_t function;      /* running function */
+    size_t window;          /* first register of this frame in the register file */
+    size_t window_size;     /* how many registers this frame has */
+} Frame;
+
+static uint8_t static_memory[STATIC_SIZE];
+static uint8_t stack_memory[STACK_SIZE];
+static uint8_t heap_memory[HEAP_SIZE];
+static uint32_t next_static = 1;
+static uint32_t next_heap = 1;
+static uint32_t sp = STACK_START;
+static uint32_t fp = STACK_START;
+
+static Frame* frames;
+static size_t frame_count, frame_capacity;
+static uint32_t* registers;
+static uint8_t* valid;
+static size_t register_count, register_capacity;
+
+/* Register window of the top frame */
+static uint32_t* R;
+static uint8_t* V;
+
+/* Value of a register of the top frame, or of the closest caller setting a register with the same name */
+#define REG(slot, name) (V[slot] ? R[slot] : find_register(name))
+#define SET(slot, value) do { uint32_t value_ = (value); R[slot] = value_; V[slot] = 1; } while (0)
+
+static inline void fail(const char* message)
+{
+    fflush(stdout);
+    fprintf(stderr, "error: %s\n", message);
+    exit(1);
+}
+
+static inline float as_float(uint32_t word) { float f; memcpy(&f, &word, sizeof(f)); return f; }
+static inline uint32_t as_word(float f) { uint32_t word; memcpy(&word, &f, sizeof(word)); return word; }
+
+/* Host memory for 'count' bytes starting at a machine address */
+static inline uint8_t* memory_at(uint32_t address, uint32_t count)
+{
+    if (address - STACK_START < STACK_SIZE && count <= STACK_SIZE - (address - STACK_START))
+        return stack_memory + (address - STACK_START);
+    if (address - STATIC_START < STATIC_SIZE && count <= STATIC_SIZE - (address - STATIC_START))
+        return static_memory + (address - STATIC_START);
+    if (address - HEAP_START < HEAP_SIZE && count <= HEAP_SIZE - (address - HEAP_START))
+        return heap_memory + (address - HEAP_START);
+
+    fail("[segmentation fault] invalid memory address");
+    return NULL;
+}
+
+static inline uint32_t load_word(uint32_t address) { uint32_t word; memcpy(&word, memory_at(address, 4), 4); return word; }
+static inline uint32_t load_byte(uint32_t address) { return *memory_at(address, 1); }
+static inline void store_word(uint32_t address, uint32_t word) { memcpy(memory_at(address, 4), &word, 4); }
+static inline void store_byte(uint32_t address, uint32_t word) { *memory_at(address, 1) = (uint8_t) word; }
+static inline void store_bytes(uint32_t address, const char* bytes, uint32_t count) { memcpy(memory_at(address, count), bytes, count); }
+
+static inline void move_memory(uint32_t source, uint32_t destination, uint32_t count)
+{
+    if (count == 0)
+        return;
+
+    uint8_t* from = memory_at(source, count);
+    memmove(memory_at(destination, count), from, count);
+}
+
+/* Invalid stack pointers are reported and ignored, as the machine does */
+static inline void set_stack_pointer(uint32_t address)
+{
+    if (address < STACK_START || address >= STACK_START + STACK_SIZE)
+    {
+        fprintf(stderr, "error: 0x%x is not a valid stack address\n", address);
+        return;
+    }
+    sp = address;
+}
+
+static inline uint32_t static_alloc(uint32_t size)
+{
+    if (size == 0)
+        return 0;
+
+    uint32_t position = next_static;
+    next_static += size;
+    return STATIC_START + position;
+}
+
+static inline uint32_t heap_alloc(uint32_t size)
+{
+    if (size == 0)
+        return 0;
+
+    uint32_t position = next_heap;
+    next_heap += size;
+    return HEAP_START + position;
+}
+
+static inline uint32_t find_register(uint32_t name)
+{
+    size_t i;
+    uint32_t k;
+    for (i = frame_count; i-- > 0;)
+    {
+        const Frame* frame = &frames[i];
+        for (k = name_slot_begin[name]; k < name_slot_begin[name + 1]; k++)
+        {
+            if (name_slots[k][0] != frame->function)
+                continue;
+
+            if (name_slots[k][1] < frame->window_size && valid[frame->window + name_slots[k][1]])
+                return registers[frame->window + name_slots[k][1]];
+            break;
+        }
+    }
+
+    fflush(stdout);
+    fprintf(stderr, "error: Trying to access invalid register: '%s'\n", register_names[name]);
+    exit(1);
+}
+
+/* Clear the register window of a frame */
+static inline void open_window(const Frame* frame)
+{
+    register_count = frame->window + frame->window_size;
+    if (register_count > register_capacity)
+    {
+        while (register_capacity < register_count)
+            register_capacity = register_capacity ? 2 * register_capacity : 65536;
+        registers = realloc(registers, register_capacity * sizeof(uint32_t));
+        valid = realloc(valid, register_capacity);
+        if (registers == NULL || valid == NULL)
+            fail("out of memory for registers");
+    }
+
+    memset(registers + frame->window, 0, frame->window_size * sizeof(uint32_t));
+    memset(valid + frame->window, 0, frame->window_size);
+    R = registers + frame->window;
+    V = valid + frame->window;
+}
+
+static inline void push_frame(uint32_t return_site, uint32_t function, int32_t return_slot)
+{
+    Frame* frame;
+    if (frame_count == frame_capacity)
+    {
+        frame_capacity = frame_capacity ? 2 * frame_capacity : 1024;
+        frames = realloc(frames, frame_capacity * sizeof(Frame));
+        if (frames == NULL)
+            fail("out of memory for frames");
+    }
+
+    frame = &frames[frame_count++];
+    frame->return_site = return_site;
+    frame->stack_pointer = sp;
+    frame->frame_pointer = fp;
+    frame->return_slot = return_slot;
+    frame->function = function;
+    frame->window = register_count;
+    frame->window_size = window_sizes[function];
+    open_window(frame);
+}
+
+/* Go back to the caller, returns the call instruction */
+static inline uint32_t pop_frame(int32_t* out_return_slot)
+{
+    const Frame* frame;
+    const Frame* top;
+    if (frame_count <= 1)
+        fail("Could not restore previous program state, there's no previous program state");
+
+    frame = &frames[--frame_count];
+    set_stack_pointer(frame->stack_pointer);
+    fp = frame->frame_pointer;
+    register_count = frame->window;
+
+    top = &frames[frame_count - 1];
+    R = registers + top->window;
+    V = valid + top->window;
+
+    if (out_return_slot != NULL)
+        *out_return_slot = frame->return_slot;
+    return frame->return_site;
+}
+
+/* Reuse the top frame for 'function', moving the arguments pushed for it to the start of the frame */
+static inline void tail_call(uint32_t function, uint32_t frame_size)
+{
+    Frame* frame = &frames[frame_count - 1];
+    if (frame_size > 0)
+        move_memory(sp, fp, frame_size);
+    set_stack_pointer(fp);
+
+    frame->function = function;
+    frame->window_size = window_sizes[function];
+    open_window(frame);
+}
+
+static inline void set_slot(int32_t slot, uint32_t word)
+{
+    if (slot == BASE_SLOT)
+        fp = word;
+    else if (slot == STACK_SLOT)
+        set_stack_pointer(word);
+    else
+        SET(slot, word);
+}
+
+static inline void enter_function(uint32_t function, uint32_t frame_size, const char* name)
+{
+    if (frame_count <= 1 || frames[frame_count - 1].function != function)
+    {
+        fflush(stdout);
+        fprintf(stderr, "error: Function '%s' reached without being called\n", name);
+        exit(1);
+    }
+
+    fp = sp;
+    set_stack_pointer(sp + frame_size);
+}
+
+static inline uint32_t divide(uint32_t l, uint32_t r)
+{
+    if (r == 0)
+        fail("Division by 0");
+    return (uint32_t) ((int32_t) l / (int32_t) r);
+}
+
+static inline uint32_t divide_float(uint32_t l, uint32_t r)
+{
+    if (r == 0)
+        fail("Division by 0");
+    return as_word(as_float(l) / as_float(r));
+}
+
+static inline uint32_t modulo(uint32_t l, uint32_t r) { return (uint32_t) ((int32_t) l % (int32_t) r); }
+
+static inline void print_float(uint32_t word) { printf("%g", (double) as_float(word)); }
+static inline void print_string(uint32_t address) { fputs((const char*) memory_at(address, 1), stdout); }
+
+/* Read a line from the standard input, without its end of line */
+static inline char* read_line(size_t* out_size)
+{
+    static char* line;
+    static size_t capacity;
+    size_t size = 0;
+    int c;
+    do
+    {
+        if (size + 1 >= capacity)
+        {
+            capacity = capacity ? 2 * capacity : 256;
+            line = realloc(line, capacity);
+            if (line == NULL)
+                fail("out of memory for input");
+        }
+        c = getchar();
+        if (c != EOF && c != '\n')
+            line[size++] = (char) c;
+    } while (c != EOF && c != '\n');
+
+    line[size] = '\0';
+    *out_size = size;
+    return line;
+}
+
+static inline void parse_error(const char* instruction, const char* input)
+{
+    fflush(stdout);
+    fprintf(stderr, "error: Could not parse argument in function %s. Received: %s\n", instruction, input);
+    exit(1);
+}
+
+static inline uint32_t read_int(void)
+{
+    size_t size;
+    char* line = read_line(&size);
+    char* end;
+    long value;
+    errno = 0;
+    value = strtol(line, &end, 10);
+    if (end == line)
+        parse_error("readi", line);
+    if (errno == ERANGE || value < INT_MIN || value > INT_MAX)
+        abort();
+    return (uint32_t) (int32_t) value;
+}
+
+static inline uint32_t read_float(void)
+{
+    size_t size;
+    char* line = read_line(&size);
+    char* end;
+    float value;
+    errno = 0;
+    value = strtof(line, &end);
+    if (end == line)
+        parse_error("readf", line);
+    if (errno == ERANGE)
+        abort();
+    return as_word(value);
+}
+
+static inline uint32_t read_char(void)
+{
+    size_t size;
+    char* line = read_line(&size);
+    if (size != 1)
+        parse_error("readc", line);
+    return (uint8_t) line[0];
+}
+
+static inline void read_string(uint32_t address)
+{
+    size_t size;
+    char* line = read_line(&size);
+    store_bytes(address, line, (uint32_t) size + 1);
+}
+)";
+
+    // Word constants are written in hex, so every bit pattern is kept
+    std::string word(uint32_t value)
+    {
+        char buffer[16];
+        std::snprintf(buffer, sizeof(buffer), "0x%08xu", value);
+        return buffer;
+    }
+
+    // C string literal with the given bytes, every byte that is not plain text is escaped
+    std::string c_string(const std::string& bytes)
+    {
+        std::string result = "\"";
+        for (unsigned char c : bytes)
+        {
+            if (c == '"' || c == '\\' || c == '?')
+            {
+                result += '\\';
+                result += c;
+            }
+            else if (c >= ' ' && c < 127)
+                result += c;
+            else
+            {
+                char buffer[8];
+                std::snprintf(buffer, sizeof(buffer), "\\%03o", c);
+                result += buffer;
+            }
+        }
+        result += '"';
+
+        return result;
+    }
+
+    // Tac source of an instruction, safe to put in a C comment
+    std::string comment(const Tac& tac)
+    {
+        auto source = TacWriter::str(tac);
+        for (size_t pos = source.find("*/"); pos != std::string::npos; pos = source.find("*/", pos))
+            source.replace(pos, 2, "* /");
+        for (auto& c : source)
+            if (c == '\n')
+                c = ' ';
+
+        return source;
+    }
+
+    /**
+     * @brief Translation of a single program
+     *
+     */
+    class Translation
+    {
+        public:
+            Translation(const Program& program, const std::vector<FunctionInfo>& functions, const std::vector<uint>& instruction_function)
+                : m_program(program)
+                , m_functions(functions)
+                , m_instruction_function(instruction_function)
+            { }
+
+            void write(std::ostream& out);
+
+        private:
+            std::string statement(size_t pc);
+            std::string assign(const Tac& tac, char type);
+            std::string bin_op(const Tac& tac);
+            std::string call(size_t pc);
+
+            // Register read by slot, special registers are machine state
+            std::string read_register(const std::string& name, int slot);
+
+            // Register write by slot
+            std::string set_register(int slot, const std::string& value);
+
+            // X == X, X[Y] == X + Y
+            std::string var_value(const Variable& var);
+
+            // X == X, X[Y] == *(X+Y)
+            std::string access_value(const Variable& var);
+
+            // Variables are accessed, constants are converted into words
+            std::string actual_value(const Value& val);
+
+            // Binary operation operand, X[Y] == X + Y
+            std::string operand_value(const Value& val, bool& out_is_float);
+
+            // Constants as assignw and assignb convert them
+            std::string word_immediate(const Value& val);
+            std::string byte_immediate(const Value& val);
+
+            std::string label(size_t pc);
+            uint name_id(const std::string& name);
+
+            const Program& m_program;
+            const std::vector<FunctionInfo>& m_functions;
+            const std::vector<uint>& m_instruction_function;
+
+            std::set<size_t> m_labels;          // instructions some jump goes to
+            std::vector<size_t> m_return_sites; // calls that might be returned to
+            std::map<std::string, uint> m_name_ids;
+            std::vector<std::string> m_names;   // registers that might be searched by name
+            bool m_has_returns = false;         // some instruction goes back to a call
+    };
+
+    void Translation::write(std::ostream& out)
+    {
+        // Statements first, so labels and names are known when writing tables
+        std::vector<std::string> statements;
+        for (size_t pc = 0; pc < m_program.size(); pc++)
+            statements.push_back(statement(pc));
+
+        out << "/* Translated by tac-runner, build it with: cc -O2 file.c */" << std::endl;
+        out << "#define STATIC_START " << MemoryManager::static_start() << "u" << std::endl;
+        out << "#define STATIC_SIZE " << STATIC_MEMORY_SIZE << "u" << std::endl;
+        out << "#define STACK_START " << MemoryManager::stack_start() << "u" << std::endl;
+        out << "#define STACK_SIZE " << STACK_MEMORY_SIZE << "u" << std::endl;
+        out << "#define HEAP_START " << MemoryManager::heap_start() << "u" << std::endl;
+        out << "#define HEAP_SIZE " << HEAP_MEMORY_SIZE << "u" << std::endl;
+        out << std::endl;
+
+        // Window size of every function, and slots of every name that might be searched for
+        out << "static const unsigned long window_sizes[] = {";
+        for (size_t f = 0; f < m_functions.size(); f++)
+            out << (f > 0 ? ", " : "") << m_functions[f].slot_names.size();
+        out << "};" << std::endl;
+
+        std::vector<std::pair<uint, uint>> name_slots;
+        std::vector<size_t> name_slot_begin;
+        for (auto const& name : m_names)
+        {
+            name_slot_begin.push_back(name_slots.size());
+            for (size_t f = 0; f < m_functions.size(); f++)
+            {
+                auto it = m_functions[f].slots.find(name);
+                if (it != m_functions[f].slots.end())
+                    name_slots.emplace_back(f, it->second);
+            }
+        }
+        name_slot_begin.push_back(name_slots.size());
+
+        out << "static const char* const register_names[] = {\"\"";
+        for (auto const& name : m_names)
+            out << ", " << c_string(name);
+        out << "};" << std::endl;
+
+        out << "static const unsigned int name_slot_begin[] = {0";
+        for (auto begin : name_slot_begin)
+            out << ", " << begin + 1;
+        out << "};" << std::endl;
+
+        out << "static const unsigned int name_slots[][2] = {{0, 0}";
+        for (auto const& [function, slot] : name_slots)
+            out << ", {" << function << ", " << slot << "}";
+        out << "};" << std::endl;
+
+        out << RUNTIME << std::endl;
+
+        out << "int main(void)" << std::endl;
+        out << "{" << std::endl;
+        out << "    uint32_t return_site = 0;" << std::endl;
+        out << "    uint32_t status = 0;" << std::endl;
+        out << "    int32_t return_slot = 0;" << std::endl;
+        out << "    (void) return_site;" << std::endl;
+        out << "    (void) return_slot;" << std::endl;
+        out << "    push_frame(0, 0, -1);" << std::endl;
+        out << std::endl;
+
+        for (size_t pc = 0; pc < m_program.size(); pc++)
+        {
+            if (m_labels.count(pc) > 0)
+                out << "L" << pc << ":" << std::endl;
+            out << "    /* " << comment(m_program[pc]) << " */" << std::endl;
+            out << "    " << statements[pc] << std::endl;
+        }
+
+        // Labels at the end of the program jump past its last instruction
+        if (m_labels.count(m_program.size()) > 0)
+            out << "L" << m_program.size() << ":" << std::endl;
+        out << "    goto finish;" << std::endl;
+        out << std::endl;
+
+        // Returns go back to the instruction after their call
+        if (m_has_returns)
+        {
+            out << "return_dispatch:" << std::endl;
+            out << "    switch (return_site)" << std::endl;
+            out << "    {" << std::endl;
+            for (auto site : m_return_sites)
+                out << "    case " << site << ": goto L" << site + 1 << ";" << std::endl;
+            out << "    default: fail(\"Invalid return address\");" << std::endl;
+            out << "    }" << std::endl;
+            out << std::endl;
+        }
+
+        out << "finish:" << std::endl;
+        out << "    fflush(stdout);" << std::endl;
+        out << "    return (int) status;" << std::endl;
+        out << "}" << std::endl;
+    }
+
+    std::string Translation::statement(size_t pc)
+    {
+        auto const& tac = m_program[pc];
+        auto const& args = tac.args();
+        auto const function = m_instruction_function[pc];
+        std::stringstream ss;
+
+        switch (tac.instr())
+        {
+        case Instr::METASTATICV:
+        case Instr::METASTRING:
+        {
+            auto const& name = args[0].get<std::string>();
+            auto const slot = name == BASE ? BASE_SLOT : name == STACK ? STACK_SLOT : (int) m_functions[function].slots.at(name);
+            if (tac.instr() == Instr::METASTATICV)
+            {
+                auto const size = args[1].get<int>();
+                if (size <= 0)
+                    return "fail(\"Could not allocate static memory for static variable '" + name + "'\");";
+
+                return set_register(slot, "static_alloc(" + std::to_string(size) + "u)");
+            }
+
+            // Strings are stored with their terminating null byte
+            auto const& string = args[1].get<std::string>();
+            auto const size = std::to_string(string.size() + 1) + "u";
+            ss << "{ uint32_t address = static_alloc(" << size << "); ";
+            ss << set_register(slot, "address") << " ";
+            ss << "store_bytes(address, " << c_string(string) << ", " << size << "); }";
+            return ss.str();
+        }
+        case Instr::METALABEL:
+            return ";";
+        case Instr::ASSIGNW:
+            return assign(tac, 'w');
+        case Instr::ASSIGNB:
+            return assign(tac, 'b');
+        case Instr::ADD:
+        case Instr::SUB:
+        case Instr::MULT:
+        case Instr::DIV:
+        case Instr::MOD:
+        case Instr::EQ:
+        case Instr::NEQ:
+        case Instr::AND:
+        case Instr::OR:
+        case Instr::LT:
+        case Instr::LEQ:
+        case Instr::GT:
+        case Instr::GEQ:
+            return bin_op(tac);
+        case Instr::MINUS:
+        case Instr::NEG:
+        {
+            auto const& var = args[0].get<Variable>();
+            auto const value = actual_value(args[1]);
+            if (tac.instr() == Instr::NEG)
+                return set_register(var.slot, "!" + value);
+            if (var.name[0] == 'f') // floats start with f
+                return set_register(var.slot, "as_word(-as_float(" + value + "))");
+            return set_register(var.slot, "(uint32_t) -(int32_t) " + value);
+        }
+        case Instr::GOTO:
+            return "goto " + label(tac.target()) + ";";
+        case Instr::GOIF:
+            return "if (" + actual_value(args[1]) + ") goto " + label(tac.target()) + ";";
+        case Instr::GOIFNOT:
+            return "if (!" + actual_value(args[1]) + ") goto " + label(tac.target()) + ";";
+        case Instr::MALLOC:
+            return set_register(args[0].get<Variable>().slot, "heap_alloc(" + actual_value(args[1]) + ")");
+        case Instr::MEMCPY:
+            ss << "{ uint32_t count = " << actual_value(args[2]) << "; ";
+            ss << "uint32_t destination = " << access_value(args[0].get<Variable>()) << "; ";
+            ss << "move_memory(" << access_value(args[1].get<Variable>()) << ", destination, count); }";
+            return ss.str();
+        case Instr::FREE:
+            // Heap memory is never reused, so freeing it does nothing
+            return "(void) " + access_value(args[0].get<Variable>()) + ";";
+        case Instr::EXIT:
+            return "status = " + word(args[0].get<int>()) + "; goto finish;";
+        case Instr::RETURN:
+            m_has_returns = true;
+            ss << "{ uint32_t value = " << actual_value(args[0]) << "; ";
+            ss << "return_site = pop_frame(&return_slot); set_slot(return_slot, value); goto return_dispatch; }";
+            return ss.str();
+        case Instr::PARAM:
+        {
+            // param x n == assignw x (STACK + n)
+            auto const& var = args[0].get<Variable>();
+            auto const value = "(" + actual_value(args[1]) + " + sp)";
+            if (var.is_access)
+                return "store_word(" + var_value(var) + ", " + value + ");";
+            return set_register(var.slot, value);
+        }
+        case Instr::CALL:
+            return call(pc);
+        case Instr::PRINTI:
+            return "printf(\"%d\", (int32_t) " + actual_value(args[0]) + ");";
+        case Instr::PRINTF:
+            return "print_float(" + actual_value(args[0]) + ");";
+        case Instr::PRINT:
+            return "print_string(" + actual_value(args[0]) + ");";
+        case Instr::PRINTC:
+            return "putchar((char) " + actual_value(args[0]) + ");";
+        case Instr::READI:
+            return set_register(args[0].get<Variable>().slot, "read_int()");
+        case Instr::READF:
+            return set_register(args[0].get<Variable>().slot, "read_float()");
+        case Instr::READC:
+            return set_register(args[0].get<Variable>().slot, "read_char()");
+        case Instr::READ:
+        {
+            auto const& var = args[0].get<Variable>();
+            return "read_string(" + read_register(var.name, var.slot) + ");";
+        }
+        case Instr::ITOF:
+            return set_register(args[0].get<Variable>().slot, "as_word((float) (int32_t) " + actual_value(args[1]) + ")");
+        case Instr::FTOI:
+            return set_register(args[0].get<Variable>().slot, "(uint32_t) (int32_t) as_float(" + actual_value(args[1]) + ")");
+        case Instr::METAFUNBEGIN:
+            ss << "enter_function(" << function << ", " << word(args[1].get<int>()) << ", ";
+            ss << c_string(args[0].get<std::string>()) << ");";
+            return ss.str();
+        case Instr::METAFUNEND:
+            m_has_returns = true;
+            return "return_site = pop_frame(NULL); goto return_dispatch;";
+        default:
+            break;
+        }
+
+        return "fail(\"Unsupported instruction\");";
+    }
+
+    std::string Translation::assign(const Tac& tac, char type)
+    {
+        auto const& args = tac.args();
+        auto const& lvalue = args[0].get<Variable>();
+        auto const& rvalue_arg = args[1];
+        auto const immediate = type == 'w' ? word_immediate(rvalue_arg) : byte_immediate(rvalue_arg);
+        auto const store = type == 'w' ? "store_word(" : "store_byte(";
+        auto const load = type == 'w' ? "load_word(" : "load_byte(";
+
+        if (!rvalue_arg.is<Variable>())
+        {
+            if (lvalue.is_access)
+                return store + var_value(lvalue) + ", " + immediate + ");";
+            return set_register(lvalue.slot, immediate);
+        }
+
+        auto const& rvalue = rvalue_arg.get<Variable>();
+        if (lvalue.is_access && rvalue.is_access)
+            return "fail(\"Four Address Code detected\");";
+        if (lvalue.is_access)
+        {
+            // The address is computed before the value
+            return "{ uint32_t address = " + var_value(lvalue) + "; " + store + "address, " + access_value(rvalue) + "); }";
+        }
+        if (rvalue.is_access)
+            return set_register(lvalue.slot, load + var_value(rvalue) + ")");
+
+        return set_register(lvalue.slot, access_value(rvalue));
+    }
+
+    std::string Translation::bin_op(const Tac& tac)
+    {
+        auto const& args = tac.args();
+        auto const& lvalue = args[0].get<Variable>();
+        bool l_is_float, r_is_float;
+        auto const l = operand_value(args[1], l_is_float);
+        auto const r = operand_value(args[2], r_is_float);
+
+        auto const instr = tac.instr();
+        bool const type_matters = instr != Instr::EQ && instr != Instr::NEQ && instr != Instr::AND && instr != Instr::OR;
+        if (type_matters && l_is_float != r_is_float)
+            return "fail(\"Can't operate values of different types\");";
+
+        auto float_op = [&l, &r](const std::string& op) { return "as_word(as_float(" + l + ") " + op + " as_float(" + r + "))"; };
+        auto float_cmp = [&l, &r](const std::string& op) { return "(uint32_t) (as_float(" + l + ") " + op + " as_float(" + r + "))"; };
+        auto int_cmp = [&l, &r](const std::string& op) { return "(uint32_t) ((int32_t) " + l + " " + op + " (int32_t) " + r + ")"; };
+
+        std::string value;
+        switch (instr)
+        {
+        case Instr::ADD:
+            value = l_is_float ? float_op("+") : "(uint32_t) (" + l + " + " + r + ")";
+            break;
+        case Instr::SUB:
+            value = l_is_float ? float_op("-") : "(uint32_t) (" + l + " - " + r + ")";
+            break;
+        case Instr::MULT:
+            value = l_is_float ? float_op("*") : "(uint32_t) (" + l + " * " + r + ")";
+            break;
+        case Instr::DIV:
+            value = (l_is_float ? "divide_float(" : "divide(") + l + ", " + r + ")";
+            break;
+        case Instr::MOD:
+            if (l_is_float)
+                return "fail(\"mod operation not defined for float\");";
+            value = "modulo(" + l + ", " + r + ")";
+            break;
+        case Instr::EQ:
+            value = "(uint32_t) (" + l + " == " + r + ")";
+            break;
+        case Instr::NEQ:
+            value = "(uint32_t) (" + l + " != " + r + ")";
+            break;
+        case Instr::AND:
+            value = "(uint32_t) (" + l + " && " + r + ")";
+            break;
+        case Instr::OR:
+            value = "(uint32_t) (" + l + " || " + r + ")";
+            break;
+        case Instr::LT:
+            value = l_is_float ? float_cmp("<") : int_cmp("<");
+            break;
+        case Instr::LEQ:
+            value = l_is_float ? float_cmp("<=") : int_cmp("<=");
+            break;
+        case Instr::GT:
+            value = l_is_float ? float_cmp(">") : int_cmp(">");
+            break;
+        case Instr::GEQ:
+            value = l_is_float ? float_cmp(">=") : int_cmp(">=");
+            break;
+        default:
+            return "fail(\"Unsupported operation\");";
+        }
+
+        return set_register(lvalue.slot, value);
+    }
+
+    std::string Translation::call(size_t pc)
+    {
+        auto const& tac = m_program[pc];
+        auto const& next_return = tac.args()[0].get<Variable>();
+        auto const function = m_instruction_function[tac.target()];
+        std::stringstream ss;
+
+        if (tac.is_tail_call())
+        {
+            auto const frame_size = m_program[tac.target()].args()[1].get<int>();
+            ss << "tail_call(" << function << ", " << word(frame_size > 0 ? frame_size : 0) << "); ";
+        }
+        else
+        {
+            m_return_sites.push_back(pc);
+            m_labels.insert(pc + 1);
+            ss << "push_frame(" << pc << ", " << function << ", " << next_return.slot << "); ";
+        }
+
+        ss << "goto " << label(tac.target()) << ";";
+        return ss.str();
+    }
+
+    std::string Translation::read_register(const std::string& name, int slot)
+    {
+        if (slot == BASE_SLOT)
+            return "fp";
+        if (slot == STACK_SLOT)
+            return "sp";
+
+        return "REG(" + std::to_string(slot) + ", " + std::to_string(name_id(name)) + ")";
+    }
+
+    std::string Translation::set_register(int slot, const std::string& value)
+    {
+        if (slot == BASE_SLOT)
+            return "fp = " + value + ";";
+        if (slot == STACK_SLOT)
+            return "set_stack_pointer(" + value + ");";
+
+        return "SET(" + std::to_string(slot) + ", " + value + ");";
+    }
+
+    std::string Translation::var_value(const Variable& var)
+    {
+        auto const reg = read_register(var.name, var.slot);
+        if (!var.is_access)
+            return reg;
+
+        if (std::holds_alternative<int>(var.index))
+            return "(uint32_t) (" + reg + " + " + word(std::get<int>(var.index)) + ")";
+
+        return "(uint32_t) (" + reg + " + " + read_register(std::get<std::string>(var.index), var.index_slot) + ")";
+    }
+
+    std::string Translation::access_value(const Variable& var)
+    {
+        if (var.is_access)
+            return "load_word(" + var_value(var) + ")";
+
+        return var_value(var);
+    }
+
+    std::string Translation::actual_value(const Value& val)
+    {
+        if (val.is<Variable>())
+            return access_value(val.get<Variable>());
+
+        return word_immediate(val);
+    }
+
+    std::string Translation::operand_value(const Value& val, bool& out_is_float)
+    {
+        out_is_float = false;
+        if (val.is<Variable>())
+        {
+            auto const& var = val.get<Variable>();
+            out_is_float = var.name[0] == 'f'; // floats start with f
+            return var_value(var);
+        }
+        else if (val.is<char>())
+            return word((unsigned char) val.get<char>());
+        else if (val.is<int>() || val.is<float>())
+        {
+            out_is_float = val.is<float>();
+            return word_immediate(val);
+        }
+
+        return word(0);
+    }
+
+    std::string Translation::word_immediate(const Value& val)
+    {
+        if (val.is<int>())
+            return word(val.get<int>());
+        if (val.is<char>())
+            return word((int) val.get<char>());
+        if (val.is<bool>())
+            return word(val.get<bool>());
+        if (val.is<float>())
+        {
+            auto const f = val.get<float>();
+            uint32_t bits;
+            std::memcpy(&bits, &f, sizeof(bits));
+            return word(bits);
+        }
+
+        return word(0);
+    }
+
+    std::string Translation::byte_immediate(const Value& val)
+    {
+        uint8_t byte = 0;
+        if (val.is<int>())
+            byte = (uint8_t) val.get<int>();
+        else if (val.is<char>())
+            byte = (uint8_t) val.get<char>();
+        else if (val.is<bool>())
+            byte = val.get<bool>();
+        else if (val.is<float>())
+        {
+            auto const f = val.get<float>();
+            std::memcpy(&byte, &f, sizeof(byte));
+        }
+
+        return word(byte);
+    }
+
+    std::string Translation::label(size_t pc)
+    {
+        m_labels.insert(pc);
+        return "L" + std::to_string(pc);
+    }
+
+    uint Translation::name_id(const std::string& name)
+    {
+        auto it = m_name_ids.find(name);
+        if (it != m_name_ids.end())
+            return it->second;
+
+        // Id 0 is left unused, so tables are never empty
+        m_names.push_back(name);
+        m_name_ids[name] = m_names.size();
+        return m_names.size();
+    }
+}
+
+uint CTranslator::write(const std::string& filename, const TacMachine& machine)
+{
+    std::ofstream out(filename);
+    if (!out.good())
+    {
+        std::stringstream ss;
+        ss << "Could not open file '" << filename << "' to write C code";
+        App::error(ss.str());
+        return FAIL;
+    }
+
+    write(out, machine);
+    return out.good() ? SUCCESS : FAIL;
+}
+
+void CTranslator::write(std::ostream& out, const TacMachine& machine)
+{
+    Translation translation(machine.m_program, machine.m_functions, machine.m_instruction_function);
+    translation.write(out);
+}
@@ -0,0 +1,49 @@
+/**
+ * @file CTranslator.hpp
+ * @brief Ahead of time translation of tac programs into standalone C programs
+ *
+ */
+#ifndef CTRANSLATOR_HPP
+#define CTRANSLATOR_HPP
+
+// Local includes
+#include "TacMachine.hpp"
+
+// C++ includes
+#include <string>
+#include <ostream>
+
+namespace TacRunner
+{
+    /**
+     * @brief Translates a program loaded in a machine into a single C file. The C program
+     *        reproduces the machine: memory regions are arrays with the same global addresses,
+     *        every frame gets a register window with the same slots, and registers not set in
+     *        a frame are searched in its callers by name. Every instruction becomes a C statement,
+     *        jumps become gotos and returns go back to their call through a switch, so the result
+     *        prints the same output as running the program in the machine
+     *
+     */
+    class CTranslator
+    {
+        public:
+            /**
+             * @brief Write the C translation of a program to a file
+             *
+             * @param filename file where to write the C program
+             * @param machine machine with the program loaded, not started yet
+             * @return uint success status, 0 on success, 1 on failure
+             */
+            static uint write(const std::string& filename, const TacMachine& machine);
+
+            /**
+             * @brief Write the C translation of a program to a stream
+             *
+             * @param out stream where to write the C program
+             * @param machine machine with the program loaded, not started yet
+             */
+            static void write(std::ostream& out, const TacMachine& machine);
+    };
+}
+
+#endif // CTRANSLATOR_HPP
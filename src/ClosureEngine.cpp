@@ -0,0 +1,305 @@
+#include "ClosureEngine.hpp"
+#include "Application.hpp"
+
+// C++ includes
+#include <cstring>
+#include <sstream>
+
+namespace TacRunner
+{
+    namespace
+    {
+        /**
+         * @brief Operand of a compiled instruction
+         *
+         */
+        struct Operand
+        {
+            bool ok = false;            // if a handler can read it from the running frame
+            bool is_float = false;      // if it holds a float, same rules as the interpreter
+            int slot = NO_SLOT;         // register slot, NO_SLOT for inmediates
+            REGISTER_TYPE value = 0;    // inmediate value
+        };
+
+        // Variables read without going to memory, whose register slot is known
+        bool is_plain_register(const Variable& var)
+        {
+            return !var.is_access && var.slot >= 0 && std::holds_alternative<int>(var.index);
+        }
+
+        Operand operand(const Value& val)
+        {
+            Operand out;
+            if (val.is<Variable>())
+            {
+                auto const& var = val.get<Variable>();
+                out.ok = is_plain_register(var);
+                out.is_float = !var.name.empty() && var.name[0] == 'f';
+                out.slot = var.slot;
+            }
+            else if (val.is<int>())
+            {
+                out.ok = true;
+                out.value = static_cast<REGISTER_TYPE>(val.get<int>());
+            }
+            else if (val.is<char>())
+            {
+                out.ok = true;
+                out.value = static_cast<REGISTER_TYPE>(static_cast<unsigned char>(val.get<char>()));
+            }
+            else if (val.is<float>())
+            {
+                auto const f = val.get<float>();
+                std::memcpy(&out.value, &f, sizeof(out.value));
+                out.ok = true;
+                out.is_float = true;
+            }
+
+            // Bools and strings are left to the interpreter, as they warn or fail when used
+            return out;
+        }
+
+        // Inmediates assigned to words without warnings
+        bool is_word_inmediate(const Value& val)
+        {
+            return val.is<int>() || val.is<float>();
+        }
+    }
+
+    void ClosureEngine::compile(const TacMachine& machine, std::vector<Closure>& out_closures)
+    {
+        auto const& program = machine.m_program;
+        out_closures.clear();
+        out_closures.reserve(program.size());
+        for (auto const& tac : program)
+            out_closures.push_back(compile(machine, tac));
+    }
+
+    Closure ClosureEngine::compile(const TacMachine& machine, const Tac& tac)
+    {
+        Closure closure;
+        closure.fn = interpret;
+        closure.tac = &tac;
+
+        auto const& args = tac.args();
+        switch (tac.instr())
+        {
+        case Instr::METALABEL:
+            closure.fn = nop;
+            break;
+        case Instr::GOTO:
+            closure.fn = jump;
+            closure.target = tac.target();
+            break;
+        case Instr::GOIF:
+        case Instr::GOIFNOT:
+        {
+            auto const& condition = args[1];
+            auto const op = operand(condition);
+            if (!op.ok || (!condition.is<Variable>() && !is_word_inmediate(condition)))
+                break;
+
+            closure.fn = tac.instr() == Instr::GOIF ? branch_if : branch_unless;
+            closure.target = tac.target();
+            closure.a_slot = op.slot;
+            closure.a = op.value;
+            break;
+        }
+        case Instr::ASSIGNW:
+        case Instr::ASSIGNB:
+        {
+            closure.type = tac.instr() == Instr::ASSIGNW ? 'w' : 'b';
+            closure.lvalue = &args[0].get<Variable>();
+            auto const& lvalue = *closure.lvalue;
+            auto const& rvalue_arg = args[1];
+            if (rvalue_arg.is<Variable>())
+            {
+                closure.rvalue = &rvalue_arg.get<Variable>();
+                auto const& rvalue = *closure.rvalue;
+
+                // Four address code is reported by the interpreter
+                if (lvalue.is_access && rvalue.is_access)
+                    break;
+                else if (lvalue.is_access)
+                    closure.fn = store;
+                else if (rvalue.is_access)
+                    closure.fn = load;
+                else if (is_plain_register(lvalue) && is_plain_register(rvalue))
+                {
+                    closure.fn = move;
+                    closure.dest = lvalue.slot;
+                    closure.a_slot = rvalue.slot;
+                }
+            }
+            else if (!rvalue_arg.is<std::string>())
+            {
+                closure.value = &rvalue_arg;
+                if (lvalue.is_access)
+                    closure.fn = store_inmediate;
+                else if (closure.type == 'w' && is_word_inmediate(rvalue_arg) && lvalue.slot >= 0)
+                {
+                    closure.fn = set_inmediate;
+                    closure.dest = lvalue.slot;
+                    closure.a = operand(rvalue_arg).value;
+                }
+            }
+            break;
+        }
+        case Instr::ADD: case Instr::SUB: case Instr::MULT: case Instr::DIV: case Instr::MOD:
+        case Instr::EQ: case Instr::NEQ: case Instr::AND: case Instr::OR:
+        case Instr::LT: case Instr::LEQ: case Instr::GT: case Instr::GEQ:
+        {
+            auto const& lvalue = args[0].get<Variable>();
+            auto const l = operand(args[1]);
+            auto const r = operand(args[2]);
+            if (lvalue.slot < 0 || !l.ok || !r.ok)
+                break;
+
+            // Operations whose operand types must match get an error from the interpreter
+            auto const untyped = tac.instr() == Instr::EQ || tac.instr() == Instr::NEQ ||
+                                 tac.instr() == Instr::AND || tac.instr() == Instr::OR;
+            if (!untyped && l.is_float != r.is_float)
+                break;
+
+            auto const is_float = l.is_float;
+            switch (tac.instr())
+            {
+            case Instr::ADD:  closure.fn = is_float ? binary<TacMachine::addf>  : binary<TacMachine::add>;  break;
+            case Instr::SUB:  closure.fn = is_float ? binary<TacMachine::subf>  : binary<TacMachine::sub>;  break;
+            case Instr::MULT: closure.fn = is_float ? binary<TacMachine::multf> : binary<TacMachine::mult>; break;
+            case Instr::DIV:  closure.fn = is_float ? binary<TacMachine::divf>  : binary<TacMachine::div>;  break;
+            case Instr::MOD:  closure.fn = is_float ? interpret                 : binary<TacMachine::mod>;  break;
+            case Instr::EQ:   closure.fn = binary<TacMachine::eq>;      break;
+            case Instr::NEQ:  closure.fn = binary<TacMachine::neq>;     break;
+            case Instr::AND:  closure.fn = binary<TacMachine::and_op>;  break;
+            case Instr::OR:   closure.fn = binary<TacMachine::or_op>;   break;
+            case Instr::LT:   closure.fn = is_float ? binary<TacMachine::ltf>   : binary<TacMachine::lt>;   break;
+            case Instr::LEQ:  closure.fn = is_float ? binary<TacMachine::leqf>  : binary<TacMachine::leq>;  break;
+            case Instr::GT:   closure.fn = is_float ? binary<TacMachine::gtf>   : binary<TacMachine::gt>;   break;
+            case Instr::GEQ:  closure.fn = is_float ? binary<TacMachine::geqf>  : binary<TacMachine::geq>;  break;
+            default: break;
+            }
+
+            closure.dest = lvalue.slot;
+            closure.a_slot = l.slot;
+            closure.a = l.value;
+            closure.b_slot = r.slot;
+            closure.b = r.value;
+            break;
+        }
+        default:
+            break;
+        }
+
+        return closure;
+    }
+
+    bool ClosureEngine::read(const TacMachine& machine, int slot, REGISTER_TYPE inmediate, REGISTER_TYPE& out_value)
+    {
+        if (slot == NO_SLOT)
+        {
+            out_value = inmediate;
+            return true;
+        }
+
+        // Registers not set in the running frame are searched by name in the interpreter
+        auto const& frame = machine.m_frames.back();
+        auto const reg = frame.window + slot;
+        if (static_cast<size_t>(slot) >= frame.window_size || !machine.m_register_valid[reg])
+            return false;
+
+        out_value = machine.m_register_file[reg];
+        return true;
+    }
+
+    uint ClosureEngine::interpret(const Closure& closure, TacMachine& machine)
+    {
+        return machine.run_tac_instruction(*closure.tac);
+    }
+
+    uint ClosureEngine::nop(const Closure&, TacMachine&)
+    {
+        return SUCCESS;
+    }
+
+    uint ClosureEngine::jump(const Closure& closure, TacMachine& machine)
+    {
+        machine.branch_to(closure.target);
+        return SUCCESS;
+    }
+
+    uint ClosureEngine::branch_if(const Closure& closure, TacMachine& machine)
+    {
+        REGISTER_TYPE value;
+        if (!read(machine, closure.a_slot, closure.a, value))
+            return interpret(closure, machine);
+
+        if (value)
+            machine.branch_to(closure.target);
+
+        return SUCCESS;
+    }
+
+    uint ClosureEngine::branch_unless(const Closure& closure, TacMachine& machine)
+    {
+        REGISTER_TYPE value;
+        if (!read(machine, closure.a_slot, closure.a, value))
+            return interpret(closure, machine);
+
+        if (!value)
+            machine.branch_to(closure.target);
+
+        return SUCCESS;
+    }
+
+    uint ClosureEngine::move(const Closure& closure, TacMachine& machine)
+    {
+        REGISTER_TYPE value;
+        if (!read(machine, closure.a_slot, closure.a, value))
+            return interpret(closure, machine);
+
+        machine.set_slot(closure.dest, value);
+        return SUCCESS;
+    }
+
+    uint ClosureEngine::set_inmediate(const Closure& closure, TacMachine& machine)
+    {
+        machine.set_slot(closure.dest, closure.a);
+        return SUCCESS;
+    }
+
+    uint ClosureEngine::load(const Closure& closure, TacMachine& machine)
+    {
+        return machine.load(*closure.lvalue, *closure.rvalue, closure.type);
+    }
+
+    uint ClosureEngine::store(const Closure& closure, TacMachine& machine)
+    {
+        return machine.store(*closure.lvalue, *closure.rvalue, closure.type);
+    }
+
+    uint ClosureEngine::store_inmediate(const Closure& closure, TacMachine& machine)
+    {
+        return machine.store_inmediate(*closure.lvalue, *closure.value, closure.type);
+    }
+
+    template<uint (*operation)(uint, uint, uint&)>
+    uint ClosureEngine::binary(const Closure& closure, TacMachine& machine)
+    {
+        REGISTER_TYPE l_val, r_val;
+        if (!read(machine, closure.a_slot, closure.a, l_val) || !read(machine, closure.b_slot, closure.b, r_val))
+            return interpret(closure, machine);
+
+        uint result;
+        if (operation(l_val, r_val, result) == FAIL)
+        {
+            std::stringstream ss;
+            ss << "Could not perform binary operation " << closure.tac->str();
+            App::error(ss.str());
+            return FAIL;
+        }
+
+        machine.set_slot(closure.dest, result);
+        return SUCCESS;
+    }
+}
@@ -0,0 +1,97 @@
+/**
+ * @file ClosureEngine.hpp
+ * @brief Execution engine running instructions as pre-bound handlers instead of dispatching them
+ *        through a switch every time they run
+ *
+ */
+#ifndef CLOSURE_ENGINE_HPP
+#define CLOSURE_ENGINE_HPP
+
+// Local includes
+#include "TacMachine.hpp"
+
+// C++ includes
+#include <vector>
+
+namespace TacRunner
+{
+    struct Closure;
+
+    /**
+     * @brief Function running a compiled instruction on a machine
+     *
+     * @return uint success status, 0 on success, 1 on failure
+     */
+    using ClosureHandler = uint (*)(const Closure&, TacMachine&);
+
+    /**
+     * @brief Instruction compiled at load time: the handler to run plus everything it needs,
+     *        resolved once so it's not looked up again every time the instruction runs
+     *
+     */
+    struct Closure
+    {
+        ClosureHandler fn;                  // handler running this instruction
+        const Tac* tac;                     // instruction, run by the interpreter when a handler can't
+        const Variable* lvalue = nullptr;   // variable written, for assignments
+        const Variable* rvalue = nullptr;   // variable read, for assignments between variables
+        const Value* value = nullptr;       // inmediate read, for assignments of inmediates
+        int dest = NO_SLOT;                 // register slot written
+        int a_slot = NO_SLOT;               // register slot of the first operand, NO_SLOT for inmediates
+        int b_slot = NO_SLOT;               // register slot of the second operand, NO_SLOT for inmediates
+        REGISTER_TYPE a = 0;                // first operand, for inmediates
+        REGISTER_TYPE b = 0;                // second operand, for inmediates
+        size_t target = 0;                  // instruction jumped to, for jumps
+        char type = 'w';                    // word or byte, for assignments
+    };
+
+    /**
+     * @brief Compiles every instruction of a program into a closure. Handlers check what they
+     *        assumed at compile time, like operands being registers set in the running frame,
+     *        and run the instruction in the interpreter when they can't handle it, so both engines
+     *        produce the same results and the same errors
+     *
+     */
+    class ClosureEngine
+    {
+        public:
+            /**
+             * @brief Compile every instruction in the program of a machine
+             *
+             * @param machine machine with the program loaded, its instructions should outlive the closures
+             * @param out_closures where to store a closure for each instruction, in program order
+             */
+            static void compile(const TacMachine& machine, std::vector<Closure>& out_closures);
+
+        private:
+            static Closure compile(const TacMachine& machine, const Tac& tac);
+
+            /**
+             * @brief Read an operand from the running frame
+             *
+             * @param machine machine to read from
+             * @param slot register slot, NO_SLOT for inmediates
+             * @param inmediate value of the operand if it's an inmediate
+             * @param out_value where to store the value
+             * @return true if it could be read without looking up callers
+             */
+            static bool read(const TacMachine& machine, int slot, REGISTER_TYPE inmediate, REGISTER_TYPE& out_value);
+
+            // Handlers, one per kind of instruction
+            static uint interpret(const Closure& closure, TacMachine& machine);
+            static uint nop(const Closure& closure, TacMachine& machine);
+            static uint jump(const Closure& closure, TacMachine& machine);
+            static uint branch_if(const Closure& closure, TacMachine& machine);
+            static uint branch_unless(const Closure& closure, TacMachine& machine);
+            static uint move(const Closure& closure, TacMachine& machine);
+            static uint set_inmediate(const Closure& closure, TacMachine& machine);
+            static uint load(const Closure& closure, TacMachine& machine);
+            static uint store(const Closure& closure, TacMachine& machine);
+            static uint store_inmediate(const Closure& closure, TacMachine& machine);
+
+            template<uint (*operation)(uint, uint, uint&)>
+            static uint binary(const Closure& closure, TacMachine& machine);
+    };
+}
+
+#endif // CLOSURE_ENGINE_HPP
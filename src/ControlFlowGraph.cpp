@@ -0,0 +1,422 @@
+// Local includes
+#include "ControlFlowGraph.hpp"
+#include "Application.hpp"
+
+// C++ includes
+#include <sstream>
+#include <unordered_map>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+
+using namespace TacRunner;
+
+namespace
+{
+    // Instructions after which execution does not continue with the next instruction
+    bool ends_block(Instr instr)
+    {
+        switch (instr)
+        {
+        case Instr::GOTO:
+        case Instr::GOIF:
+        case Instr::GOIFNOT:
+        case Instr::RETURN:
+        case Instr::EXIT:
+        case Instr::METAFUNEND:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Label name used by a jump instruction
+    const std::string& jump_label(const Tac& tac)
+    {
+        return tac.args()[0].get<std::string>();
+    }
+
+    // Escape a string to be used inside a dot label
+    std::string dot_escape(const std::string& str)
+    {
+        std::string result;
+        for (char c : str)
+        {
+            if (c == '"' || c == '\\' || c == '{' || c == '}' || c == '<' || c == '>' || c == '|')
+                result += '\\';
+
+            if (c == '\n')
+                result += "\\\\n";
+            else if (!std::isprint(static_cast<unsigned char>(c)))
+            {
+                // Non printable chars, like a '\0' char argument, are shown by their code
+                char code[8];
+                std::snprintf(code, sizeof(code), "\\\\x%02x", static_cast<unsigned char>(c));
+                result += code;
+            }
+            else
+                result += c;
+        }
+        return result;
+    }
+}
+
+uint ControlFlowGraph::build(const Program& program, std::vector<ControlFlowGraph>& out_graphs, bool resolved_targets)
+{
+    std::vector<ControlFlowGraph> graphs;
+    graphs.push_back(ControlFlowGraph("<GLOBAL SCOPE>"));
+
+    // Find function for every instruction, and labels
+    std::vector<size_t> function_of(program.size());
+    std::unordered_map<std::string, size_t> labels;
+    size_t current_function = 0;
+    for (size_t i = 0; i < program.size(); i++)
+    {
+        auto const& t = program[i];
+        if (t.instr() == Instr::METAFUNBEGIN)
+        {
+            graphs.push_back(ControlFlowGraph(t.args()[0].get<std::string>()));
+            current_function = graphs.size() - 1;
+        }
+        else if (t.instr() == Instr::METALABEL)
+            labels[t.args()[0].get<std::string>()] = i;
+
+        function_of[i] = current_function;
+
+        if (t.instr() == Instr::METAFUNEND)
+            current_function = 0;
+    }
+
+    // Labels are removed once jump targets are resolved, so targets start blocks instead
+    std::vector<bool> is_target(program.size(), false);
+    if (resolved_targets)
+        for (auto const& t : program)
+            if ((t.instr() == Instr::GOTO || t.instr() == Instr::GOIF || t.instr() == Instr::GOIFNOT) && t.target() < program.size())
+                is_target[t.target()] = true;
+
+    // Split in blocks: a block starts at labels, functions, and after jumps
+    std::vector<size_t> block_at(program.size(), NO_BLOCK);
+    for (size_t i = 0; i < program.size(); i++)
+    {
+        auto const instr = program[i].instr();
+        bool is_leader =    i == 0 ||
+                            function_of[i] != function_of[i-1] ||
+                            instr == Instr::METALABEL ||
+                            is_target[i] ||
+                            instr == Instr::METAFUNBEGIN ||
+                            ends_block(program[i-1].instr());
+
+        auto& graph = graphs[function_of[i]];
+        if (is_leader)
+            graph.m_blocks.push_back(BasicBlock{i, i, {}, {}, NO_BLOCK, NO_LOOP});
+
+        graph.m_blocks.back().end = i + 1;
+        block_at[i] = graph.m_blocks.size() - 1;
+    }
+
+    // Add edges
+    for (size_t f = 0; f < graphs.size(); f++)
+    {
+        auto& blocks = graphs[f].m_blocks;
+        for (size_t b = 0; b < blocks.size(); b++)
+        {
+            auto const last = blocks[b].end - 1;
+            auto const& t = program[last];
+            auto& successors = blocks[b].successors;
+
+            // Jump target
+            if (t.instr() == Instr::GOTO || t.instr() == Instr::GOIF || t.instr() == Instr::GOIFNOT)
+            {
+                // A label at the end of the program resolves to its size, jumping there ends the program
+                size_t target = program.size() + 1;
+                if (resolved_targets)
+                    target = t.target();
+                else
+                {
+                    auto it = labels.find(jump_label(t));
+                    if (it != labels.end())
+                        target = it->second;
+                }
+
+                if (target > program.size())
+                {
+                    std::stringstream ss;
+                    ss << "Can't build control flow graph, invalid jump target in instruction: " << t.str();
+                    App::error(ss.str());
+                    return FAIL;
+                }
+
+                // Jumps between functions are not supported by the machine, so they have no edge,
+                // and neither do jumps out of the program
+                if (target < program.size() && function_of[target] == f)
+                    successors.push_back(block_at[target]);
+            }
+
+            // Fall through to next instruction
+            bool falls_through = t.instr() != Instr::GOTO && t.instr() != Instr::RETURN &&
+                                 t.instr() != Instr::EXIT && t.instr() != Instr::METAFUNEND;
+            if (falls_through && last + 1 < program.size() && function_of[last + 1] == f)
+            {
+                auto const next = block_at[last + 1];
+                if (std::find(successors.begin(), successors.end(), next) == successors.end())
+                    successors.push_back(next);
+            }
+
+            for (auto s : successors)
+                blocks[s].predecessors.push_back(b);
+        }
+    }
+
+    for (auto& graph : graphs)
+    {
+        graph.compute_dominators();
+        graph.compute_loops();
+    }
+
+    out_graphs.swap(graphs);
+    return SUCCESS;
+}
+
+void ControlFlowGraph::compute_dominators()
+{
+    m_reverse_postorder.clear();
+    m_postorder_index.assign(m_blocks.size(), NO_BLOCK);
+    if (m_blocks.empty())
+        return;
+
+    // Iterative depth first search to find postorder
+    std::vector<bool> visited(m_blocks.size(), false);
+    std::vector<std::pair<size_t, size_t>> stack; // block, next successor to visit
+    stack.push_back({entry(), 0});
+    visited[entry()] = true;
+    while (!stack.empty())
+    {
+        auto& [block, next] = stack.back();
+        auto const& successors = m_blocks[block].successors;
+        if (next < successors.size())
+        {
+            auto const s = successors[next++];
+            if (!visited[s])
+            {
+                visited[s] = true;
+                stack.push_back({s, 0});
+            }
+            continue;
+        }
+
+        m_reverse_postorder.push_back(block);
+        stack.pop_back();
+    }
+
+    std::reverse(m_reverse_postorder.begin(), m_reverse_postorder.end());
+    for (size_t i = 0; i < m_reverse_postorder.size(); i++)
+        m_postorder_index[m_reverse_postorder[i]] = i;
+
+    // Cooper, Harvey & Kennedy iterative algorithm. The entry block dominates itself
+    // while computing, and it's set back to NO_BLOCK when done
+    for (auto& block : m_blocks)
+        block.immediate_dominator = NO_BLOCK;
+    m_blocks[entry()].immediate_dominator = entry();
+
+    auto intersect = [this](size_t a, size_t b) {
+        while (a != b)
+        {
+            while (m_postorder_index[a] > m_postorder_index[b])
+                a = m_blocks[a].immediate_dominator;
+            while (m_postorder_index[b] > m_postorder_index[a])
+                b = m_blocks[b].immediate_dominator;
+        }
+        return a;
+    };
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t i = 1; i < m_reverse_postorder.size(); i++)
+        {
+            auto const b = m_reverse_postorder[i];
+            size_t new_idom = NO_BLOCK;
+            for (auto p : m_blocks[b].predecessors)
+            {
+                if (m_blocks[p].immediate_dominator == NO_BLOCK)
+                    continue;
+                new_idom = new_idom == NO_BLOCK ? p : intersect(p, new_idom);
+            }
+
+            if (m_blocks[b].immediate_dominator != new_idom)
+            {
+                m_blocks[b].immediate_dominator = new_idom;
+                changed = true;
+            }
+        }
+    }
+
+    m_blocks[entry()].immediate_dominator = NO_BLOCK;
+
+    // Number the dominator tree, so dominance checks take constant time
+    std::vector<std::vector<size_t>> children(m_blocks.size());
+    for (auto b : m_reverse_postorder)
+        if (m_blocks[b].immediate_dominator != NO_BLOCK)
+            children[m_blocks[b].immediate_dominator].push_back(b);
+
+    m_dominator_tree_enter.assign(m_blocks.size(), 0);
+    m_dominator_tree_exit.assign(m_blocks.size(), 0);
+    size_t counter = 0;
+    stack.push_back({entry(), 0});
+    m_dominator_tree_enter[entry()] = counter++;
+    while (!stack.empty())
+    {
+        auto& [block, next] = stack.back();
+        if (next < children[block].size())
+        {
+            auto const child = children[block][next++];
+            m_dominator_tree_enter[child] = counter++;
+            stack.push_back({child, 0});
+            continue;
+        }
+
+        m_dominator_tree_exit[block] = counter++;
+        stack.pop_back();
+    }
+}
+
+void ControlFlowGraph::compute_loops()
+{
+    m_loops.clear();
+
+    // Find back edges: an edge to a block dominating its source. Group them by header
+    std::vector<size_t> headers;
+    std::vector<std::vector<size_t>> latches(m_blocks.size());
+    for (auto b : m_reverse_postorder)
+        for (auto s : m_blocks[b].successors)
+        {
+            if (!dominates(s, b))
+                continue;
+
+            if (latches[s].empty())
+                headers.push_back(s);
+            latches[s].push_back(b);
+        }
+
+    // Loop body: every block reaching a back edge source without going through the header
+    std::vector<size_t> mark(m_blocks.size(), NO_BLOCK);
+    for (auto header : headers)
+    {
+        Loop loop{header, {header}, NO_LOOP, 0};
+        mark[header] = header;
+
+        std::vector<size_t> stack;
+        for (auto latch : latches[header])
+            if (mark[latch] != header)
+            {
+                mark[latch] = header;
+                loop.blocks.push_back(latch);
+                stack.push_back(latch);
+            }
+
+        while (!stack.empty())
+        {
+            auto const x = stack.back();
+            stack.pop_back();
+            for (auto p : m_blocks[x].predecessors)
+                if (mark[p] != header && m_postorder_index[p] != NO_BLOCK)
+                {
+                    mark[p] = header;
+                    loop.blocks.push_back(p);
+                    stack.push_back(p);
+                }
+        }
+
+        m_loops.push_back(std::move(loop));
+    }
+
+    // Bigger loops contain smaller ones, so sort them by size and assign blocks from
+    // outer to inner loops. The last loop assigned to a block is its innermost loop
+    std::stable_sort(m_loops.begin(), m_loops.end(), [](const Loop& a, const Loop& b) { return a.blocks.size() > b.blocks.size(); });
+    for (size_t l = 0; l < m_loops.size(); l++)
+    {
+        auto& loop = m_loops[l];
+        std::sort(loop.blocks.begin(), loop.blocks.end());
+
+        loop.parent = m_blocks[loop.header].loop;
+        loop.depth = loop.parent == NO_LOOP ? 1 : m_loops[loop.parent].depth + 1;
+        for (auto b : loop.blocks)
+            m_blocks[b].loop = l;
+    }
+}
+
+bool ControlFlowGraph::dominates(size_t a, size_t b) const
+{
+    if (m_postorder_index[a] == NO_BLOCK || m_postorder_index[b] == NO_BLOCK)
+        return false;
+
+    // 'a' dominates 'b' when 'b' is inside the subtree of 'a' in the dominator tree
+    return m_dominator_tree_enter[a] <= m_dominator_tree_enter[b] && m_dominator_tree_exit[b] <= m_dominator_tree_exit[a];
+}
+
+size_t ControlFlowGraph::block_of(size_t instruction) const
+{
+    // Blocks are sorted by program position
+    auto it = std::upper_bound(m_blocks.begin(), m_blocks.end(), instruction,
+                    [](size_t i, const BasicBlock& block) { return i < block.begin; });
+
+    if (it == m_blocks.begin())
+        return NO_BLOCK;
+
+    --it;
+    if (instruction >= it->end)
+        return NO_BLOCK;
+
+    return it - m_blocks.begin();
+}
+
+std::string ControlFlowGraph::dot(const Program& program, size_t id) const
+{
+    std::stringstream ss;
+    ss << "\tsubgraph cluster_" << id << " {" << std::endl;
+    ss << "\t\tlabel=\"" << dot_escape(m_name) << "\";" << std::endl;
+
+    for (size_t b = 0; b < m_blocks.size(); b++)
+    {
+        auto const& block = m_blocks[b];
+        ss << "\t\tf" << id << "_b" << b << " [shape=record, label=\"{B" << b;
+        if (block.loop != NO_LOOP)
+            ss << " (loop depth " << m_loops[block.loop].depth << ")";
+        ss << "|";
+
+        for (size_t i = block.begin; i < block.end; i++)
+        {
+            auto const& t = program[i];
+            std::stringstream instr;
+            instr << instr_to_str(t.instr());
+            for (auto const& arg : t.args())
+                instr << " " << arg.str();
+            ss << dot_escape(instr.str()) << "\\l";
+        }
+        ss << "}\"];" << std::endl;
+
+        for (auto s : block.successors)
+        {
+            ss << "\t\tf" << id << "_b" << b << " -> f" << id << "_b" << s;
+            if (dominates(s, b))
+                ss << " [style=dashed]"; // back edge
+            ss << ";" << std::endl;
+        }
+    }
+
+    ss << "\t}" << std::endl;
+    return ss.str();
+}
+
+std::string ControlFlowGraph::dot(const Program& program, const std::vector<ControlFlowGraph>& graphs)
+{
+    std::stringstream ss;
+    ss << "digraph tac {" << std::endl;
+    ss << "\tnode [fontname=\"monospace\"];" << std::endl;
+    for (size_t i = 0; i < graphs.size(); i++)
+        ss << graphs[i].dot(program, i);
+    ss << "}" << std::endl;
+
+    return ss.str();
+}
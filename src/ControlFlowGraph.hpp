@@ -0,0 +1,200 @@
+/**
+ * @file ControlFlowGraph.hpp
+ * @brief Basic blocks, dominators and loops for tac programs
+ *
+ */
+#ifndef CONTROLFLOWGRAPH_HPP
+#define CONTROLFLOWGRAPH_HPP
+
+// Local includes
+#include "Tac.hpp"
+
+// C++ includes
+#include <string>
+#include <vector>
+
+// Block index used for missing blocks, like the dominator of the entry block
+#define NO_BLOCK ((size_t) -1)
+
+// Loop index used for blocks outside any loop, or outermost loops parent
+#define NO_LOOP -1
+
+namespace TacRunner
+{
+    /**
+     * @brief Sequence of instructions with a single entry point and a single exit point
+     *
+     */
+    struct BasicBlock
+    {
+        size_t begin;                       // first instruction of this block in the program
+        size_t end;                         // one past the last instruction of this block in the program
+        std::vector<size_t> successors;     // blocks that may run right after this one
+        std::vector<size_t> predecessors;   // blocks that may run right before this one
+        size_t immediate_dominator;         // NO_BLOCK for the entry block and unreachable blocks
+        int loop;                           // innermost loop containing this block, NO_LOOP if none
+
+        inline size_t size() const { return end - begin; }
+    };
+
+    /**
+     * @brief Natural loop, every back edge to the same header is merged into one loop
+     *
+     */
+    struct Loop
+    {
+        size_t header;              // block dominating every block in the loop
+        std::vector<size_t> blocks; // blocks in this loop, header included
+        int parent;                 // innermost loop containing this one, NO_LOOP for outermost loops
+        uint depth;                 // nesting depth, 1 for outermost loops
+    };
+
+    /**
+     * @brief Control flow graph for a single function. Instructions outside every
+     *        function belong to the global scope graph. Blocks are sorted by program position
+     *        and the first one is the entry block
+     *
+     */
+    class ControlFlowGraph
+    {
+        public:
+            /**
+             * @brief Build a control flow graph for every function in the program, the first
+             *        graph is the global scope
+             *
+             * @param program program to split in basic blocks
+             * @param out_graphs where to store the resulting graphs
+             * @param resolved_targets if jumps should use their already resolved target (as in the program
+             *                         stored by a tac machine) instead of looking up their labels
+             * @return uint success status, 0 on success, 1 on failure
+             */
+            static uint build(const Program& program, std::vector<ControlFlowGraph>& out_graphs, bool resolved_targets = false);
+
+            /**
+             * @brief Graphviz representation of a set of graphs, one cluster per function
+             *
+             * @param program program used to build the graphs
+             * @param graphs graphs to show
+             * @return std::string graph in dot format
+             */
+            static std::string dot(const Program& program, const std::vector<ControlFlowGraph>& graphs);
+
+            /**
+             * @brief Name of the function represented by this graph
+             *
+             * @return const std::string& function name
+             */
+            inline const std::string& name() const { return m_name; }
+
+            /**
+             * @brief Basic blocks in this graph, sorted by program position
+             *
+             * @return const std::vector<BasicBlock>& blocks
+             */
+            inline const std::vector<BasicBlock>& blocks() const { return m_blocks; }
+
+            /**
+             * @brief Loops in this graph, outer loops come before the loops nested in them
+             *
+             * @return const std::vector<Loop>& loops
+             */
+            inline const std::vector<Loop>& loops() const { return m_loops; }
+
+            /**
+             * @brief Reachable blocks in reverse postorder, starting from the entry block
+             *
+             * @return const std::vector<size_t>& block indices
+             */
+            inline const std::vector<size_t>& reverse_postorder() const { return m_reverse_postorder; }
+
+            /**
+             * @brief Entry block of this graph
+             *
+             * @return size_t index of the entry block
+             */
+            inline size_t entry() const { return 0; }
+
+            /**
+             * @brief Tells if block 'a' dominates block 'b': every path from the entry to 'b' goes through 'a'
+             *
+             * @param a dominator block
+             * @param b dominated block
+             * @return true if 'a' dominates 'b'
+             * @return false otherwise, or if 'b' is unreachable
+             */
+            bool dominates(size_t a, size_t b) const;
+
+            /**
+             * @brief Find the block containing a program position
+             *
+             * @param instruction position in the program
+             * @return size_t index of the block containing it, NO_BLOCK if it's not in this graph
+             */
+            size_t block_of(size_t instruction) const;
+
+            /**
+             * @brief Graphviz representation of this graph, as a cluster of a bigger graph
+             *
+             * @param program program used to build this graph
+             * @param id unique id for this graph among every graph in the same dot file
+             * @return std::string subgraph in dot format
+             */
+            std::string dot(const Program& program, size_t id) const;
+
+        private:
+            ControlFlowGraph(const std::string& name) : m_name(name) { }
+
+            /**
+             * @brief Compute reverse postorder and immediate dominators
+             *
+             */
+            void compute_dominators();
+
+            /**
+             * @brief Compute natural loops and their nesting, requires dominators
+             *
+             */
+            void compute_loops();
+
+        private:
+            /**
+             * @brief Function name
+             *
+             */
+            std::string m_name;
+
+            /**
+             * @brief Basic blocks, sorted by program position
+             *
+             */
+            std::vector<BasicBlock> m_blocks;
+
+            /**
+             * @brief Natural loops, outer loops first
+             *
+             */
+            std::vector<Loop> m_loops;
+
+            /**
+             * @brief Reachable blocks in reverse postorder
+             *
+             */
+            std::vector<size_t> m_reverse_postorder;
+
+            /**
+             * @brief Position of each block in the reverse postorder, NO_BLOCK for unreachable blocks
+             *
+             */
+            std::vector<size_t> m_postorder_index;
+
+            /**
+             * @brief Time when each block is entered and exited in a depth first search of the
+             *        dominator tree, used to check dominance
+             *
+             */
+            std::vector<size_t> m_dominator_tree_enter;
+            std::vector<size_t> m_dominator_tree_exit;
+    };
+}
+
+#endif // CONTROLFLOWGRAPH_HPP
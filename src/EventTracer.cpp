@@ -0,0 +1,100 @@
+#include "EventTracer.hpp"
+
+// C++ includes
+#include <iomanip>
+
+namespace TacRunner
+{
+    EventTracer::Scope::Scope(EventTracer* tracer, const Tac& tac, size_t pc)
+        : m_tracer(tracer)
+        , m_instr(tac.instr())
+        , m_pc(pc)
+    {
+        if (m_tracer != nullptr)
+            m_start = std::chrono::steady_clock::now();
+    }
+
+    EventTracer::Scope::~Scope()
+    {
+        if (m_tracer == nullptr)
+            return;
+
+        auto const end = std::chrono::steady_clock::now();
+        auto const timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(m_start - m_tracer->m_start).count();
+        auto const duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - m_start).count();
+        m_tracer->record(TraceEvent::COMPLETE, static_cast<uint32_t>(m_instr), m_pc, timestamp, duration);
+    }
+
+    EventTracer::EventTracer(const Program& program, const std::vector<FunctionInfo>& functions)
+        : m_program(program)
+        , m_functions(functions)
+    {
+        m_events.reserve(EVENT_BUFFER_SIZE);
+    }
+
+    uint EventTracer::open(const std::string& filename)
+    {
+        m_out.open(filename);
+        if (!m_out.good())
+            return FAIL;
+
+        m_out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        m_start = std::chrono::steady_clock::now();
+
+        // The global scope is running from the start
+        begin(GLOBAL_SCOPE, 0);
+        return SUCCESS;
+    }
+
+    uint EventTracer::close(const FrameStack& frames, size_t pc)
+    {
+        if (!m_out.is_open())
+            return FAIL;
+
+        for (size_t i = frames.size(); i --> 0;)
+            end(frames[i].function, pc);
+
+        flush();
+        m_out << std::endl << "]}" << std::endl;
+        m_out.close();
+
+        return m_out.good() ? SUCCESS : FAIL;
+    }
+
+    void EventTracer::record(TraceEvent::Phase phase, uint32_t name, size_t pc, int64_t timestamp, int64_t duration)
+    {
+        if (m_events.size() == EVENT_BUFFER_SIZE)
+            flush();
+
+        m_events.push_back(TraceEvent{phase, name, pc, timestamp, duration});
+    }
+
+    void EventTracer::flush()
+    {
+        m_out << std::fixed << std::setprecision(3);
+        for (auto const& event : m_events)
+        {
+            m_out << (m_written == 0 ? "" : ",") << std::endl;
+            m_out << "{\"name\":\"";
+            if (event.phase == TraceEvent::COMPLETE)
+                m_out << instr_to_str(static_cast<Instr>(event.name)) << "\",\"cat\":\"io\"";
+            else
+                m_out << m_functions[event.name].name << "\",\"cat\":\"call\"";
+
+            // Timestamps are in microseconds
+            m_out << ",\"ph\":\"" << static_cast<char>(event.phase) << "\"";
+            m_out << ",\"ts\":" << event.timestamp / 1000.0;
+            if (event.phase == TraceEvent::COMPLETE)
+                m_out << ",\"dur\":" << event.duration / 1000.0;
+
+            m_out << ",\"pid\":1,\"tid\":1,\"args\":{\"pc\":" << event.pc;
+            if (event.pc < m_program.size() && m_program[event.pc].line() != 0)
+                m_out << ",\"line\":" << m_program[event.pc].line();
+            m_out << "}}";
+
+            m_written++;
+        }
+
+        m_events.clear();
+    }
+}
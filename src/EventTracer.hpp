@@ -0,0 +1,136 @@
+/**
+ * @file EventTracer.hpp
+ * @brief Timeline of function calls and I/O of a running program, in Chrome's trace event format
+ *
+ */
+#ifndef EVENT_TRACER_HPP
+#define EVENT_TRACER_HPP
+
+// Local includes
+#include "TacMachine.hpp"
+
+// C++ includes
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define EVENT_BUFFER_SIZE 65536 // events kept in memory before writing them to the file
+
+namespace TacRunner
+{
+    /**
+     * @brief Something that happened while running, as stored in the event buffer
+     *
+     */
+    struct TraceEvent
+    {
+        enum Phase : char
+        {
+            BEGIN = 'B',    // a function was entered
+            END = 'E',      // a function was left
+            COMPLETE = 'X'  // an instruction ran, with its duration
+        };
+
+        Phase phase;
+        uint32_t name;      // function index for BEGIN and END, instruction for COMPLETE
+        size_t pc;          // instruction that caused the event
+        int64_t timestamp;  // nanoseconds since tracing started
+        int64_t duration;   // nanoseconds, for COMPLETE
+    };
+
+    /**
+     * @brief Records function entries and exits, and reads and prints, with their time. Events
+     *        go to a buffer allocated up front, and are only written to the file when it's full
+     *        or when tracing stops, so writing them doesn't get in the middle of the timeline
+     *        more than needed. The file can be opened in chrome://tracing or ui.perfetto.dev
+     *
+     */
+    class EventTracer
+    {
+        public:
+            /**
+             * @brief Times an instruction from its creation until it's destroyed, when tracing
+             *
+             */
+            class Scope
+            {
+                public:
+                    Scope(EventTracer* tracer, const Tac& tac, size_t pc);
+                    ~Scope();
+
+                private:
+                    EventTracer* m_tracer;  // tracer recording the instruction, null when not tracing
+                    Instr m_instr;
+                    size_t m_pc;
+                    std::chrono::steady_clock::time_point m_start;
+            };
+
+            /**
+             * @brief Create a tracer for a program
+             *
+             * @param program program being traced
+             * @param functions function table of the machine running it
+             */
+            EventTracer(const Program& program, const std::vector<FunctionInfo>& functions);
+
+            /**
+             * @brief Start writing events to a file
+             *
+             * @param filename file where to write events
+             * @return uint success status, 0 on success, 1 if the file could not be opened
+             */
+            uint open(const std::string& filename);
+
+            /**
+             * @brief Write pending events and finish the file. Functions still running are left
+             *
+             * @param frames frame stack of the machine, from the outermost frame
+             * @param pc instruction the machine stopped at
+             * @return uint success status, 0 on success, 1 if the file could not be written
+             */
+            uint close(const FrameStack& frames, size_t pc);
+
+            /**
+             * @brief Record that a function was entered
+             *
+             * @param function function entered
+             * @param pc instruction calling it
+             */
+            inline void begin(uint function, size_t pc) { record(TraceEvent::BEGIN, function, pc, now(), 0); }
+
+            /**
+             * @brief Record that a function was left
+             *
+             * @param function function left
+             * @param pc instruction leaving it
+             */
+            inline void end(uint function, size_t pc) { record(TraceEvent::END, function, pc, now(), 0); }
+
+            inline size_t events() const { return m_written + m_events.size(); }
+
+        private:
+            inline int64_t now() const
+            {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+            }
+
+            void record(TraceEvent::Phase phase, uint32_t name, size_t pc, int64_t timestamp, int64_t duration);
+
+            /**
+             * @brief Write buffered events to the file, and empty the buffer
+             *
+             */
+            void flush();
+
+            const Program& m_program;
+            const std::vector<FunctionInfo>& m_functions;
+            std::ofstream m_out;
+            std::vector<TraceEvent> m_events;               // events not written yet
+            size_t m_written = 0;                           // events already written
+            std::chrono::steady_clock::time_point m_start;  // when tracing started
+    };
+}
+
+#endif // EVENT_TRACER_HPP
@@ -0,0 +1,236 @@
+#include "HeapProfiler.hpp"
+
+// C++ includes
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace TacRunner
+{
+    namespace
+    {
+        uint bit_width(uint64_t value)
+        {
+            uint width = 0;
+            for (; value != 0; value >>= 1)
+                width++;
+            return width;
+        }
+
+        std::string site_str(size_t pc, const Program& program)
+        {
+            std::stringstream ss;
+            ss << "pc " << pc;
+            if (pc < program.size() && program[pc].line() != 0)
+                ss << ", line " << program[pc].line();
+            return ss.str();
+        }
+    }
+
+    HeapProfiler::HeapProfiler()
+    {
+        m_lifetimes.fill(0);
+        m_series.reserve(HEAP_SERIES_SIZE);
+    }
+
+    void HeapProfiler::allocated(uint address, uint64_t size, size_t pc, uint64_t steps)
+    {
+        auto& site = m_sites[pc];
+        if (address == 0)
+        {
+            site.failed++;
+            return;
+        }
+
+        site.allocations++;
+        site.bytes += size;
+        site.live_bytes += size;
+        site.peak_live_bytes = std::max(site.peak_live_bytes, site.live_bytes);
+
+        m_live[address] = LiveBlock{pc, size, steps};
+        m_live_bytes += size;
+        if (m_live_bytes > m_peak_live_bytes)
+        {
+            m_peak_live_bytes = m_live_bytes;
+            m_peak_steps = steps;
+        }
+
+        sample(steps);
+    }
+
+    void HeapProfiler::freed(uint address, uint64_t steps)
+    {
+        auto const block = m_live.find(address);
+        if (block == m_live.end())
+            return;
+
+        auto const& [pc, size, allocated_at] = block->second;
+        auto const lifetime = steps - allocated_at;
+        auto& site = m_sites[pc];
+        site.frees++;
+        site.live_bytes -= size;
+        site.lifetime += lifetime;
+        site.max_lifetime = std::max(site.max_lifetime, lifetime);
+
+        m_lifetimes[std::min<uint>(bit_width(lifetime), HEAP_LIFETIME_BUCKETS - 1)]++;
+        m_live_bytes -= size;
+        m_live.erase(block);
+
+        sample(steps);
+    }
+
+    void HeapProfiler::sample(uint64_t steps)
+    {
+        // The last sample still covers this step, update it
+        if (!m_series.empty() && steps - m_series.back().steps < m_interval)
+        {
+            auto& last = m_series.back();
+            last.live_bytes = m_live_bytes;
+            last.peak_bytes = std::max(last.peak_bytes, m_live_bytes);
+            last.live_blocks = m_live.size();
+            return;
+        }
+
+        // Series is full, merge neighbouring samples into samples twice as long
+        if (m_series.size() == HEAP_SERIES_SIZE)
+        {
+            for (size_t i = 0; i < HEAP_SERIES_SIZE / 2; i++)
+            {
+                auto const& first = m_series[2 * i];
+                auto const& second = m_series[2 * i + 1];
+                m_series[i] = HeapSample{first.steps, second.live_bytes, std::max(first.peak_bytes, second.peak_bytes), second.live_blocks};
+            }
+            m_series.resize(HEAP_SERIES_SIZE / 2);
+            m_interval *= 2;
+
+            if (steps - m_series.back().steps < m_interval)
+            {
+                sample(steps);
+                return;
+            }
+        }
+
+        m_series.push_back(HeapSample{steps, m_live_bytes, m_live_bytes, m_live.size()});
+    }
+
+    std::string HeapProfiler::str(
+        const Program& program,
+        const std::vector<FunctionInfo>& functions,
+        const std::vector<uint>& instruction_function,
+        uint64_t steps) const
+    {
+        uint64_t allocations = 0, failed = 0, bytes = 0, frees = 0;
+        std::vector<size_t> sites;
+        for (auto const& [pc, site] : m_sites)
+        {
+            allocations += site.allocations;
+            failed += site.failed;
+            bytes += site.bytes;
+            frees += site.frees;
+            sites.push_back(pc);
+        }
+
+        std::stringstream ss;
+        ss << "Heap profile: " << allocations << " allocations of " << bytes << " bytes, " << frees << " frees, "
+           << failed << " failed allocations in " << steps << " instructions" << std::endl;
+        ss << "\tPeak live memory: " << m_peak_live_bytes << " bytes at instruction " << m_peak_steps << std::endl;
+
+        // Sites allocating the most bytes first
+        std::sort(sites.begin(), sites.end(), [&](size_t a, size_t b) {
+            auto const& site_a = m_sites.at(a);
+            auto const& site_b = m_sites.at(b);
+            return site_a.bytes != site_b.bytes ? site_a.bytes > site_b.bytes : a < b;
+        });
+
+        ss << std::fixed << std::setprecision(1);
+        ss << "\t" << std::left << std::setw(20) << "site" << std::setw(24) << "function" << std::right
+           << std::setw(10) << "allocs"
+           << std::setw(12) << "bytes"
+           << std::setw(10) << "frees"
+           << std::setw(12) << "live bytes"
+           << std::setw(12) << "peak live"
+           << std::setw(12) << "mean life"
+           << std::setw(12) << "max life" << std::endl;
+        for (auto const pc : sites)
+        {
+            auto const& site = m_sites.at(pc);
+            ss << "\t" << std::left << std::setw(20) << site_str(pc, program)
+               << std::setw(24) << functions[instruction_function[pc]].name << std::right
+               << std::setw(10) << site.allocations
+               << std::setw(12) << site.bytes
+               << std::setw(10) << site.frees
+               << std::setw(12) << site.live_bytes
+               << std::setw(12) << site.peak_live_bytes;
+            if (site.frees > 0)
+                ss << std::setw(12) << static_cast<double>(site.lifetime) / site.frees << std::setw(12) << site.max_lifetime;
+            else
+                ss << std::setw(12) << "-" << std::setw(12) << "-";
+            ss << std::endl;
+        }
+
+        // Lifetimes of freed blocks, bucket i holds lifetimes in [2^(i-1), 2^i)
+        auto const most = *std::max_element(m_lifetimes.begin(), m_lifetimes.end());
+        if (most > 0)
+        {
+            ss << "\tLifetime of freed blocks, in instructions:" << std::endl;
+            size_t first = 0, last = HEAP_LIFETIME_BUCKETS - 1;
+            while (m_lifetimes[first] == 0)
+                first++;
+            while (m_lifetimes[last] == 0)
+                last--;
+
+            for (size_t i = first; i <= last; i++)
+            {
+                std::stringstream range;
+                if (i == 0)
+                    range << "0";
+                else
+                    range << "[" << (1ULL << (i - 1)) << ", " << (1ULL << i) << ")";
+
+                ss << "\t\t" << std::setw(24) << range.str() << std::setw(10) << m_lifetimes[i] << " "
+                   << std::string(static_cast<size_t>(40.0 * m_lifetimes[i] / most + 0.5), '#') << std::endl;
+            }
+        }
+
+        // Blocks never freed, the largest first
+        if (!m_live.empty())
+        {
+            std::vector<std::pair<uint, LiveBlock>> blocks(m_live.begin(), m_live.end());
+            std::sort(blocks.begin(), blocks.end(), [](auto const& a, auto const& b) {
+                return a.second.size != b.second.size ? a.second.size > b.second.size : a.first < b.first;
+            });
+
+            ss << "\tBlocks not freed: " << blocks.size() << " blocks, " << m_live_bytes << " bytes" << std::endl;
+            for (size_t i = 0; i < blocks.size() && i < HEAP_LEAKS_SHOWN; i++)
+            {
+                auto const& [address, block] = blocks[i];
+                ss << "\t\t0x" << std::hex << address << std::dec << ": " << block.size << " bytes allocated at "
+                   << site_str(block.pc, program) << " in " << functions[instruction_function[block.pc]].name
+                   << ", instruction " << block.allocated_at << std::endl;
+            }
+
+            if (blocks.size() > HEAP_LEAKS_SHOWN)
+                ss << "\t\t... " << blocks.size() - HEAP_LEAKS_SHOWN << " more" << std::endl;
+        }
+
+        return ss.str();
+    }
+
+    uint HeapProfiler::write_series(const std::string& filename, uint64_t steps) const
+    {
+        std::ofstream out(filename);
+        if (!out.good())
+            return FAIL;
+
+        out << "instructions,live_bytes,peak_bytes,live_blocks" << std::endl;
+        for (auto const& sample : m_series)
+            out << sample.steps << "," << sample.live_bytes << "," << sample.peak_bytes << "," << sample.live_blocks << std::endl;
+
+        // Live memory doesn't change after the last sample, close the series at the end of the run
+        if (m_series.empty() || m_series.back().steps < steps)
+            out << steps << "," << m_live_bytes << "," << m_live_bytes << "," << m_live.size() << std::endl;
+
+        return out.good() ? SUCCESS : FAIL;
+    }
+}
@@ -0,0 +1,139 @@
+/**
+ * @file HeapProfiler.hpp
+ * @brief Heap allocations of a running program, attributed to the instruction performing them
+ *
+ */
+#ifndef HEAP_PROFILER_HPP
+#define HEAP_PROFILER_HPP
+
+// Local includes
+#include "TacMachine.hpp"
+
+// C++ includes
+#include <array>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define HEAP_SERIES_SIZE 4096       // samples of live memory kept, neighbours are merged when full
+#define HEAP_LIFETIME_BUCKETS 64    // lifetimes are counted in buckets of powers of two instructions
+#define HEAP_LEAKS_SHOWN 20         // leaked blocks listed in the report, the largest first
+
+namespace TacRunner
+{
+    /**
+     * @brief What the allocations performed by a single malloc instruction did
+     *
+     */
+    struct AllocationSite
+    {
+        uint64_t allocations = 0;       // blocks allocated
+        uint64_t failed = 0;            // allocations the heap could not serve
+        uint64_t bytes = 0;             // bytes allocated
+        uint64_t frees = 0;             // blocks freed
+        uint64_t live_bytes = 0;        // bytes allocated and not freed yet
+        uint64_t peak_live_bytes = 0;   // most bytes alive at the same time
+        uint64_t lifetime = 0;          // instructions run between allocating and freeing, for freed blocks
+        uint64_t max_lifetime = 0;      // longest lifetime of a freed block
+    };
+
+    /**
+     * @brief A block allocated and not freed yet
+     *
+     */
+    struct LiveBlock
+    {
+        size_t pc;              // malloc instruction that allocated it
+        uint64_t size;          // bytes in the block
+        uint64_t allocated_at;  // instructions run when it was allocated
+    };
+
+    /**
+     * @brief Live memory over an interval of the run
+     *
+     */
+    struct HeapSample
+    {
+        uint64_t steps;         // instructions run when the interval started
+        uint64_t live_bytes;    // bytes alive at the end of the interval
+        uint64_t peak_bytes;    // most bytes alive during the interval
+        uint64_t live_blocks;   // blocks alive at the end of the interval
+    };
+
+    /**
+     * @brief Follows every malloc and free of a program, attributing blocks to the instruction
+     *        that allocated them. Live memory is sampled on every change, and samples are merged
+     *        two by two when the series fills up, so long runs keep a fixed amount of samples
+     *        spread over the whole run, without losing peaks
+     *
+     */
+    class HeapProfiler
+    {
+        public:
+            HeapProfiler();
+
+            /**
+             * @brief Count an allocation
+             *
+             * @param address virtual address of the block, 0 if it could not be allocated
+             * @param size bytes requested
+             * @param pc malloc instruction
+             * @param steps instructions run so far by the machine
+             */
+            void allocated(uint address, uint64_t size, size_t pc, uint64_t steps);
+
+            /**
+             * @brief Count a block being freed. Addresses that were never allocated are ignored,
+             *        the heap reports them
+             *
+             * @param address virtual address of the block
+             * @param steps instructions run so far by the machine
+             */
+            void freed(uint address, uint64_t steps);
+
+            /**
+             * @brief Report with totals, a table of allocation sites sorted by bytes, a histogram of
+             *        lifetimes and the blocks still alive, which leaked if the program finished
+             *
+             * @param program program being profiled, with the source line of each instruction
+             * @param functions function table of the machine
+             * @param instruction_function function each instruction belongs to
+             * @param steps instructions run so far by the machine
+             * @return std::string human readable report
+             */
+            std::string str(
+                const Program& program,
+                const std::vector<FunctionInfo>& functions,
+                const std::vector<uint>& instruction_function,
+                uint64_t steps) const;
+
+            /**
+             * @brief Write live memory over time as csv, one sample per line
+             *
+             * @param filename file where to write the samples
+             * @param steps instructions run so far by the machine, ends the last sample
+             * @return uint success status, 0 on success, 1 if the file could not be written
+             */
+            uint write_series(const std::string& filename, uint64_t steps) const;
+
+        private:
+            /**
+             * @brief Add the current live memory to the series
+             *
+             * @param steps instructions run so far by the machine
+             */
+            void sample(uint64_t steps);
+
+            std::unordered_map<size_t, AllocationSite> m_sites;     // allocation site of every malloc instruction that ran
+            std::unordered_map<uint, LiveBlock> m_live;             // blocks not freed yet, by address
+            std::array<uint64_t, HEAP_LIFETIME_BUCKETS> m_lifetimes;// freed blocks by the bit width of their lifetime
+            std::vector<HeapSample> m_series;                       // live memory over time
+            uint64_t m_interval = 1;                                // instructions covered by every sample at least
+            uint64_t m_live_bytes = 0;
+            uint64_t m_peak_live_bytes = 0;
+            uint64_t m_peak_steps = 0;                              // instructions run when the peak was reached
+    };
+}
+
+#endif // HEAP_PROFILER_HPP
@@ -0,0 +1,791 @@
+// Local includes
+#include "JitCompiler.hpp"
+#include "Application.hpp"
+
+// C++ includes
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <sstream>
+
+#if JIT_SUPPORTED
+#include <sys/mman.h>
+#endif
+
+using namespace TacRunner;
+
+namespace
+{
+    // Host registers, numbered as in their x86-64 encoding
+    enum HostRegister : uint8_t
+    {
+        RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+        R8, R9, R10, R11, R12, R13, R14, R15
+    };
+
+    // Host registers keeping machine state while native code runs
+    const HostRegister WINDOW = R12;    // register window
+    const HostRegister VALID = R13;     // valid flags of the register window
+    const HostRegister MEMORY = R14;    // stack memory
+    const HostRegister STATE = R15;     // JitState
+    const HostRegister STEPS = RBX;     // instructions run
+    const HostRegister FRAME = RBP;     // value of BASE
+
+    // Condition codes for conditional jumps and sets
+    enum Condition : uint8_t
+    {
+        EQUAL = 0x4,
+        NOT_EQUAL = 0x5,
+        ABOVE = 0x7,
+        LESS = 0xC,
+        GREATER_EQUAL = 0xD,
+        LESS_EQUAL = 0xE,
+        GREATER = 0xF
+    };
+
+    // Opcodes of two register operations, 'op dst, src'
+    enum Operation : uint8_t
+    {
+        ADD = 0x01,
+        OR = 0x09,
+        AND = 0x21,
+        SUB = 0x29,
+        XOR = 0x31,
+        CMP = 0x39,
+        TEST = 0x85,
+        MOV = 0x89
+    };
+
+    // Opcode extensions of operations with an immediate, 'op dst, imm'
+    enum ImmediateOperation : uint8_t
+    {
+        ADD_IMM = 0,
+        SUB_IMM = 5,
+        CMP_IMM = 7
+    };
+
+    /**
+     * @brief Encoder for the few x86-64 instructions used by the templates, with jumps to labels
+     *        resolved once all code is emitted. Operations are 32 bits wide unless stated otherwise
+     *
+     */
+    class Assembler
+    {
+        public:
+            using Label = size_t;
+
+            // Code size and pending jumps, to go back to when an instruction can't be compiled after all
+            struct Mark
+            {
+                size_t code;
+                size_t fixups;
+            };
+
+            inline size_t size() const { return m_code.size(); }
+            inline const std::vector<uint8_t>& code() const { return m_code; }
+
+            inline Mark mark() const { return Mark{m_code.size(), m_fixups.size()}; }
+            inline void rewind(const Mark& mark) { m_code.resize(mark.code); m_fixups.resize(mark.fixups); }
+
+            inline Label new_label() { m_labels.push_back(UNBOUND); return m_labels.size() - 1; }
+            inline void bind(Label label) { m_labels[label] = m_code.size(); }
+
+            // Resolve every jump, fails if some jump goes to a label that was never bound
+            uint link()
+            {
+                for (auto const& [position, label] : m_fixups)
+                {
+                    if (m_labels[label] == UNBOUND)
+                        return FAIL;
+
+                    int32_t const offset = (int64_t) m_labels[label] - (int64_t) (position + 4);
+                    memcpy(&m_code[position], &offset, sizeof(offset));
+                }
+
+                return SUCCESS;
+            }
+
+            // 64 bit operations
+            void push(HostRegister reg) { rex(false, 0, 0, reg); byte(0x50 + (reg & 7)); }
+            void pop(HostRegister reg) { rex(false, 0, 0, reg); byte(0x58 + (reg & 7)); }
+            void ret() { byte(0xC3); }
+            void jmp(HostRegister reg) { rex(false, 0, 0, reg); byte(0xFF); modrm(4, reg); }
+            void mov64(HostRegister dst, HostRegister src) { rex(true, src, 0, dst); byte(0x89); modrm(src, dst); }
+            void load64(HostRegister dst, HostRegister base, int32_t disp) { rex(true, dst, 0, base); byte(0x8B); modrm(dst, base, disp); }
+            void store64(HostRegister base, int32_t disp, HostRegister src) { rex(true, src, 0, base); byte(0x89); modrm(src, base, disp); }
+            void inc64(HostRegister reg) { rex(true, 0, 0, reg); byte(0xFF); modrm(0, reg); }
+            void inc64(HostRegister base, int32_t disp) { rex(true, 0, 0, base); byte(0xFF); modrm(0, base, disp); }
+
+            // Register operations
+            void mov(HostRegister dst, uint32_t imm) { rex(false, 0, 0, dst); byte(0xB8 + (dst & 7)); imm32(imm); }
+            void op(Operation operation, HostRegister dst, HostRegister src) { rex(false, src, 0, dst); byte(operation); modrm(src, dst); }
+            void op(ImmediateOperation operation, HostRegister dst, uint32_t imm) { rex(false, 0, 0, dst); byte(0x81); modrm(operation, dst); imm32(imm); }
+            void imul(HostRegister dst, HostRegister src) { rex(false, dst, 0, src); byte(0x0F); byte(0xAF); modrm(dst, src); }
+            void neg(HostRegister reg) { rex(false, 0, 0, reg); byte(0xF7); modrm(3, reg); }
+            void cdq() { byte(0x99); }
+            void idiv(HostRegister reg) { rex(false, 0, 0, reg); byte(0xF7); modrm(7, reg); }
+
+            // Set the low byte of RAX to RBX to a condition, and zero extend a low byte
+            void set(Condition condition, HostRegister reg) { assert(reg <= RBX); byte(0x0F); byte(0x90 + condition); modrm(0, reg); }
+            void movzx(HostRegister dst, HostRegister src) { assert(src <= RBX); rex(false, dst, 0, 0); byte(0x0F); byte(0xB6); modrm(dst, src); }
+
+            // Memory at [base + disp]
+            void load(HostRegister dst, HostRegister base, int32_t disp) { rex(false, dst, 0, base); byte(0x8B); modrm(dst, base, disp); }
+            void store(HostRegister base, int32_t disp, HostRegister src) { rex(false, src, 0, base); byte(0x89); modrm(src, base, disp); }
+            void store8(HostRegister base, int32_t disp, uint8_t imm) { rex(false, 0, 0, base); byte(0xC6); modrm(0, base, disp); byte(imm); }
+            void cmp8(HostRegister base, int32_t disp, uint8_t imm) { rex(false, 0, 0, base); byte(0x80); modrm(7, base, disp); byte(imm); }
+
+            // Memory at [base + index]
+            void load(HostRegister dst, HostRegister base, HostRegister index) { rex(false, dst, index, base); byte(0x8B); sib(dst, base, index); }
+            void load_byte(HostRegister dst, HostRegister base, HostRegister index) { rex(false, dst, index, base); byte(0x0F); byte(0xB6); sib(dst, base, index); }
+            void store(HostRegister base, HostRegister index, HostRegister src) { rex(false, src, index, base); byte(0x89); sib(src, base, index); }
+            void store_byte(HostRegister base, HostRegister index, HostRegister src) { assert(src <= RBX); rex(false, src, index, base); byte(0x88); sib(src, base, index); }
+
+            // Jumps to labels
+            void jmp(Label label) { byte(0xE9); fixup(label); }
+            void jump_if(Condition condition, Label label) { byte(0x0F); byte(0x80 + condition); fixup(label); }
+
+        private:
+            static constexpr size_t UNBOUND = (size_t) -1;
+
+            inline void byte(uint8_t b) { m_code.push_back(b); }
+
+            inline void imm32(uint32_t imm)
+            {
+                for (int i = 0; i < 4; i++)
+                    byte((imm >> (8 * i)) & 0xFF);
+            }
+
+            // REX prefix, only emitted when needed
+            inline void rex(bool wide, uint8_t reg, uint8_t index, uint8_t base)
+            {
+                uint8_t const prefix = 0x40 | (wide << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3);
+                if (prefix != 0x40)
+                    byte(prefix);
+            }
+
+            // Register operand
+            inline void modrm(uint8_t reg, uint8_t rm) { byte(0xC0 | ((reg & 7) << 3) | (rm & 7)); }
+
+            // Memory operand [base + disp32]
+            inline void modrm(uint8_t reg, uint8_t base, int32_t disp)
+            {
+                byte(0x80 | ((reg & 7) << 3) | (base & 7));
+                if ((base & 7) == RSP)
+                    byte(0x24);
+                imm32(disp);
+            }
+
+            // Memory operand [base + index]
+            inline void sib(uint8_t reg, uint8_t base, uint8_t index)
+            {
+                assert((base & 7) != RBP && index != RSP);
+                byte(0x04 | ((reg & 7) << 3));
+                byte(((index & 7) << 3) | (base & 7));
+            }
+
+            inline void fixup(Label label)
+            {
+                m_fixups.emplace_back(m_code.size(), label);
+                imm32(0);
+            }
+
+            std::vector<uint8_t> m_code;
+            std::vector<size_t> m_labels;
+            std::vector<std::pair<size_t, Label>> m_fixups;
+    };
+
+    using Label = Assembler::Label;
+
+    // Word value of a constant, as read by assignments, conditional jumps and unary operations.
+    // Fails for constants the interpreter warns about
+    bool word_immediate(const Value& val, uint32_t& out_imm)
+    {
+        if (val.is<int>())
+            out_imm = (uint32_t) val.get<int>();
+        else if (val.is<float>())
+        {
+            float const f = val.get<float>();
+            memcpy(&out_imm, &f, sizeof(out_imm));
+        }
+        else
+            return false;
+
+        return true;
+    }
+
+    // Byte value of a constant, as read by assignb. Fails for constants the interpreter warns about
+    bool byte_immediate(const Value& val, uint32_t& out_imm)
+    {
+        if (val.is<char>())
+            out_imm = (uint8_t) val.get<char>();
+        else if (val.is<bool>())
+            out_imm = val.get<bool>();
+        else
+            return false;
+
+        return true;
+    }
+
+    /**
+     * @brief Translates the instructions of a single function
+     *
+     */
+    class FunctionCompiler
+    {
+        public:
+            FunctionCompiler(const Program& program, size_t begin, size_t end, size_t window_size)
+                : m_program(program)
+                , m_begin(begin)
+                , m_end(end)
+                , m_window_size(window_size)
+            { }
+
+            /**
+             * @brief Generate code for the function
+             *
+             * @param out_entries offset of the code for each instruction, or NO_ENTRY
+             *                    when it can't run as native code
+             * @return uint success status, 0 on success, 1 on failure
+             */
+            uint compile(std::vector<size_t>& out_entries);
+
+            inline const std::vector<uint8_t>& code() const { return m_asm.code(); }
+
+            static constexpr size_t NO_ENTRY = (size_t) -1;
+
+        private:
+            bool compile_instruction(const Tac& tac, Label bail);
+            bool compile_assign(const Tac& tac, Label bail, uint width);
+            bool compile_bin_op(const Tac& tac, Label bail);
+            bool compile_unary_op(const Tac& tac, Label bail);
+            bool compile_jump(const Tac& tac, Label bail);
+
+            // Read a register of the frame, jumping to 'bail' when it was not set in the frame
+            bool read_slot(HostRegister dst, int slot, Label bail);
+
+            // Value of a variable without reading memory: X == X, X[Y] == X + Y
+            bool variable_value(HostRegister dst, HostRegister scratch, const Variable& var, Label bail);
+
+            // Value of a binary operation operand, and if it's a float
+            bool operand_value(HostRegister dst, const Value& val, bool& out_is_float, Label bail);
+
+            // Actual value of a value into RAX: X == X, X[Y] == *(X+Y)
+            bool actual_value(const Value& val, Label bail);
+
+            // Store RAX into a register of the frame
+            bool write_register(const Variable& var);
+
+            // Check that 'width' bytes at the address in RCX are in the stack, leave its offset in RDX
+            void check_stack(uint width, Label bail);
+
+            // Label running a jump target, or returning to the interpreter if it's out of this function
+            Label jump_target(size_t target);
+
+            // Return to the interpreter, which runs 'pc' next
+            void exit_to(size_t pc);
+
+            const Program& m_program;
+            size_t m_begin;
+            size_t m_end;
+            size_t m_window_size;
+
+            Assembler m_asm;
+            Label m_exit;
+            std::vector<Label> m_labels;                    // code for each instruction
+            std::vector<std::pair<Label, size_t>> m_exits;  // returns to the interpreter placed after the code
+    };
+
+    uint FunctionCompiler::compile(std::vector<size_t>& out_entries)
+    {
+        // Save host registers, load the state and jump to the entry, given in RSI
+        Label const start = m_asm.new_label();
+        m_asm.bind(start);
+        for (auto reg : {RBX, RBP, R12, R13, R14, R15})
+            m_asm.push(reg);
+        m_asm.mov64(STATE, RDI);
+        m_asm.load64(WINDOW, STATE, offsetof(JitState, registers));
+        m_asm.load64(VALID, STATE, offsetof(JitState, valid));
+        m_asm.load64(MEMORY, STATE, offsetof(JitState, stack_memory));
+        m_asm.load(FRAME, STATE, offsetof(JitState, frame_pointer));
+        m_asm.op(XOR, STEPS, STEPS);
+        m_asm.jmp(RSI);
+
+        // Return to the interpreter, the next instruction to run is in RAX
+        m_exit = m_asm.new_label();
+        m_asm.bind(m_exit);
+        m_asm.store64(STATE, offsetof(JitState, steps), STEPS);
+        for (auto reg : {R15, R14, R13, R12, RBP, RBX})
+            m_asm.pop(reg);
+        m_asm.ret();
+
+        m_labels.clear();
+        for (size_t pc = m_begin; pc < m_end; pc++)
+            m_labels.push_back(m_asm.new_label());
+
+        std::vector<size_t> entries(m_end - m_begin, NO_ENTRY);
+        for (size_t pc = m_begin; pc < m_end; pc++)
+        {
+            m_asm.bind(m_labels[pc - m_begin]);
+            auto const position = m_asm.size();
+            auto const mark = m_asm.mark();
+            Label const bail = m_asm.new_label();
+            if (compile_instruction(m_program[pc], bail))
+            {
+                entries[pc - m_begin] = position;
+                m_exits.emplace_back(bail, pc);
+            }
+            else
+            {
+                m_asm.rewind(mark);
+                exit_to(pc);
+            }
+        }
+
+        // Failed checks give the instruction back to the interpreter
+        for (auto const& [label, pc] : m_exits)
+        {
+            m_asm.bind(label);
+            exit_to(pc);
+        }
+
+        if (m_asm.link() == FAIL)
+            return FAIL;
+
+        out_entries.swap(entries);
+        return SUCCESS;
+    }
+
+    bool FunctionCompiler::compile_instruction(const Tac& tac, Label bail)
+    {
+        switch (tac.instr())
+        {
+        case Instr::METALABEL:
+            m_asm.inc64(STEPS);
+            return true;
+        case Instr::ASSIGNW:
+            return compile_assign(tac, bail, WORD_SIZE);
+        case Instr::ASSIGNB:
+            return compile_assign(tac, bail, 1);
+        case Instr::ADD:
+        case Instr::SUB:
+        case Instr::MULT:
+        case Instr::DIV:
+        case Instr::MOD:
+        case Instr::EQ:
+        case Instr::NEQ:
+        case Instr::AND:
+        case Instr::OR:
+        case Instr::LT:
+        case Instr::LEQ:
+        case Instr::GT:
+        case Instr::GEQ:
+            return compile_bin_op(tac, bail);
+        case Instr::MINUS:
+        case Instr::NEG:
+            return compile_unary_op(tac, bail);
+        case Instr::GOTO:
+        case Instr::GOIF:
+        case Instr::GOIFNOT:
+            return compile_jump(tac, bail);
+        default:
+            return false;
+        }
+    }
+
+    bool FunctionCompiler::compile_assign(const Tac& tac, Label bail, uint width)
+    {
+        auto const& args = tac.args();
+        auto const& lvalue = args[0].get<Variable>();
+        auto const& rvalue = args[1];
+        auto const immediate = width == WORD_SIZE ? word_immediate : byte_immediate;
+        uint32_t imm;
+
+        if (lvalue.is_access)
+        {
+            // x[j] = y, x[j] = c
+            if (rvalue.is<Variable>())
+            {
+                auto const& var = rvalue.get<Variable>();
+                if (var.is_access || !variable_value(RAX, RDX, var, bail))
+                    return false;
+            }
+            else if (immediate(rvalue, imm))
+                m_asm.mov(RAX, imm);
+            else
+                return false;
+
+            if (!variable_value(RCX, RDX, lvalue, bail))
+                return false;
+
+            check_stack(width, bail);
+            if (width == WORD_SIZE)
+                m_asm.store(MEMORY, RDX, RAX);
+            else
+                m_asm.store_byte(MEMORY, RDX, RAX);
+            m_asm.inc64(STATE, offsetof(JitState, stack_writes));
+        }
+        else
+        {
+            // x = y[j], x = y, x = c
+            if (rvalue.is<Variable>() && rvalue.get<Variable>().is_access)
+            {
+                if (!variable_value(RCX, RDX, rvalue.get<Variable>(), bail))
+                    return false;
+
+                check_stack(width, bail);
+                if (width == WORD_SIZE)
+                    m_asm.load(RAX, MEMORY, RDX);
+                else
+                    m_asm.load_byte(RAX, MEMORY, RDX);
+                m_asm.inc64(STATE, offsetof(JitState, stack_reads));
+            }
+            else if (rvalue.is<Variable>())
+            {
+                if (!variable_value(RAX, RDX, rvalue.get<Variable>(), bail))
+                    return false;
+            }
+            else if (immediate(rvalue, imm))
+                m_asm.mov(RAX, imm);
+            else
+                return false;
+
+            if (!write_register(lvalue))
+                return false;
+        }
+
+        m_asm.inc64(STEPS);
+        return true;
+    }
+
+    bool FunctionCompiler::compile_bin_op(const Tac& tac, Label bail)
+    {
+        auto const& args = tac.args();
+        bool l_is_float, r_is_float;
+        if (!operand_value(RAX, args[1], l_is_float, bail) || !operand_value(RCX, args[2], r_is_float, bail))
+            return false;
+
+        // Float arithmetic and comparisons are left to the interpreter
+        auto const instr = tac.instr();
+        bool const raw_bits = instr == Instr::EQ || instr == Instr::NEQ || instr == Instr::AND || instr == Instr::OR;
+        if (!raw_bits && (l_is_float || r_is_float))
+            return false;
+
+        auto compare = [this](Condition condition) {
+            m_asm.op(CMP, RAX, RCX);
+            m_asm.set(condition, RAX);
+            m_asm.movzx(RAX, RAX);
+        };
+
+        switch (instr)
+        {
+        case Instr::ADD:
+            m_asm.op(ADD, RAX, RCX);
+            break;
+        case Instr::SUB:
+            m_asm.op(SUB, RAX, RCX);
+            break;
+        case Instr::MULT:
+            m_asm.imul(RAX, RCX);
+            break;
+        case Instr::DIV:
+        case Instr::MOD:
+        {
+            // Division by 0 is an error, and INT_MIN / -1 traps, the interpreter handles both
+            Label const divide = m_asm.new_label();
+            m_asm.op(TEST, RCX, RCX);
+            m_asm.jump_if(EQUAL, bail);
+            m_asm.op(CMP_IMM, RCX, (uint32_t) -1);
+            m_asm.jump_if(NOT_EQUAL, divide);
+            m_asm.op(CMP_IMM, RAX, 0x80000000u);
+            m_asm.jump_if(EQUAL, bail);
+            m_asm.bind(divide);
+            m_asm.cdq();
+            m_asm.idiv(RCX);
+            if (instr == Instr::MOD)
+                m_asm.op(MOV, RAX, RDX);
+            break;
+        }
+        case Instr::EQ:
+            compare(EQUAL);
+            break;
+        case Instr::NEQ:
+            compare(NOT_EQUAL);
+            break;
+        case Instr::LT:
+            compare(LESS);
+            break;
+        case Instr::LEQ:
+            compare(LESS_EQUAL);
+            break;
+        case Instr::GT:
+            compare(GREATER);
+            break;
+        case Instr::GEQ:
+            compare(GREATER_EQUAL);
+            break;
+        case Instr::AND:
+        case Instr::OR:
+            m_asm.op(TEST, RAX, RAX);
+            m_asm.set(NOT_EQUAL, RAX);
+            m_asm.op(TEST, RCX, RCX);
+            m_asm.set(NOT_EQUAL, RCX);
+            m_asm.op(instr == Instr::AND ? AND : OR, RAX, RCX);
+            m_asm.movzx(RAX, RAX);
+            break;
+        default:
+            return false;
+        }
+
+        if (!write_register(args[0].get<Variable>()))
+            return false;
+
+        m_asm.inc64(STEPS);
+        return true;
+    }
+
+    bool FunctionCompiler::compile_unary_op(const Tac& tac, Label bail)
+    {
+        auto const& args = tac.args();
+        auto const& lvalue = args[0].get<Variable>();
+        if (!actual_value(args[1], bail))
+            return false;
+
+        if (tac.instr() == Instr::NEG)
+        {
+            m_asm.op(TEST, RAX, RAX);
+            m_asm.set(EQUAL, RAX);
+            m_asm.movzx(RAX, RAX);
+        }
+        else if (lvalue.name[0] == 'f') // floats start with f, flip their sign bit
+        {
+            m_asm.mov(RCX, 0x80000000u);
+            m_asm.op(XOR, RAX, RCX);
+        }
+        else
+            m_asm.neg(RAX);
+
+        if (!write_register(lvalue))
+            return false;
+
+        m_asm.inc64(STEPS);
+        return true;
+    }
+
+    bool FunctionCompiler::compile_jump(const Tac& tac, Label bail)
+    {
+        if (tac.instr() == Instr::GOTO)
+        {
+            m_asm.inc64(STEPS);
+            m_asm.jmp(jump_target(tac.target()));
+            return true;
+        }
+
+        if (!actual_value(tac.args()[1], bail))
+            return false;
+
+        m_asm.inc64(STEPS);
+        m_asm.op(TEST, RAX, RAX);
+        m_asm.jump_if(tac.instr() == Instr::GOIF ? NOT_EQUAL : EQUAL, jump_target(tac.target()));
+        return true;
+    }
+
+    bool FunctionCompiler::read_slot(HostRegister dst, int slot, Label bail)
+    {
+        if (slot == BASE_SLOT)
+        {
+            m_asm.op(MOV, dst, FRAME);
+            return true;
+        }
+
+        // STACK and registers without a slot in this window are left to the interpreter
+        if (slot < 0 || (size_t) slot >= m_window_size)
+            return false;
+
+        m_asm.cmp8(VALID, slot, 0);
+        m_asm.jump_if(EQUAL, bail);
+        m_asm.load(dst, WINDOW, slot * WORD_SIZE);
+        return true;
+    }
+
+    bool FunctionCompiler::variable_value(HostRegister dst, HostRegister scratch, const Variable& var, Label bail)
+    {
+        if (!read_slot(dst, var.slot, bail))
+            return false;
+
+        if (!var.is_access)
+            return true;
+
+        if (std::holds_alternative<int>(var.index))
+        {
+            auto const index = std::get<int>(var.index);
+            if (index != 0)
+                m_asm.op(ADD_IMM, dst, (uint32_t) index);
+            return true;
+        }
+
+        if (!read_slot(scratch, var.index_slot, bail))
+            return false;
+
+        m_asm.op(ADD, dst, scratch);
+        return true;
+    }
+
+    bool FunctionCompiler::operand_value(HostRegister dst, const Value& val, bool& out_is_float, Label bail)
+    {
+        if (val.is<Variable>())
+        {
+            auto const& var = val.get<Variable>();
+            out_is_float = var.name[0] == 'f'; // floats start with f
+            return variable_value(dst, RDX, var, bail);
+        }
+
+        uint32_t imm;
+        if (val.is<int>())
+            imm = (uint32_t) val.get<int>();
+        else if (val.is<char>())
+            imm = (uint8_t) val.get<char>();
+        else if (!word_immediate(val, imm))
+            return false;
+
+        out_is_float = val.is<float>();
+        m_asm.mov(dst, imm);
+        return true;
+    }
+
+    bool FunctionCompiler::actual_value(const Value& val, Label bail)
+    {
+        uint32_t imm;
+        if (!val.is<Variable>())
+        {
+            if (!word_immediate(val, imm))
+                return false;
+
+            m_asm.mov(RAX, imm);
+            return true;
+        }
+
+        auto const& var = val.get<Variable>();
+        if (!var.is_access)
+            return variable_value(RAX, RDX, var, bail);
+
+        if (!variable_value(RCX, RDX, var, bail))
+            return false;
+
+        check_stack(WORD_SIZE, bail);
+        m_asm.load(RAX, MEMORY, RDX);
+        m_asm.inc64(STATE, offsetof(JitState, stack_reads));
+        return true;
+    }
+
+    bool FunctionCompiler::write_register(const Variable& var)
+    {
+        if (var.is_access || var.slot < 0 || (size_t) var.slot >= m_window_size)
+            return false;
+
+        m_asm.store(WINDOW, var.slot * WORD_SIZE, RAX);
+        m_asm.store8(VALID, var.slot, 1);
+        return true;
+    }
+
+    void FunctionCompiler::check_stack(uint width, Label bail)
+    {
+        m_asm.op(MOV, RDX, RCX);
+        m_asm.op(SUB_IMM, RDX, MemoryManager::stack_start());
+        m_asm.op(CMP_IMM, RDX, STACK_MEMORY_SIZE - width);
+        m_asm.jump_if(ABOVE, bail);
+    }
+
+    Label FunctionCompiler::jump_target(size_t target)
+    {
+        if (target >= m_begin && target < m_end)
+            return m_labels[target - m_begin];
+
+        Label const label = m_asm.new_label();
+        m_exits.emplace_back(label, target);
+        return label;
+    }
+
+    void FunctionCompiler::exit_to(size_t pc)
+    {
+        m_asm.mov(RAX, pc);
+        m_asm.jmp(m_exit);
+    }
+}
+
+JitCompiler::JitCompiler(const Program& program, const std::vector<uint>& instruction_function)
+    : m_program(program)
+    , m_instruction_function(instruction_function)
+    , m_entries(program.size(), nullptr)
+{
+    uint functions = 0;
+    for (auto function : instruction_function)
+        functions = std::max(functions, function + 1);
+
+    m_function_code.resize(functions, nullptr);
+}
+
+JitCompiler::~JitCompiler()
+{
+#if JIT_SUPPORTED
+    for (auto const& buffer : m_buffers)
+        munmap(buffer.memory, buffer.size);
+#endif
+}
+
+uint JitCompiler::compile(uint function, size_t window_size)
+{
+#if JIT_SUPPORTED
+    assert(function != GLOBAL_SCOPE && function < m_function_code.size() && "Invalid function to compile");
+    if (m_function_code[function] != nullptr)
+        return SUCCESS;
+
+    // Functions take a contiguous range of instructions
+    size_t begin = 0;
+    while (begin < m_program.size() && m_instruction_function[begin] != function)
+        begin++;
+    size_t end = begin;
+    while (end < m_program.size() && m_instruction_function[end] == function)
+        end++;
+
+    FunctionCompiler compiler(m_program, begin, end, window_size);
+    std::vector<size_t> entries;
+    if (compiler.compile(entries) == FAIL)
+        return FAIL;
+
+    // Write the code into writable memory, then make it executable
+    auto const& code = compiler.code();
+    void* memory = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+    {
+        App::warning("Could not allocate memory for native code");
+        return FAIL;
+    }
+
+    memcpy(memory, code.data(), code.size());
+    if (mprotect(memory, code.size(), PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(memory, code.size());
+        App::warning("Could not make native code executable");
+        return FAIL;
+    }
+
+    m_buffers.push_back(CodeBuffer{memory, code.size()});
+    m_function_code[function] = memory;
+    for (size_t pc = begin; pc < end; pc++)
+        if (entries[pc - begin] != FunctionCompiler::NO_ENTRY)
+            m_entries[pc] = static_cast<const uint8_t*>(memory) + entries[pc - begin];
+
+    return SUCCESS;
+#else
+    return FAIL;
+#endif
+}
+
+size_t JitCompiler::run(JitState& state, size_t pc) const
+{
+    assert(has_entry(pc) && "No native code for this instruction");
+    using NativeCode = uint64_t (*)(JitState*, const void*);
+    auto const code = reinterpret_cast<NativeCode>(const_cast<void*>(m_function_code[m_instruction_function[pc]]));
+    return code(&state, m_entries[pc]);
+}
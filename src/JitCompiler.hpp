@@ -0,0 +1,135 @@
+/**
+ * @file JitCompiler.hpp
+ * @brief Baseline compiler from hot tac functions into x86-64 machine code
+ *
+ */
+#ifndef JITCOMPILER_HPP
+#define JITCOMPILER_HPP
+
+// Local includes
+#include "TacMachine.hpp"
+
+// C++ includes
+#include <cstdint>
+#include <vector>
+
+// Native code can only be generated when running on x86-64 Linux, other hosts always interpret
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_SUPPORTED 1
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+// Calls to a function plus backward jumps inside it before it's compiled
+#define JIT_THRESHOLD 1000
+
+namespace TacRunner
+{
+    /**
+     * @brief Machine state shared with native code while it runs. Native code reads the
+     *        state of the running frame on entry, and writes back what it did on exit
+     *
+     */
+    struct JitState
+    {
+        REGISTER_TYPE* registers;       // register window of the running frame
+        uint8_t* valid;                 // valid flags of the register window
+        std::byte* stack_memory;        // first byte of the stack memory
+        REGISTER_TYPE frame_pointer;    // value of BASE
+        uint64_t steps = 0;             // instructions run by native code
+        uint64_t stack_reads = 0;       // stack memory reads performed by native code
+        uint64_t stack_writes = 0;      // stack memory writes performed by native code
+    };
+
+    /**
+     * @brief Template based compiler from tac functions into x86-64 code. Every instruction is
+     *        translated on its own into a fixed sequence of host instructions: registers of the
+     *        running frame stay in its register window, and stack memory is accessed directly.
+     *        Instructions that can't be translated, and those whose operands fail a runtime check
+     *        (registers not set in the frame, memory out of the stack, division by 0...),
+     *        return to the interpreter, which runs them and continues
+     *
+     */
+    class JitCompiler
+    {
+        public:
+            /**
+             * @brief Create a compiler for the functions of a program
+             *
+             * @param program program whose functions will be compiled, jump targets should be resolved
+             * @param instruction_function index of the function each instruction belongs to
+             */
+            JitCompiler(const Program& program, const std::vector<uint>& instruction_function);
+            ~JitCompiler();
+
+            JitCompiler(const JitCompiler&) = delete;
+            JitCompiler& operator=(const JitCompiler&) = delete;
+
+            /**
+             * @brief Compile a function into native code
+             *
+             * @param function index of the function to compile, the global scope can't be compiled
+             * @param window_size how many registers the function's register window has
+             * @return uint success status, 0 on success, 1 on failure
+             */
+            uint compile(uint function, size_t window_size);
+
+            /**
+             * @brief Tell if native code can start running at an instruction
+             *
+             * @param pc instruction to start running from
+             * @return true if the instruction was compiled
+             */
+            inline bool has_entry(size_t pc) const { return m_entries[pc] != nullptr; }
+
+            /**
+             * @brief Run native code from an instruction with compiled code until it reaches an
+             *        instruction it can't run
+             *
+             * @param state state of the running frame
+             * @param pc instruction to start running from
+             * @return size_t next instruction the interpreter should run
+             */
+            size_t run(JitState& state, size_t pc) const;
+
+            /**
+             * @brief How many functions were compiled so far
+             *
+             */
+            inline size_t compiled_functions() const { return m_buffers.size(); }
+
+        private:
+            /**
+             * @brief Executable memory holding the code for a function
+             *
+             */
+            struct CodeBuffer
+            {
+                void* memory;
+                size_t size;
+            };
+
+            const Program& m_program;
+            const std::vector<uint>& m_instruction_function;
+
+            /**
+             * @brief Native code for each instruction, null for instructions without it
+             *
+             */
+            std::vector<const void*> m_entries;
+
+            /**
+             * @brief Start of the code for each function, it loads the state and jumps to an entry
+             *
+             */
+            std::vector<const void*> m_function_code;
+
+            /**
+             * @brief Executable memory owned by this compiler
+             *
+             */
+            std::vector<CodeBuffer> m_buffers;
+    };
+}
+
+#endif // JITCOMPILER_HPP
@@ -0,0 +1,137 @@
+#include "LineProfiler.hpp"
+
+// C++ includes
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+namespace TacRunner
+{
+    namespace
+    {
+        double to_ms(std::chrono::nanoseconds time)
+        {
+            return std::chrono::duration<double, std::milli>(time).count();
+        }
+    }
+
+    LineProfiler::LineProfiler(size_t program_size, size_t function_count)
+        : m_hits(program_size, 0)
+        , m_functions(function_count)
+    { }
+
+    void LineProfiler::sync(const FrameStack& frames, uint64_t steps)
+    {
+        auto const now = std::chrono::steady_clock::now();
+
+        // Pop returned frames, and frames reused by a tail call
+        auto matching = [&](size_t i) {
+            return  frames[i].function == m_stack[i].function &&
+                    frames[i].collapsed_frames == m_stack[i].collapsed_frames;
+        };
+        while (!m_stack.empty() && (m_stack.size() > frames.size() || !matching(m_stack.size() - 1)))
+            leave(m_stack, m_functions, steps, now);
+
+        // Push called frames
+        for (size_t i = m_stack.size(); i < frames.size(); i++)
+        {
+            auto const function = frames[i].function;
+            m_stack.push_back(ProfiledFrame{function, frames[i].collapsed_frames, steps, now});
+            m_functions[function].calls++;
+            m_functions[function].active++;
+        }
+    }
+
+    void LineProfiler::leave(
+        std::vector<ProfiledFrame>& stack,
+        std::vector<FunctionProfile>& profiles,
+        uint64_t steps,
+        std::chrono::steady_clock::time_point now)
+    {
+        auto const frame = stack.back();
+        stack.pop_back();
+
+        auto const time = std::chrono::duration_cast<std::chrono::nanoseconds>(now - frame.entry_time);
+        auto& profile = profiles[frame.function];
+        profile.exclusive_time += time - frame.callee_time;
+        profile.active--;
+
+        // Recursive calls are already counted by the outermost one
+        if (profile.active == 0)
+        {
+            profile.inclusive_steps += steps - frame.entry_steps;
+            profile.inclusive_time += time;
+        }
+
+        if (!stack.empty())
+            stack.back().callee_time += time;
+    }
+
+    std::string LineProfiler::str(
+        const Program& program,
+        const std::vector<FunctionInfo>& functions,
+        const std::vector<uint>& instruction_function,
+        uint64_t steps,
+        const std::string& source_file) const
+    {
+        // Frames still running are counted until now
+        auto profiles = m_functions;
+        auto stack = m_stack;
+        auto const now = std::chrono::steady_clock::now();
+        while (!stack.empty())
+            leave(stack, profiles, steps, now);
+
+        std::vector<uint64_t> exclusive_steps(functions.size(), 0);
+        std::map<size_t, uint64_t> line_hits;
+        for (size_t pc = 0; pc < program.size(); pc++)
+        {
+            exclusive_steps[instruction_function[pc]] += m_hits[pc];
+            if (program[pc].line() != 0)
+                line_hits[program[pc].line()] += m_hits[pc];
+        }
+
+        std::stringstream ss;
+        ss << "Line profile: " << steps << " instructions" << std::endl;
+        ss << std::fixed << std::setprecision(3);
+        ss << "\t" << std::left << std::setw(24) << "function" << std::right
+           << std::setw(10) << "calls"
+           << std::setw(14) << "exclusive"
+           << std::setw(14) << "inclusive"
+           << std::setw(14) << "excl. ms"
+           << std::setw(14) << "incl. ms" << std::endl;
+        for (size_t i = 0; i < functions.size(); i++)
+        {
+            auto const& profile = profiles[i];
+            if (profile.calls == 0 && exclusive_steps[i] == 0)
+                continue;
+
+            ss << "\t" << std::left << std::setw(24) << functions[i].name << std::right
+               << std::setw(10) << profile.calls
+               << std::setw(14) << exclusive_steps[i]
+               << std::setw(14) << profile.inclusive_steps
+               << std::setw(14) << to_ms(profile.exclusive_time)
+               << std::setw(14) << to_ms(profile.inclusive_time) << std::endl;
+        }
+
+        std::ifstream source(source_file);
+        if (!source.good())
+            return ss.str();
+
+        // Lines with instructions get their count in the margin, even if they never ran
+        ss << source_file << ":" << std::endl;
+        std::string text;
+        for (size_t line = 1; std::getline(source, text); line++)
+        {
+            auto const hits = line_hits.find(line);
+            if (hits != line_hits.end())
+                ss << std::setw(12) << hits->second;
+            else
+                ss << std::setw(12) << "";
+
+            ss << " | " << text << std::endl;
+        }
+
+        return ss.str();
+    }
+}
@@ -0,0 +1,130 @@
+/**
+ * @file LineProfiler.hpp
+ * @brief Execution profile of every source line and every function of a running program
+ *
+ */
+#ifndef LINE_PROFILER_HPP
+#define LINE_PROFILER_HPP
+
+// Local includes
+#include "TacMachine.hpp"
+
+// C++ includes
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace TacRunner
+{
+    /**
+     * @brief What a function did while profiling. Inclusive counts also include what its callees
+     *        did, and count recursive calls once, from the outermost call
+     *
+     */
+    struct FunctionProfile
+    {
+        uint64_t calls = 0;                         // times a frame was pushed for it, tail calls included
+        uint64_t inclusive_steps = 0;               // instructions run from its calls until they returned
+        std::chrono::nanoseconds inclusive_time{0}; // time from its calls until they returned
+        std::chrono::nanoseconds exclusive_time{0}; // same, without the time spent in its callees
+        uint active = 0;                            // frames for it in the frame stack
+    };
+
+    /**
+     * @brief Function running in a frame of the frame stack while profiling
+     *
+     */
+    struct ProfiledFrame
+    {
+        uint function;                                      // running function
+        uint64_t collapsed_frames;                          // tail calls into the frame when it was pushed
+        uint64_t entry_steps;                               // instructions run when it was pushed
+        std::chrono::steady_clock::time_point entry_time;   // when it was pushed
+        std::chrono::nanoseconds callee_time{0};            // time spent in frames pushed on top of it
+    };
+
+    /**
+     * @brief Counts how many times each instruction runs, and follows the frame stack of the machine
+     *        to count calls, instructions and time for every function. Counts are reported per
+     *        source line, next to the source file they come from
+     *
+     */
+    class LineProfiler
+    {
+        public:
+            /**
+             * @brief Create a profiler for a program
+             *
+             * @param program_size instructions in the program
+             * @param function_count functions in the program, the global scope included
+             */
+            LineProfiler(size_t program_size, size_t function_count);
+
+            /**
+             * @brief Count an instruction about to run. Changes in the frame stack since the
+             *        previous instruction are counted as calls and returns
+             *
+             * @param pc instruction about to run
+             * @param frames frame stack of the machine
+             * @param steps instructions run so far by the machine
+             */
+            inline void step(size_t pc, const FrameStack& frames, uint64_t steps)
+            {
+                auto const& top = frames.back();
+                if (m_stack.size() != frames.size() || m_stack.empty() ||
+                    m_stack.back().function != top.function ||
+                    m_stack.back().collapsed_frames != top.collapsed_frames)
+                    sync(frames, steps);
+
+                m_hits[pc]++;
+            }
+
+            /**
+             * @brief Report with a table of functions, followed by the source file annotated
+             *        with how many times instructions in each line ran
+             *
+             * @param program program being profiled, with the source line of each instruction
+             * @param functions function table of the machine
+             * @param instruction_function function each instruction belongs to
+             * @param steps instructions run so far by the machine
+             * @param source_file file the program was read from, not annotated if it can't be read
+             * @return std::string human readable report
+             */
+            std::string str(
+                const Program& program,
+                const std::vector<FunctionInfo>& functions,
+                const std::vector<uint>& instruction_function,
+                uint64_t steps,
+                const std::string& source_file) const;
+
+        private:
+            /**
+             * @brief Update the profiled frames to match the frame stack
+             *
+             * @param frames frame stack of the machine
+             * @param steps instructions run so far by the machine
+             */
+            void sync(const FrameStack& frames, uint64_t steps);
+
+            /**
+             * @brief Pop the top profiled frame, adding what its function did to its profile
+             *
+             * @param stack profiled frames
+             * @param profiles profile of every function
+             * @param steps instructions run so far
+             * @param now current time
+             */
+            static void leave(
+                std::vector<ProfiledFrame>& stack,
+                std::vector<FunctionProfile>& profiles,
+                uint64_t steps,
+                std::chrono::steady_clock::time_point now);
+
+            std::vector<uint64_t> m_hits;               // times each instruction ran
+            std::vector<FunctionProfile> m_functions;   // profile of every function
+            std::vector<ProfiledFrame> m_stack;         // function running in each frame, bottom first
+    };
+}
+
+#endif // LINE_PROFILER_HPP
@@ -0,0 +1,187 @@
+// Local includes
+#include "Liveness.hpp"
+#include "TacMachine.hpp"
+
+// C++ includes
+#include <bitset>
+
+using namespace TacRunner;
+
+namespace
+{
+    // Name written by static data declarations, as they are registers too
+    const std::string* static_data_name(const Tac& tac)
+    {
+        if (tac.instr() != Instr::METASTATICV && tac.instr() != Instr::METASTRING)
+            return nullptr;
+
+        return &tac.args()[0].get<std::string>();
+    }
+}
+
+bool RegisterSet::merge(const RegisterSet& other)
+{
+    bool changed = false;
+    for (size_t i = 0; i < m_words.size(); i++)
+    {
+        auto const merged = m_words[i] | other.m_words[i];
+        changed |= merged != m_words[i];
+        m_words[i] = merged;
+    }
+
+    return changed;
+}
+
+size_t RegisterSet::count() const
+{
+    size_t result = 0;
+    for (auto word : m_words)
+        result += std::bitset<64>(word).count();
+
+    return result;
+}
+
+void Liveness::compute(const Program& program, const std::vector<ControlFlowGraph>& graphs, std::vector<Liveness>& out_liveness)
+{
+    // Registers live at the start of a function are read from its callers. Those are escaping,
+    // and considering them live at calls might make more registers live at function starts
+    std::unordered_set<std::string> escaping;
+    std::vector<Liveness> liveness;
+    bool changed = true;
+    while (changed)
+    {
+        liveness.assign(graphs.size(), Liveness());
+        for (size_t g = 0; g < graphs.size(); g++)
+            liveness[g].solve(program, graphs[g], escaping);
+
+        changed = false;
+        for (size_t g = 0; g < graphs.size(); g++)
+        {
+            if (graphs[g].blocks().empty())
+                continue;
+
+            auto const& live = liveness[g];
+            auto const& entry = live.live_in(graphs[g].entry());
+            for (size_t id = 0; id < live.m_names.size(); id++)
+                if (entry.test(id) && escaping.insert(live.m_names[id]).second)
+                    changed = true;
+        }
+    }
+
+    out_liveness.swap(liveness);
+}
+
+int Liveness::id_of(const std::string& name) const
+{
+    auto it = m_ids.find(name);
+    if (it == m_ids.end())
+        return NO_REGISTER;
+
+    return it->second;
+}
+
+void Liveness::add_register(const std::string& name)
+{
+    if (name == BASE || name == STACK || m_ids.count(name) != 0)
+        return;
+
+    m_ids[name] = m_names.size();
+    m_names.push_back(name);
+}
+
+int Liveness::defined_id(const Tac& tac) const
+{
+    auto const* def = tac.defined_variable();
+    auto const* static_name = static_data_name(tac);
+    return def != nullptr ? id_of(def->name) : static_name != nullptr ? id_of(*static_name) : NO_REGISTER;
+}
+
+void Liveness::transfer(const Tac& tac, RegisterSet& live) const
+{
+    auto const def_id = defined_id(tac);
+    if (def_id != NO_REGISTER)
+        live.reset(def_id);
+
+    tac.for_each_used_register([&](const std::string& name) {
+        auto const id = id_of(name);
+        if (id != NO_REGISTER)
+            live.set(id);
+    });
+
+    // Callees may read escaping registers
+    if (tac.instr() == Instr::CALL)
+        for (auto id : m_escaping_ids)
+            live.set(id);
+}
+
+void Liveness::solve(const Program& program, const ControlFlowGraph& graph, const std::unordered_set<std::string>& escaping)
+{
+    auto const& blocks = graph.blocks();
+
+    // Collect register names
+    for (auto const& block : blocks)
+        for (size_t i = block.begin; i < block.end; i++)
+        {
+            auto const& tac = program[i];
+            if (auto const* def = tac.defined_variable())
+                add_register(def->name);
+            if (auto const* static_name = static_data_name(tac))
+                add_register(*static_name);
+
+            tac.for_each_used_register([this](const std::string& name) { add_register(name); });
+        }
+
+    for (auto const& name : escaping)
+        add_register(name);
+
+    auto const n_registers = m_names.size();
+    m_escaping = RegisterSet(n_registers);
+    for (auto const& name : escaping)
+    {
+        auto const id = id_of(name);
+        if (id != NO_REGISTER)
+        {
+            m_escaping.set(id);
+            m_escaping_ids.push_back(id);
+        }
+    }
+
+    // Registers read before being written in each block (gen), and written in each block (kill)
+    std::vector<RegisterSet> gen(blocks.size(), RegisterSet(n_registers));
+    std::vector<RegisterSet> kill(blocks.size(), RegisterSet(n_registers));
+    for (size_t b = 0; b < blocks.size(); b++)
+        for (size_t i = blocks[b].end; i --> blocks[b].begin;)
+        {
+            auto const& tac = program[i];
+            transfer(tac, gen[b]);
+
+            auto const def_id = defined_id(tac);
+            if (def_id != NO_REGISTER)
+                kill[b].set(def_id);
+        }
+
+    // Iterate in postorder until nothing changes: live_in = gen + (live_out - kill)
+    m_live_in.assign(blocks.size(), RegisterSet(n_registers));
+    m_live_out.assign(blocks.size(), RegisterSet(n_registers));
+    auto const& order = graph.reverse_postorder();
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t k = order.size(); k --> 0;)
+        {
+            auto const b = order[k];
+            auto& out = m_live_out[b];
+            for (auto s : blocks[b].successors)
+                out.merge(m_live_in[s]);
+
+            auto& in = m_live_in[b];
+            for (size_t w = 0; w < in.m_words.size(); w++)
+            {
+                auto const word = gen[b].m_words[w] | (out.m_words[w] & ~kill[b].m_words[w]);
+                changed |= word != in.m_words[w];
+                in.m_words[w] = word;
+            }
+        }
+    }
+}
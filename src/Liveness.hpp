@@ -0,0 +1,152 @@
+/**
+ * @file Liveness.hpp
+ * @brief Register liveness analysis over control flow graphs
+ *
+ */
+#ifndef LIVENESS_HPP
+#define LIVENESS_HPP
+
+// Local includes
+#include "Tac.hpp"
+#include "ControlFlowGraph.hpp"
+
+// C++ includes
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <stdint.h>
+
+// Register id for names that are not tracked, like BASE and STACK
+#define NO_REGISTER -1
+
+namespace TacRunner
+{
+    /**
+     * @brief Fixed size set of register ids
+     *
+     */
+    class RegisterSet
+    {
+        public:
+            RegisterSet(size_t size = 0) : m_words((size + 63) / 64, 0) { }
+
+            inline bool test(size_t id) const { return (m_words[id / 64] >> (id % 64)) & 1; }
+            inline void set(size_t id) { m_words[id / 64] |= uint64_t(1) << (id % 64); }
+            inline void reset(size_t id) { m_words[id / 64] &= ~(uint64_t(1) << (id % 64)); }
+
+            /**
+             * @brief Add every register in 'other' to this set
+             *
+             * @param other set to merge, should have the same size
+             * @return true if this set changed
+             * @return false otherwise
+             */
+            bool merge(const RegisterSet& other);
+
+            /**
+             * @brief Amount of registers in this set
+             *
+             * @return size_t register count
+             */
+            size_t count() const;
+
+        private:
+            std::vector<uint64_t> m_words;
+
+        friend class Liveness;
+    };
+
+    /**
+     * @brief Registers live at the start and end of every block of a function. Besides
+     *        registers read later in the same function, registers may be read by callees: a
+     *        function reading a register it didn't write gets the value from its callers. Such
+     *        registers are called escaping, and they are live at every call
+     *
+     */
+    class Liveness
+    {
+        public:
+            /**
+             * @brief Compute liveness for every graph of a program
+             *
+             * @param program program used to build the graphs
+             * @param graphs control flow graphs for every function in the program
+             * @param out_liveness where to store liveness for each graph, in the same order
+             */
+            static void compute(const Program& program, const std::vector<ControlFlowGraph>& graphs, std::vector<Liveness>& out_liveness);
+
+            /**
+             * @brief Names of every register tracked in this function, indexed by register id
+             *
+             * @return const std::vector<std::string>& register names
+             */
+            inline const std::vector<std::string>& registers() const { return m_names; }
+
+            /**
+             * @brief Id of a register in this function
+             *
+             * @param name register name
+             * @return int register id, NO_REGISTER if not tracked
+             */
+            int id_of(const std::string& name) const;
+
+            /**
+             * @brief Tells if a register might be read by another function
+             *
+             * @param id register id
+             * @return true if it's escaping, so it should be considered always live
+             * @return false otherwise
+             */
+            inline bool is_escaping(size_t id) const { return m_escaping.test(id); }
+
+            inline const RegisterSet& live_in(size_t block) const { return m_live_in[block]; }
+            inline const RegisterSet& live_out(size_t block) const { return m_live_out[block]; }
+
+            /**
+             * @brief Update a live set backwards through an instruction: its written register
+             *        is not live before it, and the registers it reads are
+             *
+             * @param tac instruction
+             * @param live registers live after the instruction, updated to registers live before it
+             */
+            void transfer(const Tac& tac, RegisterSet& live) const;
+
+            /**
+             * @brief Id of the register written by an instruction
+             *
+             * @param tac instruction
+             * @return int register id, NO_REGISTER if it doesn't write a tracked register
+             */
+            int defined_id(const Tac& tac) const;
+
+        private:
+            Liveness() = default;
+
+            /**
+             * @brief Collect register names of a function and solve the liveness equations
+             *
+             * @param program program used to build the graph
+             * @param graph function graph
+             * @param escaping names of escaping registers
+             */
+            void solve(const Program& program, const ControlFlowGraph& graph, const std::unordered_set<std::string>& escaping);
+
+            /**
+             * @brief Add a register name to this function if it's not tracked yet
+             *
+             * @param name register name
+             */
+            void add_register(const std::string& name);
+
+        private:
+            std::vector<std::string> m_names;
+            std::unordered_map<std::string, int> m_ids;
+            std::vector<size_t> m_escaping_ids;
+            RegisterSet m_escaping;
+            std::vector<RegisterSet> m_live_in;
+            std::vector<RegisterSet> m_live_out;
+    };
+}
+
+#endif // LIVENESS_HPP
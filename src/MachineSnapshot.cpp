@@ -0,0 +1,484 @@
+// Local includes
+#include "MachineSnapshot.hpp"
+#include "Application.hpp"
+
+// C++ includes
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <functional>
+#include <string.h>
+
+// Linux includes
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace TacRunner;
+
+namespace
+{
+    /**
+     * @brief Sequential writer for snapshot files, keeps track of the
+     *        current offset so payloads can be page aligned
+     *
+     */
+    class SnapshotWriter
+    {
+        public:
+            SnapshotWriter(const std::string& filename)
+                : m_file(filename, std::ios::binary | std::ios::trunc)
+                , m_offset(0)
+            { }
+
+            inline bool good() const { return m_file.good(); }
+
+            void put_bytes(const void* bytes, size_t count)
+            {
+                m_file.write(static_cast<const char*>(bytes), count);
+                m_offset += count;
+            }
+
+            template<typename T>
+            void put(T value) { put_bytes(&value, sizeof(value)); }
+
+            void put_string(const std::string& str)
+            {
+                put<uint32_t>(str.size());
+                put_bytes(str.data(), str.size());
+            }
+
+            // Fill with zeros until the next page boundary
+            void align()
+            {
+                static const char zeros[SNAPSHOT_PAGE_SIZE] = {0};
+                auto padding = (SNAPSHOT_PAGE_SIZE - m_offset % SNAPSHOT_PAGE_SIZE) % SNAPSHOT_PAGE_SIZE;
+                put_bytes(zeros, padding);
+            }
+
+        private:
+            std::ofstream m_file;
+            size_t m_offset;
+    };
+
+    /**
+     * @brief A read only, private mapping of a snapshot file. Memory chunks restored
+     *        from a snapshot keep a reference to it, so it lives as long as they do
+     *
+     */
+    struct MappedFile
+    {
+        std::byte* data = nullptr;
+        size_t size = 0;
+
+        ~MappedFile() { if (data != nullptr) munmap(data, size); }
+    };
+
+    /**
+     * @brief Sequential reader over a mapped snapshot file, every read is bounds checked
+     *
+     */
+    class SnapshotReader
+    {
+        public:
+            SnapshotReader(std::shared_ptr<MappedFile> file) : m_file(file), m_offset(0) { }
+
+            uint get_bytes(void* out_bytes, size_t count)
+            {
+                const std::byte* bytes;
+                if (view(count, bytes) == FAIL)
+                    return FAIL;
+
+                memcpy(out_bytes, bytes, count);
+                return SUCCESS;
+            }
+
+            // Get a pointer to the next 'count' bytes in the mapping, without copying them
+            uint view(size_t count, const std::byte* &out_bytes)
+            {
+                if (count > m_file->size - m_offset)
+                    return FAIL;
+
+                out_bytes = m_file->data + m_offset;
+                m_offset += count;
+                return SUCCESS;
+            }
+
+            template<typename T>
+            uint get(T& out_value) { return get_bytes(&out_value, sizeof(out_value)); }
+
+            uint get_string(std::string& out_str)
+            {
+                uint32_t size;
+                const std::byte* bytes;
+                if (get(size) == FAIL || view(size, bytes) == FAIL)
+                    return FAIL;
+
+                out_str.assign(reinterpret_cast<const char*>(bytes), size);
+                return SUCCESS;
+            }
+
+            void align() { m_offset += (SNAPSHOT_PAGE_SIZE - m_offset % SNAPSHOT_PAGE_SIZE) % SNAPSHOT_PAGE_SIZE; }
+
+            inline std::shared_ptr<MappedFile> file() const { return m_file; }
+
+        private:
+            std::shared_ptr<MappedFile> m_file;
+            size_t m_offset;
+    };
+
+    bool is_zero(const std::byte* bytes, size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+            if (bytes[i] != std::byte{0})
+                return false;
+        return true;
+    }
+
+    // Write every chunk in a memory map. Zero chunks are stored without payload
+    void write_chunks(SnapshotWriter& writer, const MemoryMap& memory_map, std::function<const std::byte*(const MemoryChunk&)> chunk_data)
+    {
+        writer.put<uint64_t>(memory_map.size());
+        for (auto const& [start, chunk] : memory_map)
+        {
+            writer.put<uint32_t>(chunk.start_pos());
+            writer.put<uint32_t>(chunk.size());
+
+            const std::byte* bytes = chunk_data(chunk);
+            bool has_data = !is_zero(bytes, chunk.size());
+            writer.put<uint8_t>(has_data);
+            if (!has_data)
+                continue;
+
+            writer.align();
+            writer.put_bytes(bytes, chunk.size());
+        }
+    }
+
+    // Read chunks written by 'write_chunks'. Chunks with payload point directly to the mapping
+    uint read_chunks(SnapshotReader& reader, MemoryMap& out_memory_map)
+    {
+        uint64_t n_chunks;
+        if (reader.get(n_chunks) == FAIL)
+            return FAIL;
+
+        out_memory_map.clear();
+        for (uint64_t i = 0; i < n_chunks; i++)
+        {
+            uint32_t start, size;
+            uint8_t has_data;
+            if (reader.get(start) == FAIL || reader.get(size) == FAIL || reader.get(has_data) == FAIL)
+                return FAIL;
+
+            if (!has_data)
+            {
+                out_memory_map.insert({start, MemoryChunk(size, start)});
+                continue;
+            }
+
+            reader.align();
+            const std::byte* bytes;
+            if (reader.view(size, bytes) == FAIL)
+                return FAIL;
+
+            // The mapping is private, so writing to it is safe and won't touch the file
+            std::shared_ptr<std::byte []> memory(reader.file(), const_cast<std::byte*>(bytes));
+            out_memory_map.insert({start, MemoryChunk(size, start, memory)});
+        }
+
+        return SUCCESS;
+    }
+}
+
+uint64_t MachineSnapshot::program_fingerprint(const Program& program)
+{
+    // FNV-1a over the string representation of every instruction
+    uint64_t hash = 14695981039346656037ULL;
+    for (auto const& tac : program)
+    {
+        for (char c : tac.str())
+        {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ULL;
+        }
+        hash ^= '\n';
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+uint MachineSnapshot::save(const TacMachine& machine, const std::string& filename)
+{
+    SnapshotWriter writer(filename);
+    if (!writer.good())
+    {
+        std::stringstream ss;
+        ss << "Could not open snapshot file '" << filename << "' for writing";
+        App::error(ss.str());
+        return FAIL;
+    }
+
+    // Header
+    writer.put_bytes(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    writer.put<uint32_t>(SNAPSHOT_VERSION);
+    writer.put<uint32_t>(SNAPSHOT_PAGE_SIZE);
+    writer.put<uint64_t>(machine.m_program.size());
+    writer.put<uint64_t>(program_fingerprint(machine.m_program));
+
+    // Machine registers
+    writer.put<uint64_t>(machine.m_program_counter);
+    writer.put<REGISTER_TYPE>(machine.m_frame_pointer);
+    writer.put<uint8_t>(static_cast<uint8_t>(machine.m_status));
+    writer.put<REGISTER_TYPE>(machine.m_exit_status_code);
+    writer.put<uint64_t>(machine.m_step_count);
+
+    // Frame stack
+    writer.put<uint64_t>(machine.m_frames.size());
+    for (auto const& frame : machine.m_frames)
+    {
+        writer.put<uint64_t>(frame.program_counter);
+        writer.put<uint64_t>(frame.stack_pointer);
+        writer.put<REGISTER_TYPE>(frame.frame_pointer);
+        writer.put<int32_t>(frame.return_slot);
+        writer.put<uint32_t>(frame.function);
+        writer.put<uint64_t>(frame.window);
+        writer.put<uint64_t>(frame.window_size);
+        writer.put<uint64_t>(frame.collapsed_frames);
+    }
+
+    // Register file
+    writer.put<uint64_t>(machine.m_register_file.size());
+    writer.put_bytes(machine.m_register_file.data(), machine.m_register_file.size() * sizeof(REGISTER_TYPE));
+    writer.put_bytes(machine.m_register_valid.data(), machine.m_register_valid.size());
+
+    // Static memory
+    auto const& static_mem = machine.m_memory.m_static;
+    writer.put<uint32_t>(static_mem.m_next_memory_position);
+    writer.put<uint64_t>(static_mem.m_allocations_counter);
+    writer.put<uint64_t>(static_mem.m_read_counter);
+    writer.put<uint64_t>(static_mem.m_write_counter);
+    writer.put<uint64_t>(static_mem.m_allocated_memory);
+    write_chunks(writer, static_mem.m_memory_map, chunk_data);
+
+    // Heap memory
+    auto const& heap = machine.m_memory.m_heap;
+    writer.put<uint32_t>(heap.m_next_memory_position);
+    writer.put<uint64_t>(heap.m_allocations_counter);
+    writer.put<uint64_t>(heap.m_free_counter);
+    writer.put<uint64_t>(heap.m_read_counter);
+    writer.put<uint64_t>(heap.m_write_counter);
+    writer.put<uint64_t>(heap.m_allocated_memory);
+    write_chunks(writer, heap.m_memory_map, chunk_data);
+
+    // Stack memory, only pages with some non zero byte are stored
+    auto const& stack = machine.m_memory.m_stack;
+    writer.put<uint64_t>(stack.m_stack_pointer);
+    writer.put<uint64_t>(stack.m_push_count);
+    writer.put<uint64_t>(stack.m_pop_count);
+    writer.put<uint64_t>(stack.m_read_count);
+    writer.put<uint64_t>(stack.m_write_count);
+
+    std::vector<uint32_t> pages;
+    for (size_t start = 0; start < STACK_MEMORY_SIZE; start += SNAPSHOT_PAGE_SIZE)
+    {
+        auto count = std::min<size_t>(SNAPSHOT_PAGE_SIZE, STACK_MEMORY_SIZE - start);
+        if (!is_zero(VirtualStack::m_memory + start, count))
+            pages.push_back(start / SNAPSHOT_PAGE_SIZE);
+    }
+
+    writer.put<uint64_t>(pages.size());
+    for (auto page : pages)
+        writer.put<uint32_t>(page);
+
+    for (auto page : pages)
+    {
+        size_t start = static_cast<size_t>(page) * SNAPSHOT_PAGE_SIZE;
+        writer.align();
+        writer.put_bytes(VirtualStack::m_memory + start, std::min<size_t>(SNAPSHOT_PAGE_SIZE, STACK_MEMORY_SIZE - start));
+    }
+
+    if (!writer.good())
+    {
+        std::stringstream ss;
+        ss << "Error writing snapshot file '" << filename << "'";
+        App::error(ss.str());
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+uint MachineSnapshot::load(TacMachine& machine, const std::string& filename)
+{
+    // Map the entire file, chunks will reference this mapping instead of copying it
+    auto file = std::make_shared<MappedFile>();
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat file_stat;
+    if (fd < 0 || fstat(fd, &file_stat) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        std::stringstream ss;
+        ss << "Could not open snapshot file '" << filename << "'";
+        App::error(ss.str());
+        return FAIL;
+    }
+
+    file->size = file_stat.st_size;
+    void* data = file->size == 0 ? MAP_FAILED : mmap(nullptr, file->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        std::stringstream ss;
+        ss << "Could not map snapshot file '" << filename << "' into memory";
+        App::error(ss.str());
+        return FAIL;
+    }
+    file->data = static_cast<std::byte*>(data);
+
+    SnapshotReader reader(file);
+    auto corrupted = [&filename]() {
+        std::stringstream ss;
+        ss << "Snapshot file '" << filename << "' is corrupted or truncated";
+        App::error(ss.str());
+        return FAIL;
+    };
+
+    // Check header
+    char magic[sizeof(SNAPSHOT_MAGIC)];
+    uint32_t version, page_size;
+    uint64_t program_size, fingerprint;
+    if (reader.get_bytes(magic, sizeof(magic)) == FAIL || memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0)
+    {
+        std::stringstream ss;
+        ss << "File '" << filename << "' is not a tac machine snapshot";
+        App::error(ss.str());
+        return FAIL;
+    }
+
+    if (reader.get(version) == FAIL || reader.get(page_size) == FAIL ||
+        reader.get(program_size) == FAIL || reader.get(fingerprint) == FAIL)
+        return corrupted();
+
+    if (version != SNAPSHOT_VERSION || page_size != SNAPSHOT_PAGE_SIZE)
+    {
+        std::stringstream ss;
+        ss << "Unsupported snapshot version " << version << " with page size " << page_size;
+        App::error(ss.str());
+        return FAIL;
+    }
+
+    if (program_size != machine.m_program.size() || fingerprint != program_fingerprint(machine.m_program))
+    {
+        App::error("Snapshot was created by a different program");
+        return FAIL;
+    }
+
+    // Machine registers
+    uint64_t program_counter, step_count;
+    REGISTER_TYPE frame_pointer, exit_status_code;
+    uint8_t status;
+    if (reader.get(program_counter) == FAIL || reader.get(frame_pointer) == FAIL || reader.get(status) == FAIL ||
+        reader.get(exit_status_code) == FAIL || reader.get(step_count) == FAIL || program_counter > program_size)
+        return corrupted();
+
+    // Frame stack
+    uint64_t n_frames;
+    FrameStack frames;
+    if (reader.get(n_frames) == FAIL || n_frames == 0)
+        return corrupted();
+
+    for (uint64_t i = 0; i < n_frames; i++)
+    {
+        uint64_t pc, sp, window, window_size, collapsed_frames;
+        REGISTER_TYPE fp;
+        int32_t return_slot;
+        uint32_t function;
+        if (reader.get(pc) == FAIL || reader.get(sp) == FAIL || reader.get(fp) == FAIL || reader.get(return_slot) == FAIL ||
+            reader.get(function) == FAIL || reader.get(window) == FAIL || reader.get(window_size) == FAIL || reader.get(collapsed_frames) == FAIL ||
+            function >= machine.m_functions.size())
+            return corrupted();
+
+        frames.push_back(Frame{pc, sp, fp, return_slot, function, window, window_size, collapsed_frames});
+    }
+
+    // Register file
+    uint64_t n_registers;
+    if (reader.get(n_registers) == FAIL || frames.back().window + frames.back().window_size != n_registers)
+        return corrupted();
+
+    std::vector<REGISTER_TYPE> register_file(n_registers);
+    std::vector<uint8_t> register_valid(n_registers);
+    if (reader.get_bytes(register_file.data(), n_registers * sizeof(REGISTER_TYPE)) == FAIL ||
+        reader.get_bytes(register_valid.data(), n_registers) == FAIL)
+        return corrupted();
+
+    // Static memory
+    VirtualStaticMemory static_mem;
+    if (reader.get(static_mem.m_next_memory_position) == FAIL || reader.get(static_mem.m_allocations_counter) == FAIL ||
+        reader.get(static_mem.m_read_counter) == FAIL || reader.get(static_mem.m_write_counter) == FAIL ||
+        reader.get(static_mem.m_allocated_memory) == FAIL || read_chunks(reader, static_mem.m_memory_map) == FAIL)
+        return corrupted();
+
+    // Heap memory
+    VirtualHeap heap;
+    if (reader.get(heap.m_next_memory_position) == FAIL || reader.get(heap.m_allocations_counter) == FAIL ||
+        reader.get(heap.m_free_counter) == FAIL || reader.get(heap.m_read_counter) == FAIL ||
+        reader.get(heap.m_write_counter) == FAIL || reader.get(heap.m_allocated_memory) == FAIL ||
+        read_chunks(reader, heap.m_memory_map) == FAIL)
+        return corrupted();
+
+    // Stack memory
+    uint64_t stack_pointer, push_count, pop_count, read_count, write_count, n_pages;
+    if (reader.get(stack_pointer) == FAIL || reader.get(push_count) == FAIL || reader.get(pop_count) == FAIL ||
+        reader.get(read_count) == FAIL || reader.get(write_count) == FAIL || reader.get(n_pages) == FAIL ||
+        stack_pointer >= STACK_MEMORY_SIZE)
+        return corrupted();
+
+    std::vector<uint32_t> pages(n_pages);
+    for (auto& page : pages)
+        if (reader.get(page) == FAIL || static_cast<size_t>(page) * SNAPSHOT_PAGE_SIZE >= STACK_MEMORY_SIZE)
+            return corrupted();
+
+    // Everything but the stack pages was read, now we can start modifying the machine
+    memset(VirtualStack::m_memory, 0, STACK_MEMORY_SIZE);
+    for (auto page : pages)
+    {
+        size_t start = static_cast<size_t>(page) * SNAPSHOT_PAGE_SIZE;
+        size_t count = std::min<size_t>(SNAPSHOT_PAGE_SIZE, STACK_MEMORY_SIZE - start);
+        const std::byte* bytes;
+        reader.align();
+        if (reader.view(count, bytes) == FAIL)
+            return corrupted();
+
+        memcpy(VirtualStack::m_memory + start, bytes, count);
+    }
+
+    auto& stack = machine.m_memory.m_stack;
+    stack.m_stack_pointer = stack_pointer;
+    stack.m_push_count  = push_count;
+    stack.m_pop_count   = pop_count;
+    stack.m_read_count  = read_count;
+    stack.m_write_count = write_count;
+
+    machine.m_memory.m_static = static_mem;
+    machine.m_memory.m_heap   = heap;
+    machine.m_frames.swap(frames);
+    machine.m_register_file.swap(register_file);
+    machine.m_register_valid.swap(register_valid);
+    machine.m_frames.reserve(FRAME_STACK_RESERVE);
+    machine.m_register_file.reserve(REGISTER_FILE_RESERVE);
+    machine.m_register_valid.reserve(REGISTER_FILE_RESERVE);
+    machine.m_program_counter  = program_counter;
+    machine.m_frame_pointer    = frame_pointer;
+    machine.m_exit_status_code = exit_status_code;
+    machine.m_step_count       = step_count;
+
+    // A restored machine is ready to continue, unless it was already done
+    auto saved_status = static_cast<TacMachine::Status>(status);
+    machine.m_status = saved_status == TacMachine::Status::FINISHED ? TacMachine::Status::FINISHED : TacMachine::Status::PAUSED;
+
+    return SUCCESS;
+}
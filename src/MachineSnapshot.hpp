@@ -0,0 +1,81 @@
+/**
+ * @file MachineSnapshot.hpp
+ * @brief Save and restore a complete tac machine state to and from disk
+ *
+ */
+#ifndef MACHINESNAPSHOT_HPP
+#define MACHINESNAPSHOT_HPP
+
+// Local includes
+#include "TacMachine.hpp"
+
+// C++ includes
+#include <string>
+
+// Snapshot file identification
+#define SNAPSHOT_MAGIC "TACSNAP"
+#define SNAPSHOT_VERSION 4
+
+// Granularity used to skip untouched (all zero) memory. Data pages are
+// aligned to this size inside the file, so they can be mapped directly
+#define SNAPSHOT_PAGE_SIZE 4096
+
+namespace TacRunner
+{
+    /**
+     * @brief Serializes a tac machine into a binary file and restores it back.
+     *
+     *        File layout (host byte order):
+     *          - header: magic, version, page size, program fingerprint
+     *          - machine registers: pc, fp, status code, step count
+     *          - frame stack and register file
+     *          - static memory and heap chunks. Zero chunks have no payload
+     *          - stack: stack pointer and a list of non zero pages
+     *        Every payload (chunk or page) starts in a page aligned offset. When
+     *        loading, the file is mapped in memory and heap/static chunks point
+     *        directly into the (private, copy on write) mapping.
+     *
+     */
+    class MachineSnapshot
+    {
+        public:
+            /**
+             * @brief Write the state of 'machine' into 'filename'
+             *
+             * @param machine machine to save
+             * @param filename file where to store the snapshot
+             * @return uint success status, 0 on success, 1 on failure
+             */
+            static uint save(const TacMachine& machine, const std::string& filename);
+
+            /**
+             * @brief Load the state stored in 'filename' into 'machine'. The machine should
+             *        be running the same program that produced the snapshot
+             *
+             * @param machine machine where to restore the state
+             * @param filename file with the snapshot
+             * @return uint success status, 0 on success, 1 on failure
+             */
+            static uint load(TacMachine& machine, const std::string& filename);
+
+            /**
+             * @brief Hash identifying a program, used to check that a snapshot
+             *        is restored into the same program
+             *
+             * @param program program to hash
+             * @return uint64_t program fingerprint
+             */
+            static uint64_t program_fingerprint(const Program& program);
+
+        private:
+            /**
+             * @brief Raw bytes stored by a memory chunk
+             *
+             * @param chunk chunk whose memory is requested
+             * @return const std::byte* pointer to the chunk's memory
+             */
+            static const std::byte* chunk_data(const MemoryChunk& chunk) { return chunk.memory().get(); }
+    };
+}
+
+#endif // MACHINESNAPSHOT_HPP
@@ -0,0 +1,168 @@
+#include "MemoryTracer.hpp"
+
+// C++ includes
+#include <cstring>
+
+namespace TacRunner
+{
+    MemoryTracer::MemoryTracer(const size_t& program_counter)
+        : m_program_counter(program_counter)
+    {
+        m_buffer.reserve(MEMORY_TRACE_BUFFER_SIZE);
+    }
+
+    uint MemoryTracer::open(const std::string& filename, const std::vector<FunctionInfo>& functions, const std::vector<uint>& instruction_function)
+    {
+        m_out.open(filename, std::ios::binary);
+        if (!m_out.good())
+            return FAIL;
+
+        // Header: magic, function names, and the function of every instruction
+        m_out.write(MEMORY_TRACE_MAGIC, strlen(MEMORY_TRACE_MAGIC));
+        put_varint(functions.size());
+        for (auto const& function : functions)
+        {
+            put_varint(function.name.size());
+            m_buffer.insert(m_buffer.end(), function.name.begin(), function.name.end());
+            if (m_buffer.size() > MEMORY_TRACE_BUFFER_SIZE - MEMORY_TRACE_MAX_RECORD)
+                flush();
+        }
+
+        put_varint(instruction_function.size());
+        for (auto const function : instruction_function)
+        {
+            put_varint(function);
+            if (m_buffer.size() > MEMORY_TRACE_BUFFER_SIZE - MEMORY_TRACE_MAX_RECORD)
+                flush();
+        }
+
+        flush();
+        return m_out.good() ? SUCCESS : FAIL;
+    }
+
+    uint MemoryTracer::close()
+    {
+        if (!m_out.is_open())
+            return FAIL;
+
+        flush();
+        m_out.close();
+
+        return m_out.good() ? SUCCESS : FAIL;
+    }
+
+    void MemoryTracer::flush()
+    {
+        m_out.write(reinterpret_cast<const char*>(m_buffer.data()), m_buffer.size());
+        m_buffer.clear();
+    }
+
+    uint MemoryTraceReader::open(const std::string& filename)
+    {
+        m_in.open(filename, std::ios::binary);
+        if (!m_in.good())
+            return FAIL;
+
+        m_buffer.resize(MEMORY_TRACE_BUFFER_SIZE);
+        m_buffer.resize(m_in.read(reinterpret_cast<char*>(m_buffer.data()), m_buffer.size()).gcount());
+        m_position = 0;
+
+        auto const magic_size = strlen(MEMORY_TRACE_MAGIC);
+        if (m_buffer.size() < magic_size || memcmp(m_buffer.data(), MEMORY_TRACE_MAGIC, magic_size) != 0)
+            return FAIL;
+        m_position = magic_size;
+
+        uint64_t count;
+        if (!get_varint(count))
+            return FAIL;
+
+        m_functions.resize(count);
+        for (auto& name : m_functions)
+        {
+            uint64_t size;
+            if (!get_varint(size))
+                return FAIL;
+
+            name.reserve(size);
+            for (uint8_t byte; size > 0 && get_byte(byte); size--)
+                name.push_back(static_cast<char>(byte));
+
+            if (size > 0)
+                return FAIL;
+        }
+
+        if (!get_varint(count))
+            return FAIL;
+
+        m_instruction_function.resize(count);
+        for (auto& function : m_instruction_function)
+        {
+            uint64_t value;
+            if (!get_varint(value))
+                return FAIL;
+            function = static_cast<uint>(value);
+        }
+
+        return SUCCESS;
+    }
+
+    bool MemoryTraceReader::next(MemoryAccess& out_access)
+    {
+        uint8_t flags;
+        if (!get_byte(flags))
+            return false;
+
+        // From here on, running out of bytes means the record was cut
+        m_truncated = true;
+        uint64_t size = flags >> 3;
+        uint64_t address_delta, pc_delta;
+        if ((size == 0 && !get_varint(size)) || !get_varint(address_delta) || !get_varint(pc_delta))
+            return false;
+        m_truncated = false;
+
+        m_last_address = static_cast<uint>(m_last_address + unzigzag(address_delta));
+        m_last_pc = static_cast<size_t>(m_last_pc + unzigzag(pc_delta));
+
+        out_access.address = m_last_address;
+        out_access.size = static_cast<uint>(size);
+        out_access.region = static_cast<MemoryManager::MemoryType>((flags >> 1) & 0x3);
+        out_access.write = flags & 1;
+        out_access.pc = m_last_pc;
+        return true;
+    }
+
+    bool MemoryTraceReader::get_byte(uint8_t& out_byte)
+    {
+        if (m_position == m_buffer.size())
+        {
+            if (!m_in.good())
+                return false;
+
+            m_buffer.resize(MEMORY_TRACE_BUFFER_SIZE);
+            m_buffer.resize(m_in.read(reinterpret_cast<char*>(m_buffer.data()), m_buffer.size()).gcount());
+            m_position = 0;
+            if (m_buffer.empty())
+                return false;
+        }
+
+        out_byte = m_buffer[m_position++];
+        return true;
+    }
+
+    bool MemoryTraceReader::get_varint(uint64_t& out_value)
+    {
+        out_value = 0;
+        uint8_t byte;
+        for (uint shift = 0; shift < 64; shift += 7)
+        {
+            if (!get_byte(byte))
+                return false;
+
+            out_value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+                return true;
+        }
+
+        return false;
+    }
+}
@@ -0,0 +1,184 @@
+/**
+ * @file MemoryTracer.hpp
+ * @brief Binary trace of every guest memory read and write, and a reader for it
+ *
+ */
+#ifndef MEMORY_TRACER_HPP
+#define MEMORY_TRACER_HPP
+
+// Local includes
+#include "TacMachine.hpp"
+
+// C++ includes
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define MEMORY_TRACE_MAGIC "TACMEMT1"           // first bytes of every memory trace file
+#define MEMORY_TRACE_BUFFER_SIZE (1 << 20)      // bytes of records kept in memory before writing them to the file
+#define MEMORY_TRACE_MAX_RECORD 32              // bytes a single record may take, flags and three varints
+#define MEMORY_TRACE_INLINE_SIZE 31             // largest access size stored in the flags byte
+
+namespace TacRunner
+{
+    /**
+     * @brief A guest memory read or write, as stored in a memory trace
+     *
+     */
+    struct MemoryAccess
+    {
+        uint address;                       // first virtual address accessed
+        uint size;                          // bytes accessed
+        MemoryManager::MemoryType region;   // memory holding those bytes
+        bool write;                         // if those bytes were written, read otherwise
+        size_t pc;                          // instruction performing the access
+    };
+
+    /**
+     * @brief Records guest memory accesses going through the memory manager into a file.
+     *        The file starts with a header holding the name of every function and the function of
+     *        every instruction, so accesses can be attributed without the program. Then every
+     *        access takes a flags byte, with the kind of access, its region and its size when
+     *        small, followed by the distance to the previous address and the previous pc as
+     *        zigzag varints. Most accesses are close to the previous one, and take 3 or 4 bytes
+     *
+     */
+    class MemoryTracer
+    {
+        public:
+            /**
+             * @brief Create a tracer for a machine
+             *
+             * @param program_counter program counter of the machine, read on every access
+             */
+            MemoryTracer(const size_t& program_counter);
+
+            /**
+             * @brief Start writing accesses to a file, after a header describing the program
+             *
+             * @param filename file where to write accesses
+             * @param functions function table of the machine
+             * @param instruction_function function of every instruction in the program
+             * @return uint success status, 0 on success, 1 if the file could not be opened
+             */
+            uint open(const std::string& filename, const std::vector<FunctionInfo>& functions, const std::vector<uint>& instruction_function);
+
+            /**
+             * @brief Write pending accesses and close the file
+             *
+             * @return uint success status, 0 on success, 1 if the file could not be written
+             */
+            uint close();
+
+            /**
+             * @brief Record an access at the current program counter
+             *
+             * @param address first virtual address accessed
+             * @param size bytes accessed
+             * @param region memory holding those bytes
+             * @param write if the access is a write
+             */
+            inline void record(uint address, size_t size, MemoryManager::MemoryType region, bool write)
+            {
+                if (m_buffer.size() > MEMORY_TRACE_BUFFER_SIZE - MEMORY_TRACE_MAX_RECORD)
+                    flush();
+
+                auto const inline_size = size <= MEMORY_TRACE_INLINE_SIZE ? size : 0;
+                m_buffer.push_back(static_cast<uint8_t>((write ? 1 : 0) | static_cast<uint>(region) << 1 | inline_size << 3));
+                if (inline_size == 0)
+                    put_varint(size);
+
+                put_varint(zigzag(static_cast<int64_t>(address) - static_cast<int64_t>(m_last_address)));
+                put_varint(zigzag(static_cast<int64_t>(m_program_counter) - static_cast<int64_t>(m_last_pc)));
+                m_last_address = address;
+                m_last_pc = m_program_counter;
+                m_accesses++;
+            }
+
+            inline size_t accesses() const { return m_accesses; }
+
+        private:
+            static inline uint64_t zigzag(int64_t value) { return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63); }
+
+            inline void put_varint(uint64_t value)
+            {
+                while (value >= 0x80)
+                {
+                    m_buffer.push_back(static_cast<uint8_t>(value | 0x80));
+                    value >>= 7;
+                }
+                m_buffer.push_back(static_cast<uint8_t>(value));
+            }
+
+            /**
+             * @brief Write buffered records to the file, and empty the buffer
+             *
+             */
+            void flush();
+
+            const size_t& m_program_counter;
+            std::ofstream m_out;
+            std::vector<uint8_t> m_buffer;  // records not written yet
+            uint m_last_address = 0;        // address of the previous access
+            size_t m_last_pc = 0;           // pc of the previous access
+            size_t m_accesses = 0;          // accesses recorded so far
+    };
+
+    /**
+     * @brief Reads back a file written by MemoryTracer, one access at a time
+     *
+     */
+    class MemoryTraceReader
+    {
+        public:
+            /**
+             * @brief Open a memory trace and read its header
+             *
+             * @param filename file to read
+             * @return uint success status, 0 on success, 1 if the file could not be read or is not a memory trace
+             */
+            uint open(const std::string& filename);
+
+            /**
+             * @brief Read the next access
+             *
+             * @param out_access where to store it
+             * @return true if an access was read
+             * @return false at the end of the trace, or if it's truncated
+             */
+            bool next(MemoryAccess& out_access);
+
+            /**
+             * @brief Tells if the trace ended in the middle of a record
+             *
+             */
+            inline bool truncated() const { return m_truncated; }
+
+            inline const std::vector<std::string>& functions() const { return m_functions; }
+
+            /**
+             * @brief Function running an instruction
+             *
+             * @param pc instruction
+             * @return uint index in functions(), or the number of functions if pc is not in the program
+             */
+            inline uint function_of(size_t pc) const { return pc < m_instruction_function.size() ? m_instruction_function[pc] : m_functions.size(); }
+
+        private:
+            bool get_byte(uint8_t& out_byte);
+            bool get_varint(uint64_t& out_value);
+            static inline int64_t unzigzag(uint64_t value) { return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1); }
+
+            std::ifstream m_in;
+            std::vector<uint8_t> m_buffer;  // bytes read from the file and not decoded yet
+            size_t m_position = 0;          // next byte to decode in the buffer
+            std::vector<std::string> m_functions;
+            std::vector<uint> m_instruction_function;
+            uint m_last_address = 0;
+            size_t m_last_pc = 0;
+            bool m_truncated = false;
+    };
+}
+
+#endif // MEMORY_TRACER_HPP
@@ -0,0 +1,1944 @@
+// Local includes
+#include "Optimizer.hpp"
+#include "ControlFlowGraph.hpp"
+#include "Liveness.hpp"
+#include "TacWriter.hpp"
+#include "TacMachine.hpp"
+#include "Application.hpp"
+
+// C++ includes
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <climits>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <tuple>
+
+using namespace TacRunner;
+
+namespace
+{
+    // Amount of stores remembered while looking for dead stores in a block
+    const size_t MAX_PENDING_STORES = 64;
+
+    bool is_jump(Instr instr)
+    {
+        return instr == Instr::GOTO || instr == Instr::GOIF || instr == Instr::GOIFNOT;
+    }
+
+    bool is_binary(Instr instr)
+    {
+        switch (instr)
+        {
+        case Instr::ADD: case Instr::SUB: case Instr::MULT: case Instr::DIV: case Instr::MOD:
+        case Instr::EQ: case Instr::NEQ: case Instr::AND: case Instr::OR:
+        case Instr::LT: case Instr::LEQ: case Instr::GT: case Instr::GEQ:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // The machine treats registers starting with 'f' as floats in arithmetic
+    bool is_float_register(const std::string& name)
+    {
+        return !name.empty() && name[0] == 'f';
+    }
+
+    bool is_plain_variable(const Value& value)
+    {
+        return value.is<Variable>() && !value.get<Variable>().is_access;
+    }
+
+    // Word stored in a register by assignw with a constant, or read as a value by other instructions
+    bool word_constant(const Value& value, REGISTER_TYPE& out_bits)
+    {
+        if (value.is<int>())
+            out_bits = (REGISTER_TYPE) value.get<int>();
+        else if (value.is<char>())
+            out_bits = (REGISTER_TYPE) value.get<char>();
+        else if (value.is<bool>())
+            out_bits = (REGISTER_TYPE) value.get<bool>();
+        else if (value.is<float>())
+        {
+            auto const f = value.get<float>();
+            std::memcpy(&out_bits, &f, sizeof(out_bits));
+        }
+        else
+            return false;
+
+        return true;
+    }
+
+    // Word stored in a register by assignb with a constant, only its first byte
+    bool byte_constant(const Value& value, REGISTER_TYPE& out_bits)
+    {
+        if (!word_constant(value, out_bits))
+            return false;
+
+        out_bits &= 0xff;
+        return true;
+    }
+
+    // Constant operand of a binary operation, only ints and chars are valid non float operands
+    bool operand_constant(const Value& value, REGISTER_TYPE& out_bits)
+    {
+        if (value.is<int>())
+            out_bits = (REGISTER_TYPE) value.get<int>();
+        else if (value.is<char>())
+            out_bits = (unsigned char) value.get<char>();
+        else
+            return false;
+
+        return true;
+    }
+
+    // Compute a binary operation over non float operands as the machine does. Operations that
+    // would fail at run time are not computed
+    bool fold_binary(Instr instr, REGISTER_TYPE l, REGISTER_TYPE r, REGISTER_TYPE& out_result)
+    {
+        auto const li = (int) l, ri = (int) r;
+        switch (instr)
+        {
+        case Instr::ADD:  out_result = l + r; break;
+        case Instr::SUB:  out_result = l - r; break;
+        case Instr::MULT: out_result = l * r; break;
+        case Instr::DIV:
+        case Instr::MOD:
+            if (ri == 0 || (li == INT_MIN && ri == -1))
+                return false;
+            out_result = (REGISTER_TYPE) (instr == Instr::DIV ? li / ri : li % ri);
+            break;
+        case Instr::EQ:  out_result = l == r; break;
+        case Instr::NEQ: out_result = l != r; break;
+        case Instr::AND: out_result = l && r; break;
+        case Instr::OR:  out_result = l || r; break;
+        case Instr::LT:  out_result = li < ri; break;
+        case Instr::LEQ: out_result = li <= ri; break;
+        case Instr::GT:  out_result = li > ri; break;
+        case Instr::GEQ: out_result = li >= ri; break;
+        default:
+            return false;
+        }
+
+        return true;
+    }
+
+    // Tells if an argument position can hold a constant instead of a register
+    bool accepts_constant(Instr instr, size_t position)
+    {
+        switch (instr)
+        {
+        case Instr::ASSIGNW: case Instr::ASSIGNB:
+        case Instr::MINUS: case Instr::NEG: case Instr::ITOF: case Instr::FTOI:
+        case Instr::MALLOC: case Instr::PARAM: case Instr::GOIF: case Instr::GOIFNOT:
+            return position == 1;
+        case Instr::MEMCPY:
+            return position == 2;
+        case Instr::RETURN:
+            return position == 0;
+        default:
+            return is_binary(instr) && (position == 1 || position == 2);
+        }
+    }
+
+    // Instructions whose only effect is writing their register
+    bool is_removable(const Tac& tac)
+    {
+        if (tac.defined_variable() == nullptr)
+            return false;
+
+        switch (tac.instr())
+        {
+        case Instr::ASSIGNW: case Instr::ASSIGNB:
+        case Instr::ADD: case Instr::SUB: case Instr::MULT:
+        case Instr::EQ: case Instr::NEQ: case Instr::AND: case Instr::OR:
+        case Instr::LT: case Instr::LEQ: case Instr::GT: case Instr::GEQ:
+        case Instr::MINUS: case Instr::NEG: case Instr::ITOF: case Instr::FTOI:
+        case Instr::PARAM:
+            return true;
+        case Instr::DIV: case Instr::MOD:
+        {
+            // Division by zero is an error, keep it unless the divisor is known
+            REGISTER_TYPE divisor;
+            return operand_constant(tac.args()[2], divisor) && divisor != 0 && (int) divisor != -1;
+        }
+        default:
+            return false;
+        }
+    }
+
+    // Instructions that might read or write memory, besides stores
+    bool may_access_memory(const Tac& tac)
+    {
+        auto const& args = tac.args();
+        switch (tac.instr())
+        {
+        case Instr::ASSIGNW: case Instr::ASSIGNB:
+            return args[1].is<Variable>() && args[1].get<Variable>().is_access;
+        case Instr::PARAM:
+            return args[0].get<Variable>().is_access;
+        case Instr::ADD: case Instr::SUB: case Instr::MULT: case Instr::DIV: case Instr::MOD:
+        case Instr::EQ: case Instr::NEQ: case Instr::AND: case Instr::OR:
+        case Instr::LT: case Instr::LEQ: case Instr::GT: case Instr::GEQ:
+        case Instr::MINUS: case Instr::NEG: case Instr::ITOF: case Instr::FTOI:
+        case Instr::GOTO: case Instr::GOIF: case Instr::GOIFNOT: case Instr::METALABEL:
+        case Instr::PRINTI: case Instr::PRINTF: case Instr::PRINTC:
+        case Instr::READI: case Instr::READF: case Instr::READC:
+            return false;
+        default:
+            return true;
+        }
+    }
+
+    /**
+     * @brief Known value of a register: a constant, or a copy of another register
+     *
+     */
+    struct Fact
+    {
+        bool is_constant;
+        REGISTER_TYPE bits;
+        std::string copy;
+    };
+
+    /**
+     * @brief Facts known at some point of a block
+     *
+     */
+    class Facts
+    {
+        public:
+            const Fact* find(const std::string& name) const
+            {
+                auto it = m_facts.find(name);
+                return it == m_facts.end() ? nullptr : &it->second;
+            }
+
+            void set_constant(const std::string& name, REGISTER_TYPE bits)
+            {
+                m_facts[name] = Fact{true, bits, ""};
+            }
+
+            void set_copy(const std::string& name, const std::string& source)
+            {
+                m_facts[name] = Fact{false, 0, source};
+                m_copies[source].push_back(name);
+            }
+
+            // Forget everything about a register, and registers copied from it
+            void kill(const std::string& name)
+            {
+                m_facts.erase(name);
+
+                auto it = m_copies.find(name);
+                if (it == m_copies.end())
+                    return;
+
+                for (auto const& copy : it->second)
+                {
+                    auto fact = m_facts.find(copy);
+                    if (fact != m_facts.end() && !fact->second.is_constant && fact->second.copy == name)
+                        m_facts.erase(fact);
+                }
+                m_copies.erase(it);
+            }
+
+        private:
+            std::unordered_map<std::string, Fact> m_facts;
+            std::unordered_map<std::string, std::vector<std::string>> m_copies; // registers that might be a copy of each register
+    };
+
+    // Tells if an instruction is 'add x BASE k', computing the address of a frame slot
+    bool is_frame_address(const Tac& tac, int& out_offset)
+    {
+        auto const& args = tac.args();
+        if (tac.instr() != Instr::ADD || !is_plain_variable(args[0]) || !is_plain_variable(args[1]) ||
+            args[1].get<Variable>().name != BASE || !args[2].is<int>())
+            return false;
+
+        out_offset = args[2].get<int>();
+        return true;
+    }
+
+    /**
+     * @brief Registers known to hold a frame address, BASE plus some offset
+     *
+     */
+    class FrameAddresses
+    {
+        public:
+            // Offset from BASE stored in a register, if known
+            const int* offset_of(const std::string& name) const
+            {
+                auto it = m_offsets.find(name);
+                return it == m_offsets.end() ? nullptr : &it->second;
+            }
+
+            // First register still holding an offset, which every other register with the same offset is replaced with
+            const std::string* holder_of(int offset) const
+            {
+                auto it = m_holders.find(offset);
+                return it == m_holders.end() ? nullptr : &it->second;
+            }
+
+            void set(const std::string& name, int offset)
+            {
+                m_offsets[name] = offset;
+                m_holders.emplace(offset, name);
+            }
+
+            void kill(const std::string& name)
+            {
+                auto it = m_offsets.find(name);
+                if (it == m_offsets.end())
+                    return;
+
+                auto holder = m_holders.find(it->second);
+                if (holder != m_holders.end() && holder->second == name)
+                    m_holders.erase(holder);
+                m_offsets.erase(it);
+            }
+
+            void clear()
+            {
+                m_offsets.clear();
+                m_holders.clear();
+            }
+
+        private:
+            std::unordered_map<std::string, int> m_offsets;
+            std::unordered_map<int, std::string> m_holders;
+    };
+
+    // Frame slot read by 'assignw x BASE[k]' or 'assignb x BASE[k]'
+    bool is_frame_load(const Tac& tac, int& out_offset)
+    {
+        auto const& args = tac.args();
+        if ((tac.instr() != Instr::ASSIGNW && tac.instr() != Instr::ASSIGNB) || !is_plain_variable(args[0]) || !args[1].is<Variable>())
+            return false;
+
+        auto const& source = args[1].get<Variable>();
+        if (source.name != BASE || !source.is_access || !std::holds_alternative<int>(source.index))
+            return false;
+
+        out_offset = std::get<int>(source.index);
+        return true;
+    }
+
+    // Frame slot written by an instruction, returns the amount of bytes written or 0 if it doesn't write one
+    uint frame_store(const Tac& tac, int& out_offset)
+    {
+        auto const& args = tac.args();
+        if (args.empty() || !args[0].is<Variable>() || tac.instr() == Instr::RETURN ||
+            tac.instr() == Instr::PRINTI || tac.instr() == Instr::PRINTF || tac.instr() == Instr::PRINTC || tac.instr() == Instr::PRINT)
+            return 0;
+
+        auto const& var = args[0].get<Variable>();
+        if (var.name != BASE || !var.is_access || !std::holds_alternative<int>(var.index))
+            return 0;
+
+        out_offset = std::get<int>(var.index);
+        return tac.instr() == Instr::ASSIGNB ? 1 : WORD_SIZE;
+    }
+
+    /**
+     * @brief Graphs where some label is the target of a jump from another graph. Those jumps
+     *        have no edge, so code in such graphs might run without going through their entry
+     *
+     * @param program program used to build the graphs
+     * @param graphs graphs to check
+     * @return std::vector<bool> for every graph, if it's the target of jumps from other graphs
+     */
+    std::vector<bool> foreign_jump_targets(const Program& program, const std::vector<ControlFlowGraph>& graphs)
+    {
+        std::vector<size_t> graph_of(program.size());
+        std::unordered_map<std::string, size_t> label_graph;
+        for (size_t g = 0; g < graphs.size(); g++)
+            for (auto const& block : graphs[g].blocks())
+                for (size_t i = block.begin; i < block.end; i++)
+                {
+                    graph_of[i] = g;
+                    if (program[i].instr() == Instr::METALABEL)
+                        label_graph[program[i].args()[0].get<std::string>()] = g;
+                }
+
+        std::vector<bool> targets(graphs.size(), false);
+        for (size_t i = 0; i < program.size(); i++)
+        {
+            if (!is_jump(program[i].instr()))
+                continue;
+
+            auto it = label_graph.find(program[i].args()[0].get<std::string>());
+            if (it != label_graph.end() && it->second != graph_of[i])
+                targets[it->second] = true;
+        }
+
+        return targets;
+    }
+
+    /**
+     * @brief Frame slots of a function that can only be accessed as BASE[k], because their
+     *        address is never stored in a register. Pointers are computed as BASE plus some offset,
+     *        and might reach any slot after that offset, so only slots before every such offset are private
+     *
+     * @param program program used to build the graph
+     * @param graph function graph
+     * @return int end of the private slots, every slot from 0 to this offset is private
+     */
+    int private_frame_end(const Program& program, const ControlFlowGraph& graph)
+    {
+        auto const& blocks = graph.blocks();
+        if (blocks.empty() || program[blocks[graph.entry()].begin].instr() != Instr::METAFUNBEGIN)
+            return 0;
+
+        int end = program[blocks[graph.entry()].begin].args()[1].get<int>();
+        for (auto const& block : blocks)
+            for (size_t i = block.begin; i < block.end; i++)
+            {
+                auto const& t = program[i];
+                int offset;
+                if (is_frame_address(t, offset))
+                {
+                    end = std::min(end, offset);
+                    continue;
+                }
+
+                for (auto const& arg : t.args())
+                {
+                    if (!arg.is<Variable>())
+                        continue;
+
+                    // BASE copied somewhere, or accessed with an unknown offset
+                    auto const& var = arg.get<Variable>();
+                    bool const is_base_read = var.name == BASE && (!var.is_access || !std::holds_alternative<int>(var.index));
+                    bool const is_base_index = std::holds_alternative<std::string>(var.index) && std::get<std::string>(var.index) == BASE;
+                    if (is_base_read || is_base_index)
+                        return 0;
+                }
+            }
+
+        return std::max(end, 0);
+    }
+
+    /**
+     * @brief Position where instructions should be inserted to run right before entering a loop.
+     *        That's the end of the only block entering the loop from outside, which should fall
+     *        through the loop header
+     *
+     * @param program program used to build the graph
+     * @param graph function graph
+     * @param loop loop to find a preheader for
+     * @param out_position where to store the insertion position
+     * @return true if the loop has a preheader position
+     * @return false otherwise
+     */
+    bool preheader_position(const Program& program, const ControlFlowGraph& graph, const Loop& loop, size_t& out_position)
+    {
+        auto const& blocks = graph.blocks();
+        auto const& header = blocks[loop.header];
+        size_t entering = NO_BLOCK;
+        for (auto p : header.predecessors)
+        {
+            if (std::binary_search(loop.blocks.begin(), loop.blocks.end(), p))
+                continue;
+            if (entering != NO_BLOCK)
+                return false;
+            entering = p;
+        }
+
+        if (entering == NO_BLOCK || blocks[entering].end != header.begin || program[header.begin].instr() != Instr::METALABEL)
+            return false;
+
+        // The entering block should reach the header only by falling through
+        auto const& last = program[blocks[entering].end - 1];
+        if (is_jump(last.instr()) && last.args()[0].get<std::string>() == program[header.begin].args()[0].get<std::string>())
+            return false;
+
+        out_position = header.begin;
+        return true;
+    }
+
+    // Blocks outside a loop reached from blocks inside it
+    std::vector<size_t> loop_exits(const ControlFlowGraph& graph, const Loop& loop)
+    {
+        std::vector<size_t> exits;
+        for (auto b : loop.blocks)
+            for (auto s : graph.blocks()[b].successors)
+                if (!std::binary_search(loop.blocks.begin(), loop.blocks.end(), s) && std::find(exits.begin(), exits.end(), s) == exits.end())
+                    exits.push_back(s);
+
+        return exits;
+    }
+
+    // Amount of times each register is written in some blocks
+    std::unordered_map<std::string, size_t> count_definitions(const Program& program, const ControlFlowGraph& graph, const std::vector<size_t>& blocks)
+    {
+        std::unordered_map<std::string, size_t> definitions;
+        for (auto b : blocks)
+            for (size_t i = graph.blocks()[b].begin; i < graph.blocks()[b].end; i++)
+                if (auto const* def = program[i].defined_variable())
+                    definitions[def->name]++;
+
+        return definitions;
+    }
+
+    // Tells if 'copy' moves the result of 'producer' to another register, so 'producer' could write it there directly
+    bool can_coalesce(const Tac& producer, const Tac& copy, const Liveness& liveness, const RegisterSet& live_after_copy)
+    {
+        auto const& args = copy.args();
+        if (copy.instr() != Instr::ASSIGNW || !is_plain_variable(args[0]) || !is_plain_variable(args[1]))
+            return false;
+
+        // Assignb only writes a byte of its register, so it's not the same in a different register
+        auto const* def = producer.defined_variable();
+        if (def == nullptr || !is_removable(producer) || producer.instr() == Instr::ASSIGNB || producer.instr() == Instr::PARAM)
+            return false;
+
+        auto const& source = args[1].get<Variable>().name;
+        auto const& destination = args[0].get<Variable>().name;
+        if (def->name != source || destination == BASE || destination == STACK)
+            return false;
+
+        // Minus takes float negation from its register name
+        if (is_float_register(source) != is_float_register(destination))
+            return false;
+
+        auto const id = liveness.id_of(source);
+        return id != NO_REGISTER && !live_after_copy.test(id) && !liveness.is_escaping(id);
+    }
+
+    // Blocks where each register is written
+    std::unordered_map<std::string, std::vector<size_t>> definition_blocks(const Program& program, const ControlFlowGraph& graph)
+    {
+        std::unordered_map<std::string, std::vector<size_t>> blocks;
+        for (size_t b = 0; b < graph.blocks().size(); b++)
+            for (size_t i = graph.blocks()[b].begin; i < graph.blocks()[b].end; i++)
+                if (auto const* def = program[i].defined_variable())
+                    blocks[def->name].push_back(b);
+
+        return blocks;
+    }
+
+    // Tells if a register is always written before entering a loop, so reading it before the loop can't fail
+    bool is_defined_before(const ControlFlowGraph& graph, const Loop& loop, const std::unordered_map<std::string, std::vector<size_t>>& definitions, const std::string& name)
+    {
+        if (name == BASE || name == STACK)
+            return true;
+
+        auto it = definitions.find(name);
+        if (it == definitions.end())
+            return false;
+
+        for (auto b : it->second)
+            if (!std::binary_search(loop.blocks.begin(), loop.blocks.end(), b) && graph.dominates(b, loop.header))
+                return true;
+
+        return false;
+    }
+
+    /**
+     * @brief Memory position written by a store
+     *
+     */
+    struct Store
+    {
+        std::string base;
+        Access index;
+        uint width;
+    };
+
+    /**
+     * @brief Function whose body can be copied into its callers
+     *
+     */
+    struct InlineCandidate
+    {
+        size_t begin;       // position of its @function
+        size_t end;         // position of its @endfunction
+        int frame_size;
+    };
+
+    // Position of the @endfunction closing the function starting at 'begin', or program.size() if missing
+    size_t function_end(const Program& program, size_t begin)
+    {
+        size_t end = begin + 1;
+        while (end < program.size() && program[end].instr() != Instr::METAFUNEND)
+            end++;
+
+        return end;
+    }
+
+    /**
+     * @brief Tells if a function body can be copied into its callers: it's a leaf with at most 'threshold'
+     *        instructions, and BASE is only used as BASE[k] or in 'add x BASE k', so moving its frame
+     *        to a fixed offset in the caller's frame only changes constants
+     *
+     * @param program program the function belongs to
+     * @param begin position of its @function
+     * @param end position of its @endfunction
+     * @param threshold maximum body size, labels not included
+     * @return true if it can be inlined
+     */
+    bool can_inline(const Program& program, size_t begin, size_t end, uint threshold)
+    {
+        if (end >= program.size())
+            return false;
+
+        uint size = 0;
+        for (size_t i = begin + 1; i < end; i++)
+        {
+            auto const& t = program[i];
+            switch (t.instr())
+            {
+            case Instr::CALL: case Instr::PARAM: case Instr::METAFUNBEGIN:
+            case Instr::METASTATICV: case Instr::METASTRING:
+                return false;
+            case Instr::METALABEL:
+                continue;
+            default:
+                break;
+            }
+
+            if (++size > threshold)
+                return false;
+
+            int offset;
+            if (is_frame_address(t, offset))
+                continue;
+
+            for (auto const& arg : t.args())
+            {
+                if (!arg.is<Variable>())
+                    continue;
+
+                auto const& var = arg.get<Variable>();
+                bool const is_index = std::holds_alternative<std::string>(var.index);
+                if (var.name == STACK || (is_index && (std::get<std::string>(var.index) == BASE || std::get<std::string>(var.index) == STACK)))
+                    return false;
+                if (var.name == BASE && (!var.is_access || is_index))
+                    return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+uint Optimizer::optimize(Program& program)
+{
+    m_stats = Stats();
+    m_stats.original_size = program.size();
+
+    // Inlining runs once, later passes clean up inlined bodies
+    if (m_level >= 2 && m_inline_threshold > 0 && inline_calls(program) == FAIL)
+        return FAIL;
+
+    for (uint round = 0; m_level > 0 && round < MAX_OPTIMIZATION_ROUNDS; round++)
+    {
+        auto const changes = m_stats.total();
+
+        thread_jumps(program);
+        if (remove_unreachable_code(program) == FAIL || propagate(program) == FAIL || number_frame_addresses(program) == FAIL)
+            return FAIL;
+
+        if (m_level >= 2 && (eliminate_dead_code(program) == FAIL || eliminate_dead_stores(program) == FAIL))
+            return FAIL;
+
+        if (m_level >= 2 && (promote_frame_slots(program) == FAIL || hoist_loop_invariants(program) == FAIL || reduce_strength(program) == FAIL))
+            return FAIL;
+
+        if (m_stats.total() == changes)
+            break;
+    }
+
+    m_stats.final_size = program.size();
+    return SUCCESS;
+}
+
+uint Optimizer::inline_calls(Program& program)
+{
+    std::vector<ControlFlowGraph> graphs;
+    if (ControlFlowGraph::build(program, graphs) == FAIL)
+        return FAIL;
+
+    std::vector<Liveness> liveness;
+    Liveness::compute(program, graphs, liveness);
+
+    // Small leaf functions reading no register from their callers
+    std::unordered_map<std::string, InlineCandidate> candidates;
+    for (size_t g = 0; g < graphs.size(); g++)
+    {
+        auto const& blocks = graphs[g].blocks();
+        if (blocks.empty() || program[blocks[graphs[g].entry()].begin].instr() != Instr::METAFUNBEGIN)
+            continue;
+
+        auto const begin = blocks[graphs[g].entry()].begin;
+        auto const end = function_end(program, begin);
+        auto const& entry_live = liveness[g].live_in(graphs[g].entry());
+        if (entry_live.count() != 0 || !can_inline(program, begin, end, m_inline_threshold))
+            continue;
+
+        candidates[graphs[g].name()] = InlineCandidate{begin, end, program[begin].args()[1].get<int>()};
+    }
+
+    if (candidates.empty())
+        return SUCCESS;
+
+    std::vector<bool> removed(program.size(), false);
+    std::vector<std::pair<size_t, Tac>> inserted;
+    for (size_t g = 0; g < graphs.size(); g++)
+    {
+        auto const& blocks = graphs[g].blocks();
+        if (blocks.empty() || program[blocks[graphs[g].entry()].begin].instr() != Instr::METAFUNBEGIN)
+            continue;
+
+        // Inlined frames go right after the caller's frame, they never overlap as inlined functions are leaves
+        auto const caller_begin = blocks[graphs[g].entry()].begin;
+        auto const frame_offset = program[caller_begin].args()[1].get<int>();
+        int extra_frame = 0;
+        for (auto const& block : blocks)
+            for (size_t i = block.begin; i < block.end; i++)
+            {
+                auto const& call = program[i];
+                if (call.instr() != Instr::CALL)
+                    continue;
+
+                auto const& callee_name = call.args()[1].get<std::string>();
+                auto it = candidates.find(callee_name);
+                if (it == candidates.end() || it->second.begin == caller_begin)
+                    continue;
+
+                // Arguments are pushed right before the call, they should be written into the inlined frame instead
+                std::vector<size_t> params;
+                bool valid_params = true;
+                for (size_t j = i; j-- > block.begin && program[j].instr() != Instr::CALL;)
+                    if (program[j].instr() == Instr::PARAM)
+                    {
+                        params.push_back(j);
+                        valid_params &= is_plain_variable(program[j].args()[0]) && program[j].args()[1].is<int>();
+                    }
+
+                if (!valid_params)
+                    continue;
+
+                for (auto j : params)
+                {
+                    auto const& args = program[j].args();
+                    program[j] = Tac(Instr::ADD, args[0], Value(Variable{BASE, 0, false}), Value(frame_offset + args[1].get<int>()));
+                }
+
+                // Copy the body with new registers and labels, returns write the call result and leave the body
+                auto const& callee = it->second;
+                auto const& result = call.args()[0];
+                auto const end_label = new_register("_inline_end");
+                std::unordered_map<std::string, std::string> renamed;
+                auto rename = [&](const std::string& name) -> const std::string& {
+                    auto& new_name = renamed[name];
+                    if (new_name.empty())
+                        new_name = new_register(name);
+                    return new_name;
+                };
+
+                for (size_t k = callee.begin + 1; k < callee.end; k++)
+                {
+                    auto t = program[k];
+                    auto& args = t.args();
+                    if (t.instr() == Instr::METALABEL || is_jump(t.instr()))
+                        args[0] = Value(rename(args[0].get<std::string>()));
+
+                    int offset;
+                    if (is_frame_address(t, offset))
+                        args[2] = Value(frame_offset + offset);
+
+                    for (auto& arg : args)
+                    {
+                        if (!arg.is<Variable>())
+                            continue;
+
+                        auto var = arg.get<Variable>();
+                        if (var.name == BASE && var.is_access)
+                            var.index = frame_offset + std::get<int>(var.index);
+                        else if (var.name != BASE)
+                            var.name = rename(var.name);
+
+                        if (std::holds_alternative<std::string>(var.index))
+                            var.index = rename(std::get<std::string>(var.index));
+
+                        arg = Value(var);
+                    }
+
+                    if (t.instr() == Instr::RETURN)
+                    {
+                        inserted.emplace_back(i, Tac(Instr::ASSIGNW, result, args[0]));
+                        inserted.emplace_back(i, Tac(Instr::GOTO, Value(end_label)));
+                    }
+                    else
+                        inserted.emplace_back(i, std::move(t));
+                }
+
+                inserted.emplace_back(i, Tac(Instr::METALABEL, Value(end_label)));
+                removed[i] = true;
+                extra_frame = std::max(extra_frame, callee.frame_size);
+
+                std::stringstream ss;
+                ss << graphs[g].name() << ": " << callee_name << " at instruction " << i;
+                m_stats.inlined_calls.push_back(ss.str());
+                m_stats.inlined++;
+            }
+
+        // Grow the caller's frame to hold inlined frames
+        if (extra_frame > 0)
+        {
+            auto const caller_end = function_end(program, caller_begin);
+            program[caller_begin].args()[1] = Value(frame_offset + extra_frame);
+            if (caller_end < program.size() && !program[caller_end].args().empty())
+                program[caller_end].args()[0] = Value(frame_offset + extra_frame);
+        }
+    }
+
+    compact(program, removed, inserted);
+    return SUCCESS;
+}
+
+std::string Optimizer::report() const
+{
+    std::stringstream ss;
+    ss << "Optimized program (-O" << m_level << "): " << m_stats.original_size << " -> " << m_stats.final_size << " instructions" << std::endl;
+    ss << "\tinlined calls: " << m_stats.inlined << std::endl;
+    for (auto const& call : m_stats.inlined_calls)
+        ss << "\t\t" << call << std::endl;
+    ss << "\tthreaded jumps: " << m_stats.threaded_jumps << std::endl;
+    ss << "\tremoved jumps: " << m_stats.removed_jumps << std::endl;
+    ss << "\tremoved labels: " << m_stats.removed_labels << std::endl;
+    ss << "\tunreachable instructions: " << m_stats.unreachable << std::endl;
+    ss << "\tpropagated registers: " << m_stats.propagated << std::endl;
+    ss << "\tfolded instructions: " << m_stats.folded << std::endl;
+    ss << "\tremoved frame addresses: " << m_stats.frame_addresses << std::endl;
+    for (auto const& [function, count] : m_stats.frame_addresses_per_function)
+        ss << "\t\t" << function << ": " << count << std::endl;
+    ss << "\tpromoted frame slots: " << m_stats.promoted_slots << std::endl;
+    ss << "\thoisted instructions: " << m_stats.hoisted << std::endl;
+    ss << "\tstrength reduced instructions: " << m_stats.reduced << std::endl;
+    ss << "\tdead instructions: " << m_stats.dead_code << std::endl;
+    ss << "\tcoalesced copies: " << m_stats.coalesced << std::endl;
+    ss << "\tdead stores: " << m_stats.dead_stores;
+
+    return ss.str();
+}
+
+void Optimizer::thread_jumps(Program& program)
+{
+    // Label positions and the function of every instruction, 0 for the global scope
+    std::unordered_map<std::string, size_t> labels;
+    std::vector<size_t> function_of(program.size());
+    size_t function = 0, n_functions = 0;
+    for (size_t i = 0; i < program.size(); i++)
+    {
+        auto const& t = program[i];
+        if (t.instr() == Instr::METAFUNBEGIN)
+            function = ++n_functions;
+        else if (t.instr() == Instr::METALABEL)
+            labels[t.args()[0].get<std::string>()] = i;
+
+        function_of[i] = function;
+        if (t.instr() == Instr::METAFUNEND)
+            function = 0;
+    }
+
+    // First position after 'i' that is not a label
+    auto skip_labels = [&program](size_t i) {
+        while (i < program.size() && program[i].instr() == Instr::METALABEL)
+            i++;
+        return i;
+    };
+
+    // Final destination of a label, following labels placed right before a goto
+    std::unordered_map<std::string, std::string> destinations;
+    auto destination = [&](const std::string& label) {
+        std::vector<std::string> chain;
+        std::unordered_set<std::string> seen;
+        std::string current = label;
+        while (true)
+        {
+            auto known = destinations.find(current);
+            if (known != destinations.end())
+            {
+                current = known->second;
+                break;
+            }
+
+            // Stop at undefined labels and goto cycles
+            auto it = labels.find(current);
+            if (it == labels.end() || !seen.insert(current).second)
+                break;
+
+            chain.push_back(current);
+            auto const next = skip_labels(it->second + 1);
+            if (next == program.size() || program[next].instr() != Instr::GOTO || function_of[next] != function_of[it->second])
+                break;
+
+            current = program[next].args()[0].get<std::string>();
+        }
+
+        for (auto const& l : chain)
+            destinations[l] = current;
+
+        return current;
+    };
+
+    // Tells if jumping to a label is the same as going to the instruction after 'i'
+    auto is_next = [&](size_t i, const std::string& label) {
+        auto it = labels.find(label);
+        return it != labels.end() && it->second > i && skip_labels(i + 1) > it->second;
+    };
+
+    std::vector<bool> removed(program.size(), false);
+    for (size_t i = 0; i < program.size(); i++)
+    {
+        auto& t = program[i];
+        if (removed[i] || !is_jump(t.instr()))
+            continue;
+
+        auto& label = t.args()[0].get<std::string>();
+        auto const target = destination(label);
+        if (target != label)
+        {
+            label = target;
+            m_stats.threaded_jumps++;
+        }
+
+        // Conditional jumps with constant conditions are either gotos or nothing
+        REGISTER_TYPE condition;
+        if (t.instr() != Instr::GOTO && word_constant(t.args()[1], condition))
+        {
+            if ((condition != 0) == (t.instr() == Instr::GOIF))
+                t = Tac(Instr::GOTO, t.args()[0]);
+            else
+            {
+                removed[i] = true;
+                m_stats.removed_jumps++;
+                continue;
+            }
+        }
+
+        // Jumps to the next instruction do nothing
+        if (is_next(i, target))
+        {
+            removed[i] = true;
+            m_stats.removed_jumps++;
+            continue;
+        }
+
+        // 'goif L1 x; goto L2; @label L1' is 'goifnot L2 x; @label L1'
+        if (t.instr() != Instr::GOTO && i + 1 < program.size() && program[i + 1].instr() == Instr::GOTO && is_next(i + 1, target))
+        {
+            auto const instr = t.instr() == Instr::GOIF ? Instr::GOIFNOT : Instr::GOIF;
+            t = Tac(instr, Value(destination(program[i + 1].args()[0].get<std::string>())), t.args()[1]);
+            removed[i + 1] = true;
+            m_stats.removed_jumps++;
+        }
+    }
+
+    // Remove labels no longer used
+    std::unordered_set<std::string> used_labels;
+    for (size_t i = 0; i < program.size(); i++)
+    {
+        auto const& t = program[i];
+        if (!removed[i] && is_jump(t.instr()))
+            used_labels.insert(t.args()[0].get<std::string>());
+        else if (t.instr() == Instr::CALL)
+            used_labels.insert(t.args()[1].get<std::string>());
+    }
+
+    for (size_t i = 0; i < program.size(); i++)
+    {
+        auto const& t = program[i];
+        if (t.instr() == Instr::METALABEL && used_labels.count(t.args()[0].get<std::string>()) == 0)
+        {
+            removed[i] = true;
+            m_stats.removed_labels++;
+        }
+    }
+
+    compact(program, removed);
+}
+
+uint Optimizer::remove_unreachable_code(Program& program)
+{
+    std::vector<ControlFlowGraph> graphs;
+    if (ControlFlowGraph::build(program, graphs) == FAIL)
+        return FAIL;
+
+    // Reachability is unknown for graphs with jumps from other graphs
+    auto const unknown_reachability = foreign_jump_targets(program, graphs);
+
+    std::vector<bool> removed(program.size(), false);
+    for (size_t g = 0; g < graphs.size(); g++)
+    {
+        if (unknown_reachability[g])
+            continue;
+
+        auto const& blocks = graphs[g].blocks();
+        std::vector<bool> reachable(blocks.size(), false);
+        for (auto b : graphs[g].reverse_postorder())
+            reachable[b] = true;
+
+        for (size_t b = 0; b < blocks.size(); b++)
+        {
+            if (reachable[b])
+                continue;
+
+            for (size_t i = blocks[b].begin; i < blocks[b].end; i++)
+            {
+                auto const instr = program[i].instr();
+                if (instr == Instr::METAFUNBEGIN || instr == Instr::METAFUNEND || instr == Instr::METASTATICV || instr == Instr::METASTRING)
+                    continue;
+
+                removed[i] = true;
+                m_stats.unreachable++;
+            }
+        }
+    }
+
+    compact(program, removed);
+    return SUCCESS;
+}
+
+uint Optimizer::propagate(Program& program)
+{
+    std::vector<ControlFlowGraph> graphs;
+    if (ControlFlowGraph::build(program, graphs) == FAIL)
+        return FAIL;
+
+    std::vector<bool> removed(program.size(), false);
+
+    // Replace registers read by an instruction with their known values
+    auto substitute = [this](Tac& t, const auto& facts) {
+        auto const* def = t.defined_variable();
+        auto& args = t.args();
+        for (size_t k = 0; k < args.size(); k++)
+        {
+            if (!args[k].is<Variable>())
+                continue;
+
+            auto& var = args[k].get<Variable>();
+            if (std::holds_alternative<std::string>(var.index))
+                if (auto const* fact = facts(std::get<std::string>(var.index)))
+                {
+                    if (fact->is_constant)
+                        var.index = (int) fact->bits;
+                    else
+                        var.index = fact->copy;
+                    m_stats.propagated++;
+                }
+
+            if (&var == def)
+                continue;
+
+            auto const* fact = facts(var.name);
+            if (fact == nullptr)
+                continue;
+
+            if (!fact->is_constant)
+            {
+                var.name = fact->copy;
+                m_stats.propagated++;
+                continue;
+            }
+
+            if (var.is_access || !accepts_constant(t.instr(), k))
+                continue;
+
+            if (t.instr() != Instr::ASSIGNB)
+                args[k] = Value((int) fact->bits);
+            else
+            {
+                // Byte constants are written as chars: moves copy the whole register, so it should fit in a char
+                auto const byte = fact->bits & 0xff;
+                bool const is_store = args[0].get<Variable>().is_access;
+                if ((!is_store && byte != fact->bits) || byte >= 128 || !TacWriter::can_write((char) byte))
+                    continue;
+
+                args[k] = Value((char) byte);
+            }
+            m_stats.propagated++;
+        }
+    };
+
+    // Compute instructions with constant operands. Returns true when the instruction should be removed
+    auto fold = [this](Tac& t) {
+        auto const& args = t.args();
+        REGISTER_TYPE l = 0, r = 0, result;
+        if (is_binary(t.instr()))
+        {
+            bool const l_constant = operand_constant(args[1], l);
+            bool const r_constant = operand_constant(args[2], r);
+            if (l_constant && r_constant && fold_binary(t.instr(), l, r, result))
+            {
+                t = Tac(Instr::ASSIGNW, args[0], Value((int) result));
+                m_stats.folded++;
+                return false;
+            }
+
+            // x + 0, x - 0, x * 1 and 0 + x, 1 * x are copies
+            REGISTER_TYPE const neutral = t.instr() == Instr::MULT ? 1 : 0;
+            bool const is_additive = t.instr() == Instr::ADD || t.instr() == Instr::SUB;
+            if ((is_additive || t.instr() == Instr::MULT) && r_constant && r == neutral &&
+                is_plain_variable(args[1]) && !is_float_register(args[1].get<Variable>().name))
+            {
+                t = Tac(Instr::ASSIGNW, args[0], args[1]);
+                m_stats.folded++;
+            }
+            else if ((t.instr() == Instr::ADD || t.instr() == Instr::MULT) && l_constant && l == neutral &&
+                     is_plain_variable(args[2]) && !is_float_register(args[2].get<Variable>().name))
+            {
+                t = Tac(Instr::ASSIGNW, args[0], args[2]);
+                m_stats.folded++;
+            }
+
+            return false;
+        }
+
+        switch (t.instr())
+        {
+        case Instr::MINUS:
+        case Instr::NEG:
+        case Instr::ITOF:
+        {
+            if (!word_constant(args[1], l))
+                return false;
+
+            if (t.instr() == Instr::NEG)
+                result = !l;
+            else if (t.instr() == Instr::MINUS && is_float_register(args[0].get<Variable>().name))
+                result = l ^ 0x80000000; // float negation only flips the sign bit
+            else if (t.instr() == Instr::MINUS)
+                result = (REGISTER_TYPE) 0 - l;
+            else
+            {
+                float const f = (float) (int) l;
+                std::memcpy(&result, &f, sizeof(result));
+            }
+
+            t = Tac(Instr::ASSIGNW, args[0], Value((int) result));
+            m_stats.folded++;
+            return false;
+        }
+        case Instr::GOIF:
+        case Instr::GOIFNOT:
+            if (!word_constant(args[1], l))
+                return false;
+
+            m_stats.folded++;
+            if ((l != 0) == (t.instr() == Instr::GOIF))
+            {
+                t = Tac(Instr::GOTO, args[0]);
+                return false;
+            }
+            return true;
+        case Instr::ASSIGNW:
+        case Instr::ASSIGNB:
+        {
+            // Moving a register to itself does nothing
+            bool const is_self_move = is_plain_variable(args[0]) && is_plain_variable(args[1]) &&
+                                      args[0].get<Variable>().name == args[1].get<Variable>().name;
+            if (is_self_move)
+                m_stats.folded++;
+            return is_self_move;
+        }
+        default:
+            return false;
+        }
+    };
+
+    // Learn the value written by an instruction
+    auto record = [](const Tac& t, Facts& facts) {
+        auto const* def = t.defined_variable();
+        if (def == nullptr)
+            return;
+
+        auto const& name = def->name;
+        facts.kill(name);
+        if (name == BASE || name == STACK || is_float_register(name))
+            return;
+
+        if (t.instr() != Instr::ASSIGNW && t.instr() != Instr::ASSIGNB)
+            return;
+
+        auto const& value = t.args()[1];
+        REGISTER_TYPE bits;
+        if (t.instr() == Instr::ASSIGNW && word_constant(value, bits))
+            facts.set_constant(name, bits);
+        else if (t.instr() == Instr::ASSIGNB && byte_constant(value, bits))
+            facts.set_constant(name, bits);
+        else if (is_plain_variable(value))
+        {
+            auto const& source = value.get<Variable>().name;
+            if (source != name && source != STACK && !is_float_register(source))
+                facts.set_copy(name, source);
+        }
+    };
+
+    for (auto const& graph : graphs)
+    {
+        auto const& blocks = graph.blocks();
+        std::vector<Facts> exit_facts(blocks.size());
+        std::vector<bool> has_exit_facts(blocks.size(), false);
+
+        // Registers written once in the function with a constant have that value in every block dominated by it
+        std::unordered_map<std::string, std::pair<Fact, size_t>> constants; // register -> (value, block)
+        std::unordered_map<std::string, size_t> definitions;
+        for (size_t b = 0; b < blocks.size(); b++)
+            for (size_t i = blocks[b].begin; i < blocks[b].end; i++)
+                if (auto const* def = program[i].defined_variable())
+                {
+                    Facts single;
+                    record(program[i], single);
+                    auto const* fact = single.find(def->name);
+                    if (definitions[def->name]++ == 0 && fact != nullptr && fact->is_constant)
+                        constants[def->name] = std::make_pair(*fact, b);
+                    else
+                        constants.erase(def->name);
+                }
+
+        for (auto b : graph.reverse_postorder())
+        {
+            // Blocks with a single predecessor start with the facts known when it ends
+            Facts facts;
+            auto const& predecessors = blocks[b].predecessors;
+            if (predecessors.size() == 1 && has_exit_facts[predecessors[0]])
+                facts = exit_facts[predecessors[0]];
+
+            auto const known = [&facts, &constants, &graph, b](const std::string& name) -> const Fact* {
+                if (auto const* fact = facts.find(name))
+                    return fact;
+
+                auto it = constants.find(name);
+                if (it == constants.end() || it->second.second == b || !graph.dominates(it->second.second, b))
+                    return nullptr;
+
+                return &it->second.first;
+            };
+
+            for (size_t i = blocks[b].begin; i < blocks[b].end; i++)
+            {
+                auto& t = program[i];
+                substitute(t, known);
+                if (fold(t))
+                {
+                    removed[i] = true;
+                    continue;
+                }
+                record(t, facts);
+            }
+
+            for (auto s : blocks[b].successors)
+                if (blocks[s].predecessors.size() == 1)
+                {
+                    exit_facts[b] = std::move(facts);
+                    has_exit_facts[b] = true;
+                    break;
+                }
+        }
+    }
+
+    compact(program, removed);
+    return SUCCESS;
+}
+
+uint Optimizer::number_frame_addresses(Program& program)
+{
+    std::vector<ControlFlowGraph> graphs;
+    if (ControlFlowGraph::build(program, graphs) == FAIL)
+        return FAIL;
+
+    // Rewrite registers holding frame addresses read by an instruction
+    auto substitute = [this](Tac& t, const FrameAddresses& addresses) {
+        auto const* def = t.defined_variable();
+        for (auto& arg : t.args())
+        {
+            if (!arg.is<Variable>())
+                continue;
+
+            auto& var = arg.get<Variable>();
+            if (&var == def)
+                continue;
+
+            auto const* offset = addresses.offset_of(var.name);
+            if (offset == nullptr)
+                continue;
+
+            // x[j] with x = BASE + k is BASE[k + j]
+            if (var.is_access && std::holds_alternative<int>(var.index))
+            {
+                var.index = *offset + std::get<int>(var.index);
+                var.name = BASE;
+                m_stats.propagated++;
+                continue;
+            }
+
+            auto const* holder = addresses.holder_of(*offset);
+            if (holder != nullptr && *holder != var.name)
+            {
+                var.name = *holder;
+                m_stats.propagated++;
+            }
+        }
+    };
+
+    // Learn the frame address written by an instruction
+    auto record = [](const Tac& t, FrameAddresses& addresses) {
+        auto const* def = t.defined_variable();
+        if (def == nullptr)
+            return;
+
+        auto const& name = def->name;
+        if (name == BASE)
+        {
+            addresses.clear();
+            return;
+        }
+
+        addresses.kill(name);
+        if (name == STACK || is_float_register(name))
+            return;
+
+        int offset;
+        auto const& args = t.args();
+        if (is_frame_address(t, offset))
+            addresses.set(name, offset);
+        else if (t.instr() == Instr::ASSIGNW && is_plain_variable(args[1]))
+            if (auto const* source_offset = addresses.offset_of(args[1].get<Variable>().name))
+                addresses.set(name, *source_offset);
+    };
+
+    for (auto const& graph : graphs)
+    {
+        auto const& blocks = graph.blocks();
+        std::vector<FrameAddresses> exit_addresses(blocks.size());
+        std::vector<bool> has_exit_addresses(blocks.size(), false);
+
+        for (auto b : graph.reverse_postorder())
+        {
+            // Blocks with a single predecessor start with the addresses known when it ends
+            FrameAddresses addresses;
+            auto const& predecessors = blocks[b].predecessors;
+            if (predecessors.size() == 1 && has_exit_addresses[predecessors[0]])
+                addresses = exit_addresses[predecessors[0]];
+
+            for (size_t i = blocks[b].begin; i < blocks[b].end; i++)
+            {
+                substitute(program[i], addresses);
+                record(program[i], addresses);
+            }
+
+            for (auto s : blocks[b].successors)
+                if (blocks[s].predecessors.size() == 1)
+                {
+                    exit_addresses[b] = std::move(addresses);
+                    has_exit_addresses[b] = true;
+                    break;
+                }
+        }
+    }
+
+    // Address computations whose registers are no longer read can be removed now
+    std::vector<Liveness> liveness;
+    Liveness::compute(program, graphs, liveness);
+
+    std::vector<bool> removed(program.size(), false);
+    for (size_t g = 0; g < graphs.size(); g++)
+    {
+        auto const& blocks = graphs[g].blocks();
+        auto const& live_registers = liveness[g];
+        size_t function_removed = 0;
+        for (size_t b = 0; b < blocks.size(); b++)
+        {
+            auto live = live_registers.live_out(b);
+            for (size_t i = blocks[b].end; i --> blocks[b].begin;)
+            {
+                auto const& t = program[i];
+                int offset;
+                if (is_frame_address(t, offset))
+                {
+                    auto const id = live_registers.id_of(t.args()[0].get<Variable>().name);
+                    if (id != NO_REGISTER && !live.test(id) && !live_registers.is_escaping(id))
+                    {
+                        removed[i] = true;
+                        function_removed++;
+                        continue;
+                    }
+                }
+
+                live_registers.transfer(t, live);
+            }
+        }
+
+        if (function_removed > 0)
+        {
+            m_stats.frame_addresses += function_removed;
+            m_stats.frame_addresses_per_function[graphs[g].name()] += function_removed;
+        }
+    }
+
+    compact(program, removed);
+    return SUCCESS;
+}
+
+uint Optimizer::promote_frame_slots(Program& program)
+{
+    std::vector<ControlFlowGraph> graphs;
+    if (ControlFlowGraph::build(program, graphs) == FAIL)
+        return FAIL;
+
+    auto const foreign_targets = foreign_jump_targets(program, graphs);
+    std::vector<bool> removed(program.size(), false);
+    std::vector<std::pair<size_t, Tac>> inserted;
+    for (size_t g = 0; g < graphs.size(); g++)
+    {
+        auto const private_end = private_frame_end(program, graphs[g]);
+        if (foreign_targets[g] || private_end == 0)
+            continue;
+
+        auto const& blocks = graphs[g].blocks();
+        std::vector<bool> rewritten(program.size(), false);
+
+        // Outer loops first, slots promoted by a loop are already promoted in the loops nested in it
+        for (auto const& loop : graphs[g].loops())
+        {
+            size_t preheader;
+            if (!preheader_position(program, graphs[g], loop, preheader))
+                continue;
+
+            // Every exit should only be reached from the loop, to store promoted slots back
+            auto const exits = loop_exits(graphs[g], loop);
+            bool exits_ok = true;
+            for (auto e : exits)
+                for (auto p : blocks[e].predecessors)
+                    exits_ok &= std::binary_search(loop.blocks.begin(), loop.blocks.end(), p);
+            if (!exits_ok)
+                continue;
+
+            // Slots written in the loop, which should only be accessed as words with assignw
+            std::map<int, bool> candidates; // slot offset -> can be promoted
+            for (auto b : loop.blocks)
+                for (size_t i = blocks[b].begin; i < blocks[b].end; i++)
+                {
+                    int offset;
+                    if (!rewritten[i] && frame_store(program[i], offset) != 0 && offset >= 0 && offset + WORD_SIZE <= private_end)
+                        candidates.emplace(offset, true);
+                }
+
+            for (auto b : loop.blocks)
+                for (size_t i = blocks[b].begin; i < blocks[b].end; i++)
+                {
+                    auto const& t = program[i];
+                    int offset;
+                    bool const is_word_load = is_frame_load(t, offset) && t.instr() == Instr::ASSIGNW;
+                    bool const is_word_store = frame_store(t, offset) == WORD_SIZE && t.instr() == Instr::ASSIGNW &&
+                                               !(t.args()[1].is<Variable>() && t.args()[1].get<Variable>().is_access);
+
+                    for (size_t k = 0; k < t.args().size(); k++)
+                    {
+                        if (!t.args()[k].is<Variable>())
+                            continue;
+
+                        auto const& var = t.args()[k].get<Variable>();
+                        if (var.name != BASE || !var.is_access || !std::holds_alternative<int>(var.index))
+                            continue;
+
+                        // Other accesses overlapping a candidate slot prevent promoting it
+                        auto const access = std::get<int>(var.index);
+                        bool const is_promotable_access = (k == 1 && is_word_load) || (k == 0 && is_word_store);
+                        for (auto& [slot, promotable] : candidates)
+                            if (access < slot + (int) WORD_SIZE && slot < access + (int) WORD_SIZE && (access != slot || !is_promotable_access))
+                                promotable = false;
+                    }
+                }
+
+            for (auto const& [slot, promotable] : candidates)
+            {
+                if (!promotable)
+                    continue;
+
+                // Load into a register before the loop, use the register inside it, and store it when leaving
+                auto const name = new_register("_slot");
+                Value const slot_access(Variable{BASE, slot, true});
+                inserted.emplace_back(preheader, Tac(Instr::ASSIGNW, Value(Variable{name, 0, false}), slot_access));
+
+                for (auto b : loop.blocks)
+                    for (size_t i = blocks[b].begin; i < blocks[b].end; i++)
+                    {
+                        auto& t = program[i];
+                        int offset;
+                        if (is_frame_load(t, offset) && offset == slot)
+                            t.args()[1] = Value(Variable{name, 0, false});
+                        else if (frame_store(t, offset) != 0 && offset == slot)
+                            t.args()[0] = Value(Variable{name, 0, false});
+                        else
+                            continue;
+
+                        rewritten[i] = true;
+                    }
+
+                for (auto e : exits)
+                {
+                    auto position = blocks[e].begin;
+                    while (position < blocks[e].end && program[position].instr() == Instr::METALABEL)
+                        position++;
+                    inserted.emplace_back(position, Tac(Instr::ASSIGNW, slot_access, Value(Variable{name, 0, false})));
+                }
+
+                m_stats.promoted_slots++;
+            }
+        }
+    }
+
+    compact(program, removed, inserted);
+    return SUCCESS;
+}
+
+uint Optimizer::hoist_loop_invariants(Program& program)
+{
+    std::vector<ControlFlowGraph> graphs;
+    if (ControlFlowGraph::build(program, graphs) == FAIL)
+        return FAIL;
+
+    std::vector<Liveness> liveness;
+    Liveness::compute(program, graphs, liveness);
+
+    auto const foreign_targets = foreign_jump_targets(program, graphs);
+    std::vector<bool> removed(program.size(), false);
+    std::vector<std::pair<size_t, Tac>> inserted;
+    for (size_t g = 0; g < graphs.size(); g++)
+    {
+        if (foreign_targets[g])
+            continue;
+
+        auto const& graph = graphs[g];
+        auto const& blocks = graph.blocks();
+        auto const& live_registers = liveness[g];
+        auto const private_end = private_frame_end(program, graph);
+        auto const function_definitions = definition_blocks(program, graph);
+
+        // Inner loops first, instructions are moved to the innermost loop where they're invariant
+        auto const& loops = graph.loops();
+        for (size_t l = loops.size(); l --> 0;)
+        {
+            auto const& loop = loops[l];
+            size_t preheader;
+            if (!preheader_position(program, graph, loop, preheader))
+                continue;
+
+            auto definitions = count_definitions(program, graph, loop.blocks);
+            auto const exits = loop_exits(graph, loop);
+
+            // Frame slots written in this loop
+            std::vector<std::pair<int, uint>> stores;
+            for (auto b : loop.blocks)
+                for (size_t i = blocks[b].begin; i < blocks[b].end; i++)
+                {
+                    int offset;
+                    if (auto const width = frame_store(program[i], offset))
+                        stores.emplace_back(offset, width);
+                }
+
+            // Registers whose value is the same in every iteration, and can be read before the loop
+            std::unordered_set<std::string> hoisted_definitions;
+            auto is_invariant = [&](const std::string& name) {
+                auto it = definitions.find(name);
+                if (it != definitions.end() && it->second != 0)
+                    return false;
+
+                return hoisted_definitions.count(name) != 0 || is_defined_before(graph, loop, function_definitions, name);
+            };
+
+            auto can_hoist = [&](const Tac& t) {
+                auto const* def = t.defined_variable();
+                if (def == nullptr || def->name == BASE || def->name == STACK || definitions[def->name] != 1)
+                    return false;
+
+                // The written register should not be read before being written in an iteration, or after the loop
+                auto const id = live_registers.id_of(def->name);
+                if (id == NO_REGISTER || live_registers.is_escaping(id) || live_registers.live_in(loop.header).test(id))
+                    return false;
+                for (auto e : exits)
+                    if (live_registers.live_in(e).test(id))
+                        return false;
+
+                // Loads from frame slots not written in the loop
+                int offset;
+                if (is_frame_load(t, offset))
+                {
+                    uint const width = t.instr() == Instr::ASSIGNW ? WORD_SIZE : 1;
+                    if (offset < 0 || offset + (int) width > private_end)
+                        return false;
+
+                    for (auto const& [store, store_width] : stores)
+                        if (store < offset + (int) width && offset < store + (int) store_width)
+                            return false;
+
+                    return true;
+                }
+
+                if (!is_removable(t) || t.instr() == Instr::PARAM)
+                    return false;
+
+                for (auto const& arg : t.args())
+                {
+                    if (!arg.is<Variable>() || &arg.get<Variable>() == def)
+                        continue;
+
+                    auto const& var = arg.get<Variable>();
+                    if (var.is_access || !is_invariant(var.name))
+                        return false;
+                }
+
+                return true;
+            };
+
+            // Moving an instruction might make others invariant
+            bool changed = true;
+            while (changed)
+            {
+                changed = false;
+                for (auto b : graph.reverse_postorder())
+                {
+                    if (!std::binary_search(loop.blocks.begin(), loop.blocks.end(), b))
+                        continue;
+
+                    for (size_t i = blocks[b].begin; i < blocks[b].end; i++)
+                    {
+                        if (removed[i] || !can_hoist(program[i]))
+                            continue;
+
+                        removed[i] = true;
+                        definitions[program[i].defined_variable()->name] = 0;
+                        hoisted_definitions.insert(program[i].defined_variable()->name);
+                        inserted.emplace_back(preheader, program[i]);
+                        m_stats.hoisted++;
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+
+    compact(program, removed, inserted);
+    return SUCCESS;
+}
+
+uint Optimizer::reduce_strength(Program& program)
+{
+    std::vector<ControlFlowGraph> graphs;
+    if (ControlFlowGraph::build(program, graphs) == FAIL)
+        return FAIL;
+
+    auto const foreign_targets = foreign_jump_targets(program, graphs);
+    std::vector<bool> removed(program.size(), false);
+    std::vector<std::pair<size_t, Tac>> inserted;
+    for (size_t g = 0; g < graphs.size(); g++)
+    {
+        if (foreign_targets[g])
+            continue;
+
+        auto const& graph = graphs[g];
+        auto const& blocks = graph.blocks();
+        auto const function_definitions = definition_blocks(program, graph);
+        for (auto const& loop : graph.loops())
+        {
+            size_t preheader;
+            if (!preheader_position(program, graph, loop, preheader))
+                continue;
+
+            auto const definitions = count_definitions(program, graph, loop.blocks);
+            auto definitions_of = [&definitions](const std::string& name) {
+                auto it = definitions.find(name);
+                return it == definitions.end() ? 0 : it->second;
+            };
+
+            // Copies 'assignw x i' made once per iteration, register -> (copied register, position)
+            std::unordered_map<std::string, std::pair<std::string, size_t>> copies;
+            for (auto b : loop.blocks)
+                for (size_t i = blocks[b].begin; i < blocks[b].end; i++)
+                {
+                    auto const& args = program[i].args();
+                    if (program[i].instr() == Instr::ASSIGNW && is_plain_variable(args[0]) && is_plain_variable(args[1]) &&
+                        definitions_of(args[0].get<Variable>().name) == 1)
+                        copies[args[0].get<Variable>().name] = std::make_pair(args[1].get<Variable>().name, i);
+                }
+
+            // Basic induction variables: registers only written by 'add i i c' or 'sub i i c' in the loop. 'add i x c'
+            // works too if x is a copy of i made before in the same iteration, as i doesn't change in between
+            std::unordered_map<std::string, size_t> inductions; // register -> position of its update
+            for (auto b : loop.blocks)
+                for (size_t i = blocks[b].begin; i < blocks[b].end; i++)
+                {
+                    auto const& t = program[i];
+                    auto const& args = t.args();
+                    if ((t.instr() != Instr::ADD && t.instr() != Instr::SUB) || !is_plain_variable(args[0]) || !is_plain_variable(args[1]) || !args[2].is<int>())
+                        continue;
+
+                    auto const& name = args[0].get<Variable>().name;
+                    auto const& source = args[1].get<Variable>().name;
+                    bool is_update = name == source;
+                    auto copy = copies.find(source);
+                    if (!is_update && copy != copies.end() && copy->second.first == name)
+                    {
+                        auto const copy_block = graph.block_of(copy->second.second);
+                        is_update = copy_block == b ? copy->second.second < i : graph.dominates(copy_block, b);
+                    }
+
+                    if (is_update && name != STACK && !is_float_register(name) && definitions_of(name) == 1 &&
+                        is_defined_before(graph, loop, function_definitions, name))
+                        inductions[name] = i;
+                }
+
+            // Derived induction variables: 'mult j i s', optionally followed by 'add j j b' with b invariant.
+            // A register n = i * s + b is updated along with i, so they become 'assignw j n'
+            std::map<std::tuple<std::string, int, std::string>, std::string> derived; // (i, s, b) -> n
+            for (auto b : loop.blocks)
+                for (size_t i = blocks[b].begin; i < blocks[b].end; i++)
+                {
+                    auto& t = program[i];
+                    auto const& args = t.args();
+                    if (removed[i] || t.instr() != Instr::MULT || !is_plain_variable(args[0]))
+                        continue;
+
+                    size_t const k = is_plain_variable(args[1]) && args[2].is<int>() ? 1 : is_plain_variable(args[2]) && args[1].is<int>() ? 2 : 0;
+                    if (k == 0 || inductions.count(args[k].get<Variable>().name) == 0)
+                        continue;
+
+                    auto const& induction = args[k].get<Variable>().name;
+                    auto const factor = args[3 - k].get<int>();
+                    auto const& j = args[0].get<Variable>().name;
+                    if (j == induction || j == STACK || j == BASE)
+                        continue;
+
+                    // The base should be invariant, and not a float, as floats are added as floats
+                    std::string base;
+                    bool has_base = false;
+                    if (i + 1 < blocks[b].end && program[i + 1].instr() == Instr::ADD)
+                    {
+                        auto const& next = program[i + 1].args();
+                        bool const is_accumulated = is_plain_variable(next[0]) && next[0].get<Variable>().name == j &&
+                                                    is_plain_variable(next[1]) && next[1].get<Variable>().name == j;
+                        if (is_accumulated && is_plain_variable(next[2]))
+                        {
+                            base = next[2].get<Variable>().name;
+                            has_base = base != j && definitions_of(base) == 0 && !is_float_register(base) &&
+                                       is_defined_before(graph, loop, function_definitions, base);
+                        }
+                    }
+
+                    auto const key = std::make_tuple(induction, factor, has_base ? base : std::string());
+                    auto it = derived.find(key);
+                    if (it == derived.end())
+                    {
+                        // n = i * s (+ b) before the loop, and n += c * s after every 'i += c'
+                        auto const name = new_register("_iv");
+                        Value const n(Variable{name, 0, false});
+                        inserted.emplace_back(preheader, Tac(Instr::MULT, n, Value(Variable{induction, 0, false}), Value(factor)));
+                        if (has_base)
+                            inserted.emplace_back(preheader, Tac(Instr::ADD, n, n, Value(Variable{base, 0, false})));
+
+                        auto const update = inductions[induction];
+                        auto const step = (REGISTER_TYPE) program[update].args()[2].get<int>() * (REGISTER_TYPE) factor;
+                        inserted.emplace_back(update + 1, Tac(program[update].instr(), n, n, Value((int) step)));
+
+                        it = derived.emplace(key, name).first;
+                    }
+
+                    t = Tac(Instr::ASSIGNW, args[0], Value(Variable{it->second, 0, false}));
+                    if (has_base)
+                        removed[i + 1] = true;
+                    m_stats.reduced++;
+                }
+        }
+    }
+
+    // 'mult x y 2' is 'add x y y'
+    for (size_t i = 0; i < program.size(); i++)
+    {
+        auto& t = program[i];
+        if (removed[i] || t.instr() != Instr::MULT)
+            continue;
+
+        auto const& args = t.args();
+        REGISTER_TYPE factor;
+        for (size_t k = 1; k <= 2; k++)
+        {
+            auto const& other = args[3 - k];
+            if (operand_constant(args[k], factor) && factor == 2 && is_plain_variable(other) && !is_float_register(other.get<Variable>().name))
+            {
+                t = Tac(Instr::ADD, args[0], other, other);
+                m_stats.reduced++;
+                break;
+            }
+        }
+    }
+
+    compact(program, removed, inserted);
+    return SUCCESS;
+}
+
+uint Optimizer::eliminate_dead_code(Program& program)
+{
+    std::vector<ControlFlowGraph> graphs;
+    if (ControlFlowGraph::build(program, graphs) == FAIL)
+        return FAIL;
+
+    std::vector<Liveness> liveness;
+    Liveness::compute(program, graphs, liveness);
+
+    std::vector<bool> removed(program.size(), false);
+    for (size_t g = 0; g < graphs.size(); g++)
+    {
+        auto const& blocks = graphs[g].blocks();
+        auto const& live_registers = liveness[g];
+        for (auto b : graphs[g].reverse_postorder())
+        {
+            auto live = live_registers.live_out(b);
+            for (size_t i = blocks[b].end; i --> blocks[b].begin;)
+            {
+                auto const& t = program[i];
+                if (is_removable(t))
+                {
+                    auto const id = live_registers.id_of(t.defined_variable()->name);
+                    if (id != NO_REGISTER && !live.test(id) && !live_registers.is_escaping(id))
+                    {
+                        removed[i] = true;
+                        m_stats.dead_code++;
+                        continue;
+                    }
+                }
+
+                // 'op t a b; assignw x t' is 'op x a b' when t is not read later
+                if (i > blocks[b].begin && !removed[i - 1] && can_coalesce(program[i - 1], t, live_registers, live))
+                {
+                    program[i - 1].args()[0] = t.args()[0];
+                    removed[i] = true;
+                    m_stats.coalesced++;
+                    continue;
+                }
+
+                live_registers.transfer(t, live);
+            }
+        }
+    }
+
+    compact(program, removed);
+    return SUCCESS;
+}
+
+uint Optimizer::eliminate_dead_stores(Program& program)
+{
+    std::vector<ControlFlowGraph> graphs;
+    if (ControlFlowGraph::build(program, graphs) == FAIL)
+        return FAIL;
+
+    std::vector<bool> removed(program.size(), false);
+    std::vector<Store> pending; // stores performed later in the current block
+    for (auto const& graph : graphs)
+        for (auto const& block : graph.blocks())
+        {
+            pending.clear();
+            for (size_t i = block.end; i --> block.begin;)
+            {
+                auto const& t = program[i];
+                auto const& args = t.args();
+                bool const is_store = (t.instr() == Instr::ASSIGNW || t.instr() == Instr::ASSIGNB) &&
+                                      args[0].get<Variable>().is_access &&
+                                      !(args[1].is<Variable>() && args[1].get<Variable>().is_access);
+                if (is_store)
+                {
+                    auto const& var = args[0].get<Variable>();
+                    uint const width = t.instr() == Instr::ASSIGNW ? WORD_SIZE : 1;
+                    bool overwritten = false;
+                    for (auto const& store : pending)
+                        overwritten |= store.base == var.name && store.index == var.index && store.width >= width;
+
+                    if (overwritten)
+                    {
+                        removed[i] = true;
+                        m_stats.dead_stores++;
+                        continue;
+                    }
+
+                    if (pending.size() == MAX_PENDING_STORES)
+                        pending.erase(pending.begin());
+                    pending.push_back(Store{var.name, var.index, width});
+                    continue;
+                }
+
+                if (may_access_memory(t))
+                {
+                    pending.clear();
+                    continue;
+                }
+
+                // Stores after this point use a different address if their registers are written here
+                if (auto const* def = t.defined_variable())
+                {
+                    Access const as_index = def->name;
+                    pending.erase(std::remove_if(pending.begin(), pending.end(), [&](const Store& store) {
+                        return store.base == def->name || store.index == as_index;
+                    }), pending.end());
+                }
+            }
+        }
+
+    compact(program, removed);
+    return SUCCESS;
+}
+
+void Optimizer::compact(Program& program, const std::vector<bool>& removed, std::vector<std::pair<size_t, Tac>>& inserted)
+{
+    if (inserted.empty())
+    {
+        compact(program, removed);
+        return;
+    }
+
+    std::stable_sort(inserted.begin(), inserted.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    Program result;
+    result.reserve(program.size() + inserted.size());
+    size_t next = 0;
+    for (size_t i = 0; i <= program.size(); i++)
+    {
+        for (; next < inserted.size() && inserted[next].first == i; next++)
+            result.push_back(std::move(inserted[next].second));
+
+        if (i < program.size() && !removed[i])
+            result.push_back(std::move(program[i]));
+    }
+
+    program.swap(result);
+    inserted.clear();
+}
+
+std::string Optimizer::new_register(const std::string& prefix)
+{
+    // Generated registers are named like '_x__T1', so this suffix is not used by them
+    return prefix + "__O" + std::to_string(++m_new_registers);
+}
+
+void Optimizer::compact(Program& program, const std::vector<bool>& removed)
+{
+    size_t next = 0;
+    for (size_t i = 0; i < program.size(); i++)
+    {
+        if (removed[i])
+            continue;
+
+        if (next != i)
+            program[next] = std::move(program[i]);
+        next++;
+    }
+
+    program.resize(next);
+}
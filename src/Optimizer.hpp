@@ -0,0 +1,227 @@
+/**
+ * @file Optimizer.hpp
+ * @brief Optimization passes over parsed tac programs
+ *
+ */
+#ifndef OPTIMIZER_HPP
+#define OPTIMIZER_HPP
+
+// Local includes
+#include "Tac.hpp"
+
+// C++ includes
+#include <string>
+#include <vector>
+#include <map>
+
+// Highest optimization level available
+#define MAX_OPTIMIZATION_LEVEL 2
+
+// Passes are repeated until nothing changes, or up to this many times
+#define MAX_OPTIMIZATION_ROUNDS 8
+
+// Largest function inlined into its callers by default, in instructions
+#define DEFAULT_INLINE_THRESHOLD 24
+
+namespace TacRunner
+{
+    /**
+     * @brief Rewrites a program into an equivalent one that runs less instructions.
+     *        Optimization levels:
+     *          - 0: nothing
+     *          - 1: constant folding, copy propagation, jump threading, unreachable code removal,
+     *               frame address numbering
+     *          - 2: level 1 plus inlining of small leaf functions, dead code and dead store elimination,
+     *               and loop optimizations: frame slot promotion, invariant code motion and strength reduction
+     *        Programs should be optimized before being loaded by a tac machine, as jump targets
+     *        and register slots are not resolved yet.
+     *
+     */
+    class Optimizer
+    {
+        public:
+            /**
+             * @brief Create an optimizer for the given level
+             *
+             * @param level optimization level, from 0 to MAX_OPTIMIZATION_LEVEL
+             * @param inline_threshold largest function inlined into its callers, in instructions, 0 to disable inlining
+             */
+            Optimizer(uint level, uint inline_threshold = DEFAULT_INLINE_THRESHOLD) 
+                : m_level(level)
+                , m_inline_threshold(inline_threshold) 
+            { }
+
+            /**
+             * @brief Optimize a program in place
+             *
+             * @param program program to optimize
+             * @return uint success status, 0 on success, 1 on failure
+             */
+            uint optimize(Program& program);
+
+            /**
+             * @brief Summary of the changes performed by the last optimization
+             *
+             * @return std::string one line per pass
+             */
+            std::string report() const;
+
+        private:
+            /**
+             * @brief Copy the body of small leaf functions into their call sites. The inlined frame is placed
+             *        right after the caller's frame, so frame accesses only change their offset, arguments
+             *        are written there instead of the top of the stack, and registers and labels are renamed
+             *
+             * @param program program to optimize
+             * @return uint success status, 0 on success, 1 on failure
+             */
+            uint inline_calls(Program& program);
+
+            /**
+             * @brief Retarget jumps to labels followed by another jump, remove jumps to the next
+             *        instruction, resolve conditional jumps with constant conditions, and remove unused labels
+             *
+             * @param program program to optimize
+             */
+            void thread_jumps(Program& program);
+
+            /**
+             * @brief Remove instructions that can't be reached from the start of their function
+             *
+             * @param program program to optimize
+             * @return uint success status, 0 on success, 1 on failure
+             */
+            uint remove_unreachable_code(Program& program);
+
+            /**
+             * @brief Replace registers with known constant values or copies of other registers, and
+             *        compute operations whose operands are constant. Facts are propagated along chains of
+             *        blocks with a single predecessor
+             *
+             * @param program program to optimize
+             * @return uint success status, 0 on success, 1 on failure
+             */
+            uint propagate(Program& program);
+
+            /**
+             * @brief Value numbering of frame addresses: as BASE doesn't change within a frame, registers
+             *        holding BASE plus a constant are the same address. Accesses through them become frame
+             *        slot operands, like BASE[8], other reads use the first register holding that address, and
+             *        address computations no longer read are removed
+             *
+             * @param program program to optimize
+             * @return uint success status, 0 on success, 1 on failure
+             */
+            uint number_frame_addresses(Program& program);
+
+            /**
+             * @brief Keep frame slots read and written inside a loop in a register while the loop
+             *        runs. The register is loaded before the loop and stored back when leaving it.
+             *        Only slots whose address is never taken are promoted, as no pointer can reach them
+             *
+             * @param program program to optimize
+             * @return uint success status, 0 on success, 1 on failure
+             */
+            uint promote_frame_slots(Program& program);
+
+            /**
+             * @brief Move instructions computing the same value in every iteration of a loop to
+             *        its preheader, right before the loop header
+             *
+             * @param program program to optimize
+             * @return uint success status, 0 on success, 1 on failure
+             */
+            uint hoist_loop_invariants(Program& program);
+
+            /**
+             * @brief Replace multiplications by two with additions, and multiplications of induction
+             *        variables by a constant with a register updated along with the induction variable
+             *
+             * @param program program to optimize
+             * @return uint success status, 0 on success, 1 on failure
+             */
+            uint reduce_strength(Program& program);
+
+            /**
+             * @brief Remove instructions without side effects whose result is never read, and
+             *        write results copied to another register right away into that register
+             *
+             * @param program program to optimize
+             * @return uint success status, 0 on success, 1 on failure
+             */
+            uint eliminate_dead_code(Program& program);
+
+            /**
+             * @brief Remove memory stores overwritten in the same block before being read
+             *
+             * @param program program to optimize
+             * @return uint success status, 0 on success, 1 on failure
+             */
+            uint eliminate_dead_stores(Program& program);
+
+            /**
+             * @brief Remove the marked instructions from a program
+             *
+             * @param program program to compact
+             * @param removed which instructions to remove
+             */
+            static void compact(Program& program, const std::vector<bool>& removed);
+
+            /**
+             * @brief Remove the marked instructions from a program, and insert new ones
+             *
+             * @param program program to compact
+             * @param removed which instructions to remove
+             * @param inserted instructions to insert before each program position, in the same
+             *                 order when several are inserted at the same position
+             */
+            static void compact(Program& program, const std::vector<bool>& removed, std::vector<std::pair<size_t, Tac>>& inserted);
+
+            /**
+             * @brief Name for a new register, not used by the program
+             *
+             * @param prefix start of the register name
+             * @return std::string register name
+             */
+            std::string new_register(const std::string& prefix);
+
+        private:
+            uint m_level;
+            uint m_inline_threshold;
+            size_t m_new_registers = 0;
+
+            /**
+             * @brief Amount of changes performed by each pass
+             *
+             */
+            struct Stats
+            {
+                size_t inlined = 0;
+                size_t threaded_jumps = 0;
+                size_t removed_jumps = 0;
+                size_t removed_labels = 0;
+                size_t unreachable = 0;
+                size_t propagated = 0;
+                size_t folded = 0;
+                size_t frame_addresses = 0;
+                size_t promoted_slots = 0;
+                size_t hoisted = 0;
+                size_t reduced = 0;
+                size_t dead_code = 0;
+                size_t coalesced = 0;
+                size_t dead_stores = 0;
+                size_t original_size = 0;
+                size_t final_size = 0;
+                std::map<std::string, size_t> frame_addresses_per_function; // removed address computations in each function
+                std::vector<std::string> inlined_calls; // inlined call sites, as caller, callee and position
+
+                inline size_t total() const
+                {
+                    return inlined + threaded_jumps + removed_jumps + removed_labels + unreachable + propagated + folded + frame_addresses +
+                           promoted_slots + hoisted + reduced + dead_code + coalesced + dead_stores;
+                }
+            } m_stats;
+    };
+}
+
+#endif // OPTIMIZER_HPP
@@ -0,0 +1,175 @@
+#include "PerfCounters.hpp"
+
+// C++ includes
+#include <iomanip>
+#include <sstream>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace TacRunner
+{
+    namespace
+    {
+        int64_t elapsed(const timespec& start, const timespec& end)
+        {
+            return (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+        }
+
+#ifdef __linux__
+        constexpr uint64_t cache_miss(uint64_t cache)
+        {
+            return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        }
+
+        /**
+         * @brief Open a counter for this process, disabled until started
+         *
+         * @param counter counter to open
+         * @return int file descriptor of the counter, -1 on error
+         */
+        int open_counter(const PerfCounter& counter)
+        {
+            perf_event_attr attr = {};
+            attr.size = sizeof(attr);
+            attr.type = counter.type;
+            attr.config = counter.config;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+#endif
+    }
+
+    PerfCounters::PerfCounters()
+    {
+#ifdef __linux__
+        m_counters = {{
+            { "cycles",         PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+            { "instructions",   PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+            { "branch misses",  PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+            { "L1d misses",     PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_L1D) },
+            { "LLC misses",     PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_LL) }
+        }};
+#else
+        m_counters = {{
+            { "cycles", 0, 0 }, { "instructions", 0, 0 }, { "branch misses", 0, 0 },
+            { "L1d misses", 0, 0 }, { "LLC misses", 0, 0 }
+        }};
+#endif
+    }
+
+    PerfCounters::~PerfCounters()
+    {
+#ifdef __linux__
+        for (auto& counter : m_counters)
+            if (counter.fd != -1)
+                close(counter.fd);
+#endif
+    }
+
+    uint PerfCounters::start()
+    {
+#ifdef __linux__
+        // Counters are opened one by one, so a missing one doesn't take the others with it
+        for (auto& counter : m_counters)
+        {
+            counter.fd = open_counter(counter);
+            m_hardware = m_hardware || counter.fd != -1;
+        }
+
+        for (auto const& counter : m_counters)
+            if (counter.fd != -1)
+                ioctl(counter.fd, PERF_EVENT_IOC_RESET, 0);
+#endif
+
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &m_cpu_start);
+        clock_gettime(CLOCK_MONOTONIC, &m_wall_start);
+
+#ifdef __linux__
+        for (auto const& counter : m_counters)
+            if (counter.fd != -1)
+                ioctl(counter.fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+
+        return m_hardware ? SUCCESS : FAIL;
+    }
+
+    void PerfCounters::stop()
+    {
+#ifdef __linux__
+        for (auto const& counter : m_counters)
+            if (counter.fd != -1)
+                ioctl(counter.fd, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+
+        timespec wall_end, cpu_end;
+        clock_gettime(CLOCK_MONOTONIC, &wall_end);
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_end);
+        m_wall_time = elapsed(m_wall_start, wall_end);
+        m_cpu_time = elapsed(m_cpu_start, cpu_end);
+
+#ifdef __linux__
+        for (auto& counter : m_counters)
+        {
+            // value, time enabled, time running
+            uint64_t data[3] = {};
+            if (counter.fd == -1 || read(counter.fd, data, sizeof(data)) != sizeof(data) || data[2] == 0)
+            {
+                counter.value = 0;
+                continue;
+            }
+
+            // The kernel only runs some counters at a time when there are more than it can hold
+            counter.value = data[2] < data[1]
+                ? static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] / data[2])
+                : data[0];
+        }
+#endif
+    }
+
+    std::string PerfCounters::str(uint64_t guest_instructions) const
+    {
+        std::stringstream ss;
+        auto const per_instruction = [&](double value) {
+            return guest_instructions == 0 ? 0.0 : value / guest_instructions;
+        };
+
+        ss << "Performance counters: " << guest_instructions << " guest instructions" << std::endl;
+        ss << std::fixed << std::setprecision(3);
+        ss << "\twall time: " << m_wall_time / 1e6 << " ms, "
+           << per_instruction(m_wall_time) << " ns per guest instruction" << std::endl;
+        ss << "\tcpu time: " << m_cpu_time / 1e6 << " ms, "
+           << per_instruction(m_cpu_time) << " ns per guest instruction";
+
+        if (!m_hardware)
+        {
+            ss << std::endl << "\thardware counters are not available, only time was measured";
+            return ss.str();
+        }
+
+        for (auto const& counter : m_counters)
+        {
+            ss << std::endl << "\t" << counter.name << ": ";
+            if (counter.fd == -1)
+                ss << "not supported";
+            else
+                ss << counter.value << ", " << per_instruction(counter.value) << " per guest instruction";
+        }
+
+        // Host instructions per host cycle, how well the interpreter uses the cpu
+        auto const& cycles = m_counters[0];
+        auto const& instructions = m_counters[1];
+        if (cycles.fd != -1 && instructions.fd != -1 && cycles.value != 0)
+            ss << std::endl << "\thost IPC: " << static_cast<double>(instructions.value) / cycles.value;
+
+        return ss.str();
+    }
+}
@@ -0,0 +1,81 @@
+/**
+ * @file PerfCounters.hpp
+ * @brief Hardware performance counters of the host while a program runs
+ *
+ */
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+// Local includes
+#include "TacMachine.hpp"
+
+// C++ includes
+#include <array>
+#include <cstdint>
+#include <string>
+#include <ctime>
+
+#define PERF_COUNTER_KINDS 5 // cycles, instructions, branch misses, L1d misses, LLC misses
+
+namespace TacRunner
+{
+    /**
+     * @brief A counter of the host cpu
+     *
+     */
+    struct PerfCounter
+    {
+        const char* name;   // name shown in the report
+        uint32_t type;      // perf event type
+        uint64_t config;    // perf event config for its type
+        int fd = -1;        // file descriptor of the counter, -1 if it could not be opened
+        uint64_t value = 0; // events counted, scaled up if the kernel multiplexed the counter
+    };
+
+    /**
+     * @brief Counts cycles, instructions, branch misses and cache misses of the host while the
+     *        machine runs, using perf_event_open, along with wall and cpu time. Counters the kernel
+     *        doesn't allow, as usual in containers, are left out and only time is measured
+     *
+     */
+    class PerfCounters
+    {
+        public:
+            PerfCounters();
+            ~PerfCounters();
+
+            PerfCounters(const PerfCounters&) = delete;
+            PerfCounters& operator=(const PerfCounters&) = delete;
+
+            /**
+             * @brief Open and start counters, and start measuring time
+             *
+             * @return uint success status, 0 if some hardware counter is running, 1 if only time is measured
+             */
+            uint start();
+
+            /**
+             * @brief Stop counters and read them
+             *
+             */
+            void stop();
+
+            /**
+             * @brief Counters and time measured, and their cost per guest instruction
+             *
+             * @param guest_instructions instructions run by the machine while measuring
+             * @return std::string human readable report
+             */
+            std::string str(uint64_t guest_instructions) const;
+
+        private:
+            std::array<PerfCounter, PERF_COUNTER_KINDS> m_counters;
+            bool m_hardware = false;    // if some counter could be opened
+            timespec m_wall_start{};
+            timespec m_cpu_start{};
+            int64_t m_wall_time = 0;    // nanoseconds of wall time measured
+            int64_t m_cpu_time = 0;     // nanoseconds of process cpu time measured
+    };
+}
+
+#endif // PERF_COUNTERS_HPP
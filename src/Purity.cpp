@@ -0,0 +1,424 @@
+// Local includes
+#include "Purity.hpp"
+#include "ControlFlowGraph.hpp"
+#include "Liveness.hpp"
+#include "TacMachine.hpp"
+
+// C++ includes
+#include <unordered_map>
+
+using namespace TacRunner;
+
+namespace
+{
+    /**
+     * @brief What a register might point to, computed without looking at the order of its definitions
+     *
+     */
+    enum class PointerKind
+    {
+        NONE,           // not defined yet
+        FRAME,          // known offset in the function frame
+        ANY_FRAME,      // unknown offset in the function frame
+        ABOVE_FRAME,    // stack memory above the function frame
+        LOCAL,          // either the function frame or stack memory above it
+        OTHER           // anything else, it might not be a pointer at all
+    };
+
+    struct Pointer
+    {
+        PointerKind kind = PointerKind::NONE;
+        int offset = 0;     // only for frame pointers
+
+        inline bool operator==(const Pointer& other) const { return kind == other.kind && offset == other.offset; }
+        inline bool operator!=(const Pointer& other) const { return !(*this == other); }
+    };
+
+    bool is_local(const Pointer& pointer)
+    {
+        return pointer.kind != PointerKind::NONE && pointer.kind != PointerKind::OTHER;
+    }
+
+    bool is_frame(const Pointer& pointer)
+    {
+        return pointer.kind == PointerKind::FRAME || pointer.kind == PointerKind::ANY_FRAME;
+    }
+
+    // Least pointer kind describing both pointers
+    Pointer join(const Pointer& a, const Pointer& b)
+    {
+        if (a.kind == PointerKind::NONE || a == b)
+            return b;
+        if (b.kind == PointerKind::NONE)
+            return a;
+        if (a.kind == PointerKind::OTHER || b.kind == PointerKind::OTHER)
+            return Pointer{PointerKind::OTHER};
+        if (is_frame(a) && is_frame(b))
+            return Pointer{PointerKind::ANY_FRAME};
+
+        return Pointer{PointerKind::LOCAL};
+    }
+
+    // Same kind of pointer, moved by an unknown amount
+    Pointer unknown_offset(const Pointer& pointer)
+    {
+        return pointer.kind == PointerKind::FRAME ? Pointer{PointerKind::ANY_FRAME} : pointer;
+    }
+
+    /**
+     * @brief Pointer kind of every register in a function
+     *
+     */
+    class Pointers
+    {
+        public:
+            Pointer of(const Value& value) const
+            {
+                if (!value.is<Variable>() || value.get<Variable>().is_access)
+                    return Pointer{PointerKind::OTHER};
+
+                return of(value.get<Variable>().name);
+            }
+
+            Pointer of(const std::string& name) const
+            {
+                if (name == BASE)
+                    return Pointer{PointerKind::FRAME, 0};
+                if (name == STACK)
+                    return Pointer{PointerKind::ABOVE_FRAME};
+
+                auto it = m_pointers.find(name);
+                return it == m_pointers.end() ? Pointer{} : it->second;
+            }
+
+            // Join a new definition into a register, tells if it changed
+            bool define(const std::string& name, const Pointer& pointer)
+            {
+                auto& current = m_pointers[name];
+                auto const joined = join(current, pointer);
+                if (joined == current)
+                    return false;
+
+                current = joined;
+                return true;
+            }
+
+            // Pointer computed by an instruction defining a register
+            Pointer defined_by(const Tac& tac) const
+            {
+                auto const& args = tac.args();
+                switch (tac.instr())
+                {
+                case Instr::ASSIGNW:
+                    return of(args[1]);
+                case Instr::PARAM:
+                    return Pointer{PointerKind::ABOVE_FRAME};
+                case Instr::ADD:
+                case Instr::SUB:
+                {
+                    auto const left = of(args[1]);
+                    auto const right = of(args[2]);
+                    bool const left_local = is_local(left);
+                    bool const right_local = is_local(right) && tac.instr() == Instr::ADD;
+                    if (left_local == right_local)
+                        return Pointer{PointerKind::OTHER};
+
+                    auto const& pointer = left_local ? left : right;
+                    auto const& offset = left_local ? args[2] : args[1];
+                    if (pointer.kind != PointerKind::FRAME || !offset.is<int>())
+                        return unknown_offset(pointer);
+
+                    auto const delta = offset.get<int>();
+                    return Pointer{PointerKind::FRAME, pointer.offset + (tac.instr() == Instr::ADD ? delta : -delta)};
+                }
+                default:
+                    return Pointer{PointerKind::OTHER};
+                }
+            }
+
+        private:
+            std::unordered_map<std::string, Pointer> m_pointers;
+    };
+
+    /**
+     * @brief Memory access performed by an instruction
+     *
+     */
+    struct MemoryAccess
+    {
+        Pointer pointer;    // where it points to, index included
+        uint size;          // bytes read or written
+        bool write;         // if memory is written instead of read
+    };
+
+    // Memory accesses through an access variable like x[j]
+    void memory_accesses(const Tac& tac, const Pointers& pointers, std::vector<MemoryAccess>& out_accesses)
+    {
+        out_accesses.clear();
+        auto const& args = tac.args();
+        bool const is_assign = tac.instr() == Instr::ASSIGNW || tac.instr() == Instr::ASSIGNB;
+        uint const size = tac.instr() == Instr::ASSIGNB ? 1 : WORD_SIZE;
+        for (size_t i = 0; i < args.size(); i++)
+        {
+            if (!args[i].is<Variable>() || !args[i].get<Variable>().is_access)
+                continue;
+
+            auto const& var = args[i].get<Variable>();
+            auto pointer = pointers.of(var.name);
+            if (pointer.kind == PointerKind::FRAME && std::holds_alternative<int>(var.index))
+                pointer.offset += std::get<int>(var.index);
+            else
+                pointer = unknown_offset(pointer);
+
+            out_accesses.push_back(MemoryAccess{pointer, size, is_assign && i == 0});
+        }
+    }
+
+    bool has_effects(Instr instr)
+    {
+        switch (instr)
+        {
+        case Instr::PRINTI: case Instr::PRINTF: case Instr::PRINT: case Instr::PRINTC:
+        case Instr::READI: case Instr::READF: case Instr::READ: case Instr::READC:
+        case Instr::MALLOC: case Instr::FREE: case Instr::EXIT:
+        case Instr::METASTATICV: case Instr::METASTRING:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    /**
+     * @brief Analysis of a single function, ignoring the functions it calls
+     *
+     */
+    class FunctionAnalysis
+    {
+        public:
+            FunctionAnalysis(const Program& program, const ControlFlowGraph& graph, const Liveness& liveness)
+                : m_program(program)
+                , m_graph(graph)
+                , m_liveness(liveness)
+            { }
+
+            /**
+             * @brief Tell if this function might be pure, and find its arguments
+             *
+             * @param out_purity where to store the result, functions it calls are not checked
+             * @param out_callees names of the functions it calls
+             */
+            void run(FunctionPurity& out_purity, std::vector<std::string>& out_callees)
+            {
+                out_purity.pure = false;
+                out_purity.arguments.clear();
+                out_callees.clear();
+
+                auto const& blocks = m_graph.blocks();
+                if (blocks.empty() || m_program[blocks[m_graph.entry()].begin].instr() != Instr::METAFUNBEGIN)
+                    return;
+
+                m_frame_size = (uint) std::max(m_program[blocks[m_graph.entry()].begin].args()[1].get<int>(), 0);
+
+                // Registers read before being written come from a caller
+                auto const& entry_live = m_liveness.live_in(m_graph.entry());
+                for (size_t id = 0; id < m_liveness.registers().size(); id++)
+                    if (entry_live.test(id))
+                        return;
+
+                find_pointers();
+                if (!check_instructions(out_callees))
+                    return;
+
+                find_arguments(out_purity.arguments);
+                out_purity.pure = true;
+            }
+
+        private:
+            template<class F>
+            void for_each_instruction(F&& f) const
+            {
+                for (auto const& block : m_graph.blocks())
+                    for (size_t i = block.begin; i < block.end; i++)
+                        f(m_program[i]);
+            }
+
+            void find_pointers()
+            {
+                bool changed = true;
+                while (changed)
+                {
+                    changed = false;
+                    for_each_instruction([&](const Tac& t) {
+                        auto const* def = t.defined_variable();
+                        if (def != nullptr)
+                            changed |= m_pointers.define(def->name, m_pointers.defined_by(t));
+                    });
+                }
+            }
+
+            bool check_instructions(std::vector<std::string>& out_callees)
+            {
+                bool pure = true;
+                std::vector<MemoryAccess> accesses;
+                for_each_instruction([&](const Tac& t) {
+                    if (!pure)
+                        return;
+
+                    auto const& args = t.args();
+                    if (has_effects(t.instr()))
+                        pure = false;
+                    else if (t.instr() == Instr::CALL)
+                        out_callees.push_back(args[1].get<std::string>());
+                    else if (t.instr() == Instr::RETURN && is_local(m_pointers.of(args[0])))
+                        pure = false; // its stack memory is gone once it returns
+                    else if (t.instr() == Instr::MEMCPY)
+                    {
+                        auto const destination = m_pointers.of(args[0]);
+                        auto const source = m_pointers.of(args[1]);
+                        pure = is_local(destination) && is_local(source);
+                        m_reads_any_frame |= is_frame(source) || source.kind == PointerKind::LOCAL;
+                    }
+
+                    memory_accesses(t, m_pointers, accesses);
+                    for (auto const& access : accesses)
+                    {
+                        // Memory below the frame belongs to callers
+                        if (!is_local(access.pointer) || (access.pointer.kind == PointerKind::FRAME && access.pointer.offset < 0))
+                            pure = false;
+                        else if (!access.write && access.pointer.kind != PointerKind::FRAME && access.pointer.kind != PointerKind::ABOVE_FRAME)
+                            m_reads_any_frame = true;
+                    }
+                });
+
+                return pure;
+            }
+
+            // Frame bytes that might be read before being written, tracking bytes written on every path
+            void find_arguments(std::vector<FrameRange>& out_arguments)
+            {
+                if (m_reads_any_frame)
+                {
+                    if (m_frame_size > 0)
+                        out_arguments.push_back(FrameRange{0, m_frame_size});
+                    return;
+                }
+
+                auto const& blocks = m_graph.blocks();
+                std::vector<std::vector<bool>> written_out(blocks.size(), std::vector<bool>(m_frame_size, true));
+                std::vector<bool> is_argument(m_frame_size, false);
+                std::vector<bool> written;
+                std::vector<MemoryAccess> accesses;
+
+                bool changed = true;
+                while (changed)
+                {
+                    changed = false;
+                    for (auto b : m_graph.reverse_postorder())
+                    {
+                        written.assign(m_frame_size, b != m_graph.entry());
+                        for (auto p : blocks[b].predecessors)
+                            for (uint byte = 0; byte < m_frame_size; byte++)
+                                written[byte] = written[byte] && written_out[p][byte];
+
+                        for (size_t i = blocks[b].begin; i < blocks[b].end; i++)
+                        {
+                            memory_accesses(m_program[i], m_pointers, accesses);
+                            for (auto const& access : accesses)
+                            {
+                                if (access.pointer.kind != PointerKind::FRAME)
+                                    continue;
+
+                                auto const begin = (uint) access.pointer.offset;
+                                for (uint byte = begin; byte < begin + access.size && byte < m_frame_size; byte++)
+                                {
+                                    if (access.write)
+                                        written[byte] = true;
+                                    else if (!written[byte])
+                                        is_argument[byte] = true;
+                                }
+                            }
+                        }
+
+                        if (written != written_out[b])
+                        {
+                            written_out[b] = written;
+                            changed = true;
+                        }
+                    }
+                }
+
+                for (uint byte = 0; byte < m_frame_size; byte++)
+                {
+                    if (!is_argument[byte])
+                        continue;
+
+                    if (!out_arguments.empty() && out_arguments.back().offset + out_arguments.back().size == byte)
+                        out_arguments.back().size++;
+                    else
+                        out_arguments.push_back(FrameRange{byte, 1});
+                }
+            }
+
+        private:
+            const Program& m_program;
+            const ControlFlowGraph& m_graph;
+            const Liveness& m_liveness;
+            Pointers m_pointers;
+            uint m_frame_size = 0;
+            bool m_reads_any_frame = false;
+    };
+}
+
+uint PurityAnalysis::analyze(const Program& program, std::vector<FunctionPurity>& out_functions, bool resolved_targets)
+{
+    std::vector<ControlFlowGraph> graphs;
+    if (ControlFlowGraph::build(program, graphs, resolved_targets) == FAIL)
+        return FAIL;
+
+    std::vector<Liveness> liveness;
+    Liveness::compute(program, graphs, liveness);
+
+    std::unordered_map<std::string, size_t> function_index;
+    for (size_t g = 0; g < graphs.size(); g++)
+        function_index[graphs[g].name()] = g;
+
+    // Check every function on its own
+    std::vector<FunctionPurity> functions(graphs.size());
+    std::vector<std::vector<std::string>> callees(graphs.size());
+    for (size_t g = 0; g < graphs.size(); g++)
+    {
+        functions[g].name = graphs[g].name();
+        if (g != GLOBAL_SCOPE)
+            FunctionAnalysis(program, graphs[g], liveness[g]).run(functions[g], callees[g]);
+    }
+
+    // Functions calling impure functions are not pure either, recursive calls are pure until proven otherwise
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t g = 0; g < graphs.size(); g++)
+        {
+            if (!functions[g].pure)
+                continue;
+
+            for (auto const& callee : callees[g])
+            {
+                auto it = function_index.find(callee);
+                if (it == function_index.end() || !functions[it->second].pure)
+                {
+                    functions[g].pure = false;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    for (auto& function : functions)
+        if (!function.pure)
+            function.arguments.clear();
+
+    out_functions.swap(functions);
+    return SUCCESS;
+}
@@ -0,0 +1,64 @@
+/**
+ * @file Purity.hpp
+ * @brief Find functions whose result depends on nothing but their arguments
+ *
+ */
+#ifndef PURITY_HPP
+#define PURITY_HPP
+
+// Local includes
+#include "Tac.hpp"
+
+// C++ includes
+#include <string>
+#include <vector>
+
+namespace TacRunner
+{
+    /**
+     * @brief Range of bytes in a function frame
+     *
+     */
+    struct FrameRange
+    {
+        uint offset;    // first byte of the range, relative to BASE
+        uint size;      // how many bytes this range takes
+    };
+
+    /**
+     * @brief Purity of a single function
+     *
+     */
+    struct FunctionPurity
+    {
+        std::string name;                   // function name
+        bool pure = false;                  // if its result only depends on its arguments, and it has no other effect
+        std::vector<FrameRange> arguments;  // frame bytes that might be read before being written, sorted by offset
+    };
+
+    /**
+     * @brief Interprocedural purity analysis. A function is pure when it only reads memory
+     *        from its own frame or from stack memory above it, writes no memory but that one,
+     *        performs no I/O, allocations or exits, reads no register from its callers, does not
+     *        return addresses of its own stack memory and only calls pure functions.
+     *        The frame bytes a pure function reads before writing them are its arguments,
+     *        so calls with the same argument bytes return the same value
+     *
+     */
+    class PurityAnalysis
+    {
+        public:
+            /**
+             * @brief Find which functions of a program are pure
+             *
+             * @param program program to analyze
+             * @param out_functions where to store the purity of every function, the global scope first
+             *                      and then functions in program order. The global scope is never pure
+             * @param resolved_targets if jump targets in the program are already resolved
+             * @return uint success status, 0 on success, 1 on failure
+             */
+            static uint analyze(const Program& program, std::vector<FunctionPurity>& out_functions, bool resolved_targets = false);
+    };
+}
+
+#endif // PURITY_HPP
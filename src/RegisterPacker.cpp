@@ -0,0 +1,122 @@
+// Local includes
+#include "RegisterPacker.hpp"
+#include "ControlFlowGraph.hpp"
+#include "Liveness.hpp"
+#include "Application.hpp"
+
+// C++ includes
+#include <algorithm>
+
+using namespace TacRunner;
+
+namespace
+{
+    /**
+     * @brief Symmetric interference relation between registers of a function
+     *
+     */
+    class InterferenceMatrix
+    {
+        public:
+            InterferenceMatrix(size_t size) : m_size(size), m_rows(size, RegisterSet(size)) { }
+
+            inline void add(size_t a, size_t b)
+            {
+                m_rows[a].set(b);
+                m_rows[b].set(a);
+            }
+
+            inline bool test(size_t a, size_t b) const { return m_rows[a].test(b); }
+
+            inline size_t size() const { return m_size; }
+
+        private:
+            size_t m_size;
+            std::vector<RegisterSet> m_rows;
+    };
+
+    // Slot name shown for registers sharing it
+    void add_slot_name(std::vector<std::string>& slot_names, uint slot, const std::string& name)
+    {
+        if (slot == slot_names.size())
+            slot_names.push_back(name);
+        else
+            slot_names[slot] += "/" + name;
+    }
+}
+
+uint RegisterPacker::pack(const Program& program, std::vector<RegisterWindow>& out_windows, bool resolved_targets)
+{
+    std::vector<ControlFlowGraph> graphs;
+    if (ControlFlowGraph::build(program, graphs, resolved_targets) == FAIL)
+        return FAIL;
+
+    std::vector<Liveness> liveness;
+    Liveness::compute(program, graphs, liveness);
+
+    std::vector<RegisterWindow> windows(graphs.size());
+    for (size_t g = 0; g < graphs.size(); g++)
+    {
+        auto const& blocks = graphs[g].blocks();
+        auto const& live_registers = liveness[g];
+        auto const& names = live_registers.registers();
+        auto& window = windows[g];
+        window.name = graphs[g].name();
+
+        // Too many registers, every one of them gets its own slot
+        bool const packed = names.size() <= MAX_PACKED_REGISTERS;
+
+        // A written register interferes with every register live after it's written
+        InterferenceMatrix interference(packed ? names.size() : 0);
+        for (auto b : graphs[g].reverse_postorder())
+        {
+            auto live = live_registers.live_out(b);
+            window.max_live = std::max(window.max_live, live.count());
+            for (size_t i = blocks[b].end; i --> blocks[b].begin;)
+            {
+                auto const& t = program[i];
+                auto const def = live_registers.defined_id(t);
+                if (packed && def != NO_REGISTER)
+                    for (size_t id = 0; id < names.size(); id++)
+                        if (live.test(id) && id != (size_t) def)
+                            interference.add(def, id);
+
+                live_registers.transfer(t, live);
+                window.max_live = std::max(window.max_live, live.count());
+            }
+        }
+
+        // Greedy coloring in order of appearance, escaping registers get a slot of their own
+        std::vector<uint> slot_of(names.size());
+        std::vector<bool> exclusive_slot;
+        std::vector<bool> used;
+        for (size_t id = 0; id < names.size(); id++)
+        {
+            uint slot = exclusive_slot.size();
+            if (packed && !live_registers.is_escaping(id))
+            {
+                used.assign(exclusive_slot.size(), false);
+                for (size_t other = 0; other < id; other++)
+                    if (interference.test(id, other))
+                        used[slot_of[other]] = true;
+
+                for (uint s = 0; s < exclusive_slot.size(); s++)
+                    if (!used[s] && !exclusive_slot[s])
+                    {
+                        slot = s;
+                        break;
+                    }
+            }
+
+            if (slot == exclusive_slot.size())
+                exclusive_slot.push_back(!packed || live_registers.is_escaping(id));
+
+            slot_of[id] = slot;
+            window.slots[names[id]] = slot;
+            add_slot_name(window.slot_names, slot, names[id]);
+        }
+    }
+
+    out_windows.swap(windows);
+    return SUCCESS;
+}
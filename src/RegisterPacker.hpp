@@ -0,0 +1,59 @@
+/**
+ * @file RegisterPacker.hpp
+ * @brief Assign register window slots to register names, sharing slots between
+ *        registers that are never live at the same time
+ *
+ */
+#ifndef REGISTERPACKER_HPP
+#define REGISTERPACKER_HPP
+
+// Local includes
+#include "Tac.hpp"
+
+// C++ includes
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Functions with more registers than this get a slot per register, as their
+// interference matrix would take too much memory
+#define MAX_PACKED_REGISTERS 4096
+
+namespace TacRunner
+{
+    /**
+     * @brief Register window layout for a single function
+     *
+     */
+    struct RegisterWindow
+    {
+        std::string name;                               // function name
+        std::unordered_map<std::string, uint> slots;    // slot for each register name
+        std::vector<std::string> slot_names;            // names of the registers sharing each slot, separated by '/'
+        size_t max_live = 0;                            // most registers live at the same time
+    };
+
+    /**
+     * @brief Builds register windows using liveness: two registers interfere when one of them
+     *        is written while the other one is live, and registers that don't interfere can share
+     *        a slot. Registers that might be read before being written in a function (escaping ones)
+     *        keep a slot of their own, as their value might come from a caller's window
+     *
+     */
+    class RegisterPacker
+    {
+        public:
+            /**
+             * @brief Compute the register window of every function in a program
+             *
+             * @param program program to compute windows for
+             * @param out_windows where to store the windows, the global scope first and then functions
+             *                    in program order
+             * @param resolved_targets if jump targets in the program are already resolved
+             * @return uint success status, 0 on success, 1 on failure
+             */
+            static uint pack(const Program& program, std::vector<RegisterWindow>& out_windows, bool resolved_targets = false);
+    };
+}
+
+#endif // REGISTERPACKER_HPP
@@ -0,0 +1,172 @@
+#include "Sampler.hpp"
+
+// C++ includes
+#include <algorithm>
+#include <sstream>
+#include <sys/time.h>
+
+// Marks call chains whose outer frames were dropped
+#define TRUNCATED_CHAIN UINT32_MAX
+
+namespace TacRunner
+{
+    std::atomic<Sampler*> Sampler::s_active{nullptr};
+
+    Sampler::Sampler(const TacMachine& machine)
+        : m_machine(machine)
+        , m_buffer(SAMPLE_BUFFER_SIZE)
+    { }
+
+    Sampler::~Sampler()
+    {
+        stop();
+    }
+
+    uint Sampler::start(uint frequency)
+    {
+        Sampler* expected = nullptr;
+        if (frequency == 0 || !s_active.compare_exchange_strong(expected, this))
+            return FAIL;
+
+        struct sigaction action = {};
+        action.sa_handler = handle_signal;
+        action.sa_flags = SA_RESTART; // reads from stdin should not fail when a sample is taken
+        sigemptyset(&action.sa_mask);
+        if (sigaction(SIGPROF, &action, &m_previous_action) != 0)
+        {
+            s_active = nullptr;
+            return FAIL;
+        }
+
+        struct itimerval timer = {};
+        timer.it_interval.tv_sec = 0;
+        timer.it_interval.tv_usec = std::max(1000000u / frequency, 1u);
+        timer.it_value = timer.it_interval;
+        if (setitimer(ITIMER_PROF, &timer, nullptr) != 0)
+        {
+            sigaction(SIGPROF, &m_previous_action, nullptr);
+            s_active = nullptr;
+            return FAIL;
+        }
+
+        m_running = true;
+        return SUCCESS;
+    }
+
+    void Sampler::stop()
+    {
+        if (!m_running)
+            return;
+
+        struct itimerval timer = {};
+        setitimer(ITIMER_PROF, &timer, nullptr);
+        sigaction(SIGPROF, &m_previous_action, nullptr);
+        s_active = nullptr;
+        m_running = false;
+
+        collect();
+    }
+
+    void Sampler::handle_signal(int)
+    {
+        auto* const sampler = s_active.load(std::memory_order_acquire);
+        if (sampler == nullptr)
+            return;
+
+        auto const head = sampler->m_head.load(std::memory_order_relaxed);
+        if (head - sampler->m_tail.load(std::memory_order_acquire) == SAMPLE_BUFFER_SIZE)
+        {
+            sampler->m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        auto const& machine = sampler->m_machine;
+        auto& sample = sampler->m_buffer[head % SAMPLE_BUFFER_SIZE];
+        sample.pc = machine.m_program_counter;
+        sample.depth = 0;
+        sample.truncated = false;
+
+        // Frames can't be read while they are being moved to a bigger buffer
+        if (!machine.m_frames_moving)
+        {
+            auto const* const frames = machine.m_frames.data();
+            auto const size = machine.m_frames.size();
+            auto const first = size > SAMPLE_MAX_DEPTH ? size - SAMPLE_MAX_DEPTH : 0;
+            for (size_t i = first; i < size; i++)
+                sample.functions[i - first] = frames[i].function;
+
+            sample.depth = size - first;
+            sample.truncated = first != 0;
+        }
+
+        sampler->m_head.store(head + 1, std::memory_order_release);
+    }
+
+    void Sampler::collect()
+    {
+        auto const head = m_head.load(std::memory_order_acquire);
+        auto tail = m_tail.load(std::memory_order_relaxed);
+        for (; tail != head; tail++)
+        {
+            auto const& sample = m_buffer[tail % SAMPLE_BUFFER_SIZE];
+            std::vector<uint32_t> chain;
+            chain.reserve(sample.depth + 1);
+            if (sample.truncated)
+                chain.push_back(TRUNCATED_CHAIN);
+
+            chain.insert(chain.end(), sample.functions, sample.functions + sample.depth);
+            m_stacks[chain]++;
+            m_instructions[sample.pc]++;
+            m_samples++;
+        }
+
+        m_tail.store(tail, std::memory_order_release);
+    }
+
+    std::string Sampler::folded(const std::vector<FunctionInfo>& functions) const
+    {
+        std::stringstream ss;
+        for (auto const& [chain, count] : m_stacks)
+        {
+            if (chain.empty())
+                ss << "[unknown]";
+
+            // The global scope is left out when it called a function, every chain starts there
+            size_t const first = chain.size() > 1 && chain[0] == GLOBAL_SCOPE ? 1 : 0;
+            for (size_t i = first; i < chain.size(); i++)
+            {
+                ss << (i == first ? "" : ";");
+                if (chain[i] == TRUNCATED_CHAIN)
+                    ss << "[truncated]";
+                else
+                    ss << functions[chain[i]].name;
+            }
+
+            ss << " " << count << std::endl;
+        }
+
+        return ss.str();
+    }
+
+    std::string Sampler::str(const Program& program) const
+    {
+        std::stringstream ss;
+        ss << "Sampling: " << m_samples << " samples, " << m_dropped << " dropped";
+
+        // Samples per source line
+        std::map<size_t, uint64_t> lines;
+        for (auto const& [pc, count] : m_instructions)
+            if (pc < program.size() && program[pc].line() != 0)
+                lines[program[pc].line()] += count;
+
+        std::vector<std::pair<size_t, uint64_t>> hottest(lines.begin(), lines.end());
+        std::stable_sort(hottest.begin(), hottest.end(), [](auto const& a, auto const& b) { return a.second > b.second; });
+        if (hottest.size() > SAMPLE_TOP_LINES)
+            hottest.resize(SAMPLE_TOP_LINES);
+
+        for (auto const& [line, count] : hottest)
+            ss << std::endl << "\tline " << line << ": " << count << " samples";
+
+        return ss.str();
+    }
+}
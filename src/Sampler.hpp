@@ -0,0 +1,114 @@
+/**
+ * @file Sampler.hpp
+ * @brief Sampling profiler recording the call chain of a running machine from a SIGPROF handler
+ *
+ */
+#ifndef SAMPLER_HPP
+#define SAMPLER_HPP
+
+// Local includes
+#include "TacMachine.hpp"
+
+// C++ includes
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <signal.h>
+
+#define SAMPLE_DEFAULT_FREQUENCY 1000   // samples per second of cpu time by default
+#define SAMPLE_BUFFER_SIZE 4096         // samples the handler can store before the machine collects them
+#define SAMPLE_MAX_DEPTH 64             // innermost frames recorded per sample, deeper ones are dropped
+#define SAMPLE_COLLECT_MASK 0xFFFF      // the machine collects samples every SAMPLE_COLLECT_MASK + 1 instructions
+#define SAMPLE_TOP_LINES 5              // hottest lines shown in the summary
+
+namespace TacRunner
+{
+    /**
+     * @brief State of the machine when a sample was taken
+     *
+     */
+    struct Sample
+    {
+        size_t pc;                                  // instruction being run
+        uint32_t depth;                             // frames recorded, 0 if the frame stack was moving
+        bool truncated;                             // if outer frames were dropped
+        uint32_t functions[SAMPLE_MAX_DEPTH];       // function of each frame, outermost first
+    };
+
+    /**
+     * @brief Samples the program counter and the frame stack of a machine at a fixed rate of cpu
+     *        time, using setitimer and a SIGPROF handler. The handler only copies the state into
+     *        a preallocated ring buffer with atomic indices, the machine collects samples from it
+     *        while running and aggregates them by call chain. Frames pushed by native code are not
+     *        visible, so time in native code goes to the function where it was entered
+     *
+     */
+    class Sampler
+    {
+        public:
+            /**
+             * @brief Create a sampler for a machine, not started yet
+             *
+             * @param machine machine to sample, should outlive the sampler
+             */
+            Sampler(const TacMachine& machine);
+            ~Sampler();
+
+            /**
+             * @brief Start sampling. Only one sampler can run at the same time
+             *
+             * @param frequency samples per second of cpu time
+             * @return uint success status, 0 on success, 1 if the timer or the handler could not be set
+             */
+            uint start(uint frequency);
+
+            /**
+             * @brief Stop sampling, and collect pending samples
+             *
+             */
+            void stop();
+
+            /**
+             * @brief Aggregate samples taken since the last call, freeing their space in the ring buffer
+             *
+             */
+            void collect();
+
+            /**
+             * @brief Samples aggregated by call chain in folded stack format, one line per chain:
+             *        function names from outermost to innermost separated by ';', then the count
+             *
+             * @param functions function table of the machine
+             * @return std::string folded stacks, ready for flamegraph.pl
+             */
+            std::string folded(const std::vector<FunctionInfo>& functions) const;
+
+            /**
+             * @brief Summary of the samples taken, and the source lines with most samples
+             *
+             * @param program program being sampled
+             * @return std::string human readable summary
+             */
+            std::string str(const Program& program) const;
+
+        private:
+            static void handle_signal(int signal);
+
+            static std::atomic<Sampler*> s_active;      // sampler the signal handler writes to
+
+            const TacMachine& m_machine;
+            std::vector<Sample> m_buffer;               // ring buffer written by the handler
+            std::atomic<uint64_t> m_head{0};            // samples written by the handler
+            std::atomic<uint64_t> m_tail{0};            // samples collected by the machine
+            std::atomic<uint64_t> m_dropped{0};         // samples lost because the buffer was full
+            std::map<std::vector<uint32_t>, uint64_t> m_stacks;    // samples per call chain
+            std::map<size_t, uint64_t> m_instructions;  // samples per instruction
+            uint64_t m_samples = 0;                     // samples collected
+            bool m_running = false;
+            struct sigaction m_previous_action;         // SIGPROF handler before starting
+    };
+}
+
+#endif // SAMPLER_HPP
@@ -128,6 +128,12 @@ std::string TacRunner::instr_to_str(Instr instr)
     case Instr::READC:
         return "readc";
         break;
+    case Instr::ITOF:
+        return "itof";
+        break;
+    case Instr::FTOI:
+        return "ftoi";
+        break;
     case Instr::METAFUNBEGIN:
         return "@fun_begin";
         break;
@@ -227,6 +233,29 @@ Tac::Tac(Instr inst, const Value argument1, const Value argument2, const Value a
 
 Tac::~Tac()
 { }
+
+const Variable* Tac::defined_variable() const
+{
+    switch (m_instr)
+    {
+    case Instr::ASSIGNW: case Instr::ASSIGNB:
+    case Instr::ADD: case Instr::SUB: case Instr::MULT: case Instr::DIV: case Instr::MOD:
+    case Instr::MINUS: case Instr::NEG:
+    case Instr::EQ: case Instr::NEQ: case Instr::AND: case Instr::OR:
+    case Instr::LT: case Instr::LEQ: case Instr::GT: case Instr::GEQ:
+    case Instr::MALLOC: case Instr::CALL: case Instr::PARAM:
+    case Instr::READI: case Instr::READF: case Instr::READC:
+    case Instr::ITOF: case Instr::FTOI:
+        break;
+    default:
+        return nullptr;
+    }
+
+    if (m_args.empty() || !m_args[0].is<Variable>() || m_args[0].get<Variable>().is_access)
+        return nullptr;
+
+    return &m_args[0].get<Variable>();
+}
     
 std::string Tac::str() const {
     std::stringstream ts;
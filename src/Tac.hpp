@@ -72,6 +72,9 @@ namespace TacRunner {
 
     using Access = std::variant<int, std::string>;
 
+    // Slot value for variables whose register was not resolved yet
+    #define NO_SLOT -1
+
     /**
      * @brief Variable of a variable
      * 
@@ -81,6 +84,8 @@ namespace TacRunner {
         std::string name;
         Access index;
         bool is_access;
+        int slot = NO_SLOT;         // register slot for 'name', resolved by the machine when loading the program
+        int index_slot = NO_SLOT;   // register slot for 'index', when it's a variable name
 
         public:
         std::string str() const;
@@ -127,10 +132,19 @@ namespace TacRunner {
              * @brief Get the value stored in the variant
              * 
              * @tparam T variant type you'll try to get
-             * @return T value if it's actually of type T, exception otherwise
+             * @return const T& value if it's actually of type T, exception otherwise
+             */
+            template<typename T>
+            inline const T& get() const { return std::get<T>(m_actual_value); }
+
+            /**
+             * @brief Get a reference to the value stored in the variant, so it can be modified in place
+             * 
+             * @tparam T variant type you'll try to get
+             * @return T& reference to value if it's actually of type T, exception otherwise
              */
             template<typename T>
-            inline T get() const { return std::get<T>(m_actual_value); }
+            inline T& get() { return std::get<T>(m_actual_value); }
 
             /**
              * @brief Set the value of this type to the given one
@@ -167,10 +181,70 @@ namespace TacRunner {
         std::string str() const;
         inline Instr instr() const {return m_instr;}
         inline const std::vector<Value>& args() const { return m_args; }
+        inline std::vector<Value>& args() { return m_args; }
+
+        /**
+         * @brief Tells if this is a call whose frame can replace its caller's frame, 
+         *        as its result is immediately returned. Set by the machine when loading the program
+         * 
+         */
+        inline bool is_tail_call() const { return m_tail_call; }
+        inline void set_tail_call(bool tail_call) { m_tail_call = tail_call; }
+
+        /**
+         * @brief Program position a jump or call goes to. The label name is kept in 
+         *        the arguments, this position is resolved by the machine when loading the program
+         * 
+         */
+        inline size_t target() const { return m_target; }
+        inline void set_target(size_t target) { m_target = target; }
+
+        /**
+         * @brief Line of the source file this instruction was parsed from, 0 when it 
+         *        does not come from a source file
+         * 
+         */
+        inline size_t line() const { return m_line; }
+        inline void set_line(size_t line) { m_line = line; }
+
+        /**
+         * @brief Register written by this instruction, if any
+         * 
+         * @return const Variable* variable naming the written register, nullptr if this instruction 
+         *         does not write a register
+         */
+        const Variable* defined_variable() const;
+
+        /**
+         * @brief Call 'f' with the name of every register read by this instruction. Reads of
+         *        BASE and STACK are reported as well, implicit reads (like STACK in param) are not
+         * 
+         * @param f function taking a const std::string& with the register name
+         */
+        template<typename F>
+        void for_each_used_register(F&& f) const
+        {
+            auto const* def = defined_variable();
+            for (auto const& arg : m_args)
+            {
+                if (!arg.is<Variable>())
+                    continue;
+
+                auto const& var = arg.get<Variable>();
+                if (std::holds_alternative<std::string>(var.index))
+                    f(std::get<std::string>(var.index));
+
+                if (&var != def)
+                    f(var.name);
+            }
+        }
         
     private:
         Instr m_instr;
         std::vector<Value> m_args;
+        bool m_tail_call = false;
+        size_t m_target = 0;
+        size_t m_line = 0;
     };
 
     using Program = std::vector<Tac>;
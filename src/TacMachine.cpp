@@ -1,7 +1,21 @@
 #include "TacMachine.hpp"
+#include "JitCompiler.hpp"
+#include "Trace.hpp"
+#include "ClosureEngine.hpp"
+#include "LineProfiler.hpp"
+#include "Sampler.hpp"
+#include "EventTracer.hpp"
+#include "MemoryTracer.hpp"
+#include "HeapProfiler.hpp"
 #include "Application.hpp"
 #include "Tac.hpp"
+#include "MachineSnapshot.hpp"
+#include "RegisterPacker.hpp"
 #include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <fstream>
+#include <set>
 #include <string.h>
 #include <assert.h>
 
@@ -19,6 +33,12 @@ MemoryChunk::MemoryChunk(uint size, uint start_pos)
 
     memset(mem_ptr, 0, m_size);
 }
+
+MemoryChunk::MemoryChunk(uint size, uint start_pos, std::shared_ptr<std::byte []> memory)
+    : m_start_pos(start_pos)
+    , m_size(size)
+    , m_memory(memory)
+{ }
     
 std::string MemoryChunk::str(bool show_memory) const
 {
@@ -613,6 +633,9 @@ uint MemoryManager::write(const std::byte *bytes, size_t count, uint virtual_add
         return FAIL;
     }
 
+    if (m_tracer != nullptr)
+        m_tracer->record(virtual_address, count, type, true);
+
     // Write to the right type of memory
     switch (type)
     {
@@ -676,6 +699,9 @@ uint MemoryManager::read(std::byte *bytes, size_t count, uint virtual_address)
         return FAIL;
     }
 
+    if (m_tracer != nullptr)
+        m_tracer->record(virtual_address, count, type, false);
+
     // Read from the right type of memory
     switch (type)
     {
@@ -703,14 +729,12 @@ uint MemoryManager::read(std::byte *bytes, size_t count, uint virtual_address)
 uint MemoryManager::move(uint src, uint dest, size_t count)
 {
     // a byte buffer to perform the move operation
-    std::byte * buffer = new std::byte[count];
+    std::vector<std::byte> buffer(count);
 
-    if (read(buffer, count, src) == FAIL)
+    if (read(buffer.data(), count, src) == FAIL)
         return FAIL;
-    else
-        return write(buffer, count, dest);
-    
-    delete buffer;
+
+    return write(buffer.data(), count, dest);
 }
 
 uint MemoryManager::set_stack_pointer(size_t new_sp)
@@ -816,32 +840,78 @@ TacMachine::TacMachine(Program program)
     , m_memory()
     , m_status(Status::NOT_STARTED)
     , m_exit_status_code(0)
+    , m_step_count(0)
 {
     m_frame_pointer = stack_pointer();
 
-    // push global scope to callstack
-    m_callstack.push_back(CallStackData{"<GLOBAL SCOPE>", Registers(), 0});
-
-
     // initialize instruction counting
     reset_instruction_count();
 
     // Create instruction map
-    if (set_up_label_map() == FAIL)
+    auto const start = std::chrono::steady_clock::now();
+    if (set_up_label_map() == FAIL || resolve_labels() == FAIL)
     {
         App::error("Error trying to parse labels into line numbers");
         m_status = Status::ERROR;
     }
+
+    // Assign a register slot to every variable
+    auto const labels_done = std::chrono::steady_clock::now();
+    if (resolve_registers() == FAIL)
+    {
+        App::error("Error trying to assign registers to variables");
+        m_status = Status::ERROR;
+    }
+
+    // Find calls that can reuse their caller's frame
+    auto const registers_done = std::chrono::steady_clock::now();
+    find_tail_calls();
+    auto const tail_calls_done = std::chrono::steady_clock::now();
+
+    // push global scope to frame stack
+    m_frames.reserve(FRAME_STACK_RESERVE);
+    m_register_file.reserve(REGISTER_FILE_RESERVE);
+    m_register_valid.reserve(REGISTER_FILE_RESERVE);
+
+    auto const global_size = m_functions[GLOBAL_SCOPE].slot_names.size();
+    m_frames.push_back(Frame{0, m_memory.stack_pointer(), m_frame_pointer, NO_SLOT, GLOBAL_SCOPE, 0, global_size, 0});
+    m_register_file.resize(global_size, 0);
+    m_register_valid.resize(global_size, 0);
+
+    // Hot functions are compiled into native code
+    if (JIT_SUPPORTED && m_status != Status::ERROR)
+    {
+        m_jit = std::make_unique<JitCompiler>(m_program, m_instruction_function);
+        m_hotness.resize(m_functions.size(), 0);
+    }
+
+    // Hot loops are recorded into traces
+    if (m_status != Status::ERROR)
+    {
+        m_traces.resize(m_program.size());
+        m_loop_hotness.resize(m_program.size(), 0);
+        m_trace_attempts.resize(m_program.size(), 0);
+    }
+
+    m_setup_times.labels = labels_done - start;
+    m_setup_times.registers = registers_done - labels_done;
+    m_setup_times.tail_calls = tail_calls_done - registers_done;
+    m_setup_times.compilers = std::chrono::steady_clock::now() - tail_calls_done;
 }
 
-void TacMachine::run_tac_program()
+TacMachine::~TacMachine() = default;
+
+void TacMachine::run_tac_program(uint64_t max_steps)
 {
-    // Expects to be ready to init 
-    if (m_status != Status::NOT_STARTED)
+    // Expects to be ready to init or to continue a paused execution
+    if (m_status != Status::NOT_STARTED && m_status != Status::PAUSED)
         return;
 
+    if (m_status == Status::NOT_STARTED)
+        m_program_counter = 0;
+
     m_status = Status::RUNNING;
-    m_program_counter = 0;
+    uint64_t steps = 0;
     while(m_status == Status::RUNNING)
     {
         // Check if the program finished
@@ -851,11 +921,43 @@ void TacMachine::run_tac_program()
             continue;
         }
 
+        // Check if we ran out of steps for this run
+        if (max_steps != 0 && steps == max_steps)
+        {
+            m_status = Status::PAUSED;
+            continue;
+        }
+
         // Consistency checking
         assert(m_program_counter >= 0 && m_program_counter < m_program.size() && "Program counter out of bound");
 
+        // Native code runs until it reaches an instruction it can't run, which is interpreted. 
+        // Runs with a step limit are interpreted, as native code doesn't stop on it
+        if (m_jit != nullptr && max_steps == 0)
+            run_native();
+
+        // Traces run until they leave the loop, with the same restriction as native code
+        if (!m_traces.empty() && max_steps == 0 && !m_recording && m_traces[m_program_counter] != nullptr)
+            run_trace();
+
+        if (m_recording)
+            record_trace_step();
+
+#ifndef TAC_NO_PROFILE
+        if (m_profiling)
+            count_instruction(m_program[m_program_counter].instr());
+
+        if (m_line_profiler != nullptr)
+            m_line_profiler->step(m_program_counter, m_frames, m_step_count);
+#endif
+
+        if (m_sampler != nullptr && (m_step_count & SAMPLE_COLLECT_MASK) == 0)
+            m_sampler->collect();
+
         // Run a single instruction
-        auto status = run_tac_instruction(m_program[m_program_counter]);
+        auto status = m_closures.empty() ? 
+                        run_tac_instruction(m_program[m_program_counter]) : 
+                        m_closures[m_program_counter].fn(m_closures[m_program_counter], *this);
 
         // Check its status
         if (status == FAIL)
@@ -865,54 +967,125 @@ void TacMachine::run_tac_program()
         }
 
         m_program_counter++;
+        m_step_count++;
+        steps++;
     }
 }
 
 void TacMachine::set_register(const std::string &reg_name, REGISTER_TYPE value)
 {
-    // If one of the special variables, override register map assign
+    // If one of the special variables, override register assign
+    if (reg_name == BASE)
+        return set_slot(BASE_SLOT, value);
+    else if ( reg_name == STACK)
+        return set_slot(STACK_SLOT, value);
+
+    // Otherwise, set register in top frame, growing its window if this name is new
+    assert(m_frames.size() != 0);
+    auto& frame = m_frames.back();
+    auto const slot = m_functions[frame.function].slot_of(reg_name);
+    if (slot >= frame.window_size)
+    {
+        frame.window_size = slot + 1;
+        m_register_file.resize(frame.window + frame.window_size, 0);
+        m_register_valid.resize(frame.window + frame.window_size, 0);
+    }
+
+    set_slot(slot, value);
+}
+
+void TacMachine::set_register(const Variable &var, REGISTER_TYPE value)
+{
+    if (var.slot == NO_SLOT)
+        return set_register(var.name, value);
+
+    set_slot(var.slot, value);
+}
+
+uint TacMachine::get_register(const std::string &reg_name, REGISTER_TYPE &out_value)
+{
+    // Check if register is special register
     if (reg_name == BASE)
+        return get_slot(BASE_SLOT, reg_name, out_value);
+    else if(reg_name == STACK)
+        return get_slot(STACK_SLOT, reg_name, out_value);
+
+    return find_register(reg_name, out_value);
+}
+
+uint TacMachine::get_register(const Variable &var, REGISTER_TYPE &out_value)
+{
+    if (var.slot == NO_SLOT)
+        return get_register(var.name, out_value);
+
+    return get_slot(var.slot, var.name, out_value);
+}
+
+void TacMachine::set_slot(int slot, REGISTER_TYPE value)
+{
+    if (slot == BASE_SLOT)
     {
         m_frame_pointer = value;
         return;
     }
-    else if ( reg_name == STACK)
+    else if (slot == STACK_SLOT)
     {
         m_memory.set_stack_pointer(static_cast<size_t>(value));
         return;
     }
 
-    // Otherwise, set register in first stack entry
-    assert(m_callstack.size() != 0);
-    m_callstack.back().func_regs[reg_name] = value;
+    auto const& frame = m_frames.back();
+    assert(slot >= 0 && static_cast<size_t>(slot) < frame.window_size && "Register slot out of frame window");
+
+    auto const reg = frame.window + slot;
+    m_register_file[reg] = value;
+    m_register_valid[reg] = true;
 }
 
-uint TacMachine::get_register(const std::string &reg_name, REGISTER_TYPE &out_value)
+uint TacMachine::get_slot(int slot, const std::string& reg_name, REGISTER_TYPE &out_value)
 {
-    // Check if register is special register
-    if (reg_name == BASE)
+    if (slot == BASE_SLOT)
     {
         out_value = m_frame_pointer;
         return SUCCESS;
     }
-    else if(reg_name == STACK)
+    else if (slot == STACK_SLOT)
     {
         out_value = static_cast<REGISTER_TYPE>(m_memory.stack_pointer());
         return SUCCESS;
     }
 
-    for(size_t i = m_callstack.size(); i --> 0;)
+    // Check if it was set in the current frame
+    auto const& frame = m_frames.back();
+    auto const reg = frame.window + slot;
+    if (slot >= 0 && static_cast<size_t>(slot) < frame.window_size && m_register_valid[reg])
+    {
+        out_value = m_register_file[reg];
+        return SUCCESS;
+    }
+
+    // Otherwise, it might be set in a previous frame
+    return find_register(reg_name, out_value);
+}
+
+uint TacMachine::find_register(const std::string& reg_name, REGISTER_TYPE &out_value)
+{
+    for(size_t i = m_frames.size(); i --> 0;)
     {
-        auto const& regs = m_callstack[i].func_regs;
+        auto const& frame = m_frames[i];
+        auto const& slots = m_functions[frame.function].slots;
 
         // Search for first occurence of the provided register
-        auto it = regs.find(reg_name);
-        if (it == regs.end()) // could not find it
+        auto it = slots.find(reg_name);
+        if (it == slots.end() || it->second >= frame.window_size) // could not find it
             // keep searching 
             continue;
-        
-        auto &[_, value] = *it;
-        out_value = value;
+
+        auto const reg = frame.window + it->second;
+        if (!m_register_valid[reg]) // not set in this frame
+            continue;
+
+        out_value = m_register_file[reg];
         return SUCCESS;
     }    
     
@@ -923,6 +1096,16 @@ uint TacMachine::get_register(const std::string &reg_name, REGISTER_TYPE &out_va
     return FAIL;
 }
 
+uint TacMachine::save_snapshot(const std::string& filename) const
+{
+    return MachineSnapshot::save(*this, filename);
+}
+
+uint TacMachine::load_snapshot(const std::string& filename)
+{
+    return MachineSnapshot::load(*this, filename);
+}
+
 uint TacMachine::goto_label(std::string label_name)
 {
     auto it = m_label_map.find(label_name);
@@ -940,26 +1123,43 @@ uint TacMachine::goto_label(std::string label_name)
     auto const&[_, line_num] = *it;
 
     // Update program counter
-    m_program_counter = line_num;
+    jump_to(line_num);
     return SUCCESS;
 }
 
-void TacMachine::push_program_state(const std::string& next_return_reg)
+void TacMachine::push_frame(size_t return_pc, uint function, int return_slot)
 {
-    m_back_ups.push(
-        BackUp
+    // The new window starts right after the top frame's window, which is the end of the register file
+    auto const window = m_register_file.size();
+    auto const window_size = m_functions[function].slot_names.size();
+
+    // Frames are read by the sampling profiler from a signal handler, tell it when they move
+    m_frames_moving = m_frames.size() == m_frames.capacity();
+    m_frames.push_back(
+        Frame
         {
-            program_counter(), 
-            stack_pointer(), 
+            return_pc, 
+            m_memory.stack_pointer(), 
             frame_pointer(), 
-            next_return_reg
+            return_slot,
+            function,
+            window,
+            window_size,
+            0
         }
     );
+    m_frames_moving = false;
+
+    m_register_file.resize(window + window_size, 0);
+    m_register_valid.resize(window + window_size, 0);
+
+    if (m_event_tracer != nullptr)
+        m_event_tracer->begin(function, m_program_counter);
 }
 
-uint TacMachine::pop_program_state()
+uint TacMachine::pop_frame()
 {
-    if(m_back_ups.size() == 0)
+    if(m_frames.size() <= 1)
     {
         stringstream ss;
         
@@ -968,12 +1168,22 @@ uint TacMachine::pop_program_state()
         return FAIL;
     }
 
-    auto const& backup = last_back_up();
-    m_program_counter = backup.program_counter;
-    m_memory.set_stack_pointer(backup.stack_pointer);
-    m_frame_pointer = backup.frame_pointer;
+    // Calls leaving this frame without returning a value are not remembered
+    while (!m_pending_memos.empty() && m_pending_memos.back().frame >= m_frames.size())
+        m_pending_memos.pop_back();
+
+    auto const& frame = m_frames.back();
+    if (m_event_tracer != nullptr)
+        m_event_tracer->end(frame.function, m_program_counter);
 
-    m_back_ups.pop();
+    m_program_counter = frame.program_counter;
+    m_memory.set_stack_pointer(frame.stack_pointer);
+    m_frame_pointer = frame.frame_pointer;
+
+    // Discard frame registers
+    m_register_file.resize(frame.window);
+    m_register_valid.resize(frame.window);
+    m_frames.pop_back();
 
     return SUCCESS;
 }
@@ -1081,20 +1291,20 @@ uint TacMachine::run_tac_instruction(const Tac &tac)
 
 void TacMachine::reset_instruction_count()
 {
-    for(int int_inst = 0; int_inst != static_cast<int>(Instr::__LAST__); int_inst++)
-    {
-        Instr inst = static_cast<Instr>(int_inst);
-        m_instruction_count[inst] = 0;
-    }
+    m_instruction_count.fill(0);
+    m_pair_count.fill(0);
+    m_last_instruction = INSTRUCTION_KINDS;
 }
 
 uint TacMachine::set_up_label_map()
 {
     m_label_map.clear();
-    // Find labels in program
+
+    // Find labels in program, and remove them as they do nothing when executed
+    size_t next = 0;
     for(size_t i = 0; i < m_program.size(); i++)
     {
-        auto const &t = m_program[i];
+        auto &t = m_program[i];
         std::string label_name;
 
         if (t.instr() == Instr::METALABEL) // if label, get instruction name (first argument)
@@ -1120,28 +1330,604 @@ uint TacMachine::set_up_label_map()
             // Get function name as a label
             label_name = name_arg.get<std::string>();
         }
-        else 
+
+        if (!label_name.empty())
+        {
+            // Check that such label does not exists yet
+            if (m_label_map.find(label_name) != m_label_map.end())
+            {
+                stringstream ss;
+                ss << "Duplicate label: " << label_name;
+                App::error(ss.str());
+
+                return FAIL;
+            }
+
+            // Labels point to the next instruction that will be kept
+            m_label_map[label_name] = next;
+        }
+
+        if (t.instr() != Instr::METALABEL)
+        {
+            if (next != i)
+                m_program[next] = std::move(t);
+            next++;
+        }
+    }
+
+    m_program.resize(next);
+
+    return SUCCESS;
+}
+
+uint TacMachine::resolve_labels()
+{
+    for(auto &t : m_program)
+    {
+        if (t.instr() != Instr::GOTO && t.instr() != Instr::GOIF && t.instr() != Instr::GOIFNOT && t.instr() != Instr::CALL)
             continue;
-        
-        // Check that such label does not exists yet
-        if (m_label_map.find(label_name) != m_label_map.end())
+
+        // Label is first argument for jumps, second for calls
+        auto const& args = t.args();
+        auto const& label_arg = t.instr() == Instr::CALL ? args[1] : args[0];
+        assert(label_arg.is<std::string>() && "Jumps and calls should provide a label name");
+
+        auto const& label = label_arg.get<std::string>();
+        auto it = m_label_map.find(label);
+        if (it == m_label_map.end())
         {
             stringstream ss;
-            ss << "Duplicate label: " << label_name;
+            ss << "Undefined label '" << label << "' in instruction: " << t.str();
             App::error(ss.str());
 
             return FAIL;
         }
-        m_label_map[label_name] = i;
+
+        t.set_target(it->second);
+    }
+
+    return SUCCESS;
+}
+
+uint TacMachine::resolve_registers()
+{
+    // Registers never live at the same time share a slot. If windows can't be computed, 
+    // every register gets its own slot when it's first found
+    std::vector<RegisterWindow> windows;
+    if (RegisterPacker::pack(m_program, windows, true) == FAIL)
+        windows.clear();
+
+    auto function_info = [&windows](size_t function, const std::string& name) {
+        if (function >= windows.size())
+            return FunctionInfo{name, {}, {}};
+
+        auto& window = windows[function];
+        return FunctionInfo{name, std::move(window.slot_names), std::move(window.slots), window.max_live};
+    };
+
+    m_functions.clear();
+    m_functions.push_back(function_info(GLOBAL_SCOPE, "<GLOBAL SCOPE>"));
+    m_instruction_function.assign(m_program.size(), GLOBAL_SCOPE);
+
+    uint current_function = GLOBAL_SCOPE;
+    for(size_t i = 0; i < m_program.size(); i++)
+    {
+        auto &t = m_program[i];
+        auto &args = t.args();
+
+        if (t.instr() == Instr::METAFUNBEGIN)
+        {
+            assert(args.size() == 2 && args[0].is<std::string>() && "Error: @function should provide function name and stack size");
+            m_functions.push_back(function_info(m_functions.size(), args[0].get<std::string>()));
+            current_function = m_functions.size() - 1;
+        }
+
+        m_instruction_function[i] = current_function;
+
+        // Static data names are registers as well
+        if (t.instr() == Instr::METASTATICV || t.instr() == Instr::METASTRING)
+        {
+            assert(args.size() == 2 && args[0].is<std::string>());
+            resolve_slot(current_function, args[0].get<std::string>());
+        }
+
+        for (auto &arg : args)
+        {
+            if (!arg.is<Variable>())
+                continue;
+
+            auto &var = arg.get<Variable>();
+            var.slot = resolve_slot(current_function, var.name);
+            if (std::holds_alternative<std::string>(var.index))
+                var.index_slot = resolve_slot(current_function, std::get<std::string>(var.index));
+        }
+
+        if (t.instr() == Instr::METAFUNEND)
+            current_function = GLOBAL_SCOPE;
+    }
+
+    return SUCCESS;
+}
+
+uint TacMachine::find_tail_calls()
+{
+    auto const n_functions = m_functions.size();
+
+    // Register names written and read by each function
+    std::vector<std::set<std::string>> written(n_functions), read(n_functions);
+
+    // Registers holding addresses derived from BASE or from the outgoing arguments, for each function
+    std::vector<std::set<std::string>> frame_pointers(n_functions, {BASE});
+
+    // Functions whose frame can be reused by a tail call
+    std::vector<bool> reusable(n_functions, true);
+
+    // Collect reads and writes, and propagate frame pointers until nothing changes
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for(size_t i = 0; i < m_program.size(); i++)
+        {
+            auto const& t = m_program[i];
+            auto const function = m_instruction_function[i];
+            auto const& args = t.args();
+            auto const* def = t.defined_variable();
+            auto& pointers = frame_pointers[function];
+
+            if (def != nullptr)
+                written[function].insert(def->name);
+
+            // param X k makes X point into the outgoing arguments
+            bool derives_pointer = t.instr() == Instr::PARAM;
+            for (auto const& arg : args)
+            {
+                if (!arg.is<Variable>())
+                    continue;
+
+                auto const& var = arg.get<Variable>();
+                if (var.name == STACK)
+                    reusable[function] = false;
+
+                if (std::holds_alternative<std::string>(var.index))
+                    read[function].insert(std::get<std::string>(var.index));
+
+                if (&arg == &args[0] && def != nullptr)
+                    continue;
+
+                read[function].insert(var.name);
+
+                // Using a frame address as access base or in memcpy does not leak it
+                if (pointers.count(var.name) == 0 || var.is_access || t.instr() == Instr::MEMCPY)
+                    continue;
+
+                if (def != nullptr)
+                    derives_pointer = true;
+                else
+                    reusable[function] = false; // the address escapes
+            }
+
+            if (derives_pointer && def != nullptr && pointers.insert(def->name).second)
+                changed = true;
+        }
+    }
+
+    // A callee may only read registers it writes itself, or that no function but the global scope writes
+    std::set<std::string> written_by_functions;
+    for (size_t g = 0; g < n_functions; g++)
+        if (g != GLOBAL_SCOPE)
+            written_by_functions.insert(written[g].begin(), written[g].end());
+
+    std::vector<bool> reads_own_registers(n_functions, true);
+    for (size_t f = 0; f < n_functions; f++)
+        for (auto const& name : read[f])
+        {
+            if (written[f].count(name) != 0 || name == BASE || name == STACK)
+                continue;
+
+            if (written_by_functions.count(name) != 0)
+                reads_own_registers[f] = false;
+        }
+
+    // Find 'call T f' followed by 'return T'
+    for(size_t i = 0; i < m_program.size(); i++)
+    {
+        auto &t = m_program[i];
+        auto const caller = m_instruction_function[i];
+        if (t.instr() != Instr::CALL || caller == GLOBAL_SCOPE || !reusable[caller])
+            continue;
+
+        auto const& return_var = t.args()[0].get<Variable>();
+
+        // Next executed instruction should be the return
+        size_t next = i + 1;
+        if (next == m_program.size() || m_program[next].instr() != Instr::RETURN)
+            continue;
+
+        auto const& return_arg = m_program[next].args()[0];
+        if (!return_arg.is<Variable>() || return_arg.get<Variable>().is_access || return_arg.get<Variable>().name != return_var.name)
+            continue;
+
+        // The target should be a function, calls to a label at the end of the program have none
+        if (t.target() >= m_program.size() || m_program[t.target()].instr() != Instr::METAFUNBEGIN)
+            continue;
+
+        if (reads_own_registers[m_instruction_function[t.target()]])
+            t.set_tail_call(true);
+    }
+
+    return SUCCESS;
+}
+
+int TacMachine::resolve_slot(uint function, const std::string& reg_name)
+{
+    if (reg_name == BASE)
+        return BASE_SLOT;
+    else if (reg_name == STACK)
+        return STACK_SLOT;
+
+    return m_functions[function].slot_of(reg_name);
+}
+
+std::string TacMachine::register_windows_str() const
+{
+    std::stringstream ss;
+    ss << "Register windows:";
+    for (auto const& function : m_functions)
+        ss << std::endl << "\t" << function.name << ": " << function.slots.size() << " registers in " 
+           << function.slot_names.size() << " slots, at most " << function.max_live << " live";
+
+    return ss.str();
+}
+
+uint TacMachine::enable_memoization()
+{
+    std::vector<FunctionPurity> purity;
+    if (PurityAnalysis::analyze(m_program, purity, true) == FAIL || purity.size() != m_functions.size())
+    {
+        App::warning("Could not find pure functions, calls won't be memoized");
+        return FAIL;
     }
 
+    m_purity.swap(purity);
+    m_memo_table.assign(MEMO_TABLE_SIZE, MemoEntry{});
+    m_memo_calls.assign(m_functions.size(), 0);
+    m_memo_hits.assign(m_functions.size(), 0);
+    m_memoize = true;
+
+    return SUCCESS;
+}
+
+void TacMachine::disable_jit()
+{
+    m_jit.reset();
+}
+
+void TacMachine::disable_traces()
+{
+    m_traces.clear();
+    m_loop_hotness.clear();
+    m_trace_attempts.clear();
+    m_recording = false;
+}
+
+uint TacMachine::enable_profiling()
+{
+#ifdef TAC_NO_PROFILE
+    return FAIL;
+#else
+    // Native code and traces run many instructions at once, without counting them
+    disable_jit();
+    disable_traces();
+
+    reset_instruction_count();
+    m_profiling = true;
     return SUCCESS;
+#endif
+}
+
+uint TacMachine::enable_line_profiling()
+{
+#ifdef TAC_NO_PROFILE
+    return FAIL;
+#else
+    disable_jit();
+    disable_traces();
+
+    m_line_profiler = std::make_unique<LineProfiler>(m_program.size(), m_functions.size());
+    return SUCCESS;
+#endif
+}
+
+std::string TacMachine::line_profile_str(const std::string& source_file) const
+{
+    if (m_line_profiler == nullptr)
+        return "";
+
+    return m_line_profiler->str(m_program, m_functions, m_instruction_function, m_step_count, source_file);
+}
+
+uint TacMachine::enable_sampling(uint frequency)
+{
+    m_sampler = std::make_unique<Sampler>(*this);
+    if (m_sampler->start(frequency) == FAIL)
+    {
+        m_sampler.reset();
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+uint TacMachine::write_samples(const std::string& filename)
+{
+    if (m_sampler == nullptr)
+        return FAIL;
+
+    m_sampler->stop();
+    std::ofstream out(filename);
+    if (!out.good())
+        return FAIL;
+
+    out << m_sampler->folded(m_functions);
+    return SUCCESS;
+}
+
+std::string TacMachine::sampling_str() const
+{
+    if (m_sampler == nullptr)
+        return "";
+
+    return m_sampler->str(m_program);
+}
+
+uint TacMachine::enable_event_trace(const std::string& filename)
+{
+    m_event_tracer = std::make_unique<EventTracer>(m_program, m_functions);
+    if (m_event_tracer->open(filename) == FAIL)
+    {
+        m_event_tracer.reset();
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+uint TacMachine::close_event_trace()
+{
+    if (m_event_tracer == nullptr)
+        return FAIL;
+
+    auto const status = m_event_tracer->close(m_frames, m_program_counter);
+    m_event_tracer.reset();
+    return status;
+}
+
+uint TacMachine::enable_memory_trace(const std::string& filename)
+{
+    // Native code and traces read and write the stack without the memory manager
+    disable_jit();
+    disable_traces();
+
+    m_memory_tracer = std::make_unique<MemoryTracer>(m_program_counter);
+    if (m_memory_tracer->open(filename, m_functions, m_instruction_function) == FAIL)
+    {
+        m_memory_tracer.reset();
+        return FAIL;
+    }
+
+    m_memory.m_tracer = m_memory_tracer.get();
+    return SUCCESS;
+}
+
+uint TacMachine::close_memory_trace()
+{
+    if (m_memory_tracer == nullptr)
+        return FAIL;
+
+    m_memory.m_tracer = nullptr;
+    auto const status = m_memory_tracer->close();
+    m_memory_tracer.reset();
+    return status;
+}
+
+size_t TacMachine::memory_trace_accesses() const
+{
+    return m_memory_tracer == nullptr ? 0 : m_memory_tracer->accesses();
+}
+
+void TacMachine::enable_heap_profiling()
+{
+    m_heap_profiler = std::make_unique<HeapProfiler>();
+}
+
+std::string TacMachine::heap_profile_str() const
+{
+    if (m_heap_profiler == nullptr)
+        return "";
+
+    return m_heap_profiler->str(m_program, m_functions, m_instruction_function, m_step_count);
+}
+
+uint TacMachine::write_heap_series(const std::string& filename) const
+{
+    if (m_heap_profiler == nullptr)
+        return FAIL;
+
+    return m_heap_profiler->write_series(filename, m_step_count);
+}
+
+std::string TacMachine::profile_str() const
+{
+    uint64_t total = 0;
+    for (auto count : m_instruction_count)
+        total += count;
+
+    std::vector<size_t> kinds;
+    for (size_t kind = 0; kind < INSTRUCTION_KINDS; kind++)
+        if (m_instruction_count[kind] != 0)
+            kinds.push_back(kind);
+
+    std::stable_sort(kinds.begin(), kinds.end(), [&](size_t a, size_t b) { return m_instruction_count[a] > m_instruction_count[b]; });
+
+    std::stringstream ss;
+    ss << "Profile: " << total << " instructions" << std::endl;
+    ss << std::fixed << std::setprecision(2);
+    for (auto kind : kinds)
+    {
+        auto const count = m_instruction_count[kind];
+        ss << "\t" << std::left << std::setw(12) << instr_to_str(static_cast<Instr>(kind)) 
+           << std::right << std::setw(14) << count 
+           << std::setw(8) << 100.0 * count / total << "%" << std::endl;
+    }
+
+    std::vector<size_t> pairs;
+    for (size_t pair = 0; pair < m_pair_count.size(); pair++)
+        if (m_pair_count[pair] != 0)
+            pairs.push_back(pair);
+
+    std::stable_sort(pairs.begin(), pairs.end(), [&](size_t a, size_t b) { return m_pair_count[a] > m_pair_count[b]; });
+    if (pairs.size() > PROFILE_TOP_PAIRS)
+        pairs.resize(PROFILE_TOP_PAIRS);
+
+    if (!pairs.empty())
+        ss << "Most frequent instruction pairs:" << std::endl;
+
+    for (auto pair : pairs)
+    {
+        auto const count = m_pair_count[pair];
+        auto const name = instr_to_str(static_cast<Instr>(pair / INSTRUCTION_KINDS)) + " -> " + 
+                          instr_to_str(static_cast<Instr>(pair % INSTRUCTION_KINDS));
+        ss << "\t" << std::left << std::setw(24) << name 
+           << std::right << std::setw(14) << count 
+           << std::setw(8) << 100.0 * count / total << "%" << std::endl;
+    }
+
+    return ss.str();
+}
+
+std::string TacMachine::profile_json() const
+{
+    uint64_t total = 0;
+    for (auto count : m_instruction_count)
+        total += count;
+
+    std::stringstream ss;
+    ss << "{" << std::endl;
+    ss << "  \"instructions\": " << total << "," << std::endl;
+    ss << "  \"opcodes\": {";
+    bool first = true;
+    for (size_t kind = 0; kind < INSTRUCTION_KINDS; kind++)
+    {
+        if (m_instruction_count[kind] == 0)
+            continue;
+
+        ss << (first ? "" : ",") << std::endl;
+        ss << "    \"" << instr_to_str(static_cast<Instr>(kind)) << "\": " << m_instruction_count[kind];
+        first = false;
+    }
+    ss << std::endl << "  }," << std::endl;
+
+    std::vector<size_t> pairs;
+    for (size_t pair = 0; pair < m_pair_count.size(); pair++)
+        if (m_pair_count[pair] != 0)
+            pairs.push_back(pair);
+
+    std::stable_sort(pairs.begin(), pairs.end(), [&](size_t a, size_t b) { return m_pair_count[a] > m_pair_count[b]; });
+
+    ss << "  \"pairs\": [";
+    first = true;
+    for (auto pair : pairs)
+    {
+        ss << (first ? "" : ",") << std::endl;
+        ss << "    { \"first\": \"" << instr_to_str(static_cast<Instr>(pair / INSTRUCTION_KINDS)) << "\", "
+           << "\"second\": \"" << instr_to_str(static_cast<Instr>(pair % INSTRUCTION_KINDS)) << "\", "
+           << "\"count\": " << m_pair_count[pair] << " }";
+        first = false;
+    }
+    ss << std::endl << "  ]" << std::endl;
+    ss << "}" << std::endl;
+
+    return ss.str();
+}
+
+void TacMachine::use_closure_engine()
+{
+    ClosureEngine::compile(*this, m_closures);
+}
+
+std::string TacMachine::memoization_str() const
+{
+    std::stringstream ss;
+    ss << "Memoization:";
+    bool any_pure = false;
+    for (size_t f = 0; f < m_purity.size(); f++)
+    {
+        if (!m_purity[f].pure)
+            continue;
+
+        size_t argument_bytes = 0;
+        for (auto const& range : m_purity[f].arguments)
+            argument_bytes += range.size;
+
+        auto const calls = m_memo_calls[f];
+        auto const hits = m_memo_hits[f];
+        ss << std::endl << "\t" << m_purity[f].name << " (" << argument_bytes << " argument bytes): " 
+           << hits << " hits out of " << calls << " calls";
+        if (calls != 0)
+            ss << " (" << std::fixed << std::setprecision(1) << 100.0 * hits / calls << "%)";
+
+        any_pure = true;
+    }
+
+    if (!any_pure)
+        ss << std::endl << "\tno pure functions found";
+
+    return ss.str();
+}
+
+uint TacMachine::memo_arguments(uint function, std::string& out_arguments)
+{
+    // Arguments were written at the top of the stack, where the called function's frame starts
+    auto const frame = stack_pointer();
+    auto const& arguments = m_purity[function].arguments;
+    out_arguments.clear();
+    if (arguments.empty())
+        return SUCCESS;
+
+    auto const& last = arguments.back();
+    std::byte* memory;
+    if (frame + last.offset + last.size > MemoryManager::stack_end() || m_memory.mem_pos(frame, memory) == FAIL)
+        return FAIL;
+
+    for (auto const& range : arguments)
+        out_arguments.append(reinterpret_cast<const char*>(memory + range.offset), range.size);
+
+    return SUCCESS;
+}
+
+MemoEntry& TacMachine::memo_entry(uint function, const std::string& arguments)
+{
+    auto const hash = std::hash<std::string>{}(arguments) ^ (function * 0x9e3779b97f4a7c15ULL);
+    return m_memo_table[hash % MEMO_TABLE_SIZE];
+}
+
+uint FunctionInfo::slot_of(const std::string& reg_name)
+{
+    auto it = slots.find(reg_name);
+    if (it != slots.end())
+        return it->second;
+
+    uint slot = slot_names.size();
+    slot_names.push_back(reg_name);
+    slots[reg_name] = slot;
+    return slot;
 }
 
 uint TacMachine::get_var_value(const Variable &var, REGISTER_TYPE &out_value)
 {
     REGISTER_TYPE reg_value;
-    auto status = get_register(var.name, reg_value);
+    auto status = get_register(var, reg_value);
 
     // Check if getting value was successful
     if (status == FAIL)
@@ -1153,7 +1939,7 @@ uint TacMachine::get_var_value(const Variable &var, REGISTER_TYPE &out_value)
     if ( std::holds_alternative<int>(var.index))
         val = Value(std::get<int>(var.index));
     else 
-        val = Value(Variable{std::get<std::string>(var.index), 0, false});
+        val = Value(Variable{std::get<std::string>(var.index), 0, false, var.index_slot});
     
     REGISTER_TYPE reg;
     if(actual_value(val, reg) == FAIL)
@@ -1225,20 +2011,27 @@ std::string TacMachine::str(bool show_memory, bool show_labels, bool show_regist
         ( m_program_counter < m_program.size() ? m_program[m_program_counter].str() : "<Program Finished>")
         << std::endl;
     ss << "- Machine Status: " << show_status(m_status) << std::endl;
-    ss << "- Currently active callstack: " << m_callstack.size() << std::endl;
+    ss << "- Currently active callstack: " << m_frames.size() << std::endl;
     ss << "- Status Code: " << m_exit_status_code << std::endl;
     if (show_registers)
     {
-        for (auto const& call_data : m_callstack)
+        for (auto const& frame : m_frames)
         {
-            ss << "\t- " << call_data.func_name;
+            auto const& function = m_functions[frame.function];
+            ss << "\t- " << function.name;
             ss << "\t\t- Registers: " << std::endl;
-            auto const& regs = call_data.func_regs;
+
+            // Show registers sorted by name
+            std::map<std::string, REGISTER_TYPE> regs;
+            for (size_t slot = 0; slot < frame.window_size && slot < function.slot_names.size(); slot++)
+                if (m_register_valid[frame.window + slot])
+                    regs[function.slot_names[slot]] = m_register_file[frame.window + slot];
+
             if (regs.empty())
                 ss << "\t\t<No registers to show>";
             else
                 for(auto &[name, value] : regs)
-                    ss << "\t\t\t- " << name << " = 0x" << std::hex << value << std::endl;
+                    ss << "\t\t\t- " << name << " = 0x" << std::hex << value << std::dec << std::endl;
                 ss << std::endl;
         }
     }
@@ -1258,8 +2051,12 @@ std::string TacMachine::str(bool show_memory, bool show_labels, bool show_regist
     if(show_callstack)
     {
         ss << "- Callstack: ";
-        for (auto const& call : m_callstack)
-            ss << "\t[ " << call.func_name << " ] at line " << call.line_num;
+        for (auto const& frame : m_frames)
+        {
+            ss << "\t[ " << m_functions[frame.function].name << " ] at line " << frame.program_counter;
+            if (frame.collapsed_frames != 0)
+                ss << " (" << frame.collapsed_frames << " collapsed frames)";
+        }
     }
 
     
@@ -1284,6 +2081,9 @@ std::string TacMachine::show_status(Status status)
     case Status::RUNNING:
         return "RUNNING";
         break;
+    case Status::PAUSED:
+        return "PAUSED";
+        break;
     default:
         std::stringstream ss;
         ss << "Unrecognized program status: " << static_cast<int>(status);
@@ -1491,9 +2291,9 @@ uint TacMachine::load_inmediate(const Variable& var, const Value& val, char type
     assert(!var.is_access && !val.is<std::string>() && !val.is<Variable>());
 
     if(type == 'w')
-        set_register(var.name, get_inmediate_from_value_w(val));
+        set_register(var, get_inmediate_from_value_w(val));
     else if(type == 'b')
-        set_register(var.name,(REGISTER_TYPE) get_inmediate_from_value_b(val));
+        set_register(var,(REGISTER_TYPE) get_inmediate_from_value_b(val));
 
     return SUCCESS;
 }
@@ -1535,7 +2335,7 @@ uint TacMachine::load(const Variable& var, const Variable& val, char type)
     }
 
     // Set register to specified value
-    set_register(var.name, actual_rvalue);
+    set_register(var, actual_rvalue);
     return SUCCESS;
 }
 
@@ -1666,7 +2466,7 @@ uint TacMachine::move(const Variable& var, const Variable& val, char type)
         return FAIL;
     }
 
-    set_register(var.name, rvalue);
+    set_register(var, rvalue);
     return SUCCESS;
 }
 
@@ -1687,9 +2487,6 @@ uint TacMachine::run_bin_op(const Tac& tac, const std::string& opr_type, bool ty
     auto const &lvalue = lvalue_arg.get<Variable>();
     assert(!lvalue.is_access && "should not perform store and binary operation at the same time");
 
-    // Get name of variables
-    auto const &var_name = lvalue.name;
-
     // Check type matching of args
     uint l_val;
     uint r_val;
@@ -1798,7 +2595,7 @@ uint TacMachine::run_bin_op(const Tac& tac, const std::string& opr_type, bool ty
         return FAIL;
     }
 
-    set_register(var_name, result);
+    set_register(lvalue, result);
     return SUCCESS;
 }
 
@@ -1974,7 +2771,7 @@ uint TacMachine::run_unary_op(const Tac& tac)
             reg = (REGISTER_TYPE) -((int) reg);
     }
     
-    set_register(var.name, reg);
+    set_register(var, reg);
     return SUCCESS;    
 }
 
@@ -1986,9 +2783,8 @@ uint TacMachine::run_goto(const Tac& tac)
     // get values
     const auto &label_arg = args[0];
     assert(label_arg.is<std::string>() && "First argument of goto should be a label where to jump");
-    auto const& label = label_arg.get<std::string>();
-    
-    return goto_label(label);
+    branch_to(tac.target());
+    return SUCCESS;
 }
 
 uint TacMachine::run_goif(const Tac& tac, bool is_negated)
@@ -2011,7 +2807,6 @@ uint TacMachine::run_goif(const Tac& tac, bool is_negated)
     assert(!value_arg.is<std::string>());
 
     // get args values
-    const auto& label = label_arg.get<std::string>();
     REGISTER_TYPE value;
 
     if(value_arg.is<Variable>())
@@ -2024,7 +2819,9 @@ uint TacMachine::run_goif(const Tac& tac, bool is_negated)
         value = get_inmediate_from_value_w(value_arg);
 
     if((value && !is_negated) || (!value && is_negated))
-        return goto_label(label);
+    {
+        branch_to(tac.target());
+    }
 
     return SUCCESS;
 }
@@ -2059,8 +2856,11 @@ uint TacMachine::run_malloc(const Tac &tac)
     // Try to allocate memmory
     auto memory_addr = m_memory.malloc(byte_count);
 
+    if (m_heap_profiler != nullptr)
+        m_heap_profiler->allocated(memory_addr, byte_count, m_program_counter, m_step_count);
+
     // Update register
-    set_register(lvalue.name, memory_addr);
+    set_register(lvalue, memory_addr);
     
     return SUCCESS;
 }
@@ -2139,6 +2939,9 @@ uint TacMachine::run_free(const Tac& tac)
         App::error(ss.str());
         return FAIL;
     }
+
+    if (m_heap_profiler != nullptr)
+        m_heap_profiler->freed(value, m_step_count);
     
     return m_memory.free(value);
 }
@@ -2179,21 +2982,29 @@ uint TacMachine::run_return(const Tac& tac)
         return FAIL;
     }
 
-    auto const& back_up = last_back_up();
-    
-    // pop last stack
-    m_callstack.pop_back();
+    auto const return_slot = m_frames.back().return_slot;
 
-    // Write actual value and check for errors
-    set_register(back_up.next_return_reg, reg);
+    // Remember the result of a memoized call
+    if (!m_pending_memos.empty() && m_pending_memos.back().frame == m_frames.size())
+    {
+        auto& pending = m_pending_memos.back();
+        auto& entry = memo_entry(pending.function, pending.arguments);
+        entry.valid = true;
+        entry.function = pending.function;
+        entry.arguments.swap(pending.arguments);
+        entry.value = reg;
+    }
 
     // Go back to previous state
-    if(pop_program_state() == FAIL)
+    if(pop_frame() == FAIL)
     {
         App::error("Could not go back to previous program state while trying to return from function");
         return FAIL;
     }
 
+    // Write actual value in caller's registers
+    set_slot(return_slot, reg);
+
     return SUCCESS;
 }
 
@@ -2247,32 +3058,347 @@ uint TacMachine::run_call(const Tac& tac)
     assert(function_name_arg.is<std::string>());
 
     const auto& next_return = next_return_arg.get<Variable>();
-    const auto& function_name = function_name_arg.get<std::string>();
 
     // Check argument consistency
     assert(!next_return.is_access);
 
+    auto const function = m_instruction_function[tac.target()];
+    if (m_jit != nullptr)
+        count_hotness(function);
+
+    if (tac.is_tail_call())
+        return run_tail_call(tac);
+
+    // Calls to pure functions with the same arguments as a previous one return the same value
+    std::string arguments;
+    bool const memoized = m_memoize && m_purity[function].pure && memo_arguments(function, arguments) == SUCCESS;
+    if (memoized)
+    {
+        m_memo_calls[function]++;
+        auto const& entry = memo_entry(function, arguments);
+        if (entry.valid && entry.function == function && entry.arguments == arguments)
+        {
+            m_memo_hits[function]++;
+            set_slot(next_return.slot, entry.value);
+            return SUCCESS;
+        }
+    }
+
     // perform save of current state
-    push_program_state(next_return.name);
+    push_frame(m_program_counter, function, next_return.slot);
+    if (memoized)
+        m_pending_memos.push_back(PendingMemo{m_frames.size(), function, std::move(arguments)});
 
     // Go to function location
-    if (goto_label(function_name) == FAIL)
+    jump_to(tac.target());
+
+    return SUCCESS;
+}
+
+void TacMachine::count_hotness(uint function)
+{
+    if (function == GLOBAL_SCOPE || ++m_hotness[function] != JIT_THRESHOLD)
+        return;
+
+    // Functions that can't be compiled keep running in the interpreter
+    if (m_jit->compile(function, m_functions[function].slot_names.size()) == SUCCESS)
     {
         stringstream ss;
-        ss << "Could not go to function '" << function_name << "'";
+        ss << "Compiled function '" << m_functions[function].name << "' into native code";
+        App::trace(ss.str());
+    }
+}
+
+void TacMachine::run_native()
+{
+    if (!m_jit->has_entry(m_program_counter))
+        return;
+
+    // Native code was compiled for the function's own register window
+    auto const& frame = m_frames.back();
+    if (frame.function != m_instruction_function[m_program_counter] || 
+        frame.window_size != m_functions[frame.function].slot_names.size())
+        return;
+
+    JitState state{
+        m_register_file.data() + frame.window,
+        m_register_valid.data() + frame.window,
+        MemoryManager::stack_memory(),
+        m_frame_pointer
+    };
+    m_program_counter = m_jit->run(state, m_program_counter);
+    m_step_count += state.steps;
+    m_memory.count_stack_accesses(state.stack_reads, state.stack_writes);
+}
+
+void TacMachine::branch_to(size_t target)
+{
+    // Backward jumps are where loops spend their time
+    if (target <= m_program_counter)
+    {
+        if (m_jit != nullptr)
+            count_hotness(m_instruction_function[m_program_counter]);
+
+        if (!m_traces.empty())
+            count_loop(target);
+    }
+
+    jump_to(target);
+}
+
+void TacMachine::count_loop(size_t header)
+{
+    if (m_recording || m_traces[header] != nullptr || m_trace_attempts[header] == TRACE_MAX_ATTEMPTS || 
+        ++m_loop_hotness[header] != TRACE_THRESHOLD)
+        return;
+
+    // Record from the header, the loop should run in its function's own register window
+    auto const& frame = m_frames.back();
+    if (frame.function != m_instruction_function[header] || 
+        frame.window_size != m_functions[frame.function].slot_names.size())
+        return;
+
+    m_trace_attempts[header]++;
+    m_trace_header = header;
+    m_trace_next = header;
+    m_trace_steps.clear();
+    m_recording = true;
+}
+
+void TacMachine::record_trace_step()
+{
+    auto const pc = m_program_counter;
+    auto const& tac = m_program[pc];
+
+    // Going back to the header closes the loop, reaching another trace links to it
+    if (!m_trace_steps.empty() && (pc == m_trace_header || m_traces[pc] != nullptr))
+    {
+        m_recording = false;
+        auto trace = std::make_unique<Trace>();
+        if (Trace::build(m_program, m_trace_steps, pc, *trace) == FAIL)
+            return;
+
+        stringstream ss;
+        ss << "Recorded trace at instruction " << m_trace_header << ": " << trace->length() << " instructions, ";
+        ss << trace->operations() << " operations, " << trace->removed_guards() << " guards and ";
+        ss << trace->removed_loads() << " loads removed, " << trace->folded_operations() << " operations folded";
+        App::trace(ss.str());
+
+        m_traces[m_trace_header] = std::move(trace);
+        return;
+    }
+
+    // Control should go where the trace expects, some instructions might have run outside the interpreter
+    if (pc != m_trace_next || m_trace_steps.size() == TRACE_MAX_LENGTH || !Trace::can_record(tac))
+    {
+        stop_recording();
+        return;
+    }
+
+    // Observe where branches go and that memory accesses are in the stack
+    bool taken = false;
+    m_trace_next = pc + 1;
+    auto const& args = tac.args();
+    switch (tac.instr())
+    {
+    case Instr::GOTO:
+        m_trace_next = tac.target();
+        break;
+    case Instr::GOIF:
+    case Instr::GOIFNOT:
+    {
+        REGISTER_TYPE value;
+        if (!peek_value(args[1], value))
+        {
+            stop_recording();
+            return;
+        }
+
+        taken = (value != 0) == (tac.instr() == Instr::GOIF);
+        if (taken)
+            m_trace_next = tac.target();
+        break;
+    }
+    case Instr::ASSIGNW:
+    case Instr::ASSIGNB:
+    case Instr::MINUS:
+    case Instr::NEG:
+    case Instr::ITOF:
+    case Instr::FTOI:
+    {
+        REGISTER_TYPE value;
+        for (auto const& arg : args)
+        {
+            if (!arg.is<Variable>() || !arg.get<Variable>().is_access)
+                continue;
+
+            if (!peek_value(arg, value))
+            {
+                stop_recording();
+                return;
+            }
+        }
+        break;
+    }
+    default:
+        break;
+    }
+
+    m_trace_steps.push_back(TraceStep{pc, taken});
+}
+
+void TacMachine::stop_recording()
+{
+    // Loops often leave right after getting hot, the next backward jump to the header tries again
+    m_recording = false;
+    m_loop_hotness[m_trace_header] = TRACE_THRESHOLD - 1;
+}
+
+void TacMachine::run_trace()
+{
+    // Traces ending where another one starts run one after the other
+    while (m_traces[m_program_counter] != nullptr)
+    {
+        auto const& trace = *m_traces[m_program_counter];
+        auto const& frame = m_frames.back();
+        auto const function = m_instruction_function[m_program_counter];
+        if (frame.function != function || 
+            frame.window_size != m_functions[function].slot_names.size() || 
+            !trace.can_enter(m_register_valid.data() + frame.window))
+            return;
+
+        // Iterations count as backward jumps, so native code takes over once the function is compiled
+        bool const counts_hotness = m_jit != nullptr && function != GLOBAL_SCOPE;
+        if (counts_hotness && m_hotness[function] >= JIT_THRESHOLD && m_jit->has_entry(m_program_counter))
+            return;
+        uint64_t const max_iterations = counts_hotness && m_hotness[function] < JIT_THRESHOLD ? JIT_THRESHOLD - m_hotness[function] : 0;
+
+        TraceState state{
+            m_register_file.data() + frame.window,
+            m_register_valid.data() + frame.window,
+            MemoryManager::stack_memory(),
+            m_frame_pointer,
+            static_cast<REGISTER_TYPE>(m_memory.stack_pointer())
+        };
+        m_program_counter = trace.run(state, max_iterations);
+        m_step_count += state.steps;
+        m_memory.count_stack_accesses(state.stack_reads, state.stack_writes);
+
+        if (counts_hotness)
+            for (uint64_t i = 0; i < state.iterations && m_hotness[function] < JIT_THRESHOLD; i++)
+                count_hotness(function);
+
+        if (state.steps == 0)
+            return;
+    }
+
+    // Side exits taken often get their own trace
+    auto const exit = m_program_counter;
+    if (m_trace_attempts[exit] == TRACE_MAX_ATTEMPTS || ++m_loop_hotness[exit] < TRACE_THRESHOLD)
+        return;
+
+    m_trace_attempts[exit]++;
+    m_trace_header = exit;
+    m_trace_next = exit;
+    m_trace_steps.clear();
+    m_recording = true;
+}
+
+bool TacMachine::peek_slot(int slot, REGISTER_TYPE& out_value) const
+{
+    if (slot == BASE_SLOT)
+        out_value = m_frame_pointer;
+    else if (slot == STACK_SLOT)
+        out_value = static_cast<REGISTER_TYPE>(m_memory.stack_pointer());
+    else
+    {
+        auto const& frame = m_frames.back();
+        if (slot < 0 || static_cast<size_t>(slot) >= frame.window_size || !m_register_valid[frame.window + slot])
+            return false;
+
+        out_value = m_register_file[frame.window + slot];
+    }
+
+    return true;
+}
+
+bool TacMachine::peek_value(const Value& val, REGISTER_TYPE& out_value) const
+{
+    if (!val.is<Variable>())
+    {
+        out_value = val.is<int>() ? static_cast<REGISTER_TYPE>(val.get<int>()) : 0;
+        return true;
+    }
+
+    auto const& var = val.get<Variable>();
+    REGISTER_TYPE address, index = 0;
+    if (!peek_slot(var.slot, address))
+        return false;
+    if (!var.is_access)
+    {
+        out_value = address;
+        return true;
+    }
+
+    if (std::holds_alternative<int>(var.index))
+        index = static_cast<REGISTER_TYPE>(std::get<int>(var.index));
+    else if (!peek_slot(var.index_slot, index))
+        return false;
+    address += index;
+
+    // Traces only access the stack
+    auto const position = address - static_cast<REGISTER_TYPE>(MemoryManager::stack_start());
+    if (position >= STACK_MEMORY_SIZE || STACK_MEMORY_SIZE - position < WORD_SIZE)
+        return false;
+
+    out_value = 0;
+    memcpy(&out_value, MemoryManager::stack_memory() + position, WORD_SIZE);
+    return true;
+}
+
+uint TacMachine::run_tail_call(const Tac& tac)
+{
+    auto const& fun_begin = m_program[tac.target()];
+    assert(fun_begin.instr() == Instr::METAFUNBEGIN && "Tail calls should jump to a function");
+    auto const frame_size = fun_begin.args()[1].get<int>();
+
+    // Arguments were written at the top of the stack, move them to the start of the current frame
+    if (frame_size > 0 && m_memory.move(stack_pointer(), frame_pointer(), frame_size) == FAIL)
+    {
+        stringstream ss;
+        ss << "Could not move arguments for tail call to '" << fun_begin.args()[0].get<std::string>() << "'";
         App::error(ss.str());
 
         return FAIL;
     }
+    m_memory.set_stack_pointer(frame_pointer());
+
+    // Reset the register window for the new function, return state is kept
+    auto& frame = m_frames.back();
+    if (m_event_tracer != nullptr)
+    {
+        m_event_tracer->end(frame.function, m_program_counter);
+        m_event_tracer->begin(m_instruction_function[tac.target()], m_program_counter);
+    }
+
+    frame.function = m_instruction_function[tac.target()];
+    frame.window_size = m_functions[frame.function].slot_names.size();
+    frame.collapsed_frames++;
 
-    assert(m_program_counter != 0 && "Can't go back one instruction");
-    m_program_counter--;
+    m_register_file.resize(frame.window);
+    m_register_valid.resize(frame.window);
+    m_register_file.resize(frame.window + frame.window_size, 0);
+    m_register_valid.resize(frame.window + frame.window_size, 0);
+
+    // Go to function location
+    jump_to(tac.target());
 
     return SUCCESS;
 }
 
 uint TacMachine::run_print(const Tac& tac, char type)
 {
+    EventTracer::Scope const traced(m_event_tracer.get(), tac, m_program_counter);
     union {
         float f;
         int   i;
@@ -2328,6 +3454,7 @@ uint TacMachine::run_print(const Tac& tac, char type)
 
 uint TacMachine::run_read(const Tac& tac, char type)
 {
+    EventTracer::Scope const traced(m_event_tracer.get(), tac, m_program_counter);
     const auto &args = tac.args();
     assert(args.size() == 1 && "Invalid number of arguments in printx instruction");
     const auto& var_arg = args[0];
@@ -2387,13 +3514,13 @@ uint TacMachine::run_read(const Tac& tac, char type)
     // Now save according to type 
     if (type != 's') // if scalar type
     {
-        set_register(var.name, reg);
+        set_register(var, reg);
         return SUCCESS;
     }
 
     // Store string in address:
     uint addr;
-    if(get_register(var.name, addr) == FAIL)
+    if(get_register(var, addr) == FAIL)
     {
         stringstream ss;
         ss << "Couldn't retrieve address in variable '" << var.str() << "' to store a string";
@@ -2460,7 +3587,7 @@ uint TacMachine::run_convert(const Tac& tac, char t)
     }
 
     // Perform assign
-    set_register(var.name, converter.reg);
+    set_register(var, converter.reg);
 
     return SUCCESS;
 }
@@ -2481,12 +3608,18 @@ uint TacMachine::run_funbegin(const Tac&tac)
     assert(fun_name_arg.is<std::string>());
     auto const& fun_name = fun_name_arg.get<std::string>();
 
+    // The frame for this function is pushed by the call instruction
+    if (m_frames.size() <= 1 || m_frames.back().function != m_instruction_function[m_program_counter])
+    {
+        stringstream ss;
+        ss << "Function '" << fun_name << "' reached without being called";
+        App::error(ss.str());
+        return FAIL;
+    }
+
     m_frame_pointer = stack_pointer();
     m_memory.set_stack_pointer(stack_pointer() + stack_size);
 
-    // Push current callstack
-    m_callstack.push_back(CallStackData{fun_name, Registers(), frame_pointer()});
-
     return SUCCESS;
 }
 
@@ -2496,12 +3629,11 @@ uint TacMachine::run_funend(const Tac& tac)
 
     // return previous state
 
-    if(pop_program_state() == FAIL)
+    if(pop_frame() == FAIL)
     {
         App::error("Could not go back to previous position after finishing a function");
         return FAIL;
     }
 
-    m_callstack.pop_back();
     return SUCCESS;
 }   
\ No newline at end of file
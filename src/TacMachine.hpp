@@ -9,15 +9,18 @@
 
 // Local includes 
 #include "Tac.hpp"
+#include "Purity.hpp"
 
 
 // C++ includes
 #include <array>
+#include <chrono>
 #include <map>
 #include <cstddef> // byte type
 #include <memory>
 #include <functional>
-#include <stack>
+#include <unordered_map>
+#include <csignal>
 
 // Size of the stack memory
 #define MACHINE_MEMORY_SIZE 1000000000
@@ -34,6 +37,18 @@
 #define REGISTER_TYPE uint32_t // unsigned int 32 bits as register, to simulate a 32 bits machine
 #define BASE "BASE"   // base special variable name
 #define STACK "STACK" // stack special variable name 
+#define BASE_SLOT -2  // register slot for BASE
+#define STACK_SLOT -3 // register slot for STACK
+
+#define GLOBAL_SCOPE 0          // index of the global scope in the function table
+#define FRAME_STACK_RESERVE 1024    // frames reserved up front in the frame stack
+#define REGISTER_FILE_RESERVE 65536 // registers reserved up front in the register file
+#define MEMO_TABLE_SIZE 65536       // remembered results of pure function calls, colliding calls replace each other
+
+#define INSTRUCTION_KINDS static_cast<size_t>(TacRunner::Instr::__LAST__) // different instructions, counted by the profile
+#define PROFILE_TOP_PAIRS 20        // most frequent instruction pairs shown in the profile table
+
+// Define TAC_NO_PROFILE when compiling to remove instruction counting from the run loop
 
 #define SUCCESS 0 
 #define FAIL 1
@@ -43,6 +58,16 @@ namespace TacRunner
 {
     // Forward declarations:
     class MemoryChunk;
+    class JitCompiler;
+    class Trace;
+    struct TraceStep;
+    class ClosureEngine;
+    struct Closure;
+    class LineProfiler;
+    class Sampler;
+    class EventTracer;
+    class MemoryTracer;
+    class HeapProfiler;
 
     // Map from names to line number
     using LabelMap = std::map<std::string, uint>;
@@ -50,9 +75,6 @@ namespace TacRunner
     // Map from 
     using MemoryMap = std::map<uint, MemoryChunk>;
 
-    // Map from name of register (temporal) to its actual value
-    using Registers = std::map<std::string, REGISTER_TYPE>;
-
     class MemoryChunk 
     {
         public:
@@ -85,9 +107,20 @@ namespace TacRunner
              */
             std::string str(bool show_memory = true) const;
 
+            /**
+             * @brief Construct a new Memory Chunk object over an already existing memory buffer, 
+             *        the buffer is shared, not copied
+             * 
+             * @param size Size in bytes of the provided memory
+             * @param start_pos Where this memory chunk starts
+             * @param memory Buffer with at the least 'size' bytes
+             */
+            MemoryChunk(uint size, uint start_pos, std::shared_ptr<std::byte []> memory);
+
             // Make virtual heap friend as that class manages a set of this object
             friend class VirtualHeap;
             friend class VirtualStaticMemory;
+            friend class MachineSnapshot;
 
         private:
             /**
@@ -132,10 +165,13 @@ namespace TacRunner
                             , m_memory_map()
                             , m_allocations_counter(0)
                             , m_free_counter(0)
+                            , m_read_counter(0)
+                            , m_write_counter(0)
                             , m_allocated_memory(0)
             { }
 
             friend class MemoryManager;
+            friend class MachineSnapshot;
 
             /**
              * @brief Allocate 'size' bytes of memory in the virtual heap memory, return the position if 
@@ -248,7 +284,7 @@ namespace TacRunner
              * 
              * @return size_t allocation count
              */
-            inline size_t write_count() const { return m_read_counter; }
+            inline size_t write_count() const { return m_write_counter; }
 
         private:
             /**
@@ -311,6 +347,7 @@ namespace TacRunner
         VirtualStack();
 
         friend class MemoryManager;
+        friend class MachineSnapshot;
 
         /**
          * @brief push 'count' bytes of data into the stack, from 'memory'
@@ -487,10 +524,13 @@ namespace TacRunner
                 : m_next_memory_position(1)
                 , m_memory_map()
                 , m_allocations_counter(0)
+                , m_read_counter(0)
+                , m_write_counter(0)
                 , m_allocated_memory(0)
             { }
 
             friend class MemoryManager;
+            friend class MachineSnapshot;
 
             /**
              * @brief Allocate 'size' bytes of memory in the virtual static memory, return the position if 
@@ -587,7 +627,7 @@ namespace TacRunner
              * 
              * @return size_t allocation count
              */
-            inline size_t write_count() const { return m_read_counter; }
+            inline size_t write_count() const { return m_write_counter; }
 
         private:
             /**
@@ -652,6 +692,7 @@ namespace TacRunner
         public:
 
         friend class TacMachine;
+        friend class MachineSnapshot;
 
         /**
          * @brief Possible type of memories
@@ -924,6 +965,28 @@ namespace TacRunner
          */
         uint mem_pos(uint global_position, std::byte * &out_actual_mem) const;
 
+        /**
+         * @brief First byte of the stack memory, native code accesses it directly
+         * 
+         * @return std::byte* stack memory buffer
+         */
+        static inline std::byte* stack_memory() { return VirtualStack::m_memory; }
+
+        /**
+         * @brief Add stack memory accesses performed by native code to the stack counters
+         * 
+         * @param reads how many reads were performed
+         * @param writes how many writes were performed
+         */
+        inline void count_stack_accesses(size_t reads, size_t writes) 
+        { m_stack.m_read_count += reads; m_stack.m_write_count += writes; }
+
+        /**
+         * @brief Tracer recording every read and write, null when memory is not traced
+         * 
+         */
+        MemoryTracer* m_tracer = nullptr;
+
         private:
         /**
          * @brief Stack Memory
@@ -945,29 +1008,80 @@ namespace TacRunner
     };
 
     /**
-     * @brief previous state in the program
+     * @brief Static information about a function, computed when the program is loaded. 
+     *        Every register name used inside a function is assigned a slot in its register window,
+     *        registers never live at the same time may share a slot
+     * 
+     */
+    struct FunctionInfo
+    {
+        std::string name;
+        std::vector<std::string> slot_names; // names of the registers stored in each slot
+        std::unordered_map<std::string, uint> slots; // slot for each register name
+        size_t max_live = 0; // most registers live at the same time
+
+        /**
+         * @brief Get the slot for a register name, create a new one if this name has no slot yet
+         * 
+         * @param reg_name register name
+         * @return uint slot assigned to this name
+         */
+        uint slot_of(const std::string& reg_name);
+    };
+
+    /**
+     * @brief Activation record for a running function. Frames are stored contiguously in 
+     *        the machine's frame stack, and their registers live in a window of the machine's register file
+     * 
+     */
+    struct Frame
+    {
+        size_t program_counter;     // call instruction to go back to on return
+        size_t stack_pointer;       // stack pointer before the call
+        REGISTER_TYPE frame_pointer;// frame pointer before the call
+        int return_slot;            // slot in the caller's window where the return value is stored
+        uint function;              // index of the running function in the function table
+        size_t window;              // first register of this frame in the register file
+        size_t window_size;         // how many registers this frame has
+        uint64_t collapsed_frames;  // how many tail calls reused this frame
+    };
+
+    using FrameStack = std::vector<Frame>;
+
+    /**
+     * @brief Result of a call to a pure function, stored in the memoization table
      * 
      */
-    struct BackUp
+    struct MemoEntry
     {
-        size_t program_counter;
-        size_t stack_pointer;
-        size_t frame_pointer;
-        std::string next_return_reg; // (in global address)
+        bool valid = false;         // if this entry stores a result
+        uint function = 0;          // called function
+        std::string arguments;      // argument bytes of the call
+        REGISTER_TYPE value = 0;    // returned value
     };
 
     /**
-     * @brief Data representing relevant values for the actually running function
+     * @brief Call to a pure function whose result should be remembered once it returns
      * 
      */
-    struct CallStackData
+    struct PendingMemo
     {
-        std::string func_name;
-        Registers func_regs;
-        uint line_num;
+        size_t frame;               // size of the frame stack while running the call
+        uint function;              // called function
+        std::string arguments;      // argument bytes of the call
     };
 
-    using CallStack = std::vector<CallStackData>;
+    /**
+     * @brief Time spent in each step of setting up a machine for its program
+     * 
+     */
+    struct SetupTimes
+    {
+        std::chrono::nanoseconds labels{0};     // building the label map and resolving jumps to labels
+        std::chrono::nanoseconds registers{0};  // assigning a register slot to every variable
+        std::chrono::nanoseconds tail_calls{0}; // finding calls that can reuse their caller's frame
+        std::chrono::nanoseconds compilers{0};  // preparing the jit compiler and trace tables
+    };
 
     /**
      * @brief This class represents a Tac machine capable of running tac code
@@ -985,18 +1099,47 @@ namespace TacRunner
         {
             NOT_STARTED,
             RUNNING,
+            PAUSED,
             ERROR,
             FINISHED
         };
 
+        friend class MachineSnapshot;
+        friend class CTranslator;
+        friend class ClosureEngine;
+        friend class Sampler;
+
         public:
         TacMachine(Program program);
+        ~TacMachine();
 
         /**
-         * @brief Try to run the locally stored tac program
+         * @brief Try to run the locally stored tac program. A paused machine
+         *        will continue from its current program counter
          * 
+         * @param max_steps how many instructions to run before pausing the machine, 
+         *                  0 means no limit
          */
-        void run_tac_program();
+        void run_tac_program(uint64_t max_steps = 0);
+
+        /**
+         * @brief Write the entire machine state into a snapshot file, 
+         *        so it can be restored later with 'load_snapshot'
+         * 
+         * @param filename file where to write the snapshot
+         * @return uint success status, 0 on success, 1 on failure
+         */
+        uint save_snapshot(const std::string& filename) const;
+
+        /**
+         * @brief Restore the machine state from a snapshot file. The machine 
+         *        should be running the same program that created the snapshot.
+         *        On success, the machine is left paused, ready to continue running
+         * 
+         * @param filename file where the snapshot is stored
+         * @return uint success status, 0 on success, 1 on failure
+         */
+        uint load_snapshot(const std::string& filename);
 
         /**
          * @brief Set the register value, if it exists, overwrite it,
@@ -1006,6 +1149,14 @@ namespace TacRunner
          */
         void set_register(const std::string &reg_name, REGISTER_TYPE value);
 
+        /**
+         * @brief Set the register stored by a variable, using its resolved slot
+         * 
+         * @param var     Variable naming the register
+         * @param value   New value
+         */
+        void set_register(const Variable &var, REGISTER_TYPE value);
+
         /**
          * @brief Get a register's value, and return success status
          * 
@@ -1015,6 +1166,15 @@ namespace TacRunner
          */
         uint get_register(const std::string &reg_name, REGISTER_TYPE &out_value);
 
+        /**
+         * @brief Get the value of the register stored by a variable, using its resolved slot
+         * 
+         * @param var       Variable naming the register
+         * @param out_value where to store return value
+         * @return uint sucess status, 0 on success, 1 on failure
+         */
+        uint get_register(const Variable &var, REGISTER_TYPE &out_value);
+
         /**
          * @brief Make the machine go to the specified label and continue
          *        its execution from there
@@ -1052,6 +1212,27 @@ namespace TacRunner
          */
         inline Status status() const { return m_status; }
 
+        /**
+         * @brief How many instructions were executed so far
+         * 
+         * @return uint64_t executed instructions
+         */
+        inline uint64_t step_count() const { return m_step_count; }
+
+        /**
+         * @brief How long each step of setting up this machine took
+         * 
+         * @return const SetupTimes& time of each setup step
+         */
+        inline const SetupTimes& setup_times() const { return m_setup_times; }
+
+        /**
+         * @brief Program being run by this machine
+         * 
+         * @return const Program& reference to stored program
+         */
+        inline const Program& program() const { return m_program; }
+
         /**
          * @brief Return a human readable string representation of the tac machine
          * 
@@ -1061,6 +1242,177 @@ namespace TacRunner
          */
         std::string str(bool show_memory = false, bool show_labels = false, bool show_registers = false, bool show_callstack = false, uint stack_mem_bytes = 0);
 
+        /**
+         * @brief Summary of the register window of every function: how many registers it uses, 
+         *        how many slots they take and how many of them are live at the same time at most
+         * 
+         * @return std::string one line per function
+         */
+        std::string register_windows_str() const;
+
+        /**
+         * @brief Remember the results of calls to pure functions, so calls with the same arguments
+         *        return them without running the function again
+         * 
+         * @return uint success status, 0 on success, 1 if pure functions could not be found
+         */
+        uint enable_memoization();
+
+        /**
+         * @brief Run every instruction in the interpreter, without compiling hot functions 
+         *        into native code
+         * 
+         */
+        void disable_jit();
+
+        /**
+         * @brief Run every loop in the interpreter, without recording traces for hot loops
+         * 
+         */
+        void disable_traces();
+
+        /**
+         * @brief Count how many times each instruction and each pair of consecutive instructions 
+         *        runs. Every instruction is interpreted while profiling, so none is missed
+         * 
+         * @return uint success status, 0 on success, 1 if profiling was compiled out
+         */
+        uint enable_profiling();
+
+        /**
+         * @brief Table with how many times each instruction ran, sorted by count, followed by 
+         *        the most frequent pairs of consecutive instructions
+         * 
+         * @return std::string one line per instruction or pair
+         */
+        std::string profile_str() const;
+
+        /**
+         * @brief Instruction and instruction pair counts as a json object
+         * 
+         * @return std::string json object with the total count, the count of each 
+         *         instruction, and every pair that ran sorted by count
+         */
+        std::string profile_json() const;
+
+        /**
+         * @brief Count how many times each instruction runs, and calls, instructions and time 
+         *        for every function. Every instruction is interpreted while profiling
+         * 
+         * @return uint success status, 0 on success, 1 if profiling was compiled out
+         */
+        uint enable_line_profiling();
+
+        /**
+         * @brief Function table followed by the source file annotated with how many times 
+         *        instructions in each line ran
+         * 
+         * @param source_file file the program was read from
+         * @return std::string human readable report, empty if lines were not profiled
+         */
+        std::string line_profile_str(const std::string& source_file) const;
+
+        /**
+         * @brief Start sampling the running function and its callers at a fixed rate of cpu time
+         * 
+         * @param frequency samples per second
+         * @return uint success status, 0 on success, 1 if the sampling timer could not be set
+         */
+        uint enable_sampling(uint frequency);
+
+        /**
+         * @brief Stop sampling, and write the samples taken to a file as folded stacks
+         * 
+         * @param filename file where to write the folded stacks
+         * @return uint success status, 0 on success, 1 if the file could not be written
+         */
+        uint write_samples(const std::string& filename);
+
+        /**
+         * @brief Summary of the samples taken: how many were taken and the hottest source lines
+         * 
+         * @return std::string human readable summary, empty if not sampling
+         */
+        std::string sampling_str() const;
+
+        /**
+         * @brief Record every function entry and exit, and every read and print, 
+         *        into a file of trace events
+         * 
+         * @param filename file where to write events
+         * @return uint success status, 0 on success, 1 if the file could not be opened
+         */
+        uint enable_event_trace(const std::string& filename);
+
+        /**
+         * @brief Stop recording events, and finish writing them
+         * 
+         * @return uint success status, 0 on success, 1 if events were not recorded or could not be written
+         */
+        uint close_event_trace();
+
+        /**
+         * @brief Record every guest memory read and write, with its address, size, region and 
+         *        instruction, into a binary file. Native code and traces access the stack directly, 
+         *        so both are disabled while tracing memory
+         * 
+         * @param filename file where to write accesses
+         * @return uint success status, 0 on success, 1 if the file could not be opened
+         */
+        uint enable_memory_trace(const std::string& filename);
+
+        /**
+         * @brief Stop recording memory accesses, and finish writing them
+         * 
+         * @return uint success status, 0 on success, 1 if accesses were not recorded or could not be written
+         */
+        uint close_memory_trace();
+
+        /**
+         * @brief How many memory accesses were recorded so far
+         * 
+         * @return size_t accesses recorded, 0 when not tracing memory
+         */
+        size_t memory_trace_accesses() const;
+
+        /**
+         * @brief Attribute every malloc to the instruction and function performing it, and follow 
+         *        live heap memory, block lifetimes and blocks never freed
+         * 
+         */
+        void enable_heap_profiling();
+
+        /**
+         * @brief Allocation sites sorted by bytes allocated, lifetimes of freed blocks, and blocks 
+         *        still alive
+         * 
+         * @return std::string human readable report, empty if the heap was not profiled
+         */
+        std::string heap_profile_str() const;
+
+        /**
+         * @brief Write live heap memory over time to a file as csv
+         * 
+         * @param filename file where to write it
+         * @return uint success status, 0 on success, 1 if the heap was not profiled or the file could not be written
+         */
+        uint write_heap_series(const std::string& filename) const;
+
+        /**
+         * @brief Run instructions through handlers bound to them once, instead of dispatching 
+         *        every instruction through the interpreter's switch each time it runs
+         * 
+         */
+        void use_closure_engine();
+
+        /**
+         * @brief Summary of memoized calls: how many calls to each pure function were answered 
+         *        from the memoization table
+         * 
+         * @return std::string one line per pure function
+         */
+        std::string memoization_str() const;
+
         static std::string show_status(Status status);
 
         /**
@@ -1074,24 +1426,174 @@ namespace TacRunner
         private:
 
         /**
-         * @brief Creates a back up of the program state in the stack of states
+         * @brief Push a new frame for 'function' in the frame stack, saving current program state
+         * 
+         * @param return_pc call instruction to go back to on return
+         * @param function index of the function to call in the function table
+         * @param return_slot slot in the current window where to store the return value
+         */
+        void push_frame(size_t return_pc, uint function, int return_slot);
+
+        /**
+         * @brief pop the top frame, setting its saved state as the current state
+         * 
+         * @return uint success status, 0 on success, 1 else
+         */
+        uint pop_frame();
+
+        /**
+         * @brief Read the argument bytes for a call to a pure function, from the top of the stack
+         * 
+         * @param function called function
+         * @param out_arguments where to store the argument bytes
+         * @return uint success status, 0 on success, 1 if they're out of the stack
+         */
+        uint memo_arguments(uint function, std::string& out_arguments);
+
+        /**
+         * @brief Entry of the memoization table for a call
+         * 
+         * @param function called function
+         * @param arguments argument bytes of the call
+         * @return MemoEntry& entry where its result is stored
+         */
+        MemoEntry& memo_entry(uint function, const std::string& arguments);
+
+        /**
+         * @brief Reuse the top frame to run 'function_name', moving the arguments pushed for 
+         *        it to the start of the current frame. Used for calls marked as tail calls
+         * 
+         * @param tac call instruction
+         * @return uint success status, 0 on success, 1 else
+         */
+        uint run_tail_call(const Tac& tac);
+
+        /**
+         * @brief Count a call to a function or a backward jump inside it, compiling the function 
+         *        into native code once it becomes hot
+         * 
+         * @param function function where time is being spent
+         */
+        void count_hotness(uint function);
+
+        /**
+         * @brief Run native code from the current instruction, if the current function was compiled, 
+         *        until it reaches an instruction it can't run. The program counter is left there
+         * 
+         */
+        void run_native();
+
+        /**
+         * @brief Jump to an instruction, counting backward jumps as loop iterations
+         * 
+         * @param target instruction to continue from
+         */
+        void branch_to(size_t target);
+
+        /**
+         * @brief Count a backward jump to a loop header, starting to record a trace for the 
+         *        loop once it becomes hot
+         * 
+         * @param header instruction the backward jump goes to
+         */
+        void count_loop(size_t header);
+
+        /**
+         * @brief Record the current instruction into the trace being recorded, before running it.
+         *        Recording stops when the loop header is reached again, or when the instruction 
+         *        can't be part of a trace
+         * 
+         */
+        void record_trace_step();
+
+        /**
+         * @brief Give up on the trace being recorded, a new one will be recorded the next time 
+         *        its loop header is reached by a backward jump, until it's been tried TRACE_MAX_ATTEMPTS times
+         * 
+         */
+        void stop_recording();
+
+        /**
+         * @brief Run the trace for the current instruction, if the current frame can run it, 
+         *        until it leaves the trace. The program counter is left where it left
+         * 
+         */
+        void run_trace();
+
+        /**
+         * @brief Get the value of a register slot if it was set in the current frame, 
+         *        without reporting errors
+         * 
+         * @param slot register slot, or one of the special slots
+         * @param out_value where to store the value
+         * @return true if the register has a value in the current frame
+         */
+        bool peek_slot(int slot, REGISTER_TYPE& out_value) const;
+
+        /**
+         * @brief Get the actual value of a value like actual_value does, without reporting errors. 
+         *        Only registers set in the current frame and stack memory can be read
+         * 
+         * @param val value to read
+         * @param out_value where to store the value
+         * @return true if it could be read
+         */
+        bool peek_value(const Value& val, REGISTER_TYPE& out_value) const;
+
+        /**
+         * @brief Set the value of a register slot in the current window
+         * 
+         * @param slot register slot, or one of the special slots
+         * @param value new value
+         */
+        void set_slot(int slot, REGISTER_TYPE value);
+
+        /**
+         * @brief Get the value of a register slot in the current window. If it was not set 
+         *        in the current frame, look for 'reg_name' in previous frames
+         * 
+         * @param slot register slot, or one of the special slots
+         * @param reg_name name of the register stored in 'slot'
+         * @param out_value where to store the value
+         * @return uint success status, 0 on success, 1 else
+         */
+        uint get_slot(int slot, const std::string& reg_name, REGISTER_TYPE &out_value);
+
+        /**
+         * @brief Search a register by name in every frame, from top to bottom
          * 
+         * @param reg_name register name
+         * @param out_value where to store the value
+         * @return uint success status, 0 on success, 1 else
          */
-        void push_program_state(const std::string& next_return_reg);
+        uint find_register(const std::string& reg_name, REGISTER_TYPE &out_value);
 
         /**
-         * @brief pop program state, setting de old state as the current state
+         * @brief Assign a register slot to every variable in the program, 
+         *        and find the function each instruction belongs to
          * 
          * @return uint success status, 0 on success, 1 else
          */
-        uint pop_program_state();
+        uint resolve_registers();
 
         /**
-         * @brief Get the last status saved
+         * @brief Mark every 'call T f' immediately followed by 'return T' as a tail call, when 
+         *        the caller's frame can be safely reused by f: the caller does not use STACK, 
+         *        pointers to its frame don't escape, and f does not read registers from its callers
          * 
-         * @return const BackUp& reference to last status saved
+         * @return uint success status, 0 on success, 1 else
          */
-        inline const BackUp& last_back_up() const { return m_back_ups.top(); }
+        uint find_tail_calls();
+
+        /**
+         * @brief Get a slot for a register name in the given function, special 
+         *        registers get their own special slot
+         * 
+         * @param function function where this name is used
+         * @param reg_name name of the register
+         * @return int resolved slot
+         */
+        int resolve_slot(uint function, const std::string& reg_name);
 
         /**
          * @brief Run a single tac instruction. Successful execution will increase the program counter
@@ -1103,18 +1605,48 @@ namespace TacRunner
         uint run_tac_instruction(const Tac &tac);
 
         /**
-         * @brief Set the instruction count to 0 for every instruction
+         * @brief Set the instruction count to 0 for every instruction and instruction pair
          * 
          */
         void reset_instruction_count();
 
         /**
-         * @brief Set the up label map object to match the stored program 
+         * @brief Count an instruction about to run, and the pair it makes with the previous one
+         * 
+         * @param instr instruction about to run
+         */
+        inline void count_instruction(Instr instr)
+        {
+            auto const kind = static_cast<size_t>(instr);
+            m_instruction_count[kind]++;
+            if (m_last_instruction != INSTRUCTION_KINDS)
+                m_pair_count[m_last_instruction * INSTRUCTION_KINDS + kind]++;
+            m_last_instruction = kind;
+        }
+
+        /**
+         * @brief Set the up label map object to match the stored program. Labels are removed 
+         *        from the program, so every label maps to the first instruction after it
          * 
          * @return uint success status, 0 on success, 1 else
          */
         uint set_up_label_map();
 
+        /**
+         * @brief Resolve the label of every jump and call into its target program position, 
+         *        fails if some label is not defined
+         * 
+         * @return uint success status, 0 on success, 1 else
+         */
+        uint resolve_labels();
+
+        /**
+         * @brief Continue execution from the given program position
+         * 
+         * @param target next instruction to run
+         */
+        inline void jump_to(size_t target) { m_program_counter = target - 1; } // the main loop moves to the next instruction
+
         /**
          * @brief Get var's value: X == X, X[Y] == X + Y 
          * 
@@ -1166,6 +1698,12 @@ namespace TacRunner
          */
         LabelMap m_label_map;
 
+        /**
+         * @brief Time spent setting up this machine
+         * 
+         */
+        SetupTimes m_setup_times;
+
         /**
          * @brief Memory management object
          * 
@@ -1173,10 +1711,52 @@ namespace TacRunner
         MemoryManager m_memory;
 
         /**
-         * @brief How many of which instructions were found
+         * @brief How many times each instruction ran, indexed by instruction. Only counted while profiling
          * 
          */
-        std::map<Instr, uint64_t> m_instruction_count;
+        std::array<uint64_t, INSTRUCTION_KINDS> m_instruction_count;
+
+        /**
+         * @brief How many times each instruction ran right after another one, indexed 
+         *        by first * INSTRUCTION_KINDS + second. Only counted while profiling
+         * 
+         */
+        std::array<uint64_t, INSTRUCTION_KINDS * INSTRUCTION_KINDS> m_pair_count;
+
+        size_t m_last_instruction = INSTRUCTION_KINDS;  // last instruction counted, INSTRUCTION_KINDS if none
+        bool m_profiling = false;                       // if instructions are being counted
+
+        /**
+         * @brief Profile of every instruction and function, null when lines are not profiled
+         * 
+         */
+        std::unique_ptr<LineProfiler> m_line_profiler;
+
+        /**
+         * @brief Sampling profiler, null when not sampling
+         * 
+         */
+        std::unique_ptr<Sampler> m_sampler;
+
+        volatile sig_atomic_t m_frames_moving = 0; // if the frame stack is being moved, so it can't be sampled
+
+        /**
+         * @brief Recorder of function calls and I/O, null when not recording them
+         * 
+         */
+        std::unique_ptr<EventTracer> m_event_tracer;
+
+        /**
+         * @brief Recorder of guest memory reads and writes, null when not recording them
+         * 
+         */
+        std::unique_ptr<MemoryTracer> m_memory_tracer;
+
+        /**
+         * @brief Allocation sites and live heap memory over time, null when not profiling the heap
+         * 
+         */
+        std::unique_ptr<HeapProfiler> m_heap_profiler;
 
         /**
          * @brief Program status
@@ -1185,10 +1765,35 @@ namespace TacRunner
         Status m_status;
 
         /**
-         * @brief Registers identified by name and their corresponding value
+         * @brief Information for every function in the program, the first one is the global scope
+         * 
+         */
+        std::vector<FunctionInfo> m_functions;
+
+        /**
+         * @brief Index of the function each instruction belongs to
          * 
          */
-        CallStack m_callstack;
+        std::vector<uint> m_instruction_function;
+
+        /**
+         * @brief Activation records for every running function, the first one is the global scope
+         * 
+         */
+        FrameStack m_frames;
+
+        /**
+         * @brief Register values for every frame, each one owns a contiguous window
+         * 
+         */
+        std::vector<REGISTER_TYPE> m_register_file;
+
+        /**
+         * @brief Tells if the register with the same index in the register file was set 
+         *        in its frame
+         * 
+         */
+        std::vector<uint8_t> m_register_valid;
 
         /**
          * @brief Status code on exit of the program
@@ -1197,11 +1802,95 @@ namespace TacRunner
         REGISTER_TYPE m_exit_status_code;
 
         /**
-         * @brief Represents a previous state in the program to go back 
-         *        when a return instruction is called
+         * @brief How many instructions were executed so far
+         * 
+         */
+        uint64_t m_step_count;
+
+        /**
+         * @brief If calls to pure functions should be memoized
          * 
          */
-        std::stack<BackUp> m_back_ups;
+        bool m_memoize = false;
+
+        /**
+         * @brief Purity of every function, only computed when memoizing
+         * 
+         */
+        std::vector<FunctionPurity> m_purity;
+
+        /**
+         * @brief Results of calls to pure functions
+         * 
+         */
+        std::vector<MemoEntry> m_memo_table;
+
+        /**
+         * @brief Calls to pure functions still running, whose result should be remembered
+         * 
+         */
+        std::vector<PendingMemo> m_pending_memos;
+
+        /**
+         * @brief How many calls to each function were looked up in the memoization table
+         * 
+         */
+        std::vector<uint64_t> m_memo_calls;
+
+        /**
+         * @brief How many calls to each function were answered from the memoization table
+         * 
+         */
+        std::vector<uint64_t> m_memo_hits;
+
+        /**
+         * @brief Compiler of hot functions into native code, null when running everything 
+         *        in the interpreter
+         * 
+         */
+        std::unique_ptr<JitCompiler> m_jit;
+
+        /**
+         * @brief Calls to each function plus backward jumps inside it, functions are compiled
+         *        into native code when this reaches JIT_THRESHOLD
+         * 
+         */
+        std::vector<uint32_t> m_hotness;
+
+        /**
+         * @brief Optimized trace for each loop header, null for instructions without one. 
+         *        Empty when traces are disabled
+         * 
+         */
+        std::vector<std::unique_ptr<Trace>> m_traces;
+
+        /**
+         * @brief Backward jumps to each loop header since a trace was last recorded for it
+         * 
+         */
+        std::vector<uint32_t> m_loop_hotness;
+
+        /**
+         * @brief How many times a trace was recorded for each loop header
+         * 
+         */
+        std::vector<uint8_t> m_trace_attempts;
+
+        /**
+         * @brief Instructions recorded so far for the trace being recorded
+         * 
+         */
+        std::vector<TraceStep> m_trace_steps;
+
+        /**
+         * @brief Compiled handler for each instruction, empty when running through the switch
+         * 
+         */
+        std::vector<Closure> m_closures;
+
+        bool m_recording = false;   // if a trace is being recorded
+        size_t m_trace_header = 0;  // loop header of the trace being recorded
+        size_t m_trace_next = 0;    // next instruction the trace being recorded expects
 
         private:
         // The following section contains functions for every instruction, every function
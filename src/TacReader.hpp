@@ -86,6 +86,7 @@ public:
      */
     friend class Parser;
     friend class Scanner;
+    friend class Lexer;
     
 private:
     /**
@@ -94,9 +95,18 @@ private:
      * @param tac Instruction to add to the internal instruction buffer m_instructions
      */
     void add_tac_instruction(const Tac &tac);
+
+    /**
+     * @brief Used internally to tell which line each instruction comes from
+     * 
+     * @param line line of the last token read by the scanner
+     */
+    inline void set_line(size_t line) { m_line = line; }
+    inline size_t line() const { return m_line; }
     
 private:
     std::vector<Tac> m_instructions; // Tac Program
+    size_t m_line = 0;               // Line of the last token read
     Lexer m_scanner;                 // Scanner object
     Parser m_parser;                 // Parser object
 };
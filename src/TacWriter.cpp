@@ -0,0 +1,128 @@
+// Local includes
+#include "TacWriter.hpp"
+#include "Application.hpp"
+
+// C++ includes
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+
+using namespace TacRunner;
+
+namespace
+{
+    // Floats need a dot or an exponent, otherwise they're read back as integers
+    std::string float_str(float f)
+    {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.9g", f);
+
+        std::string result(buffer);
+        if (result.find_first_of(".e") == std::string::npos)
+            result += ".0";
+
+        return result;
+    }
+
+    // Strings are written between quotes, with new lines escaped
+    std::string string_str(const std::string& str)
+    {
+        std::string result = "\"";
+        for (char c : str)
+        {
+            if (c == '\n')
+                result += "\\n";
+            else
+                result += c;
+        }
+        result += '"';
+
+        return result;
+    }
+}
+
+uint TacWriter::write(const std::string& filename, const Program& program)
+{
+    std::ofstream out(filename);
+    if (!out.good())
+    {
+        std::stringstream ss;
+        ss << "Could not open file '" << filename << "' to write tac code";
+        App::error(ss.str());
+        return FAIL;
+    }
+
+    write(out, program);
+    return out.good() ? SUCCESS : FAIL;
+}
+
+void TacWriter::write(std::ostream& out, const Program& program)
+{
+    for (auto const& tac : program)
+        out << str(tac) << std::endl;
+}
+
+std::string TacWriter::str(const Tac& tac)
+{
+    std::stringstream ss;
+    switch (tac.instr())
+    {
+    case Instr::METAFUNBEGIN:
+        ss << "@function";
+        break;
+    case Instr::METAFUNEND:
+        ss << "@endfunction";
+        break;
+    default:
+        ss << instr_to_str(tac.instr());
+        break;
+    }
+
+    auto const& args = tac.args();
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        ss << " ";
+
+        // Only static string contents are quoted, other strings are names of labels, functions or static data
+        bool const is_name = args[i].is<std::string>() && !(tac.instr() == Instr::METASTRING && i == 1);
+        if (is_name)
+            ss << args[i].get<std::string>();
+        else
+            ss << str(args[i]);
+    }
+
+    return ss.str();
+}
+
+std::string TacWriter::str(const Value& value)
+{
+    if (value.is<Variable>())
+        return value.get<Variable>().str();
+    else if (value.is<bool>())
+        return value.get<bool>() ? "True" : "False";
+    else if (value.is<int>())
+        return std::to_string(value.get<int>());
+    else if (value.is<float>())
+        return float_str(value.get<float>());
+    else if (value.is<std::string>())
+        return string_str(value.get<std::string>());
+
+    auto const c = value.get<char>();
+    switch (c)
+    {
+    case '\n':
+        return "'\\n'";
+    case '\t':
+        return "'\\t'";
+    case '\0':
+        return "'\\0'";
+    default:
+        return std::string("'") + c + "'";
+    }
+}
+
+bool TacWriter::can_write(char c)
+{
+    // The reader drops quotes inside char constants, so a quote char can't be read back
+    return c == '\n' || c == '\t' || c == '\0' || (c >= ' ' && c <= '~' && c != '\'');
+}
@@ -0,0 +1,70 @@
+/**
+ * @file TacWriter.hpp
+ * @brief Write a tac program back to the textual format accepted by the tac reader
+ *
+ */
+#ifndef TACWRITER_HPP
+#define TACWRITER_HPP
+
+// Local includes
+#include "Tac.hpp"
+
+// C++ includes
+#include <string>
+#include <ostream>
+
+namespace TacRunner
+{
+    /**
+     * @brief Turns a program into tac source code, so that parsing the result
+     *        produces the same program. Comments are not part of a program, so they're lost
+     *
+     */
+    class TacWriter
+    {
+        public:
+            /**
+             * @brief Write a program to a file
+             *
+             * @param filename file where to write the program
+             * @param program program to write
+             * @return uint success status, 0 on success, 1 on failure
+             */
+            static uint write(const std::string& filename, const Program& program);
+
+            /**
+             * @brief Write a program to a stream, one instruction per line
+             *
+             * @param out stream where to write the program
+             * @param program program to write
+             */
+            static void write(std::ostream& out, const Program& program);
+
+            /**
+             * @brief Source code for a single instruction
+             *
+             * @param tac instruction to write
+             * @return std::string instruction as it should be written in a tac file
+             */
+            static std::string str(const Tac& tac);
+
+            /**
+             * @brief Source code for a single instruction argument
+             *
+             * @param value argument to write
+             * @return std::string argument as it should be written in a tac file
+             */
+            static std::string str(const Value& value);
+
+            /**
+             * @brief Tells if a char constant can be written in a tac file
+             *
+             * @param c char to check
+             * @return true if the reader can parse it back
+             * @return false otherwise
+             */
+            static bool can_write(char c);
+    };
+}
+
+#endif // TACWRITER_HPP
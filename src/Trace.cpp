@@ -0,0 +1,725 @@
+// Local includes
+#include "Trace.hpp"
+
+// C++ includes
+#include <cstring>
+#include <map>
+#include <set>
+#include <unordered_map>
+
+using namespace TacRunner;
+
+namespace
+{
+    inline float as_float(REGISTER_TYPE word) { float f; std::memcpy(&f, &word, sizeof(f)); return f; }
+    inline REGISTER_TYPE as_word(float f) { REGISTER_TYPE word; std::memcpy(&word, &f, sizeof(word)); return word; }
+
+    /**
+     * @brief Perform the arithmetic of an operation as the interpreter does
+     *
+     * @param code operation to perform, guards and memory operations just copy 'l'
+     * @param l left operand, or the only one for unary operations
+     * @param r right operand
+     * @param out_result result of the operation
+     * @return false if it can't be performed, like a division by 0
+     */
+    inline bool compute(TraceOp::Code code, REGISTER_TYPE l, REGISTER_TYPE r, REGISTER_TYPE& out_result)
+    {
+        auto const il = (int) l;
+        auto const ir = (int) r;
+        switch (code)
+        {
+        case TraceOp::ADD:      out_result = (REGISTER_TYPE) (il + ir); break;
+        case TraceOp::SUB:      out_result = (REGISTER_TYPE) (il - ir); break;
+        case TraceOp::MULT:     out_result = (REGISTER_TYPE) (il * ir); break;
+        case TraceOp::DIV:
+            if (r == 0)
+                return false;
+            out_result = (REGISTER_TYPE) (il / ir);
+            break;
+        case TraceOp::MOD:
+            if (r == 0)
+                return false;
+            out_result = (REGISTER_TYPE) (il % ir);
+            break;
+        case TraceOp::ADDF:     out_result = as_word(as_float(l) + as_float(r)); break;
+        case TraceOp::SUBF:     out_result = as_word(as_float(l) - as_float(r)); break;
+        case TraceOp::MULTF:    out_result = as_word(as_float(l) * as_float(r)); break;
+        case TraceOp::DIVF:
+            if (r == 0)
+                return false;
+            out_result = as_word(as_float(l) / as_float(r));
+            break;
+        case TraceOp::EQ:       out_result = l == r; break;
+        case TraceOp::NEQ:      out_result = l != r; break;
+        case TraceOp::AND:      out_result = l && r; break;
+        case TraceOp::OR:       out_result = l || r; break;
+        case TraceOp::LT:       out_result = il < ir; break;
+        case TraceOp::LEQ:      out_result = il <= ir; break;
+        case TraceOp::GT:       out_result = il > ir; break;
+        case TraceOp::GEQ:      out_result = il >= ir; break;
+        case TraceOp::LTF:      out_result = as_float(l) < as_float(r); break;
+        case TraceOp::LEQF:     out_result = as_float(l) <= as_float(r); break;
+        case TraceOp::GTF:      out_result = as_float(l) > as_float(r); break;
+        case TraceOp::GEQF:     out_result = as_float(l) >= as_float(r); break;
+        case TraceOp::NEG:      out_result = !l; break;
+        case TraceOp::MINUS:    out_result = (REGISTER_TYPE) -il; break;
+        case TraceOp::MINUSF:   out_result = as_word(-as_float(l)); break;
+        case TraceOp::ITOF:     out_result = as_word((float) il); break;
+        case TraceOp::FTOI:     out_result = (REGISTER_TYPE) (int) as_float(l); break;
+        default:                out_result = l; break;
+        }
+
+        return true;
+    }
+
+    inline bool is_binary(TraceOp::Code code) { return code >= TraceOp::ADD && code <= TraceOp::GEQF; }
+    inline bool is_unary(TraceOp::Code code) { return code >= TraceOp::NEG && code <= TraceOp::FTOI; }
+    inline bool is_guard(TraceOp::Code code) { return code == TraceOp::GUARD_TRUE || code == TraceOp::GUARD_FALSE; }
+
+    // Operands without index nor memory read, their value only depends on their kind
+    inline bool is_plain(const TraceOperand& operand) { return operand.index_slot == NO_SLOT && operand.load == 0; }
+
+    /**
+     * @brief Operand for the value of a variable as get_var_value computes it: X == X, X[Y] == X + Y
+     *
+     * @return false if the variable can't be used in a trace
+     */
+    bool variable_operand(const Variable& var, TraceOperand& out_operand)
+    {
+        out_operand = TraceOperand();
+        if (var.slot == BASE_SLOT)
+            out_operand.kind = TraceOperand::BASE_RELATIVE;
+        else if (var.slot == STACK_SLOT)
+            out_operand.kind = TraceOperand::STACK_RELATIVE;
+        else if (var.slot >= 0)
+        {
+            out_operand.kind = TraceOperand::REGISTER;
+            out_operand.slot = var.slot;
+        }
+        else
+            return false;
+
+        if (!var.is_access)
+            return true;
+
+        if (std::holds_alternative<int>(var.index))
+            out_operand.offset = (REGISTER_TYPE) std::get<int>(var.index);
+        else if (var.index_slot >= 0)
+            out_operand.index_slot = var.index_slot;
+        else
+            return false; // accesses indexed by BASE or STACK stay in the interpreter
+
+        return true;
+    }
+
+    /**
+     * @brief Operand for the actual value of a value: X == X, X[Y] == *(X+Y), constants become words.
+     *        Constants that make the interpreter warn are not supported
+     *
+     */
+    bool actual_operand(const Value& val, TraceOperand& out_operand)
+    {
+        out_operand = TraceOperand();
+        if (val.is<Variable>())
+        {
+            auto const& var = val.get<Variable>();
+            if (!variable_operand(var, out_operand))
+                return false;
+            if (var.is_access)
+                out_operand.load = WORD_SIZE;
+            return true;
+        }
+        if (val.is<int>())
+        {
+            out_operand.offset = (REGISTER_TYPE) val.get<int>();
+            return true;
+        }
+        if (val.is<float>())
+        {
+            out_operand.offset = as_word(val.get<float>());
+            return true;
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Operand for a binary operation argument, and its type: variables starting with f and
+     *        float constants are floats
+     *
+     */
+    bool binary_operand(const Value& val, TraceOperand& out_operand, bool& out_is_float)
+    {
+        out_operand = TraceOperand();
+        out_is_float = false;
+        if (val.is<Variable>())
+        {
+            auto const& var = val.get<Variable>();
+            out_is_float = var.name[0] == 'f'; // floats start with f
+            return variable_operand(var, out_operand);
+        }
+        if (val.is<char>())
+        {
+            out_operand.offset = (uint8_t) val.get<char>();
+            return true;
+        }
+        if (val.is<int>() || val.is<float>())
+        {
+            out_is_float = val.is<float>();
+            return actual_operand(val, out_operand);
+        }
+
+        return false; // bool operands have no value
+    }
+
+    /**
+     * @brief Translate an instruction into the trace operation performing it
+     *
+     * @param tac instruction to translate
+     * @param pc position of the instruction
+     * @param taken for conditional jumps, if the jump was taken when recording
+     * @param out_op operation for the instruction
+     * @param out_has_op if the instruction does something, labels and jumps do nothing in a trace
+     * @return false if the instruction can't be part of a trace
+     */
+    bool translate(const Tac& tac, size_t pc, bool taken, TraceOp& out_op, bool& out_has_op)
+    {
+        auto const& args = tac.args();
+        out_op = TraceOp();
+        out_op.pc = pc;
+        out_has_op = true;
+
+        switch (tac.instr())
+        {
+        case Instr::METALABEL:
+        case Instr::GOTO:
+            out_has_op = false;
+            return true;
+        case Instr::GOIF:
+        case Instr::GOIFNOT:
+        {
+            auto const expected = taken == (tac.instr() == Instr::GOIF);
+            out_op.code = expected ? TraceOp::GUARD_TRUE : TraceOp::GUARD_FALSE;
+            out_op.exit_pc = taken ? pc + 1 : tac.target();
+            return actual_operand(args[1], out_op.a);
+        }
+        case Instr::ASSIGNW:
+        case Instr::ASSIGNB:
+        {
+            auto const& lvalue = args[0].get<Variable>();
+            auto const& rvalue = args[1];
+            auto const size = tac.instr() == Instr::ASSIGNW ? WORD_SIZE : 1;
+
+            // Constants that make the interpreter warn stay there
+            TraceOperand value;
+            if (rvalue.is<Variable>())
+            {
+                if (!variable_operand(rvalue.get<Variable>(), value))
+                    return false;
+            }
+            else if (size == WORD_SIZE && (rvalue.is<int>() || rvalue.is<float>()))
+                actual_operand(rvalue, value);
+            else if (size == 1 && rvalue.is<char>())
+                value.offset = (uint8_t) rvalue.get<char>();
+            else if (size == 1 && rvalue.is<bool>())
+                value.offset = rvalue.get<bool>();
+            else
+                return false;
+
+            bool const rvalue_access = rvalue.is<Variable>() && rvalue.get<Variable>().is_access;
+            if (lvalue.is_access)
+            {
+                if (rvalue_access)
+                    return false;
+
+                out_op.code = TraceOp::STORE;
+                out_op.size = size;
+                out_op.b = value;
+                return variable_operand(lvalue, out_op.a);
+            }
+
+            if (lvalue.slot < 0)
+                return false;
+
+            // Moves copy the whole register, loads read as many bytes as the assignment
+            out_op.code = TraceOp::MOVE;
+            out_op.dest = lvalue.slot;
+            out_op.a = value;
+            if (rvalue_access)
+                out_op.a.load = size;
+            return true;
+        }
+        case Instr::ADD:
+        case Instr::SUB:
+        case Instr::MULT:
+        case Instr::DIV:
+        case Instr::MOD:
+        case Instr::EQ:
+        case Instr::NEQ:
+        case Instr::AND:
+        case Instr::OR:
+        case Instr::LT:
+        case Instr::LEQ:
+        case Instr::GT:
+        case Instr::GEQ:
+        {
+            auto const& lvalue = args[0].get<Variable>();
+            bool l_is_float, r_is_float;
+            if (lvalue.is_access || lvalue.slot < 0 ||
+                !binary_operand(args[1], out_op.a, l_is_float) ||
+                !binary_operand(args[2], out_op.b, r_is_float))
+                return false;
+
+            // Type errors are reported by the interpreter
+            auto const instr = tac.instr();
+            bool const type_matters = instr != Instr::EQ && instr != Instr::NEQ && instr != Instr::AND && instr != Instr::OR;
+            if ((type_matters && l_is_float != r_is_float) || (instr == Instr::MOD && l_is_float))
+                return false;
+
+            static const std::map<Instr, std::pair<TraceOp::Code, TraceOp::Code>> codes = {
+                {Instr::ADD,  {TraceOp::ADD, TraceOp::ADDF}},
+                {Instr::SUB,  {TraceOp::SUB, TraceOp::SUBF}},
+                {Instr::MULT, {TraceOp::MULT, TraceOp::MULTF}},
+                {Instr::DIV,  {TraceOp::DIV, TraceOp::DIVF}},
+                {Instr::MOD,  {TraceOp::MOD, TraceOp::MOD}},
+                {Instr::EQ,   {TraceOp::EQ, TraceOp::EQ}},
+                {Instr::NEQ,  {TraceOp::NEQ, TraceOp::NEQ}},
+                {Instr::AND,  {TraceOp::AND, TraceOp::AND}},
+                {Instr::OR,   {TraceOp::OR, TraceOp::OR}},
+                {Instr::LT,   {TraceOp::LT, TraceOp::LTF}},
+                {Instr::LEQ,  {TraceOp::LEQ, TraceOp::LEQF}},
+                {Instr::GT,   {TraceOp::GT, TraceOp::GTF}},
+                {Instr::GEQ,  {TraceOp::GEQ, TraceOp::GEQF}},
+            };
+            auto const& code = codes.at(instr);
+            out_op.code = l_is_float ? code.second : code.first;
+            out_op.dest = lvalue.slot;
+            return true;
+        }
+        case Instr::MINUS:
+        case Instr::NEG:
+        case Instr::ITOF:
+        case Instr::FTOI:
+        {
+            auto const& lvalue = args[0].get<Variable>();
+            if (lvalue.is_access || lvalue.slot < 0)
+                return false;
+
+            switch (tac.instr())
+            {
+            case Instr::NEG:    out_op.code = TraceOp::NEG; break;
+            case Instr::ITOF:   out_op.code = TraceOp::ITOF; break;
+            case Instr::FTOI:   out_op.code = TraceOp::FTOI; break;
+            default:            out_op.code = lvalue.name[0] == 'f' ? TraceOp::MINUSF : TraceOp::MINUS; break;
+            }
+            out_op.dest = lvalue.slot;
+            return actual_operand(args[1], out_op.a);
+        }
+        default:
+            break;
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Optimizer for the operations of a trace, it keeps what's known about registers and
+     *        frame memory from the start of an iteration up to the operation being added
+     *
+     */
+    class TraceOptimizer
+    {
+        public:
+            TraceOptimizer(std::vector<TraceOp>& out_ops) : m_ops(out_ops) { }
+
+            /**
+             * @brief Optimize an operation and add it to the trace, unless it's not needed
+             *
+             */
+            void add(TraceOp op);
+
+            size_t removed_guards = 0;
+            size_t removed_loads = 0;
+            size_t folded = 0;
+
+        private:
+            // Replace registers with known values by those values
+            void substitute(TraceOperand& operand) const;
+
+            // Forget everything that depended on the old value of a register
+            void forget(int slot);
+
+            // Forget frame memory that overlaps [offset, offset + size)
+            void forget_memory(REGISTER_TYPE offset, uint8_t size);
+
+            std::vector<TraceOp>& m_ops;
+
+            // Registers holding a constant or a frame/stack address
+            std::unordered_map<int, TraceOperand> m_known;
+
+            // Registers already checked by a guard, and the result it expected
+            std::unordered_map<int, bool> m_guarded;
+
+            // Values known to be stored in the frame, by offset from BASE and size
+            std::map<std::pair<REGISTER_TYPE, uint8_t>, TraceOperand> m_memory;
+    };
+
+    void TraceOptimizer::substitute(TraceOperand& operand) const
+    {
+        if (operand.index_slot != NO_SLOT)
+        {
+            auto it = m_known.find(operand.index_slot);
+            if (it != m_known.end() && (it->second.kind == TraceOperand::CONSTANT || operand.kind == TraceOperand::CONSTANT))
+            {
+                if (it->second.kind != TraceOperand::CONSTANT)
+                    operand.kind = it->second.kind;
+                operand.offset += it->second.offset;
+                operand.index_slot = NO_SLOT;
+            }
+        }
+
+        if (operand.kind == TraceOperand::REGISTER)
+        {
+            auto it = m_known.find(operand.slot);
+            if (it != m_known.end())
+            {
+                operand.kind = it->second.kind;
+                operand.slot = NO_SLOT;
+                operand.offset += it->second.offset;
+            }
+        }
+    }
+
+    void TraceOptimizer::forget(int slot)
+    {
+        m_known.erase(slot);
+        m_guarded.erase(slot);
+        for (auto it = m_memory.begin(); it != m_memory.end();)
+        {
+            if (it->second.kind == TraceOperand::REGISTER && it->second.slot == slot)
+                it = m_memory.erase(it);
+            else
+                it++;
+        }
+    }
+
+    void TraceOptimizer::forget_memory(REGISTER_TYPE offset, uint8_t size)
+    {
+        for (auto it = m_memory.begin(); it != m_memory.end();)
+        {
+            auto const [other_offset, other_size] = it->first;
+            if ((int32_t) (other_offset - offset) < size && (int32_t) (offset - other_offset) < other_size)
+                it = m_memory.erase(it);
+            else
+                it++;
+        }
+    }
+
+    void TraceOptimizer::add(TraceOp op)
+    {
+        substitute(op.a);
+        if (op.code != TraceOp::MOVE && !is_unary(op.code) && !is_guard(op.code))
+            substitute(op.b);
+
+        bool const a_constant = is_plain(op.a) && op.a.kind == TraceOperand::CONSTANT;
+        bool const b_constant = is_plain(op.b) && op.b.kind == TraceOperand::CONSTANT;
+
+        // Guards whose result is known are not needed
+        if (is_guard(op.code))
+        {
+            bool const expected = op.code == TraceOp::GUARD_TRUE;
+            if (a_constant && (op.a.offset != 0) == expected)
+            {
+                removed_guards++;
+                return;
+            }
+
+            if (is_plain(op.a) && op.a.kind == TraceOperand::REGISTER)
+            {
+                auto it = m_guarded.find(op.a.slot);
+                if (it != m_guarded.end() && it->second == expected)
+                {
+                    removed_guards++;
+                    return;
+                }
+                m_guarded[op.a.slot] = expected;
+            }
+
+            m_ops.push_back(op);
+            return;
+        }
+
+        // Stores remember what's written to frame slots, stores anywhere else might overwrite any of them
+        if (op.code == TraceOp::STORE)
+        {
+            if (is_plain(op.a) && op.a.kind == TraceOperand::BASE_RELATIVE)
+            {
+                forget_memory(op.a.offset, op.size);
+                if (is_plain(op.b))
+                    m_memory[{op.a.offset, op.size}] = op.b;
+            }
+            else
+                m_memory.clear();
+
+            m_ops.push_back(op);
+            return;
+        }
+
+        // Operations on constants are computed now, and frame addresses plus constants are frame addresses
+        TraceOperand result;
+        bool result_known = false;
+        if ((is_binary(op.code) && a_constant && b_constant) || (is_unary(op.code) && a_constant))
+        {
+            REGISTER_TYPE value;
+            if (compute(op.code, op.a.offset, op.b.offset, value))
+            {
+                result.offset = value;
+                result_known = true;
+            }
+        }
+        else if ((op.code == TraceOp::ADD || op.code == TraceOp::SUB) && b_constant && is_plain(op.a) &&
+                 (op.a.kind == TraceOperand::BASE_RELATIVE || op.a.kind == TraceOperand::STACK_RELATIVE))
+        {
+            result = op.a;
+            result.offset = op.code == TraceOp::ADD ? op.a.offset + op.b.offset : op.a.offset - op.b.offset;
+            result_known = true;
+        }
+        else if (op.code == TraceOp::ADD && a_constant && is_plain(op.b) &&
+                 (op.b.kind == TraceOperand::BASE_RELATIVE || op.b.kind == TraceOperand::STACK_RELATIVE))
+        {
+            result = op.b;
+            result.offset += op.a.offset;
+            result_known = true;
+        }
+
+        if (result_known)
+        {
+            op.code = TraceOp::MOVE;
+            op.a = result;
+            op.b = TraceOperand();
+            folded++;
+        }
+
+        // Loads of frame slots whose value is known reuse it
+        TraceOperand loaded_slot;
+        bool loads_slot = false;
+        if (op.code == TraceOp::MOVE && op.a.load != 0 && op.a.index_slot == NO_SLOT && op.a.kind == TraceOperand::BASE_RELATIVE)
+        {
+            auto const key = std::make_pair(op.a.offset, op.a.load);
+            auto it = m_memory.find(key);
+            if (it != m_memory.end())
+            {
+                op.code = TraceOp::FORWARD;
+                op.size = op.a.load;
+                op.b = op.a;
+                op.b.load = 0;
+                op.a = it->second;
+                removed_loads++;
+            }
+            else
+            {
+                loaded_slot = op.a;
+                loads_slot = true;
+            }
+        }
+
+        forget(op.dest);
+        if (op.code == TraceOp::MOVE && is_plain(op.a) && op.a.kind != TraceOperand::REGISTER)
+            m_known[op.dest] = op.a;
+        if (loads_slot)
+        {
+            TraceOperand value;
+            value.kind = TraceOperand::REGISTER;
+            value.slot = op.dest;
+            m_memory[{loaded_slot.offset, loaded_slot.load}] = value;
+        }
+
+        m_ops.push_back(op);
+    }
+
+    // Registers an operand reads
+    void operand_slots(const TraceOperand& operand, std::vector<int>& out_slots)
+    {
+        if (operand.kind == TraceOperand::REGISTER)
+            out_slots.push_back(operand.slot);
+        if (operand.index_slot != NO_SLOT)
+            out_slots.push_back(operand.index_slot);
+    }
+}
+
+uint Trace::build(const Program& program, const std::vector<TraceStep>& steps, size_t end, Trace& out_trace)
+{
+    if (steps.empty())
+        return FAIL;
+
+    Trace trace;
+    trace.m_header = steps.front().pc;
+    trace.m_length = steps.size();
+    trace.m_end = end;
+
+    TraceOptimizer optimizer(trace.m_ops);
+    for (size_t i = 0; i < steps.size(); i++)
+    {
+        TraceOp op;
+        bool has_op;
+        if (!translate(program[steps[i].pc], steps[i].pc, steps[i].taken, op, has_op))
+            return FAIL;
+
+        if (!has_op)
+            continue;
+
+        op.step = i;
+        optimizer.add(op);
+    }
+
+    // Registers read before being written should be set when entering the trace
+    std::set<int> written, entry;
+    for (auto const& op : trace.m_ops)
+    {
+        std::vector<int> reads;
+        operand_slots(op.a, reads);
+        operand_slots(op.b, reads);
+        for (auto slot : reads)
+            if (written.count(slot) == 0)
+                entry.insert(slot);
+
+        if (op.dest != NO_SLOT)
+            written.insert(op.dest);
+    }
+    trace.m_entry_slots.assign(entry.begin(), entry.end());
+
+    trace.m_removed_guards = optimizer.removed_guards;
+    trace.m_removed_loads = optimizer.removed_loads;
+    trace.m_folded = optimizer.folded;
+    out_trace = std::move(trace);
+
+    return SUCCESS;
+}
+
+bool Trace::can_record(const Tac& tac)
+{
+    TraceOp op;
+    bool has_op;
+    return translate(tac, 0, false, op, has_op);
+}
+
+bool Trace::can_enter(const uint8_t* valid) const
+{
+    for (auto slot : m_entry_slots)
+        if (!valid[slot])
+            return false;
+
+    return true;
+}
+
+size_t Trace::run(TraceState& state, uint64_t max_iterations) const
+{
+    auto* const registers = state.registers;
+    auto* const valid = state.valid;
+    auto* const stack = state.stack_memory;
+    auto const stack_start = (REGISTER_TYPE) MemoryManager::stack_start();
+
+    // Value of an operand, false if it reads memory outside the stack
+    auto value_of = [&](const TraceOperand& operand, REGISTER_TYPE& out_value) {
+        REGISTER_TYPE value = operand.offset;
+        switch (operand.kind)
+        {
+        case TraceOperand::REGISTER:    value += registers[operand.slot]; break;
+        case TraceOperand::BASE_RELATIVE:       value += state.frame_pointer; break;
+        case TraceOperand::STACK_RELATIVE:       value += state.stack_pointer; break;
+        default:                        break;
+        }
+        if (operand.index_slot != NO_SLOT)
+            value += registers[operand.index_slot];
+
+        if (operand.load != 0)
+        {
+            auto const position = value - stack_start;
+            if (position >= STACK_MEMORY_SIZE || STACK_MEMORY_SIZE - position < operand.load)
+                return false;
+
+            value = 0;
+            std::memcpy(&value, stack + position, operand.load);
+            state.stack_reads++;
+        }
+
+        out_value = value;
+        return true;
+    };
+
+    for (;;)
+    {
+        for (auto const& op : m_ops)
+        {
+            REGISTER_TYPE a, b = 0, result;
+            if (!value_of(op.a, a))
+            {
+                state.steps += op.step;
+                return op.pc;
+            }
+
+            switch (op.code)
+            {
+            case TraceOp::GUARD_TRUE:
+            case TraceOp::GUARD_FALSE:
+                if ((a != 0) != (op.code == TraceOp::GUARD_TRUE))
+                {
+                    state.steps += op.step + 1;
+                    return op.exit_pc;
+                }
+                continue;
+            case TraceOp::STORE:
+            {
+                value_of(op.b, b);
+                auto const position = a - stack_start;
+                if (position >= STACK_MEMORY_SIZE || STACK_MEMORY_SIZE - position < op.size)
+                {
+                    state.steps += op.step;
+                    return op.pc;
+                }
+
+                std::memcpy(stack + position, &b, op.size);
+                state.stack_writes++;
+                continue;
+            }
+            case TraceOp::FORWARD:
+            {
+                // The slot is read from memory if it's not in the stack, which leaves the trace
+                value_of(op.b, b);
+                auto const position = b - stack_start;
+                if (position >= STACK_MEMORY_SIZE || STACK_MEMORY_SIZE - position < op.size)
+                {
+                    state.steps += op.step;
+                    return op.pc;
+                }
+
+                result = op.size == WORD_SIZE ? a : a & 0xff;
+                state.stack_reads++;
+                break;
+            }
+            case TraceOp::MOVE:
+                result = a;
+                break;
+            default:
+                value_of(op.b, b);
+                if (!compute(op.code, a, b, result))
+                {
+                    state.steps += op.step;
+                    return op.pc;
+                }
+                break;
+            }
+
+            registers[op.dest] = result;
+            valid[op.dest] = 1;
+        }
+
+        state.steps += m_length;
+        state.iterations++;
+        if (m_end != m_header)
+            return m_end;
+        if (max_iterations != 0 && state.iterations == max_iterations)
+            return m_header;
+    }
+}
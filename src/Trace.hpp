@@ -0,0 +1,173 @@
+/**
+ * @file Trace.hpp
+ * @brief Linear traces recorded from hot loops, optimized and run in a specialized loop
+ *
+ */
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+// Local includes
+#include "TacMachine.hpp"
+
+// C++ includes
+#include <cstdint>
+#include <vector>
+
+#define TRACE_THRESHOLD 50      // backward jumps to a loop header before recording a trace for it
+#define TRACE_MAX_LENGTH 512    // instructions recorded before giving up on a trace
+#define TRACE_MAX_ATTEMPTS 3    // recordings tried for a loop header before giving up on it
+
+namespace TacRunner
+{
+    /**
+     * @brief Instruction executed while recording a trace
+     *
+     */
+    struct TraceStep
+    {
+        size_t pc;      // executed instruction
+        bool taken;     // for conditional jumps, if the jump was taken
+    };
+
+    /**
+     * @brief Operand of a trace operation: a register, a constant or a special register, plus
+     *        a constant offset and an optional index register, optionally read from memory
+     *
+     */
+    struct TraceOperand
+    {
+        enum Kind : uint8_t
+        {
+            CONSTANT,       // just the offset
+            REGISTER,       // register slot plus offset
+            BASE_RELATIVE,  // BASE plus offset
+            STACK_RELATIVE  // STACK plus offset
+        };
+
+        Kind kind = CONSTANT;
+        int slot = NO_SLOT;             // register slot, for registers
+        REGISTER_TYPE offset = 0;       // added to the value
+        int index_slot = NO_SLOT;       // register added to the value, for accesses indexed by a register
+        uint8_t load = 0;               // bytes read from memory at the resulting address, 0 to use the address itself
+    };
+
+    /**
+     * @brief Operation performed by a trace, every operation comes from a single instruction
+     *
+     */
+    struct TraceOp
+    {
+        enum Code : uint8_t
+        {
+            MOVE,                               // dest = a
+            FORWARD,                            // dest = a, a value known to be stored at address b
+            STORE,                              // store b at address a
+            ADD, SUB, MULT, DIV, MOD,
+            ADDF, SUBF, MULTF, DIVF,
+            EQ, NEQ, AND, OR,
+            LT, LEQ, GT, GEQ,
+            LTF, LEQF, GTF, GEQF,
+            NEG, MINUS, MINUSF, ITOF, FTOI,     // dest = op a
+            GUARD_TRUE, GUARD_FALSE             // leave the trace unless a is true/false
+        };
+
+        Code code;
+        int dest = NO_SLOT;         // register slot written by the operation
+        uint8_t size = 0;           // bytes stored or forwarded from memory
+        TraceOperand a;
+        TraceOperand b;
+        size_t pc;                  // instruction this operation comes from
+        size_t exit_pc;             // for guards, instruction to continue from when the guard fails
+        uint32_t step;              // instructions in the trace before this one
+    };
+
+    /**
+     * @brief Machine state a trace runs on. The trace reads the state of the running frame,
+     *        and adds what it did to the counters
+     *
+     */
+    struct TraceState
+    {
+        REGISTER_TYPE* registers;       // register window of the running frame
+        uint8_t* valid;                 // valid flags of the register window
+        std::byte* stack_memory;        // first byte of the stack memory
+        REGISTER_TYPE frame_pointer;    // value of BASE
+        REGISTER_TYPE stack_pointer;    // value of STACK
+        uint64_t steps = 0;             // instructions run by the trace
+        uint64_t iterations = 0;        // times the trace went back to its loop header
+        uint64_t stack_reads = 0;       // stack memory reads performed by the trace
+        uint64_t stack_writes = 0;      // stack memory writes performed by the trace
+    };
+
+    /**
+     * @brief Linear path through a loop, from its header back to it, recorded while the loop
+     *        runs in the interpreter. Branches become guards expecting the recorded direction,
+     *        and the path is optimized assuming it starts at its first instruction: constants and
+     *        frame addresses are propagated, guards whose result is known are removed, and
+     *        loads of frame slots already read or written in the same iteration reuse that value.
+     *        Side exits taken often get their own trace, from the exit to the start of another
+     *        trace. Only stack memory is accessed by traces, anything else leaves the trace
+     *
+     */
+    class Trace
+    {
+        public:
+            /**
+             * @brief Build an optimized trace from the instructions recorded for a loop
+             *
+             * @param program program the instructions come from, registers should be resolved
+             * @param steps instructions recorded from the first one until just before reaching 'end'
+             * @param end instruction reached after the last step, the first one for loops
+             * @param out_trace where to store the trace
+             * @return uint success status, 0 on success, 1 if some instruction can't be part of a trace
+             */
+            static uint build(const Program& program, const std::vector<TraceStep>& steps, size_t end, Trace& out_trace);
+
+            /**
+             * @brief Tell if an instruction can be recorded into a trace
+             *
+             * @param tac instruction to check
+             * @return true if it can be part of a trace
+             */
+            static bool can_record(const Tac& tac);
+
+            /**
+             * @brief Run the trace from its first instruction until a guard or a check fails, until
+             *        it reaches its end when it's not a loop, or until it goes back to the start
+             *        'max_iterations' times
+             *
+             * @param state state of the running frame, registers the trace reads should be valid
+             * @param max_iterations times to go back to the start before returning, 0 for no limit
+             * @return size_t next instruction the interpreter should run
+             */
+            size_t run(TraceState& state, uint64_t max_iterations) const;
+
+            /**
+             * @brief Tell if the trace can start running on a register window
+             *
+             * @param valid valid flags of the register window
+             * @return true if every register the trace reads before writing it is valid
+             */
+            bool can_enter(const uint8_t* valid) const;
+
+            inline size_t header() const { return m_header; }
+            inline size_t end() const { return m_end; }
+            inline size_t length() const { return m_length; }
+            inline size_t operations() const { return m_ops.size(); }
+            inline size_t removed_guards() const { return m_removed_guards; }
+            inline size_t removed_loads() const { return m_removed_loads; }
+            inline size_t folded_operations() const { return m_folded; }
+
+        private:
+            size_t m_header = 0;                // first instruction of the trace, a loop header or a side exit
+            size_t m_end = 0;                   // instruction reached after the trace, the header for loops
+            size_t m_length = 0;                // instructions in the trace
+            std::vector<TraceOp> m_ops;         // operations performed by the trace in order
+            std::vector<int> m_entry_slots;     // registers read before being written
+            size_t m_removed_guards = 0;        // guards whose result was known
+            size_t m_removed_loads = 0;         // loads replaced by known values
+            size_t m_folded = 0;                // operations computed while optimizing
+    };
+}
+
+#endif // TRACE_HPP
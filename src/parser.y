@@ -116,6 +116,7 @@
 %type < std::vector<TacRunner::Tac> > Data;
 %type < TacRunner::Tac > D;
 %type < std::vector<TacRunner::Tac> > Text;
+%type < TacRunner::Tac > L;
 %type < TacRunner::Tac > T;
 %type < std::vector<TacRunner::Tac> > F;
 %type < TacRunner::Value > LValue;
@@ -154,17 +155,19 @@ Data    : %empty {
         | D Data {
                     std::vector<Tac> &instrs = $2; // get instruction vector in Data
                     instrs.push_back($1);          // Add instructions to instruction list
-                    $$ = instrs;
+                    $$ = std::move(instrs);
                  }
 
 D       : METASTATICV ID INTEGER NEWLINE   
             {
                 TacRunner::Tac t($1, TacRunner::Value($2), TacRunner::Value($3));
+                t.set_line(driver.line());
                 $$ = t;
             }
         | METASTRING ID STRING NEWLINE
             {
                 TacRunner::Tac t($1, TacRunner::Value($2), TacRunner::Value($3));
+                t.set_line(driver.line());
                 $$ = t;
             }
 
@@ -173,23 +176,30 @@ Text    : %empty
                     std::vector<Tac> tac_instrs;
                     $$ = tac_instrs;
                 }
-        | T NEWLINE Text 
+        | L NEWLINE Text 
                 {
                     std::vector<Tac> &instrs = $3; // get instruction vector in Text
                     instrs.push_back($1);          // Add instructions to instruction list
-                    $$ = instrs;
+                    $$ = std::move(instrs);
                 }
 
         | F NEWLINE Text 
                 {
                     std::vector<Tac> &instrs = $3;      // get instruction vector in Text
                     auto &new_instrs = $1;              // get function instructions
-                    instrs.reserve(instrs.size() + new_instrs.size());   // Add instructions to instruction list
-                    // copy new instructions to vector with instructions
+                    // copy new instructions to vector with instructions, letting it grow geometrically
+                    // as reserving the exact size here reallocates it for every function
                     for(auto& inst : new_instrs)
-                        instrs.push_back(inst);
+                        instrs.push_back(std::move(inst));
 
-                    $$ = instrs;
+                    $$ = std::move(instrs);
+                }
+
+L       : T 
+                {
+                    // Every token of an instruction is in the same line
+                    $$ = std::move($1);
+                    $$.set_line(driver.line());
                 }
 
 T       : METALABEL ID
@@ -350,13 +360,15 @@ T       : METALABEL ID
                     $$ = TacRunner::Tac($1, TacRunner::Value($2), $3);
                 }
 
-F       :   METAFUNBEGIN ID INTEGER NEWLINE 
+F       :   METAFUNBEGIN ID INTEGER <size_t>{ $$ = driver.line(); } NEWLINE 
             Text
             METAFUNEND INTEGER 
                 {
                     TacRunner::Tac t1($1, TacRunner::Value($2), TacRunner::Value($3));
-                    TacRunner::Tac t2($6, TacRunner::Value($7));
-                    auto instrs = $5;
+                    TacRunner::Tac t2($7, TacRunner::Value($8));
+                    t1.set_line($4);
+                    t2.set_line(driver.line());
+                    auto& instrs = $6;
                     std::vector<TacRunner::Tac> new_instrs;
                     // Create a new vector and reserve enough space 
                     // as pushing from the start has to reallocate the
@@ -368,11 +380,11 @@ F       :   METAFUNBEGIN ID INTEGER NEWLINE
 
                     // Copy intermediate instructions
                     for(auto &i : instrs)
-                        new_instrs.push_back(i);
+                        new_instrs.push_back(std::move(i));
 
                     new_instrs.push_back(t1);
                     
-                    $$ = new_instrs;
+                    $$ = std::move(new_instrs);
                 }
 
 Constant : BOOL    {